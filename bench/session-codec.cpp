@@ -0,0 +1,115 @@
+// Save/restore time and file size for each session compression codec. The
+// input is either an existing session file (saveSession output) or a
+// synthetic F16 KV cache of normally distributed activations.
+//
+//   cmake -S . -B build -DLLAMA_NODE_BUILD_BENCH=ON -DLLAMA_NODE_ZSTD=ON
+//   cmake --build build --target session-codec-bench
+//   ./build/session-codec-bench [session-file | size_mb]
+
+#include "SessionCodec.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+uint16_t ToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  const uint32_t mantissa = bits & 0x7fffff;
+  if (exponent <= 0) {
+    return static_cast<uint16_t>(sign);
+  }
+  if (exponent >= 31) {
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+  return static_cast<uint16_t>(sign | (exponent << 10) | (mantissa >> 13));
+}
+
+std::vector<uint8_t> SyntheticKv(size_t bytes) {
+  std::mt19937 rng(42);
+  std::normal_distribution<float> dist(0.0f, 1.5f);
+  std::vector<uint8_t> data(bytes & ~size_t(1));
+  for (size_t i = 0; i + 1 < data.size(); i += 2) {
+    const uint16_t half = ToHalf(dist(rng));
+    std::memcpy(data.data() + i, &half, sizeof(half));
+  }
+  return data;
+}
+
+std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  std::vector<uint8_t> data(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  in.read(reinterpret_cast<char *>(data.data()), data.size());
+  return data;
+}
+
+double MsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<uint8_t> data;
+  const char *arg = argc > 1 ? argv[1] : "256";
+  if (std::ifstream(arg).good()) {
+    data = ReadFile(arg);
+  } else {
+    const size_t size_mb = std::strtoul(arg, nullptr, 10);
+    if (size_mb == 0) {
+      std::fprintf(stderr, "usage: %s [session-file | size_mb]\n", argv[0]);
+      return 1;
+    }
+    data = SyntheticKv(size_mb << 20);
+  }
+  const std::string path = "session-codec-bench.tmp";
+
+  std::printf("%-6s %12s %8s %10s %12s\n", "codec", "size MB", "ratio",
+              "save ms", "restore ms");
+  for (SessionCodec codec :
+       {SessionCodec::NONE, SessionCodec::LZ4, SessionCodec::ZSTD}) {
+    if (!SessionCodecAvailable(codec)) {
+      continue;
+    }
+    size_t size = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (codec == SessionCodec::NONE) {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(data.data()), data.size());
+      size = data.size();
+    } else {
+      size = WriteCompressedSessionFile(path, codec, 3, data.data(),
+                                        data.size());
+    }
+    const double save_ms = MsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    const auto restored = codec == SessionCodec::NONE
+                              ? ReadFile(path)
+                              : ReadCompressedSessionFile(path);
+    const double restore_ms = MsSince(start);
+    if (restored != data) {
+      std::fprintf(stderr, "%s: round trip mismatch\n",
+                   SessionCodecName(codec));
+      return 1;
+    }
+    std::printf("%-6s %12.1f %8.2f %10.1f %12.1f\n", SessionCodecName(codec),
+                size / 1048576.0, static_cast<double>(data.size()) / size,
+                save_ms, restore_ms);
+  }
+  std::remove(path.c_str());
+  return 0;
+}
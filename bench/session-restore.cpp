@@ -0,0 +1,164 @@
+// Restore latency of a plain session file: llama_state_load_file (buffered
+// read into a staging copy) against mapping the file and handing the mapped
+// state to llama_state_set_data, the way LoadSessionWorker restores it.
+// Cold runs drop the file from the page cache first (Linux only; elsewhere
+// both columns measure a warm cache).
+//
+//   cmake -S . -B build -DLLAMA_NODE_BUILD_BENCH=ON
+//   cmake --build build --target session-restore-bench
+//   ./build/session-restore-bench model.gguf [n_tokens] [iterations]
+
+#include "MappedFile.h"
+#include "llama.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Evicts `path` from the page cache so the next restore reads from disk
+bool DropPageCache(const std::string &path) {
+#if defined(__linux__)
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  fdatasync(fd);
+  const bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+  close(fd);
+  return ok;
+#else
+  (void)path;
+  return false;
+#endif
+}
+
+bool RestoreBuffered(llama_context *ctx, const std::string &path) {
+  std::vector<llama_token> tokens(llama_n_ctx(ctx));
+  size_t count = 0;
+  return llama_state_load_file(ctx, path.c_str(), tokens.data(), tokens.size(),
+                               &count);
+}
+
+bool RestoreMapped(llama_context *ctx, const std::string &path) {
+  MappedFile file(path, true);
+  uint32_t header[3];
+  if (!file.Valid() || file.Size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(header, file.Data(), sizeof(header));
+  const size_t offset = sizeof(header) + header[2] * sizeof(llama_token);
+  if (header[0] != LLAMA_SESSION_MAGIC || offset > file.Size()) {
+    return false;
+  }
+  return llama_state_set_data(ctx, file.Data() + offset,
+                              file.Size() - offset) != 0;
+}
+
+double Median(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s model.gguf [n_tokens] [iterations]\n", argv[0]);
+    return 1;
+  }
+  const int n_tokens = argc > 2 ? std::atoi(argv[2]) : 4096;
+  const int iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+  const std::string path = "session-restore-bench.bin";
+
+  llama_backend_init();
+  llama_log_set([](ggml_log_level, const char *, void *) {}, nullptr);
+
+  auto model_params = llama_model_default_params();
+  model_params.n_gpu_layers = 0;
+  llama_model *model = llama_model_load_from_file(argv[1], model_params);
+  if (model == nullptr) {
+    fprintf(stderr, "failed to load %s\n", argv[1]);
+    return 1;
+  }
+  auto ctx_params = llama_context_default_params();
+  ctx_params.n_ctx = n_tokens + 64;
+  ctx_params.n_batch = 512;
+  llama_context *ctx = llama_init_from_model(model, ctx_params);
+  if (ctx == nullptr) {
+    fprintf(stderr, "failed to create context\n");
+    return 1;
+  }
+
+  const int32_t n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+  std::vector<llama_token> tokens(n_tokens);
+  for (int i = 0; i < n_tokens; i++) {
+    tokens[i] = static_cast<llama_token>((i * 7919) % n_vocab);
+  }
+  for (int i = 0; i < n_tokens; i += ctx_params.n_batch) {
+    const int n = std::min<int>(ctx_params.n_batch, n_tokens - i);
+    if (llama_decode(ctx, llama_batch_get_one(tokens.data() + i, n)) != 0) {
+      fprintf(stderr, "decode failed\n");
+      return 1;
+    }
+  }
+  if (!llama_state_save_file(ctx, path.c_str(), tokens.data(),
+                             tokens.size())) {
+    fprintf(stderr, "failed to save %s\n", path.c_str());
+    return 1;
+  }
+
+  struct Method {
+    const char *name;
+    bool (*restore)(llama_context *, const std::string &);
+  } methods[] = {{"llama_state_load_file", RestoreBuffered},
+                 {"mmap + set_data", RestoreMapped}};
+
+  bool cold_supported = true;
+  printf("tokens=%d state=%.1f MiB iterations=%d\n", n_tokens,
+         llama_state_get_size(ctx) / (1024.0 * 1024.0), iterations);
+  printf("%-24s %12s %12s\n", "method", "cold ms", "warm ms");
+  for (const auto &method : methods) {
+    std::vector<double> cold, warm;
+    for (int i = 0; i < iterations; i++) {
+      cold_supported = DropPageCache(path) && cold_supported;
+      auto start = Clock::now();
+      if (!method.restore(ctx, path)) {
+        fprintf(stderr, "%s failed\n", method.name);
+        return 1;
+      }
+      cold.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count());
+
+      start = Clock::now();
+      method.restore(ctx, path);
+      warm.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count());
+    }
+    printf("%-24s %12.2f %12.2f\n", method.name, Median(cold), Median(warm));
+  }
+  if (!cold_supported) {
+    printf("(page cache could not be dropped; cold runs are warm)\n");
+  }
+
+  std::remove(path.c_str());
+  llama_free(ctx);
+  llama_model_free(model);
+  llama_backend_free();
+  return 0;
+}
@@ -0,0 +1,183 @@
+// Microbenchmark for the per-token streaming path of LlamaCompletionWorker
+// (and the pooled parallel slot chunks) driven by a mock decoder, so heap
+// allocations per token show up without loading a model. Every operator new
+// is counted; "before" is the shape the worker had before pooling, "after"
+// runs the StreamTextCursor and ObjectPool the worker uses now.
+//
+//   cmake -S . -B build -DLLAMA_NODE_BUILD_BENCH=ON
+//   cmake --build build --target token-hot-path-bench
+//   ./build/token-hot-path-bench [n_tokens]
+
+#include "ObjectPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<size_t> g_allocs{0};
+
+void *operator new(size_t size) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Emits pieces from a fixed vocabulary, appending to generated_text the way
+// the sampler loop does.
+struct MockDecoder {
+  std::vector<std::string> vocab = {"The", " quick", " brown", " fox",
+                                    " jumps", " over", " the", " lazy",
+                                    " dog", ".", "\n", " and"};
+  std::string generated_text;
+  size_t step = 0;
+
+  const std::string &Next() {
+    const auto &piece = vocab[(step * 7 + 3) % vocab.size()];
+    step++;
+    generated_text += piece;
+    return piece;
+  }
+};
+
+const std::vector<std::string> kStopWords = {"</s>", "User:"};
+
+// findStoppingStrings as it was called before: on a std::string copy of the
+// unsent tail
+size_t FindStopCopy(const std::string &text, size_t last_token_size,
+                    bool partial) {
+  size_t stop_pos = std::string::npos;
+  for (const auto &word : kStopWords) {
+    size_t pos = std::string::npos;
+    if (partial) {
+      for (size_t n = std::min(word.size(), text.size()); n > 0; n--) {
+        if (text.compare(text.size() - n, n, word, 0, n) == 0) {
+          pos = text.size() - n;
+          break;
+        }
+      }
+    } else {
+      const size_t span = word.size() + last_token_size;
+      pos = text.find(word, text.size() > span ? text.size() - span : 0);
+    }
+    if (pos != std::string::npos &&
+        (stop_pos == std::string::npos || pos < stop_pos)) {
+      stop_pos = pos;
+    }
+  }
+  return stop_pos;
+}
+
+struct Payload {
+  std::shared_ptr<ObjectPool<Payload>> pool;
+  std::string token;
+  std::string accumulated_text;
+  void Reset() {
+    token.clear();
+    accumulated_text.clear();
+  }
+};
+
+struct Result {
+  double ns_per_token;
+  double allocs_per_token;
+};
+
+// Owned piece, substr copies of the tail and a fresh payload per token
+Result RunBefore(size_t n_tokens) {
+  MockDecoder decoder;
+  decoder.generated_text.reserve(n_tokens * 8);
+  size_t sent_count = 0;
+  size_t sink = 0;
+  const size_t allocs_before = g_allocs.load();
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n_tokens; i++) {
+    std::string token_text = decoder.Next();
+    size_t pos = std::min(sent_count, decoder.generated_text.size());
+    const std::string str_test = decoder.generated_text.substr(pos);
+    if (FindStopCopy(str_test, token_text.size(), false) != std::string::npos ||
+        FindStopCopy(str_test, token_text.size(), true) != std::string::npos) {
+      continue;
+    }
+    const std::string to_send = decoder.generated_text.substr(pos);
+    sent_count += to_send.size();
+    auto *payload = new Payload();
+    payload->token = to_send;
+    payload->accumulated_text = decoder.generated_text;
+    sink += payload->token.size();
+    delete payload;
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const size_t allocs = g_allocs.load() - allocs_before;
+  if (sink == 0) {
+    std::puts("");
+  }
+  return {std::chrono::duration<double, std::nano>(elapsed).count() / n_tokens,
+          static_cast<double>(allocs) / n_tokens};
+}
+
+// The worker's current loop: piece length only, stop search over the tail
+// in place and payloads recycled through an ObjectPool
+Result RunAfter(size_t n_tokens) {
+  MockDecoder decoder;
+  decoder.generated_text.reserve(n_tokens * 8);
+  StreamTextCursor cursor;
+  auto pool = std::make_shared<ObjectPool<Payload>>();
+  size_t sink = 0;
+  const size_t allocs_before = g_allocs.load();
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n_tokens; i++) {
+    const size_t token_size = decoder.Next().size();
+    const std::string *word = nullptr;
+    if (cursor.FindStop(decoder.generated_text, kStopWords, token_size, false,
+                        &word) != std::string::npos ||
+        cursor.FindStop(decoder.generated_text, kStopWords, token_size,
+                        true) != std::string::npos) {
+      continue;
+    }
+    const std::string_view to_send = cursor.Unsent(decoder.generated_text);
+    cursor.Advance(to_send.size());
+    auto *payload = pool->Acquire();
+    payload->token.assign(to_send.data(), to_send.size());
+    payload->accumulated_text.assign(decoder.generated_text);
+    sink += payload->token.size();
+    pool->Recycle(payload);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const size_t allocs = g_allocs.load() - allocs_before;
+  if (sink == 0) {
+    std::puts("");
+  }
+  return {std::chrono::duration<double, std::nano>(elapsed).count() / n_tokens,
+          static_cast<double>(allocs) / n_tokens};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const size_t n_tokens = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+  if (n_tokens == 0) {
+    std::fprintf(stderr, "usage: %s [n_tokens]\n", argv[0]);
+    return 1;
+  }
+
+  const Result before = RunBefore(n_tokens);
+  const Result after = RunAfter(n_tokens);
+
+  std::printf("%-8s %14s %16s\n", "path", "ns/token", "allocs/token");
+  std::printf("%-8s %14.1f %16.3f\n", "before", before.ns_per_token,
+              before.allocs_per_token);
+  std::printf("%-8s %14.1f %16.3f\n", "after", after.ns_per_token,
+              after.allocs_per_token);
+  return 0;
+}
@@ -3,15 +3,60 @@ import type { TTSCapabilities } from './tts'
 
 export type NativeTTSCapabilities = TTSCapabilities
 
+/**
+ * Media input: a file path, a base64 data URL, or raw encoded bytes
+ * (PNG/JPEG/GIF/WebP/BMP, WAV/MP3/FLAC) passed to native without copying.
+ */
+export type MediaInput = string | Uint8Array
+
+export type MediaCacheStats = {
+  hits: number
+  misses: number
+  evictions: number
+  entries: number
+  /** Bytes held by cached encoder outputs */
+  bytes: number
+  /** Configured byte budget */
+  budget: number
+}
+
+export type EmbeddingCacheStats = {
+  hits: number
+  misses: number
+  evictions: number
+  entries: number
+  /** Bytes held by cached embeddings */
+  bytes: number
+  /** Configured byte budget */
+  budget: number
+}
+
+export type StateCacheStats = {
+  hits: number
+  misses: number
+  /** Checkpoints written */
+  stores: number
+  evictions: number
+  entries: number
+  /** Bytes of checkpoint files on disk */
+  bytes: number
+  /** Configured byte budget */
+  budget: number
+  /** Total time spent restoring checkpoints */
+  restore_ms: number
+}
+
 export type MessagePart = {
   type: string
   text?: string
   image_url?: {
     url?: string
+    /** Encoded image bytes, used instead of `url` */
+    data?: Uint8Array
   }
   input_audio?: {
     format: string
-    data?: string
+    data?: string | Uint8Array
     url?: string
   }
 } & Record<string, any>
@@ -94,6 +139,61 @@ export type LlamaModelOptions = {
    * 0 = no count cap. Default 8.
    */
   state_cache_max_checkpoints?: number
+  /**
+   * Directory recurrent/hybrid model checkpoints are written to, every
+   * `state_cache_interval` prompt tokens, and restored from on later prompts
+   * with the same prefix. Extends prefix reuse past the in-memory budget and
+   * across runs. Compressed; evicted least recently used first.
+   */
+  state_cache_dir?: string
+  /**
+   * Prompt tokens between checkpoints in `state_cache_dir`. Default 512.
+   */
+  state_cache_interval?: number
+  /**
+   * Disk budget (MiB) for `state_cache_dir`. 0 disables it. Default 4096.
+   */
+  state_cache_disk_budget_mb?: number
+  /**
+   * Hibernate the context after this many ms without calls: its state is
+   * written to `hibernate_dir` and the context, KV cache and compute buffers
+   * are freed. The model stays loaded, so methods that only read it, like
+   * `getFormattedChat` and `getModelInfo`, keep working without waking. The
+   * next async call creates the context again off the main thread and
+   * restores the state first, reporting the time as `timings.wake_ms` on
+   * completions; other sync methods, like `queueCompletion`, create it on
+   * the main thread. Contexts with multimodal, a vocoder or parallel mode
+   * enabled stay awake. 0 disables it. Default 0.
+   */
+  hibernate_after_ms?: number
+  /**
+   * Directory for hibernated state. Default: the OS temporary directory
+   */
+  hibernate_dir?: string
+  /**
+   * Byte budget for caching embedding results by token sequence, pooling and
+   * normalization. Applies to embedding, embeddingBatch and parallel
+   * embedding. 0 disables it. Default 0.
+   */
+  embedding_cache_size?: number
+  /**
+   * File the embedding cache is loaded from at startup (when it was written
+   * for the same model) and saved to by saveEmbeddingCache().
+   */
+  embedding_cache_path?: string
+  /**
+   * Directory of prompt-prefix KV state shared by every context and process
+   * using it with the same model and KV cache settings. Text completions and
+   * parallel requests start from the longest cached prefix of their prompt,
+   * and prefixes seen by more than one prompt (e.g. a system prompt) are
+   * added to it. Not used for recurrent/hybrid models or sliding-window
+   * caches without `swa_full`.
+   */
+  prefix_cache_dir?: string
+  /**
+   * Prefixes are cached at multiples of this many tokens. Default: 256
+   */
+  prefix_cache_block_size?: number
   /**
    * List of device names to use for offloading
    * Device names can be obtained from getBackendDevicesInfo()
@@ -268,9 +368,9 @@ export type LlamaCompletionOptions = {
    * Path(s) to media file(s) to process before generating text.
    * When provided, the media will be processed and added to the context.
    * Requires multimodal support to be enabled via initMultimodal.
-   * Supports both file paths and base64 data URLs.
+   * Supports file paths, base64 data URLs and Buffer / Uint8Array bytes.
    */
-  media_paths?: string | string[]
+  media_paths?: MediaInput | MediaInput[]
   /**
    * Output token embeddings during generation (TTS continuous-latent /
    * embedding-driven flows). Also allows an empty prompt.
@@ -343,6 +443,14 @@ export type LlamaParallelCompletionOptions = LlamaCompletionOptions & {
    * Example: `512` to save only the last 512 tokens
    */
   save_state_size?: number
+
+  /**
+   * Sequence state to resume from, as returned by
+   * `parallel.getSequenceState()`. Any free slot can pick the request up,
+   * including on another process running the same model. Takes precedence
+   * over `load_state_path`.
+   */
+  load_state?: Buffer
 }
 
 export type TokenProbability = {
@@ -384,6 +492,8 @@ export type LlamaCompletionResult = {
     predicted_ms: number
     predicted_per_token_ms: number
     predicted_per_second: number
+    /** Time spent waking a hibernated context for this call */
+    wake_ms?: number
   }
 }
 
@@ -396,12 +506,81 @@ export type LlamaCompletionToken = {
   completion_probabilities?: CompletionProbability[]
 }
 
+export type LlamaForkOptions = Pick<
+  LlamaCompletionOptions,
+  | 'prompt'
+  | 'grammar'
+  | 'stop'
+  | 'n_predict'
+  | 'temperature'
+  | 'top_k'
+  | 'top_p'
+  | 'min_p'
+  | 'mirostat'
+  | 'mirostat_tau'
+  | 'mirostat_eta'
+  | 'penalty_last_n'
+  | 'penalty_repeat'
+  | 'penalty_freq'
+  | 'penalty_present'
+  | 'typ_p'
+  | 'xtc_threshold'
+  | 'xtc_probability'
+  | 'dry_multiplier'
+  | 'dry_base'
+  | 'dry_allowed_length'
+  | 'dry_penalty_last_n'
+  | 'top_n_sigma'
+  | 'ignore_eos'
+  | 'seed'
+> & {
+  prompt: string
+  /**
+   * Prune down to this many branches, keeping the highest mean token
+   * log-probability. Default: 0 (never prune)
+   */
+  keep_branches?: number
+  /** Tokens generated between pruning rounds. Default: 16 */
+  prune_interval?: number
+}
+
+export type LlamaForkBranch = {
+  index: number
+  text: string
+  tokens: number[]
+  /** Sum of the log-probabilities of the sampled tokens */
+  logprob: number
+  stopped_eos: boolean
+  stopped_word: boolean
+  stopped_limit: boolean
+  pruned: boolean
+}
+
+export type LlamaForkResult = {
+  branches: LlamaForkBranch[]
+  timings: {
+    prompt_n: number
+    prompt_ms: number
+    predicted_n: number
+    predicted_ms: number
+  }
+}
+
+/**
+ * Sequence addressed by getSequenceState / saveSequenceState: the request id
+ * of an active or finished completion (as long as no other request has used
+ * its slot since), or a slot id from `LlamaParallelCompletionResult`.
+ */
+export type LlamaSequenceTarget = number | { slot_id: number }
+
 /**
  * Result from a parallel completion request (queueCompletion callback).
  * Extends the basic completion result with per-slot timing information.
  */
 export type LlamaParallelCompletionResult = {
   requestId: number
+  /** Slot that served the request; its sequence stays there until reused */
+  slot_id: number
   text: string
   reasoning_content?: string
   content?: string
@@ -436,12 +615,117 @@ export type TokenizeResult = {
   chunk_pos_media: number[]
 }
 
+export type TokenizeBatchOptions = {
+  /** Add BOS/EOS as the model expects. Default: false, like tokenize() */
+  add_special?: boolean
+  /** Parse special token text such as <|im_start|>. Default: false */
+  parse_special?: boolean
+}
+
+export type TokenizeBatchResult = {
+  /** Tokens of all texts, concatenated */
+  tokens: Int32Array
+  /** tokens.subarray(offsets[i], offsets[i + 1]) belongs to texts[i] */
+  offsets: Uint32Array
+}
+
+/**
+ * Encoding of returned embeddings:
+ * - 'f32': Float32Array (default)
+ * - 'f16': Uint16Array of IEEE half-precision bits
+ * - 'int8': Int8Array of components scaled by 127. Requires embd_normalize >= 1
+ *   (a p-norm, which keeps components in [-1, 1])
+ * - 'binary': Uint8Array of sign bits, 8 dimensions per byte, MSB first
+ */
+export type EmbeddingQuant = 'f32' | 'f16' | 'int8' | 'binary'
+
+export type EmbeddingArray = Float32Array | Uint16Array | Int8Array | Uint8Array
+
+export type EmbeddingParams = {
+  embd_normalize?: number
+  /**
+   * Keep only the first `embd_dim` dimensions (Matryoshka truncation) and
+   * renormalize them with embd_normalize. Default: all dimensions.
+   */
+  embd_dim?: number
+  embd_quant?: EmbeddingQuant
+}
+
 export type EmbeddingResult = {
-  embedding: Float32Array
+  embedding: EmbeddingArray
+}
+
+export type EmbeddingBatchParams = EmbeddingParams & {
+  /**
+   * Maximum number of tokens packed into one decode (default: n_batch).
+   * Texts are packed up to the context's n_parallel sequences per decode, so
+   * load the model with n_parallel > 1 to pack more than one text; with the
+   * default of 1 every text still gets its own decode. Rejected while
+   * parallel mode is enabled: use queueEmbedding there.
+   */
+  max_batch_tokens?: number
+  /**
+   * Also add the embeddings to this index natively, without copying them
+   * through JS. Requires one id per text in `ids`.
+   */
+  index?: LlamaVectorIndex
+  ids?: number[]
+}
+
+export type EmbeddingBatchResult = {
+  /** Embeddings of all texts, row-major, encoded as embd_quant */
+  embeddings: EmbeddingArray
+  /** embeddings.subarray(offsets[i], offsets[i + 1]) belongs to texts[i] */
+  offsets: Uint32Array
+  /** Dimensions per embedding after embd_dim truncation */
+  n_embd: number
+}
+
+export type EmbeddingChunksParams = EmbeddingBatchParams & {
+  /** Document tokens per chunk (default: as many as fit in a batch) */
+  chunk_tokens?: number
+  /** Tokens shared by consecutive chunks. Default: 0 */
+  overlap_tokens?: number
+  /**
+   * - 'none': one embedding per chunk (default)
+   * - 'mean': a single document embedding averaging the chunks
+   * - 'weighted': like 'mean', weighting each chunk by its token count
+   */
+  aggregate?: 'none' | 'mean' | 'weighted'
+}
+
+export type EmbeddingChunksResult = EmbeddingBatchResult & {
+  /**
+   * Document token range of each chunk: chunk i covers tokens
+   * chunks[2 * i] until chunks[2 * i + 1] (exclusive)
+   */
+  chunks: Uint32Array
+  /** Number of tokens in the document */
+  n_tokens: number
+}
+
+export type TokenEmbeddingResult = {
+  /** Row-major [n_tokens, n_embd] matrix of per-token embeddings */
+  embeddings: Float32Array
+  n_tokens: number
+  n_embd: number
 }
 
 export type RerankParams = {
   normalize?: number
+  /** Return only the best `top_k` documents (default: all) */
+  top_k?: number
+  /** Drop documents scoring below this */
+  threshold?: number
+  /** Truncate each document to this many tokens before scoring */
+  max_doc_tokens?: number
+  /**
+   * Maximum number of tokens packed into one decode (default: n_batch).
+   * (query, document) pairs are packed up to the context's n_parallel
+   * sequences per decode. Packed scoring is rejected while parallel mode is
+   * enabled: use queueRerank there.
+   */
+  max_batch_tokens?: number
 }
 
 export type RerankResult = {
@@ -537,7 +821,7 @@ export type FormattedChatResult = {
   type: 'jinja' | 'llama-chat'
   prompt: string
   has_media: boolean
-  media_paths?: Array<string>
+  media_paths?: Array<MediaInput>
 }
 
 export type JinjaFormattedChatResult = {
@@ -578,6 +862,46 @@ export type ToolCall = {
   id?: string
 }
 
+export type SessionCompression = 'none' | 'lz4' | 'zstd'
+
+export type SaveSessionOptions = {
+  /** Default: 'none', which writes the plain llama.cpp session format */
+  compression?: SessionCompression
+  /** zstd compression level. Default: 3 */
+  compression_level?: number
+  /**
+   * Append to an append-only session file instead of rewriting it, so a save
+   * after a chat turn writes roughly the new tokens' KV rows. `compression`
+   * then applies per chunk. loadSession restores the newest save.
+   * Requires flash attention: without it the V cache is stored transposed
+   * and every save rewrites nearly the whole state, so flash_attn_type 'off'
+   * is rejected. With 'auto' on a backend that falls back, check
+   * `bytes_written` in the result.
+   */
+  delta?: boolean
+  /**
+   * Rewrite a delta file as a single save once its size exceeds this
+   * multiple of the newest save. Default: 2
+   */
+  compact_ratio?: number
+  /**
+   * Copy the state to host memory and release the context right away;
+   * compression and file I/O run in the background. completion(),
+   * loadSession(), setSessionState() and release() called after this start
+   * once the copy is taken instead of waiting for the write. The promise
+   * resolves when the file is synced to disk.
+   */
+  snapshot?: boolean
+}
+
+export type SaveSessionResult = {
+  /** Bytes this save wrote: the appended segment for a delta save */
+  bytes_written: number
+  file_size: number
+  /** A delta save rewrote the file as a single segment */
+  compacted: boolean
+}
+
 export type ParallelRequestStatus = {
   request_id: number
   type: 'completion' | 'embedding' | 'rerank'
@@ -621,25 +945,128 @@ export interface LlamaContext {
       force_pure_content?: boolean
     },
   ): JinjaFormattedChatResult | string
+  /**
+   * Run a completion. When `stream` is given, tokens are pushed into it
+   * (blocking the decode loop while it is full) instead of `callback`.
+   */
   completion(
     options: LlamaCompletionOptions,
     callback?: (token: LlamaCompletionToken) => void,
+    stream?: LlamaTokenStream,
   ): Promise<LlamaCompletionResult>
   stopCompletion(): void
-  tokenize(text: string, media_paths?: string[]): Promise<TokenizeResult>
+  /**
+   * Evaluate `prompt` once and sample `n` continuations of it together, each
+   * in its own sequence sharing the prompt's KV cells (copied per stream
+   * unless `kv_unified`). Branch `i` is seeded `seed + i`. Needs a context
+   * loaded with `n_parallel >= n`; not available in parallel mode.
+   * Afterwards the context holds only the prompt.
+   */
+  fork(n: number, options: LlamaForkOptions): Promise<LlamaForkResult>
+  tokenize(text: string, media_paths?: MediaInput[]): Promise<TokenizeResult>
+  /**
+   * Tokenize many texts in one call, spread over n_threads threads
+   * @param texts Texts to tokenize (no media)
+   * @param options Special token handling
+   */
+  tokenizeBatch(
+    texts: string[],
+    options?: TokenizeBatchOptions,
+  ): Promise<TokenizeBatchResult>
+  /**
+   * Count the tokens of many texts without returning them
+   * @returns Token count of each text
+   */
+  countTokens(
+    texts: string[],
+    options?: TokenizeBatchOptions,
+  ): Promise<Uint32Array>
   detokenize(tokens: number[]): Promise<string>
   embedding(
     text: string,
-    params?: { embd_normalize?: number },
+    params?: EmbeddingParams,
   ): Promise<EmbeddingResult>
+  embeddingBatch(
+    texts: string[],
+    params?: EmbeddingBatchParams,
+  ): Promise<EmbeddingBatchResult>
+  /**
+   * Embed a document of any length as overlapping token windows
+   * @param text Document to embed
+   * @param params Chunking, aggregation and output options
+   * @returns Chunk embeddings, or one embedding when aggregated
+   */
+  embeddingChunks(
+    text: string,
+    params?: EmbeddingChunksParams,
+  ): Promise<EmbeddingChunksResult>
+  /**
+   * Per-token embeddings of a text. Requires pooling_type 'none'. Like
+   * embeddingBatch and embeddingChunks, rejected while parallel mode is enabled.
+   * @param text Text to embed
+   * @param params embd_normalize applies to each token (default: 2)
+   */
+  embeddingTokens(
+    text: string,
+    params?: { embd_normalize?: number },
+  ): Promise<TokenEmbeddingResult>
+  /**
+   * Late-interaction (ColBERT MaxSim) scores: for each document, the sum over
+   * query tokens of the best dot product with any document token
+   * @param query Query token matrix from embeddingTokens
+   * @param documents Document token matrices from embeddingTokens
+   * @returns One score per document
+   */
+  maxSim(query: Float32Array, documents: Float32Array[]): Promise<Float32Array>
+  /**
+   * Get embedding cache counters
+   */
+  getEmbeddingCacheStats(): EmbeddingCacheStats
+  /**
+   * Drop all cached embeddings
+   */
+  clearEmbeddingCache(): void
+  /**
+   * Write the embedding cache to `path` (default: embedding_cache_path)
+   * @returns Number of entries written
+   */
+  saveEmbeddingCache(path?: string): Promise<number>
   rerank(
     query: string,
     documents: string[],
     params?: RerankParams,
   ): Promise<RerankResult[]>
-  saveSession(path: string): Promise<void>
+  /**
+   * Save the session to a file. With `compression`, the state is written in
+   * 1 MiB chunks through lz4 (fast) or zstd (smaller; only in builds
+   * configured with LLAMA_NODE_ZSTD). loadSession detects compressed files automatically.
+   */
+  saveSession(
+    path: string,
+    options?: SaveSessionOptions,
+  ): Promise<SaveSessionResult>
   loadSession(path: string): Promise<void>
+  /**
+   * Serialize the KV state, token history and media hashes into one Buffer.
+   * The Buffer owns the native allocation, so the state is not copied again.
+   */
+  getSessionState(): Promise<Buffer>
+  /**
+   * Restore a Buffer from getSessionState(), read in place
+   * @returns Number of restored prompt tokens
+   */
+  setSessionState(state: Buffer): Promise<number>
   release(): Promise<void>
+  /**
+   * Hibernate the context now if it is idle (see `hibernate_after_ms`)
+   * @returns 0 once hibernated, otherwise ms to wait before trying again
+   */
+  hibernate(): Promise<number>
+  /**
+   * Rebuild a hibernated context ahead of the next call
+   * @returns ms the wake took, 0 when the context was awake
+   */
+  wake(): Promise<number>
   applyLoraAdapters(adapters: { path: string; scaled: number }[]): void
   removeLoraAdapters(): void
   getLoadedLoraAdapters(): { path: string; scaled: number }[]
@@ -652,6 +1079,13 @@ export interface LlamaContext {
    * @param options.image_max_tokens Maximum number of tokens for image input (for dynamic resolution models).
    *                                  Lower values reduce memory usage and improve speed for high-resolution images.
    *                                  Recommended: 256-512 for faster inference, up to 4096 for maximum detail.
+   * @param options.media_cache_size Byte budget for caching media encoder outputs by a hash of the media bytes, so
+   *                                 the same image or audio is not re-encoded across completions (default: 0,
+   *                                 disabled). One budget shared by completion() and queued media completions;
+   *                                 a hit is not decoded again.
+   * @param options.async_media_encode Encode media on a background thread while the prompt text before it is
+   *                                   decoded, instead of serially inside prompt evaluation (default: false).
+   *                                   Also applies to queueMediaCompletion, which evaluates media off the slot loop.
    * @returns boolean indicating if initialization was successful
    */
   initMultimodal(options: {
@@ -659,6 +1093,8 @@ export interface LlamaContext {
     use_gpu?: boolean
     image_min_tokens?: number
     image_max_tokens?: number
+    media_cache_size?: number
+    async_media_encode?: boolean
   }): boolean
 
   /**
@@ -681,6 +1117,21 @@ export interface LlamaContext {
    */
   releaseMultimodal(): void
 
+  /**
+   * Get media encoder cache counters
+   */
+  getMediaCacheStats(): MediaCacheStats
+
+  /**
+   * Drop all cached media encoder outputs
+   */
+  clearMediaCache(): void
+
+  /**
+   * Get counters of the `state_cache_dir` checkpoint cache
+   */
+  getStateCacheStats(): StateCacheStats
+
   /**
    * Load a vocoder / codec model (codec.cpp GGUF)
    * @param options Object containing path, optional n_batch and use_gpu
@@ -792,8 +1243,24 @@ export interface LlamaContext {
   queueCompletion(
     options: LlamaParallelCompletionOptions,
     callback?: (error: any, result: LlamaParallelCompletionResult) => void,
+    stream?: LlamaTokenStream,
   ): { requestId: number }
 
+  /**
+   * Queue a completion request with media. The media is decoded, encoded and
+   * evaluated on a worker thread and handed to the slot as a loaded state, so
+   * other slots keep decoding meanwhile. Accepts Buffer media entries, which
+   * queueCompletion does not.
+   * @param options Completion options with parallel-specific state management
+   * @param callback Optional callback that receives tokens during generation and final result
+   * @returns Promise resolving to the requestId once the request is queued
+   */
+  queueMediaCompletion(
+    options: LlamaParallelCompletionOptions,
+    callback?: (error: any, result: LlamaParallelCompletionResult) => void,
+    stream?: LlamaTokenStream,
+  ): Promise<{ requestId: number }>
+
   /**
    * Queue an embedding request for parallel processing
    * @param text Text to embed
@@ -803,7 +1270,7 @@ export interface LlamaContext {
    */
   queueEmbedding(
     text: string,
-    params?: { embd_normalize?: number },
+    params?: EmbeddingParams,
     callback?: (error: any, result: any) => void,
   ): { requestId: number }
 
@@ -828,6 +1295,22 @@ export interface LlamaContext {
    */
   cancelRequest(requestId: number): void
 
+  /**
+   * Snapshot the sequence of a slot. The processing loop pauses while the
+   * sequence is copied.
+   * @param target Request ID of an active or finished completion, or slot ID
+   * @returns State in the `save_state_path` file format
+   */
+  getSequenceState(target: LlamaSequenceTarget): Promise<Buffer>
+
+  /**
+   * Save the sequence of a slot to a file usable as `load_state_path`
+   * @param target Request ID of an active or finished completion, or slot ID
+   * @param path File path to write
+   * @returns Number of tokens saved
+   */
+  saveSequenceState(target: LlamaSequenceTarget, path: string): Promise<number>
+
   /**
    * Get current parallel processing status (one-time snapshot)
    * @returns Current parallel status
@@ -880,8 +1363,112 @@ export interface LlamaContext {
   getBackendDevicesInfo(): BackendDeviceInfo[]
 }
 
+/**
+ * Bounded native token buffer shared between a decode thread and JS.
+ * `onReadable` fires (coalesced) when data arrives or the producer finishes.
+ */
+export interface LlamaTokenStream {
+  new (
+    options: { capacity?: number },
+    onReadable: () => void,
+  ): LlamaTokenStream
+  /** Take up to `max` buffered items (defaults to the capacity). */
+  read<T = any>(max?: number): T[]
+  /** True once the producer finished and the buffer is drained, or after close(). */
+  isFinished(): boolean
+  /** Drop buffered items and release a producer waiting for space. */
+  close(): void
+}
+
+export type VectorIndexOptions = {
+  /** Vector dimension. Default: taken from the first added vectors */
+  dim?: number
+  /** Row encoding: 'f32' (default), 'int8' or 'binary' */
+  quant?: 'f32' | 'int8' | 'binary'
+  /**
+   * 'cosine' (default) normalizes rows and queries; 'dot' scores raw dot
+   * products. Binary rows always score 1 - 2 * hamming / dim.
+   */
+  metric?: 'cosine' | 'dot'
+}
+
+export type VectorIndexInfo = Required<VectorIndexOptions> & {
+  /** Number of vectors */
+  size: number
+  /** Memory used by ids and rows */
+  bytes: number
+}
+
+export type VectorSearchResult = {
+  /** Ids of the best matches, best first */
+  ids: Float64Array
+  scores: Float32Array
+}
+
+/**
+ * Native exact (flat) vector index searched with SIMD kernels on a worker
+ * thread. Adding an id that already exists replaces its vector.
+ */
+export interface LlamaVectorIndex {
+  new (options?: VectorIndexOptions): LlamaVectorIndex
+  info(): VectorIndexInfo
+  /**
+   * Add ids.length vectors. Int8Array / Uint8Array rows must already use the
+   * index quant (embedding output with embd_quant 'int8' / 'binary').
+   */
+  add(ids: number[], vectors: Float32Array | Int8Array | Uint8Array): void
+  /** Returns the number of ids that were present */
+  remove(ids: number[]): number
+  clear(): void
+  search(
+    query: Float32Array | Int8Array | Uint8Array,
+    k: number,
+  ): Promise<VectorSearchResult>
+  /** Write the index to a file, resolving the number of vectors */
+  save(path: string): Promise<number>
+  /**
+   * Replace the contents with a saved index, resolving the number of vectors.
+   * The rows are memory-mapped and searched in place until the first add or
+   * remove copies them into memory.
+   */
+  load(path: string): Promise<number>
+}
+
+export type TokenizerInfo = {
+  n_vocab: number
+  bos: number
+  eos: number
+  add_bos: boolean
+  add_eos: boolean
+}
+
+/**
+ * Vocab-only tokenizer that does not create a context. Handles opened on the
+ * same path share one native vocab, including across worker_threads, and
+ * all methods are synchronous.
+ */
+export interface LlamaTokenizer {
+  /** Opens synchronously; prefer `load` for paths not already open */
+  new (path: string): LlamaTokenizer
+  /** Load the vocab on a worker thread */
+  load(path: string): Promise<LlamaTokenizer>
+  tokenize(text: string, options?: TokenizeBatchOptions): Int32Array
+  /**
+   * @param options.special Render special tokens as text. Default: true
+   */
+  detokenize(
+    tokens: number[] | Int32Array,
+    options?: { special?: boolean },
+  ): string
+  countTokens(text: string, options?: TokenizeBatchOptions): number
+  getInfo(): TokenizerInfo
+}
+
 export interface Module {
   LlamaContext: LlamaContext
+  LlamaTokenStream: LlamaTokenStream
+  LlamaVectorIndex: LlamaVectorIndex
+  LlamaTokenizer: LlamaTokenizer
 }
 
 export type LibVariant = 'default' | 'vulkan' | 'cuda' | 'snapdragon'
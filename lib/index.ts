@@ -8,7 +8,18 @@ import type {
   LlamaCompletionToken,
   LlamaCompletionResult,
   TokenizeResult,
+  TokenizeBatchOptions,
+  TokenizeBatchResult,
   EmbeddingResult,
+  EmbeddingParams,
+  EmbeddingBatchParams,
+  EmbeddingBatchResult,
+  EmbeddingChunksParams,
+  EmbeddingChunksResult,
+  TokenEmbeddingResult,
+  EmbeddingCacheStats,
+  SaveSessionOptions,
+  SaveSessionResult,
   RerankParams,
   RerankResult,
   CompletionResponseFormat,
@@ -17,16 +28,27 @@ import type {
   Tool,
   GGUFModelInfo,
   BenchResult,
+  MediaInput,
+  MediaCacheStats,
+  StateCacheStats,
+  LlamaForkOptions,
+  LlamaForkResult,
+  LlamaVectorIndex,
+  VectorIndexOptions,
+  LlamaTokenizer,
 } from './binding'
 import { BUILD_NUMBER, BUILD_COMMIT } from './version'
 import { LlamaParallelAPI } from './parallel'
+import { LlamaCompletionStream } from './stream'
+import type { CompletionStreamOptions } from './stream'
 import { formatMediaChat } from './utils'
 import type { TTSCapabilities } from './tts'
 import type { SpeakerPayload } from './tts-voices'
 import { lookupVoice, listVoices, listLanguages } from './tts-voices'
 
 export * from './binding'
-export { LlamaParallelAPI }
+export { LlamaParallelAPI, LlamaCompletionStream }
+export type { CompletionStreamOptions } from './stream'
 export type { TTSCapabilities } from './tts'
 export type {
   OuteTTSWord,
@@ -135,21 +157,42 @@ export type FormattedChatResult =
       type: 'llama-chat'
       prompt: string
       has_media: boolean
-      media_paths?: Array<string>
+      media_paths?: Array<MediaInput>
     }
   | ({
       type: 'jinja'
       has_media: boolean
-      media_paths?: Array<string>
+      media_paths?: Array<MediaInput>
     } & JinjaFormattedChatResult)
 
 class LlamaContextWrapper {
   ctx: LlamaContext
   parallel: LlamaParallelAPI
 
-  constructor(nativeCtx: LlamaContext) {
+  private mod: Module
+  private hibernateAfterMs: number
+  private hibernateTimer?: ReturnType<typeof setTimeout>
+
+  constructor(nativeCtx: LlamaContext, mod: Module, hibernateAfterMs = 0) {
     this.ctx = nativeCtx
-    this.parallel = new LlamaParallelAPI(nativeCtx)
+    this.mod = mod
+    this.parallel = new LlamaParallelAPI(nativeCtx, mod)
+    this.hibernateAfterMs = hibernateAfterMs
+    if (hibernateAfterMs > 0) this.scheduleHibernate(hibernateAfterMs)
+  }
+
+  // Checks again after the delay native reports, or a full idle period once
+  // hibernated, since any call in between wakes the context
+  private scheduleHibernate(delayMs: number) {
+    if (this.hibernateAfterMs <= 0) return
+    this.hibernateTimer = setTimeout(() => {
+      this.ctx.hibernate().then(
+        (retryMs) => this.scheduleHibernate(retryMs || this.hibernateAfterMs),
+        () => this.scheduleHibernate(this.hibernateAfterMs),
+      )
+    }, delayMs)
+    // Never keep the process alive just to hibernate
+    this.hibernateTimer.unref?.()
   }
 
   getSystemInfo(): string {
@@ -260,28 +303,125 @@ class LlamaContextWrapper {
     )
   }
 
+  /**
+   * Run a completion and consume its tokens as an async iterator.
+   * Generation pauses while `capacity` tokens are waiting to be read;
+   * breaking out of the loop stops the completion.
+   */
+  completionStream(
+    options: LlamaCompletionOptions & { speaker?: LlamaSpeaker },
+    streamOptions?: CompletionStreamOptions,
+  ): {
+    stream: LlamaCompletionStream<LlamaCompletionToken>
+    result: Promise<LlamaCompletionResult>
+    stop: () => void
+  } {
+    const stream = new LlamaCompletionStream<LlamaCompletionToken>(
+      this.mod,
+      streamOptions,
+    )
+    stream.setOnClose(() => this.ctx.stopCompletion())
+    const { messages, media_paths = options.media_paths } = formatMediaChat(
+      options.messages,
+    )
+    const { speaker, ...rest } = options
+    const result = this.ctx.completion(
+      {
+        ...rest,
+        ...(speaker instanceof LlamaSpeaker ? { speakerId: speaker.id } : {}),
+        messages,
+        media_paths: options.media_paths || media_paths,
+      },
+      undefined,
+      stream.native,
+    )
+    return { stream, result, stop: () => stream.close() }
+  }
+
   stopCompletion(): void {
     return this.ctx.stopCompletion()
   }
 
+  /**
+   * Sample `n` continuations of one prompt in a single batched decode
+   * @param n Number of branches (at most the context's `n_parallel`)
+   */
+  fork(n: number, options: LlamaForkOptions): Promise<LlamaForkResult> {
+    return this.ctx.fork(n, options)
+  }
+
   tokenize(
     text: string,
-    { media_paths }: { media_paths?: string[] } = {},
+    { media_paths }: { media_paths?: MediaInput[] } = {},
   ): Promise<TokenizeResult> {
     return this.ctx.tokenize(text, media_paths)
   }
 
+  tokenizeBatch(
+    texts: string[],
+    options?: TokenizeBatchOptions,
+  ): Promise<TokenizeBatchResult> {
+    return this.ctx.tokenizeBatch(texts, options)
+  }
+
+  countTokens(
+    texts: string[],
+    options?: TokenizeBatchOptions,
+  ): Promise<Uint32Array> {
+    return this.ctx.countTokens(texts, options)
+  }
+
   detokenize(tokens: number[]): Promise<string> {
     return this.ctx.detokenize(tokens)
   }
 
   embedding(
     text: string,
-    params?: { embd_normalize?: number },
+    params?: EmbeddingParams,
   ): Promise<EmbeddingResult> {
     return this.ctx.embedding(text, params)
   }
 
+  embeddingBatch(
+    texts: string[],
+    params?: EmbeddingBatchParams,
+  ): Promise<EmbeddingBatchResult> {
+    return this.ctx.embeddingBatch(texts, params)
+  }
+
+  embeddingChunks(
+    text: string,
+    params?: EmbeddingChunksParams,
+  ): Promise<EmbeddingChunksResult> {
+    return this.ctx.embeddingChunks(text, params)
+  }
+
+  embeddingTokens(
+    text: string,
+    params?: { embd_normalize?: number },
+  ): Promise<TokenEmbeddingResult> {
+    return this.ctx.embeddingTokens(text, params)
+  }
+
+  maxSim(
+    query: Float32Array,
+    documents: Float32Array[],
+  ): Promise<Float32Array> {
+    return this.ctx.maxSim(query, documents)
+  }
+
+  getEmbeddingCacheStats(): EmbeddingCacheStats {
+    return this.ctx.getEmbeddingCacheStats()
+  }
+
+  clearEmbeddingCache(): void {
+    this.ctx.clearEmbeddingCache()
+  }
+
+  saveEmbeddingCache(path?: string): Promise<number> {
+    return this.ctx.saveEmbeddingCache(path)
+  }
+
   rerank(
     query: string,
     documents: string[],
@@ -305,18 +445,47 @@ class LlamaContextWrapper {
       })
   }
 
-  saveSession(path: string): Promise<void> {
-    return this.ctx.saveSession(path)
+  saveSession(
+    path: string,
+    options?: SaveSessionOptions,
+  ): Promise<SaveSessionResult> {
+    return this.ctx.saveSession(path, options)
   }
 
   loadSession(path: string): Promise<void> {
     return this.ctx.loadSession(path)
   }
 
+  getSessionState(): Promise<Buffer> {
+    return this.ctx.getSessionState()
+  }
+
+  setSessionState(state: Buffer): Promise<number> {
+    return this.ctx.setSessionState(state)
+  }
+
   release(): Promise<void> {
+    this.hibernateAfterMs = 0
+    clearTimeout(this.hibernateTimer)
     return this.ctx.release()
   }
 
+  /**
+   * Hibernate the context now if it is idle; the next async call wakes it
+   * @returns 0 once hibernated, otherwise ms to wait before trying again
+   */
+  hibernate(): Promise<number> {
+    return this.ctx.hibernate()
+  }
+
+  /**
+   * Reload a hibernated context, e.g. before sync calls like getFormattedChat
+   * @returns ms the wake took, 0 when the context was awake
+   */
+  wake(): Promise<number> {
+    return this.ctx.wake()
+  }
+
   applyLoraAdapters(adapters: { path: string; scaled: number }[]): void {
     return this.ctx.applyLoraAdapters(adapters)
   }
@@ -334,6 +503,8 @@ class LlamaContextWrapper {
     use_gpu?: boolean
     image_min_tokens?: number
     image_max_tokens?: number
+    media_cache_size?: number
+    async_media_encode?: boolean
   }): boolean {
     return this.ctx.initMultimodal(options)
   }
@@ -346,6 +517,18 @@ class LlamaContextWrapper {
     this.ctx.releaseMultimodal()
   }
 
+  getMediaCacheStats(): MediaCacheStats {
+    return this.ctx.getMediaCacheStats()
+  }
+
+  clearMediaCache(): void {
+    this.ctx.clearMediaCache()
+  }
+
+  getStateCacheStats(): StateCacheStats {
+    return this.ctx.getStateCacheStats()
+  }
+
   getMultimodalSupport(): {
     vision: boolean
     audio: boolean
@@ -548,7 +731,11 @@ export const loadModel = async (
     },
     onProgress,
   )
-  return new LlamaContextWrapper(nativeCtx)
+  return new LlamaContextWrapper(
+    nativeCtx,
+    mods[variant],
+    options.hibernate_after_ms,
+  )
 }
 
 export const initLlama = loadModule
@@ -579,6 +766,32 @@ export const getBackendDevicesInfo = async (
   return JSON.parse(jsonString as any)
 }
 
+export const createVectorIndex = async (
+  options?: VectorIndexOptions,
+  variant: LibVariant = 'default',
+): Promise<LlamaVectorIndex> => {
+  mods[variant] ??= await loadModule(variant)
+  return new mods[variant].LlamaVectorIndex(options)
+}
+
+export const loadVectorIndex = async (
+  path: string,
+  variant: LibVariant = 'default',
+): Promise<LlamaVectorIndex> => {
+  const index = await createVectorIndex({}, variant)
+  await index.load(path)
+  return index
+}
+
+export const loadTokenizer = async (
+  path: string,
+  variant: LibVariant = 'default',
+): Promise<LlamaTokenizer> => {
+  mods[variant] ??= await loadModule(variant)
+  refreshNativeLogSetup()
+  return mods[variant].LlamaTokenizer.load(path)
+}
+
 export const BuildInfo = {
   number: BUILD_NUMBER,
   commit: BUILD_COMMIT,
@@ -1,15 +1,26 @@
 // Parallel decoding API implementation for llama.node
+import fs from 'fs'
+import os from 'os'
+import path from 'path'
 import type {
+  Module,
   LlamaContext,
   LlamaCompletionToken,
   RerankParams,
+  EmbeddingParams,
+  EmbeddingArray,
   ParallelStatus,
   LlamaParallelCompletionOptions,
+  LlamaTokenStream,
+  LlamaSequenceTarget,
 } from './binding'
 import { formatMediaChat } from './utils'
+import { LlamaCompletionStream } from './stream'
+import type { CompletionStreamOptions } from './stream'
 
 export class LlamaParallelAPI {
   private context: LlamaContext
+  private mod?: Module
   private enabled: boolean = false
   private pendingRequests = new Map<
     number,
@@ -19,8 +30,9 @@ export class LlamaParallelAPI {
     }
   >()
 
-  constructor(context: LlamaContext) {
+  constructor(context: LlamaContext, mod?: Module) {
     this.context = context
+    this.mod = mod
   }
 
   /**
@@ -112,13 +124,13 @@ export class LlamaParallelAPI {
         }
       : undefined
 
-    const { messages, media_paths = options.media_paths } = formatMediaChat(
-      options.messages,
+    const { options: queued, cleanup } = await this.resolveLoadState(options)
+    const { messages, media_paths = queued.media_paths } = formatMediaChat(
+      queued.messages,
     )
-    // Queue the completion immediately (this is synchronous!)
-    const { requestId } = this.context.queueCompletion(
+    const { requestId } = await this.queue(
       {
-        ...options,
+        ...queued,
         messages,
         media_paths: media_paths,
       },
@@ -152,6 +164,7 @@ export class LlamaParallelAPI {
         reject: rejectResult,
       })
     })
+    promise.then(cleanup, cleanup)
 
     // Create stop function
     const stop = () => {
@@ -171,18 +184,163 @@ export class LlamaParallelAPI {
     }
   }
 
+  /**
+   * Queue a completion request and consume its tokens as an async iterator.
+   * The slot keeps decoding while the consumer lags; tokens arriving into a
+   * full buffer are merged into the newest entry. Breaking out of the loop
+   * cancels the request.
+   * @param options Completion options
+   * @param streamOptions Native buffer options
+   * @returns Object with requestId, token stream, promise for result, and stop function
+   */
+  async completionStream(
+    options: LlamaParallelCompletionOptions,
+    streamOptions?: CompletionStreamOptions,
+  ): Promise<{
+    requestId: number
+    stream: LlamaCompletionStream<LlamaCompletionToken & { requestId: number }>
+    promise: Promise<any>
+    stop: () => void
+  }> {
+    if (!this.enabled) {
+      throw new Error('Parallel mode is not enabled. Call enable() first.')
+    }
+    if (!this.mod) {
+      throw new Error('Native module is required for streaming')
+    }
+
+    const stream = new LlamaCompletionStream<
+      LlamaCompletionToken & { requestId: number }
+    >(this.mod, streamOptions)
+    const { options: queued, cleanup } = await this.resolveLoadState(options)
+    const { messages, media_paths = queued.media_paths } = formatMediaChat(
+      queued.messages,
+    )
+    const { requestId } = await this.queue(
+      {
+        ...queued,
+        messages,
+        media_paths: media_paths,
+      },
+      (error, result) => {
+        const pendingReq = this.pendingRequests.get(result?.requestId)
+        if (!pendingReq) return
+        if (error) {
+          pendingReq.reject(error)
+        } else {
+          pendingReq.resolve(result)
+        }
+        this.pendingRequests.delete(result.requestId)
+      },
+      stream.native,
+    )
+
+    const promise = new Promise((resolveResult, rejectResult) => {
+      this.pendingRequests.set(requestId, {
+        resolve: resolveResult,
+        reject: rejectResult,
+      })
+    })
+    promise.then(cleanup, cleanup)
+
+    const stop = () => {
+      this.context.cancelRequest(requestId)
+      const pendingReq = this.pendingRequests.get(requestId)
+      if (pendingReq) {
+        pendingReq.reject(new Error('Request cancelled'))
+        this.pendingRequests.delete(requestId)
+      }
+    }
+    stream.setOnClose(stop)
+
+    return {
+      requestId,
+      stream,
+      promise,
+      stop: () => stream.close(),
+    }
+  }
+
+  /**
+   * Snapshot the sequence of a slot, e.g. to move a conversation to another
+   * context or process. Pass the Buffer as `load_state` to resume it on any
+   * free slot.
+   * @param target Request ID of an active completion, or of a finished one
+   * whose slot has not served another request since, or `{ slot_id }`
+   * @returns Sequence state Buffer
+   */
+  async getSequenceState(target: LlamaSequenceTarget): Promise<Buffer> {
+    if (!this.enabled) {
+      throw new Error('Parallel mode is not enabled. Call enable() first.')
+    }
+    return this.context.getSequenceState(target)
+  }
+
+  /**
+   * Save the sequence of a slot to a file usable as `load_state_path`
+   * @param target Request ID or `{ slot_id }`, as for getSequenceState
+   * @param path File path to write
+   * @returns Number of tokens saved
+   */
+  async saveSequenceState(
+    target: LlamaSequenceTarget,
+    path: string,
+  ): Promise<number> {
+    if (!this.enabled) {
+      throw new Error('Parallel mode is not enabled. Call enable() first.')
+    }
+    return this.context.saveSequenceState(target, path)
+  }
+
+  // Media is evaluated off the JS thread and the slot loop before queueing;
+  // text-only requests are queued right away.
+  private async queue(
+    options: LlamaParallelCompletionOptions,
+    callback: (error: any, result: any) => void,
+    stream?: LlamaTokenStream,
+  ): Promise<{ requestId: number }> {
+    const media = options.media_paths
+    if (media && (!Array.isArray(media) || media.length > 0)) {
+      return this.context.queueMediaCompletion(options, callback, stream)
+    }
+    return this.context.queueCompletion(options, callback, stream)
+  }
+
+  // Slots only restore from files, so a `load_state` Buffer is staged in a
+  // temporary file that is removed once the request settles.
+  private async resolveLoadState(
+    options: LlamaParallelCompletionOptions,
+  ): Promise<{ options: LlamaParallelCompletionOptions; cleanup: () => void }> {
+    const { load_state, ...rest } = options
+    if (!load_state) return { options: rest, cleanup: () => {} }
+    const dir = await fs.promises.mkdtemp(path.join(os.tmpdir(), 'llama-seq-'))
+    const cleanup = () => {
+      fs.promises.rm(dir, { recursive: true, force: true }).catch(() => {})
+    }
+    const file = path.join(dir, 'state.bin')
+    try {
+      await fs.promises.writeFile(file, load_state)
+    } catch (err) {
+      cleanup()
+      throw err
+    }
+    return { options: { ...rest, load_state_path: file }, cleanup }
+  }
+
   /**
    * Queue an embedding request for parallel processing
    * @param text Text to embed
    * @param params Optional embedding parameters
-   * @returns Object with requestId and promise for result
+   * @returns Object with requestId and promise for result. Results served
+   *          from the embedding cache are not queued and have requestId -1.
    */
   async embedding(
     text: string,
-    params?: { embd_normalize?: number },
+    params?: EmbeddingParams,
   ): Promise<{
     requestId: number
-    promise: Promise<{ embedding: number[] }>
+    /** embedding is a number[] unless embd_dim or embd_quant is set */
+    promise: Promise<{ embedding: number[] | EmbeddingArray }>
   }> {
     if (!this.enabled) {
       throw new Error('Parallel mode is not enabled. Call enable() first.')
@@ -192,10 +350,12 @@ export class LlamaParallelAPI {
     let resolveResult: (value: any) => void
     let rejectResult: (reason?: any) => void
 
-    const promise = new Promise<{ embedding: number[] }>((res, rej) => {
-      resolveResult = res
-      rejectResult = rej
-    })
+    const promise = new Promise<{ embedding: number[] | EmbeddingArray }>(
+      (res, rej) => {
+        resolveResult = res
+        rejectResult = rej
+      },
+    )
 
     // Queue the embedding immediately (this is synchronous!)
     const { requestId } = this.context.queueEmbedding(
@@ -263,7 +423,15 @@ export class LlamaParallelAPI {
               document: documents[r.index],
             }))
             .sort((a: any, b: any) => b.score - a.score)
-          resolveResult(enrichedResults)
+            .filter(
+              (r: any) =>
+                params?.threshold === undefined || r.score >= params.threshold,
+            )
+          resolveResult(
+            params?.top_k
+              ? enrichedResults.slice(0, params.top_k)
+              : enrichedResults,
+          )
         }
       },
     )
@@ -0,0 +1,77 @@
+// Async-iterator view over a native LlamaTokenStream
+import { Readable } from 'stream'
+import type { LlamaTokenStream, Module } from './binding'
+
+export type CompletionStreamOptions = {
+  /**
+   * Number of items buffered natively before the producer is paused.
+   * Parallel slots share one decode loop and are never paused: tokens that
+   * arrive into a full buffer are merged into the newest item instead.
+   */
+  capacity?: number
+}
+
+export class LlamaCompletionStream<T> implements AsyncIterable<T> {
+  readonly native: LlamaTokenStream
+
+  private wake: (() => void) | null = null
+
+  private closed = false
+
+  private onClose?: () => void
+
+  constructor(mod: Module, options: CompletionStreamOptions = {}) {
+    this.native = new mod.LlamaTokenStream(
+      { capacity: options.capacity ?? 64 },
+      () => {
+        const wake = this.wake
+        this.wake = null
+        wake?.()
+      },
+    )
+  }
+
+  /** Called once when the consumer stops iterating before the producer finished */
+  setOnClose(onClose: () => void) {
+    this.onClose = onClose
+  }
+
+  async *[Symbol.asyncIterator](): AsyncIterator<T> {
+    let finished = false
+    try {
+      while (!this.closed) {
+        const items = this.native.read<T>()
+        if (items.length > 0) {
+          for (const item of items) yield item
+          continue
+        }
+        if (this.native.isFinished()) {
+          finished = true
+          return
+        }
+        // onReadable runs on this thread, so it cannot fire between read()
+        // and installing the waker
+        await new Promise<void>((resolve) => {
+          this.wake = resolve
+        })
+      }
+    } finally {
+      if (!finished) this.close()
+    }
+  }
+
+  /** Stop consuming: drops buffered items and unblocks the producer */
+  close() {
+    if (this.closed) return
+    this.closed = true
+    this.native.close()
+    const wake = this.wake
+    this.wake = null
+    wake?.()
+    this.onClose?.()
+  }
+
+  toReadable(): Readable {
+    return Readable.from(this, { objectMode: true })
+  }
+}
@@ -1,6 +1,7 @@
 
 import type {
   ChatMessage,
+  MediaInput,
 } from './binding'
 
 export const MTMD_DEFAULT_MEDIA_MARKER = '<__media__>'
@@ -8,22 +9,21 @@ export const MTMD_DEFAULT_MEDIA_MARKER = '<__media__>'
 export const formatMediaChat = (messages: ChatMessage[] | undefined): {
   messages: ChatMessage[] | undefined
   has_media: boolean
-  media_paths?: string[]
+  media_paths?: MediaInput[]
 } => {
   if (!messages)
     return {
       messages,
       has_media: false,
     }
-  const mediaPaths: string[] = []
+  const mediaPaths: MediaInput[] = []
   return {
     messages: messages.map((msg) => {
       if (Array.isArray(msg.content)) {
         const content = msg.content.map((part) => {
           // Handle multimodal content
           if (part.type === 'image_url') {
-            let path = part.image_url?.url || ''
-            mediaPaths.push(path)
+            mediaPaths.push(part.image_url?.data || part.image_url?.url || '')
             return {
               type: 'text',
               text: MTMD_DEFAULT_MEDIA_MARKER,
@@ -0,0 +1,378 @@
+#include "CheckpointCache.h"
+#include "SessionCodec.h"
+#include "SessionDelta.h"
+#include "rn-llama/rn-completion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[4] = {'L', 'N', 'C', 'K'};
+const uint32_t kVersion = 1;
+const char kSuffix[] = ".ckpt";
+
+// Start of the decompressed payload, followed by the tokens and the state
+struct CheckpointHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint64_t n_tokens;
+};
+
+} // namespace
+
+CheckpointCache::CheckpointCache(const std::string &dir, uint64_t fingerprint,
+                                 size_t interval, size_t budget)
+    : _root((fs::path(dir) / Hex(fingerprint)).string()),
+      _fingerprint(fingerprint), _interval(std::max<size_t>(interval, 1)),
+      _budget(budget) {
+  std::random_device rd;
+  _tmp_suffix = "." + Hex((static_cast<uint64_t>(rd()) << 32) | rd());
+  std::error_code ec;
+  fs::create_directories(_root, ec);
+
+  // Pick up checkpoints from earlier runs, oldest first
+  std::vector<std::pair<fs::file_time_type, std::pair<uint64_t, size_t>>> found;
+  for (fs::directory_iterator it(_root, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    const auto &path = it->path();
+    if (path.extension() != kSuffix) {
+      continue;
+    }
+    char *stem_end = nullptr;
+    const std::string stem = path.stem().string();
+    const uint64_t key = std::strtoull(stem.c_str(), &stem_end, 16);
+    std::error_code stat_ec;
+    const auto size = fs::file_size(path, stat_ec);
+    const auto time = fs::last_write_time(path, stat_ec);
+    if (stem.size() == 16 && *stem_end == '\0' && !stat_ec) {
+      found.push_back({time, {key, static_cast<size_t>(size)}});
+    }
+  }
+  std::sort(found.begin(), found.end());
+  for (const auto &file : found) {
+    _entries[file.second.first] = {file.second.second, ++_clock};
+    _bytes += file.second.second;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Evict(0);
+  }
+  _thread = std::thread([this]() { Run(); });
+}
+
+CheckpointCache::~CheckpointCache() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _cv.notify_all();
+  _thread.join();
+}
+
+std::string CheckpointCache::Path(uint64_t key) const {
+  return (fs::path(_root) / (Hex(key) + kSuffix)).string();
+}
+
+std::vector<uint64_t>
+CheckpointCache::Keys(const std::vector<llama_token> &tokens) const {
+  std::vector<uint64_t> keys;
+  if (tokens.size() <= _interval) {
+    return keys;
+  }
+  keys.resize((tokens.size() - 1) / _interval);
+  uint64_t key = _fingerprint;
+  for (size_t i = 0; i < keys.size(); i++) {
+    key = BlockKey(key, tokens.data() + i * _interval, _interval);
+    keys[i] = key;
+  }
+  return keys;
+}
+
+bool CheckpointCache::Contains(uint64_t key) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _entries.count(key) > 0;
+}
+
+size_t CheckpointCache::Read(const std::vector<uint64_t> &keys,
+                             const std::vector<llama_token> &tokens,
+                             size_t min_tokens, std::vector<uint8_t> &state) {
+  if (keys.size() * _interval <= min_tokens) {
+    // Memory is already past every boundary
+    return 0;
+  }
+  for (size_t i = keys.size(); i-- > 0;) {
+    const size_t boundary = (i + 1) * _interval;
+    if (boundary <= min_tokens) {
+      break;
+    }
+    if (!Contains(keys[i])) {
+      continue;
+    }
+    const std::string path = Path(keys[i]);
+    std::vector<uint8_t> payload;
+    try {
+      payload = ReadCompressedSessionFile(path);
+    } catch (const std::exception &) {
+      // Unreadable: forget it so the boundary is stored again
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _entries.find(keys[i]);
+      if (it != _entries.end()) {
+        _bytes -= it->second.bytes;
+        _entries.erase(it);
+      }
+      std::error_code ec;
+      fs::remove(path, ec);
+      continue;
+    }
+    CheckpointHeader header;
+    if (payload.size() < sizeof(header)) {
+      continue;
+    }
+    memcpy(&header, payload.data(), sizeof(header));
+    const size_t tokens_size = boundary * sizeof(llama_token);
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion || header.key != keys[i] ||
+        header.n_tokens != boundary ||
+        payload.size() < sizeof(header) + tokens_size ||
+        memcmp(payload.data() + sizeof(header), tokens.data(), tokens_size) !=
+            0) {
+      continue;
+    }
+    state.assign(payload.begin() + sizeof(header) + tokens_size,
+                 payload.end());
+
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(keys[i]);
+    if (it != _entries.end()) {
+      it->second.used = ++_clock;
+    }
+    _stats.hits++;
+    return boundary;
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  _stats.misses++;
+  return 0;
+}
+
+void CheckpointCache::WriteCheckpoint(uint64_t key,
+                                      const std::vector<llama_token> &tokens,
+                                      const std::vector<uint8_t> &state) {
+  CheckpointHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.key = key;
+  header.n_tokens = tokens.size();
+  const size_t tokens_size = tokens.size() * sizeof(llama_token);
+  std::vector<uint8_t> payload(sizeof(header) + tokens_size + state.size());
+  memcpy(payload.data(), &header, sizeof(header));
+  memcpy(payload.data() + sizeof(header), tokens.data(), tokens_size);
+  memcpy(payload.data() + sizeof(header) + tokens_size, state.data(),
+         state.size());
+
+  const std::string path = Path(key);
+  const std::string tmp_path = path + _tmp_suffix + ".tmp";
+  std::error_code ec;
+  size_t size = 0;
+  try {
+    size = WriteCompressedSessionFile(tmp_path, SessionCodec::LZ4, 0,
+                                      payload.data(), payload.size());
+  } catch (const std::exception &) {
+    fs::remove(tmp_path, ec);
+    return;
+  }
+  fs::rename(tmp_path, path, ec);
+  if (ec) {
+    fs::remove(tmp_path, ec);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto &entry = _entries[key];
+  _bytes = _bytes - entry.bytes + size;
+  entry = {size, ++_clock};
+  _stats.stores++;
+  Evict(key);
+}
+
+void CheckpointCache::Evict(uint64_t keep) {
+  while (_bytes > _budget && !_entries.empty()) {
+    auto oldest = _entries.end();
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+      if (it->first != keep &&
+          (oldest == _entries.end() || it->second.used < oldest->second.used)) {
+        oldest = it;
+      }
+    }
+    if (oldest == _entries.end()) {
+      // Only the newest checkpoint is left and it alone exceeds the budget
+      oldest = _entries.find(keep);
+    }
+    std::error_code ec;
+    fs::remove(Path(oldest->first), ec);
+    _bytes -= oldest->second.bytes;
+    _entries.erase(oldest);
+    _stats.evictions++;
+  }
+}
+
+void CheckpointCache::Store(uint64_t key, std::vector<llama_token> tokens,
+                            std::vector<uint8_t> state) {
+  auto tokens_ptr = std::make_shared<std::vector<llama_token>>(std::move(tokens));
+  auto state_ptr = std::make_shared<std::vector<uint8_t>>(std::move(state));
+  Enqueue([this, key, tokens_ptr, state_ptr]() {
+    WriteCheckpoint(key, *tokens_ptr, *state_ptr);
+  });
+}
+
+void CheckpointCache::AddRestoreTime(double ms) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _stats.restore_ms += ms;
+}
+
+CheckpointCacheStats CheckpointCache::Stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  CheckpointCacheStats stats = _stats;
+  stats.entries = _entries.size();
+  stats.bytes = _bytes;
+  stats.budget = _budget;
+  return stats;
+}
+
+void CheckpointCache::Enqueue(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(std::move(job));
+  }
+  _cv.notify_all();
+}
+
+void CheckpointCache::Flush() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cv.wait(lock, [this]() { return _jobs.empty() && !_busy; });
+}
+
+void CheckpointCache::Run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _cv.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+    if (_jobs.empty()) {
+      return;
+    }
+    auto job = std::move(_jobs.front());
+    _jobs.pop_front();
+    _busy = true;
+    lock.unlock();
+    try {
+      job();
+    } catch (const std::exception &) {
+      // A failed write only costs a future miss
+    }
+    lock.lock();
+    _busy = false;
+    _cv.notify_all();
+  }
+}
+
+bool CheckpointCacheSupported(rnllama::llama_rn_context *rn_ctx) {
+  return llama_model_is_recurrent(rn_ctx->model) ||
+         llama_model_is_hybrid(rn_ctx->model);
+}
+
+bool PrefillCheckpoints(rnllama::llama_rn_context *rn_ctx,
+                        CheckpointCache &cache, const std::string &prompt) {
+  // Same tokens loadPrompt evaluates, BOS included, or no key would match
+  const auto tokens = common_tokenize(rn_ctx->ctx, prompt, true, true);
+  // loadPrompt truncates prompts that do not fit; leave those to it
+  if (tokens.empty() || tokens.size() >= llama_n_ctx(rn_ctx->ctx)) {
+    return false;
+  }
+  const auto keys = cache.Keys(tokens);
+  if (keys.empty()) {
+    return false;
+  }
+
+  // Recurrent state only resumes from its exact end, which may be short of
+  // the last sampled token
+  llama_context *ctx = rn_ctx->ctx;
+  auto *memory = llama_get_memory(ctx);
+  auto completion = rn_ctx->completion;
+  const auto &prev_tokens = completion->embd;
+  const size_t n_memory =
+      static_cast<size_t>(llama_memory_seq_pos_max(memory, 0) + 1);
+  const bool in_memory =
+      n_memory <= prev_tokens.size() && n_memory < tokens.size() &&
+      std::equal(prev_tokens.begin(), prev_tokens.begin() + n_memory,
+                 tokens.begin());
+  size_t n_done = in_memory ? n_memory : 0;
+
+  std::vector<uint8_t> state;
+  const auto start = std::chrono::steady_clock::now();
+  const size_t n_hit = cache.Read(keys, tokens, n_done, state);
+  if (n_hit > 0) {
+    // A failed restore leaves sequence 0 empty
+    n_done = llama_state_seq_set_data(ctx, state.data(), state.size(), 0) ==
+                     state.size()
+                 ? n_hit
+                 : 0;
+    cache.AddRestoreTime(std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+    if (n_done == 0) {
+      llama_memory_seq_rm(memory, 0, -1, -1);
+    }
+  } else if (!in_memory) {
+    return false;
+  }
+
+  // Evaluate up to each remaining boundary and checkpoint it
+  const int32_t n_batch = rn_ctx->params.n_batch;
+  const size_t interval = cache.interval();
+  for (size_t i = n_done / interval; i < keys.size(); i++) {
+    const size_t boundary = (i + 1) * interval;
+    bool ok = true;
+    while (ok && n_done < boundary) {
+      const int32_t n_eval =
+          static_cast<int32_t>(std::min<size_t>(n_batch, boundary - n_done));
+      ok = llama_decode(ctx, llama_batch_get_one(
+                                 const_cast<llama_token *>(tokens.data() + n_done),
+                                 n_eval)) == 0;
+      if (ok) {
+        n_done += n_eval;
+      }
+    }
+    if (!ok) {
+      // Memory now holds a partial batch past n_done; start cold
+      llama_memory_seq_rm(memory, 0, -1, -1);
+      n_done = 0;
+      break;
+    }
+    if (cache.Contains(keys[i])) {
+      continue;
+    }
+    state.resize(llama_state_seq_get_size(ctx, 0));
+    state.resize(llama_state_seq_get_data(ctx, state.data(), state.size(), 0));
+    if (!state.empty()) {
+      cache.Store(keys[i],
+                  std::vector<llama_token>(tokens.begin(),
+                                           tokens.begin() + boundary),
+                  std::move(state));
+    }
+  }
+
+  // Publish the evaluated prefix so loadPrompt resumes after it
+  completion->embd.assign(tokens.begin(), tokens.begin() + n_done);
+  completion->n_past = static_cast<llama_pos>(n_done);
+  rn_ctx->setMediaHashes({});
+  return true;
+}
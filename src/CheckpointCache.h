@@ -0,0 +1,118 @@
+#pragma once
+
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct CheckpointCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t stores = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+  size_t budget = 0;
+  // Total time spent reading and restoring checkpoints
+  double restore_ms = 0;
+};
+
+// Disk tier for recurrent and hybrid model state, which cannot be cut back
+// to an earlier position and so has to be checkpointed at the exact token
+// it is resumed from. Checkpoints are taken every `interval` prompt tokens
+// and keyed like PrefixCache boundaries: a rolling hash of the interval
+// blocks, seeded with the fingerprint. Each is one LZ4-compressed file
+// holding its tokens and sequence state, written through a temporary name
+// by a background thread.
+//
+// The directory is bounded by a byte budget and evicted least recently
+// used first. A restore touches the file, so the order survives restarts.
+//
+// <dir>/<fingerprint>/<key>.ckpt
+class CheckpointCache {
+public:
+  CheckpointCache(const std::string &dir, uint64_t fingerprint,
+                  size_t interval, size_t budget);
+  // Finishes queued writes
+  ~CheckpointCache();
+
+  // Keys of the interval boundaries of `tokens` that leave at least one
+  // token to evaluate; keys[i] is the boundary at (i + 1) * interval().
+  std::vector<uint64_t> Keys(const std::vector<llama_token> &tokens) const;
+
+  // Reads the deepest stored checkpoint past `min_tokens` whose tokens are
+  // a prefix of `tokens` into `state` and returns its length, or 0.
+  size_t Read(const std::vector<uint64_t> &keys,
+              const std::vector<llama_token> &tokens, size_t min_tokens,
+              std::vector<uint8_t> &state);
+
+  bool Contains(uint64_t key);
+
+  // Queues writing sequence `state` for `tokens` under `key`
+  void Store(uint64_t key, std::vector<llama_token> tokens,
+             std::vector<uint8_t> state);
+
+  void AddRestoreTime(double ms);
+
+  // Blocks until queued writes are on disk
+  void Flush();
+
+  CheckpointCacheStats Stats();
+
+  size_t interval() const { return _interval; }
+  uint64_t fingerprint() const { return _fingerprint; }
+
+private:
+  struct Entry {
+    size_t bytes;
+    uint64_t used;
+  };
+
+  std::string Path(uint64_t key) const;
+  void Enqueue(std::function<void()> job);
+  void Run();
+  void WriteCheckpoint(uint64_t key, const std::vector<llama_token> &tokens,
+                       const std::vector<uint8_t> &state);
+  // Drops least recently used files until the directory fits the budget.
+  // Requires _mutex.
+  void Evict(uint64_t keep);
+
+  std::string _root;
+  uint64_t _fingerprint;
+  size_t _interval;
+  size_t _budget;
+  std::string _tmp_suffix;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque<std::function<void()>> _jobs;
+  std::unordered_map<uint64_t, Entry> _entries;
+  uint64_t _clock = 0;
+  size_t _bytes = 0;
+  CheckpointCacheStats _stats;
+  bool _busy = false;
+  bool _stopping = false;
+  std::thread _thread;
+};
+
+// True for recurrent and hybrid models, the ones PrefixCache does not cover.
+// Callers only create a CheckpointCache for those, unless the test-only
+// LLAMA_NODE_STATE_CACHE_FORCE=1 environment variable asks for it on an
+// attention model.
+bool CheckpointCacheSupported(rnllama::llama_rn_context *rn_ctx);
+
+// Restores the deepest checkpoint of `prompt` in `cache` when it is past
+// what memory already holds, then evaluates the prompt up to its last
+// interval boundary, queueing a checkpoint at each boundary not stored yet.
+// The evaluated prefix is handed to rn-llama like a loaded session, so
+// loadPrompt resumes after it. Returns false without touching memory when
+// memory has diverged from the prompt and there is no checkpoint to restore,
+// leaving that case to rn-llama's in-memory state cache.
+bool PrefillCheckpoints(rnllama::llama_rn_context *rn_ctx,
+                        CheckpointCache &cache, const std::string &prompt);
@@ -13,6 +13,9 @@ DecodeAudioTokenWorker::DecodeAudioTokenWorker(const Napi::CallbackInfo &info,
       _is_embeddings(true) {}
 
 void DecodeAudioTokenWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
   try {
     if (!_rn_ctx->tts_wrapper) {
       SetError("Vocoder not initialized");
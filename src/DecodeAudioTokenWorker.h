@@ -1,5 +1,7 @@
+#include "SessionState.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
+#include <memory>
 #include <vector>
 
 class DecodeAudioTokenWorker : public Napi::AsyncWorker,
@@ -12,6 +14,11 @@ public:
   DecodeAudioTokenWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx,
                          std::vector<float> embeddings, int embedding_dim);
 
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
 protected:
   void Execute();
   void OnOK();
@@ -24,4 +31,5 @@ private:
   int _embedding_dim = 0;
   bool _is_embeddings = false;
   std::vector<float> _result;
+  std::shared_ptr<ContextGate> _gate;
 };
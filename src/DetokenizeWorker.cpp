@@ -6,6 +6,9 @@ DetokenizeWorker::DetokenizeWorker(const Napi::CallbackInfo &info,
     : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx), _tokens(tokens) {}
 
 void DetokenizeWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
   const auto text = tokens_to_str(_rn_ctx->ctx, _tokens.begin(), _tokens.end());
   _text = std::move(text);
 }
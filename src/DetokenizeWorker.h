@@ -1,5 +1,7 @@
+#include "SessionState.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
+#include <memory>
 #include <vector>
 
 class DetokenizeWorker : public Napi::AsyncWorker,
@@ -8,6 +10,11 @@ public:
   DetokenizeWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx,
                    std::vector<int32_t> tokens);
 
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
 protected:
   void Execute();
   void OnOK();
@@ -17,4 +24,5 @@ private:
   rnllama::llama_rn_context* _rn_ctx;
   std::vector<int32_t> _tokens;
   std::string _text;
+  std::shared_ptr<ContextGate> _gate;
 };
\ No newline at end of file
@@ -1,16 +1,21 @@
 #include "DisposeWorker.h"
+#include "HibernateWorker.h"
 #include "rn-llama/rn-completion.h"
+#include <cstdio>
 
 DisposeWorker::DisposeWorker(const Napi::CallbackInfo &info,
                              rnllama::llama_rn_context* rn_ctx, rnllama::llama_rn_context** parent_ptr)
     : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx), _parent_ptr(parent_ptr) {}
 
 void DisposeWorker::Execute() { 
+  if (_gate) {
+    _gate->Wait();
+  }
   if (_rn_ctx) {
     // Ensure all child contexts are properly cleaned up first
     try {
       // Now delete the main context
-      delete _rn_ctx;
+      DeleteContext(_rn_ctx);
       
       // Set parent pointer to nullptr to prevent double free
       if (_parent_ptr) {
@@ -24,6 +29,17 @@ void DisposeWorker::Execute() {
       return;
     }
   }
+  if (!_remove_file.empty()) {
+    std::remove(_remove_file.c_str());
+  }
+  if (_prefix_cache) {
+    _prefix_cache->Flush();
+    _prefix_cache.reset();
+  }
+  if (_checkpoint_cache) {
+    _checkpoint_cache->Flush();
+    _checkpoint_cache.reset();
+  }
 }
 
 void DisposeWorker::OnOK() { Resolve(AsyncWorker::Env().Undefined()); }
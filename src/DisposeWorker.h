@@ -1,10 +1,29 @@
 #include "common.hpp"
+#include "CheckpointCache.h"
+#include "PrefixCache.h"
+#include "SessionState.h"
 #include "rn-llama/rn-llama.h"
 
 class DisposeWorker : public Napi::AsyncWorker, public Napi::Promise::Deferred {
 public:
   DisposeWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx, rnllama::llama_rn_context** parent_ptr);
 
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+  // Flushed and released after the context
+  void SetPrefixCache(std::shared_ptr<PrefixCache> cache) {
+    _prefix_cache = std::move(cache);
+  }
+  void SetCheckpointCache(std::shared_ptr<CheckpointCache> cache) {
+    _checkpoint_cache = std::move(cache);
+  }
+
+  // State file of a hibernated context, removed once it is written
+  void SetRemoveFile(std::string path) { _remove_file = std::move(path); }
+
 protected:
   void Execute();
   void OnOK();
@@ -13,4 +32,8 @@ protected:
 private:
   rnllama::llama_rn_context* _rn_ctx;
   rnllama::llama_rn_context** _parent_ptr; // Pointer to the parent's _rn_ctx pointer
+  std::shared_ptr<PrefixCache> _prefix_cache;
+  std::shared_ptr<CheckpointCache> _checkpoint_cache;
+  std::string _remove_file;
+  std::shared_ptr<ContextGate> _gate;
 };
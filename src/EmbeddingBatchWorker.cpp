@@ -0,0 +1,246 @@
+#include "EmbeddingBatchWorker.h"
+#include "EmbeddingWorker.h"
+#include "LlamaContext.h"
+#include <algorithm>
+#include <stdexcept>
+
+void CheckPackedContext(rnllama::llama_rn_context *rn_ctx) {
+  if (rn_ctx->slot_manager != nullptr) {
+    throw std::runtime_error(
+        "Batched embedding is not supported while parallel mode is enabled; "
+        "use queueEmbedding or queueRerank");
+  }
+}
+
+size_t EmbeddingBatchTokenLimit(llama_context *ctx, size_t max_batch_tokens) {
+  // Non-causal models need each sequence inside a single ubatch
+  size_t limit = std::min<size_t>(
+      {llama_n_batch(ctx), llama_n_ubatch(ctx), llama_n_ctx(ctx)});
+  if (max_batch_tokens > 0) {
+    limit = std::min(limit, max_batch_tokens);
+  }
+  return limit;
+}
+
+void EmbedSequences(rnllama::llama_rn_context *rn_ctx,
+                    const std::vector<std::vector<llama_token>> &sequences,
+                    size_t max_batch_tokens, int32_t embd_normalize,
+                    std::vector<float> &out, size_t &n_out) {
+  llama_context *ctx = rn_ctx->ctx;
+  const auto pooling = llama_pooling_type(ctx);
+  if (pooling == LLAMA_POOLING_TYPE_NONE) {
+    throw std::runtime_error("Batched embedding requires a pooling type");
+  }
+  n_out = pooling == LLAMA_POOLING_TYPE_RANK
+              ? llama_model_n_cls_out(rn_ctx->model)
+              : llama_model_n_embd(rn_ctx->model);
+
+  const size_t n_tokens_max = EmbeddingBatchTokenLimit(ctx, max_batch_tokens);
+  const size_t n_seq_max = std::max<size_t>(1, llama_n_seq_max(ctx));
+  for (size_t i = 0; i < sequences.size(); i++) {
+    if (sequences[i].size() > n_tokens_max) {
+      throw std::runtime_error(
+          "Input " + std::to_string(i) + " has " +
+          std::to_string(sequences[i].size()) +
+          " tokens, exceeding the batch size of " +
+          std::to_string(n_tokens_max));
+    }
+  }
+
+  out.assign(sequences.size() * n_out, 0.0f);
+  auto *memory = llama_get_memory(ctx);
+  llama_batch batch = llama_batch_init(static_cast<int32_t>(n_tokens_max), 0, 1);
+  std::vector<size_t> batch_inputs; // input index for each seq id in batch
+
+  // The cached prompt is gone afterwards; make the next completion start over
+  auto reset_prompt = [&]() {
+    llama_memory_clear(memory, true);
+    rn_ctx->completion->embd.clear();
+    rn_ctx->completion->n_past = 0;
+  };
+
+  auto flush = [&]() {
+    if (batch_inputs.empty()) {
+      return;
+    }
+    llama_memory_clear(memory, true);
+    if (llama_decode(ctx, batch) != 0) {
+      throw std::runtime_error("Failed to decode embedding batch");
+    }
+    for (size_t s = 0; s < batch_inputs.size(); s++) {
+      const float *embd =
+          llama_get_embeddings_seq(ctx, static_cast<llama_seq_id>(s));
+      if (embd == nullptr) {
+        throw std::runtime_error("Failed to get sequence embeddings");
+      }
+      common_embd_normalize(embd, out.data() + batch_inputs[s] * n_out,
+                            static_cast<int>(n_out), embd_normalize);
+    }
+    common_batch_clear(batch);
+    batch_inputs.clear();
+  };
+
+  try {
+    for (size_t i = 0; i < sequences.size(); i++) {
+      const auto &tokens = sequences[i];
+      if (tokens.empty()) {
+        continue;
+      }
+      if (static_cast<size_t>(batch.n_tokens) + tokens.size() > n_tokens_max ||
+          batch_inputs.size() >= n_seq_max) {
+        flush();
+      }
+      const auto seq_id = static_cast<llama_seq_id>(batch_inputs.size());
+      for (size_t j = 0; j < tokens.size(); j++) {
+        common_batch_add(batch, tokens[j], static_cast<llama_pos>(j), {seq_id},
+                         true);
+      }
+      batch_inputs.push_back(i);
+    }
+    flush();
+  } catch (...) {
+    llama_batch_free(batch);
+    reset_prompt();
+    throw;
+  }
+  llama_batch_free(batch);
+  reset_prompt();
+}
+
+void EmbedSequencesCached(rnllama::llama_rn_context *rn_ctx,
+                          const std::vector<std::vector<llama_token>> &sequences,
+                          size_t max_batch_tokens, int32_t embd_normalize,
+                          EmbeddingCache *cache, std::vector<float> &out,
+                          size_t &n_out) {
+  // Only sequences missing from the cache are decoded
+  const int32_t pooling = llama_pooling_type(rn_ctx->ctx);
+  std::vector<std::shared_ptr<const CachedEmbedding>> cached(sequences.size());
+  std::vector<EmbeddingKey> keys(sequences.size());
+  std::vector<size_t> pending;
+  std::vector<std::vector<llama_token>> missing;
+  for (size_t i = 0; i < sequences.size(); i++) {
+    if (cache != nullptr) {
+      keys[i] = EmbeddingCacheKey(sequences[i], pooling, embd_normalize);
+      cached[i] = GetCachedEmbedding(*cache, keys[i]);
+      if (cached[i]) {
+        continue;
+      }
+    }
+    pending.push_back(i);
+    missing.push_back(sequences[i]);
+  }
+
+  std::vector<float> computed;
+  size_t n_embd = 0;
+  if (!missing.empty()) {
+    EmbedSequences(rn_ctx, missing, max_batch_tokens, embd_normalize, computed,
+                   n_embd);
+  } else if (!sequences.empty()) {
+    n_embd = cached[0]->embd.size();
+  }
+
+  n_out = n_embd;
+  out.assign(sequences.size() * n_embd, 0.0f);
+  for (size_t i = 0; i < sequences.size(); i++) {
+    if (cached[i] && cached[i]->embd.size() == n_embd) {
+      std::copy(cached[i]->embd.begin(), cached[i]->embd.end(),
+                out.begin() + i * n_embd);
+    }
+  }
+  for (size_t k = 0; k < pending.size(); k++) {
+    const auto begin = computed.begin() + k * n_embd;
+    std::copy(begin, begin + n_embd, out.begin() + pending[k] * n_embd);
+    if (cache != nullptr) {
+      PutCachedEmbedding(*cache, keys[pending[k]],
+                         std::vector<float>(begin, begin + n_embd));
+    }
+  }
+}
+
+EmbeddingBatchWorker::EmbeddingBatchWorker(const Napi::CallbackInfo &info,
+                                           rnllama::llama_rn_context *rn_ctx,
+                                           std::vector<std::string> texts,
+                                           common_params &params,
+                                           EmbeddingFormat format,
+                                           size_t max_batch_tokens)
+    : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx),
+      _texts(std::move(texts)), _params(params), _format(format),
+      _max_batch_tokens(max_batch_tokens) {}
+
+void EmbeddingBatchWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
+  try {
+    CheckPackedContext(_rn_ctx);
+    Embed();
+    _format.Apply(_result.embeddings.data(), _texts.size(), _result.n_embd,
+                  _result.output);
+    if (_index) {
+      AddToIndex();
+    }
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+// Fills _result.embeddings with the full-size embedding of every text
+void EmbeddingBatchWorker::Embed() {
+  if (llama_pooling_type(_rn_ctx->ctx) == LLAMA_POOLING_TYPE_NONE) {
+    // Without pooling rn-llama picks the output itself; embed one by one
+    for (const auto &text : _texts) {
+      auto embedding = EmbedText(_rn_ctx, text, _params, _cache.get());
+      _result.n_embd = embedding.size();
+      _result.embeddings.insert(_result.embeddings.end(), embedding.begin(),
+                                embedding.end());
+    }
+    return;
+  }
+
+  std::vector<std::vector<llama_token>> sequences;
+  sequences.reserve(_texts.size());
+  for (const auto &text : _texts) {
+    sequences.push_back(common_tokenize(_rn_ctx->ctx, text, true, true));
+  }
+  EmbedSequencesCached(_rn_ctx, sequences, _max_batch_tokens,
+                       _params.embd_normalize, _cache.get(),
+                       _result.embeddings, _result.n_embd);
+}
+
+// Adds the (embd_dim truncated) f32 embeddings to the index under _index_ids
+void EmbeddingBatchWorker::AddToIndex() {
+  const size_t dim = _format.OutputDim(_result.n_embd);
+  if (dim == _result.n_embd) {
+    _index->AddFloat(_index_ids.data(), _result.embeddings.data(),
+                     _texts.size(), dim, _result.n_embd);
+    return;
+  }
+  EmbeddingFormat truncate = _format;
+  truncate.quant = EmbeddingQuant::F32;
+  std::vector<uint8_t> rows;
+  truncate.Apply(_result.embeddings.data(), _texts.size(), _result.n_embd,
+                 rows);
+  _index->AddFloat(_index_ids.data(),
+                   reinterpret_cast<const float *>(rows.data()), _texts.size(),
+                   dim, dim);
+}
+
+void EmbeddingBatchWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  auto result = Napi::Object::New(env);
+  // offsets[i] .. offsets[i + 1] is the slice of embeddings for texts[i]
+  const size_t row = _format.RowElements(_result.n_embd);
+  auto offsets = Napi::Uint32Array::New(env, _texts.size() + 1);
+  for (size_t i = 0; i <= _texts.size(); i++) {
+    offsets[i] = static_cast<uint32_t>(i * row);
+  }
+  result.Set("embeddings", _format.ToTypedArray(env, _result.output));
+  result.Set("offsets", offsets);
+  result.Set("n_embd",
+             Napi::Number::New(env, _format.OutputDim(_result.n_embd)));
+  Napi::Promise::Deferred::Resolve(result);
+}
+
+void EmbeddingBatchWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "EmbeddingCache.h"
+#include "EmbeddingFormat.h"
+#include "VectorIndex.h"
+#include "SessionState.h"
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <memory>
+#include <vector>
+
+struct EmbeddingBatchResult {
+  std::vector<float> embeddings; // [n_texts * n_embd]
+  size_t n_embd = 0;
+  std::vector<uint8_t> output; // embeddings encoded as EmbeddingFormat
+};
+
+// Throws while parallel mode is enabled: packed decodes clear the context
+// memory, which holds the sequences of every parallel slot.
+void CheckPackedContext(rnllama::llama_rn_context *rn_ctx);
+
+// Most tokens EmbedSequences puts in one decode: n_batch, n_ubatch and n_ctx
+// of the context, further capped by `max_batch_tokens` when non-zero. Longer
+// sequences are rejected.
+size_t EmbeddingBatchTokenLimit(llama_context *ctx, size_t max_batch_tokens);
+
+// Runs `sequences` through llama_decode packed several per batch with
+// distinct seq ids (up to the context's n_seq_max and `max_batch_tokens`),
+// and writes the pooled output of each sequence, normalized with
+// `embd_normalize`, to `out` in input order. `n_out` receives the per
+// sequence size: n_cls_out for rank pooling, otherwise n_embd. Clears the
+// context memory and throws on failure.
+void EmbedSequences(rnllama::llama_rn_context *rn_ctx,
+                    const std::vector<std::vector<llama_token>> &sequences,
+                    size_t max_batch_tokens, int32_t embd_normalize,
+                    std::vector<float> &out, size_t &n_out);
+
+// EmbedSequences that takes sequences found in `cache` (when not null) from
+// it and stores the newly computed ones.
+void EmbedSequencesCached(rnllama::llama_rn_context *rn_ctx,
+                          const std::vector<std::vector<llama_token>> &sequences,
+                          size_t max_batch_tokens, int32_t embd_normalize,
+                          EmbeddingCache *cache, std::vector<float> &out,
+                          size_t &n_out);
+
+class EmbeddingBatchWorker : public Napi::AsyncWorker,
+                             public Napi::Promise::Deferred {
+public:
+  EmbeddingBatchWorker(const Napi::CallbackInfo &info,
+                       rnllama::llama_rn_context *rn_ctx,
+                       std::vector<std::string> texts, common_params &params,
+                       EmbeddingFormat format, size_t max_batch_tokens);
+
+  void SetCache(std::shared_ptr<EmbeddingCache> cache) {
+    _cache = std::move(cache);
+  }
+
+  // Also adds every embedding to `index` under the matching entry of `ids`
+  void SetIndex(std::shared_ptr<VectorStore> index, std::vector<int64_t> ids) {
+    _index = std::move(index);
+    _index_ids = std::move(ids);
+  }
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  void Embed();
+  void AddToIndex();
+
+  rnllama::llama_rn_context *_rn_ctx;
+  std::vector<std::string> _texts;
+  common_params _params;
+  EmbeddingFormat _format;
+  size_t _max_batch_tokens;
+  std::shared_ptr<EmbeddingCache> _cache;
+  std::shared_ptr<VectorStore> _index;
+  std::vector<int64_t> _index_ids;
+  EmbeddingBatchResult _result;
+  std::shared_ptr<ContextGate> _gate;
+};
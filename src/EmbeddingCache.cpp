@@ -0,0 +1,196 @@
+#include "EmbeddingCache.h"
+#include "SessionDelta.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+// File layout: magic, version, fingerprint, then per entry
+// { uint64 key, uint64 check, uint32 n_floats, float[n_floats] } until EOF.
+static const char kMagic[4] = {'L', 'N', 'E', 'C'};
+static const uint32_t kVersion = 2;
+// Guards against reading a corrupt length as a huge allocation
+static const uint32_t kMaxFloats = 1u << 24;
+
+static const uint64_t kFnvOffset = 14695981039346656037ULL;
+
+static uint64_t Fnv1a(const void *data, size_t size, uint64_t hash) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+EmbeddingKey EmbeddingCacheKey(const std::vector<llama_token> &tokens,
+                               int32_t pooling, int32_t embd_normalize) {
+  const int32_t mode[2] = {pooling, embd_normalize};
+  uint64_t hash = Fnv1a(mode, sizeof(mode), kFnvOffset);
+  const uint64_t n = tokens.size();
+  hash = Fnv1a(&n, sizeof(n), hash);
+
+  std::vector<int32_t> input(mode, mode + 2);
+  input.insert(input.end(), tokens.begin(), tokens.end());
+  EmbeddingKey key;
+  key.hash = Fnv1a(tokens.data(), tokens.size() * sizeof(llama_token), hash);
+  key.check = ContentHash64(reinterpret_cast<const uint8_t *>(input.data()),
+                            input.size() * sizeof(int32_t));
+  return key;
+}
+
+std::shared_ptr<const CachedEmbedding>
+GetCachedEmbedding(EmbeddingCache &cache, const EmbeddingKey &key) {
+  auto cached = cache.Get(key.hash);
+  if (cached && cached->check != key.check) {
+    return nullptr;
+  }
+  return cached;
+}
+
+void PutCachedEmbedding(EmbeddingCache &cache, const EmbeddingKey &key,
+                        std::vector<float> embd) {
+  auto value = std::make_shared<CachedEmbedding>();
+  value->embd = std::move(embd);
+  value->check = key.check;
+  cache.Put(key.hash, std::move(value));
+}
+
+// Concurrent saves, from this or another process, each write their own file
+// and only the rename is shared.
+static std::string UniqueTempPath(const std::string &path) {
+  static const uint64_t process_tag = []() {
+    std::random_device rd;
+    return (static_cast<uint64_t>(rd()) << 32) | rd();
+  }();
+  static std::atomic<uint64_t> counter{0};
+  char suffix[48];
+  snprintf(suffix, sizeof(suffix), ".%016llx-%llu.tmp",
+           static_cast<unsigned long long>(process_tag),
+           static_cast<unsigned long long>(counter++));
+  return path + suffix;
+}
+
+uint64_t EmbeddingCacheFingerprint(const llama_model *model,
+                                   const std::string &model_path) {
+  char desc[256] = {0};
+  llama_model_desc(model, desc, sizeof(desc));
+  // Models that share an architecture and size, like two fine-tunes of one
+  // base, only differ in the file they were loaded from
+  std::error_code ec;
+  const auto file_size = std::filesystem::file_size(model_path, ec);
+  const auto mtime = std::filesystem::last_write_time(model_path, ec);
+  const uint64_t shape[5] = {
+      llama_model_n_params(model), llama_model_size(model),
+      static_cast<uint64_t>(llama_model_n_embd(model)),
+      ec ? 0 : static_cast<uint64_t>(file_size),
+      ec ? 0 : static_cast<uint64_t>(mtime.time_since_epoch().count())};
+  uint64_t hash = Fnv1a(desc, strlen(desc), kFnvOffset);
+  hash = Fnv1a(model_path.data(), model_path.size(), hash);
+  return Fnv1a(shape, sizeof(shape), hash);
+}
+
+size_t SaveEmbeddingCache(EmbeddingCache &cache, const std::string &path,
+                          uint64_t fingerprint) {
+  const std::string tmp_path = UniqueTempPath(path);
+  size_t count = 0;
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("Failed to open " + tmp_path);
+    }
+    out.write(kMagic, sizeof(kMagic));
+    out.write(reinterpret_cast<const char *>(&kVersion), sizeof(kVersion));
+    out.write(reinterpret_cast<const char *>(&fingerprint), sizeof(fingerprint));
+    // Write a snapshot so lookups are not blocked on disk I/O
+    for (const auto &entry : cache.Snapshot()) {
+      const uint32_t n = static_cast<uint32_t>(entry.second->embd.size());
+      out.write(reinterpret_cast<const char *>(&entry.first),
+                sizeof(entry.first));
+      out.write(reinterpret_cast<const char *>(&entry.second->check),
+                sizeof(entry.second->check));
+      out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+      out.write(reinterpret_cast<const char *>(entry.second->embd.data()),
+                entry.second->Bytes());
+      count++;
+    }
+    if (!out) {
+      out.close();
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("Failed to write " + tmp_path);
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("Failed to replace " + path);
+  }
+  return count;
+}
+
+size_t LoadEmbeddingCache(EmbeddingCache &cache, const std::string &path,
+                          uint64_t fingerprint) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return 0;
+  }
+  char magic[sizeof(kMagic)];
+  uint32_t version = 0;
+  uint64_t file_fingerprint = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char *>(&version), sizeof(version));
+  in.read(reinterpret_cast<char *>(&file_fingerprint),
+          sizeof(file_fingerprint));
+  if (!in || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      version != kVersion || file_fingerprint != fingerprint) {
+    return 0;
+  }
+
+  size_t count = 0;
+  while (true) {
+    uint64_t key = 0;
+    uint64_t check = 0;
+    uint32_t n = 0;
+    in.read(reinterpret_cast<char *>(&key), sizeof(key));
+    in.read(reinterpret_cast<char *>(&check), sizeof(check));
+    in.read(reinterpret_cast<char *>(&n), sizeof(n));
+    if (!in || n > kMaxFloats) {
+      break;
+    }
+    auto value = std::make_shared<CachedEmbedding>();
+    value->check = check;
+    value->embd.resize(n);
+    in.read(reinterpret_cast<char *>(value->embd.data()), value->Bytes());
+    if (!in) {
+      break;
+    }
+    cache.Put(key, std::move(value));
+    count++;
+  }
+  return count;
+}
+
+SaveEmbeddingCacheWorker::SaveEmbeddingCacheWorker(
+    const Napi::CallbackInfo &info, std::shared_ptr<EmbeddingCache> cache,
+    std::string path, uint64_t fingerprint)
+    : AsyncWorker(info.Env()), Deferred(info.Env()), _cache(std::move(cache)),
+      _path(std::move(path)), _fingerprint(fingerprint) {}
+
+void SaveEmbeddingCacheWorker::Execute() {
+  try {
+    _count = SaveEmbeddingCache(*_cache, _path, _fingerprint);
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void SaveEmbeddingCacheWorker::OnOK() {
+  Napi::Promise::Deferred::Resolve(
+      Napi::Number::New(Napi::AsyncWorker::Env(), _count));
+}
+
+void SaveEmbeddingCacheWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "LruCache.h"
+#include "common.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct CachedEmbedding {
+  std::vector<float> embd;
+  // EmbeddingKey::check of the input the entry was computed for
+  uint64_t check = 0;
+
+  size_t Bytes() const { return embd.size() * sizeof(float); }
+};
+
+// Embedding results keyed by EmbeddingKey::hash. One per context.
+typedef ByteLruCache<uint64_t, CachedEmbedding> EmbeddingCache;
+
+// `hash` indexes the cache; `check` is an independent hash of the same input,
+// stored with the entry so a collision on `hash` reads as a miss.
+struct EmbeddingKey {
+  uint64_t hash = 0;
+  uint64_t check = 0;
+};
+
+// Key for the embedding of `tokens` under a pooling type and normalization.
+EmbeddingKey EmbeddingCacheKey(const std::vector<llama_token> &tokens,
+                               int32_t pooling, int32_t embd_normalize);
+
+// Entry for `key`, or null if absent or stored for a different input.
+std::shared_ptr<const CachedEmbedding>
+GetCachedEmbedding(EmbeddingCache &cache, const EmbeddingKey &key);
+
+void PutCachedEmbedding(EmbeddingCache &cache, const EmbeddingKey &key,
+                        std::vector<float> embd);
+
+// Identifies the model a persisted cache was written for: its shape plus the
+// path, size and modification time of the file it was loaded from.
+uint64_t EmbeddingCacheFingerprint(const llama_model *model,
+                                   const std::string &model_path);
+
+// Writes all entries to `path` through a temporary file unique to this call,
+// least recently used first. Returns the number of entries written; throws on I/O errors.
+size_t SaveEmbeddingCache(EmbeddingCache &cache, const std::string &path,
+                          uint64_t fingerprint);
+
+// Adds the entries in `path` to `cache`. Missing files and files written for
+// another model are ignored. Returns the number of entries read.
+size_t LoadEmbeddingCache(EmbeddingCache &cache, const std::string &path,
+                          uint64_t fingerprint);
+
+class SaveEmbeddingCacheWorker : public Napi::AsyncWorker,
+                                 public Napi::Promise::Deferred {
+public:
+  SaveEmbeddingCacheWorker(const Napi::CallbackInfo &info,
+                           std::shared_ptr<EmbeddingCache> cache,
+                           std::string path, uint64_t fingerprint);
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  std::shared_ptr<EmbeddingCache> _cache;
+  std::string _path;
+  uint64_t _fingerprint;
+  size_t _count = 0;
+};
@@ -0,0 +1,137 @@
+#include "EmbeddingChunksWorker.h"
+#include "EmbeddingBatchWorker.h"
+#include "LlamaContext.h"
+#include <algorithm>
+#include <stdexcept>
+
+EmbeddingChunksWorker::EmbeddingChunksWorker(const Napi::CallbackInfo &info,
+                                             rnllama::llama_rn_context *rn_ctx,
+                                             std::string text,
+                                             EmbeddingFormat format,
+                                             EmbeddingChunksOptions options)
+    : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx),
+      _text(std::move(text)), _format(format), _options(options) {}
+
+void EmbeddingChunksWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
+  try {
+    CheckPackedContext(_rn_ctx);
+    const llama_vocab *vocab = llama_model_get_vocab(_rn_ctx->model);
+    const auto tokens = common_tokenize(vocab, _text, false, true);
+    _result.n_tokens = tokens.size();
+
+    // Every window is wrapped in the special tokens a single text would get
+    std::vector<llama_token> prefix, suffix;
+    if (llama_vocab_get_add_bos(vocab)) {
+      prefix.push_back(llama_vocab_bos(vocab));
+    }
+    if (llama_vocab_get_add_eos(vocab)) {
+      suffix.push_back(llama_vocab_eos(vocab));
+    }
+    if (llama_vocab_get_add_sep(vocab)) {
+      suffix.push_back(llama_vocab_sep(vocab));
+    }
+    const size_t n_special = prefix.size() + suffix.size();
+    const size_t limit =
+        EmbeddingBatchTokenLimit(_rn_ctx->ctx, _options.max_batch_tokens);
+    if (limit <= n_special) {
+      throw std::runtime_error("Batch size is too small for a chunk");
+    }
+    size_t chunk = limit - n_special;
+    if (_options.chunk_tokens > 0) {
+      chunk = std::min(chunk, _options.chunk_tokens);
+    }
+    if (_options.overlap_tokens >= chunk) {
+      throw std::runtime_error("overlap_tokens must be less than the chunk "
+                               "size of " + std::to_string(chunk));
+    }
+    const size_t stride = chunk - _options.overlap_tokens;
+
+    std::vector<std::vector<llama_token>> windows;
+    for (size_t start = 0; start < tokens.size(); start += stride) {
+      const size_t end = std::min(start + chunk, tokens.size());
+      std::vector<llama_token> window(prefix);
+      window.insert(window.end(), tokens.begin() + start, tokens.begin() + end);
+      window.insert(window.end(), suffix.begin(), suffix.end());
+      windows.push_back(std::move(window));
+      _result.spans.push_back(static_cast<uint32_t>(start));
+      _result.spans.push_back(static_cast<uint32_t>(end));
+      if (end == tokens.size()) {
+        break;
+      }
+    }
+
+    std::vector<float> chunk_embd;
+    size_t n_embd = 0;
+    EmbedSequencesCached(_rn_ctx, windows, _options.max_batch_tokens,
+                         _format.embd_normalize, _cache.get(), chunk_embd,
+                         n_embd);
+    if (windows.empty()) {
+      n_embd = llama_model_n_embd(_rn_ctx->model);
+    }
+    _result.n_embd = n_embd;
+
+    if (_options.aggregate == ChunkAggregate::NONE) {
+      _result.n_rows = windows.size();
+      _result.embeddings = std::move(chunk_embd);
+    } else {
+      // Average the chunk vectors, by token count when weighted, and
+      // normalize the result like a single embedding
+      std::vector<float> sum(n_embd, 0.0f);
+      double total = 0.0;
+      for (size_t c = 0; c < windows.size(); c++) {
+        const float weight =
+            _options.aggregate == ChunkAggregate::WEIGHTED
+                ? static_cast<float>(_result.spans[2 * c + 1] -
+                                     _result.spans[2 * c])
+                : 1.0f;
+        const float *row = chunk_embd.data() + c * n_embd;
+        for (size_t d = 0; d < n_embd; d++) {
+          sum[d] += weight * row[d];
+        }
+        total += weight;
+      }
+      if (total > 0.0) {
+        for (auto &v : sum) {
+          v = static_cast<float>(v / total);
+        }
+      }
+      _result.n_rows = 1;
+      _result.embeddings.resize(n_embd);
+      common_embd_normalize(sum.data(), _result.embeddings.data(),
+                            static_cast<int>(n_embd), _format.embd_normalize);
+    }
+    _format.Apply(_result.embeddings.data(), _result.n_rows, _result.n_embd,
+                  _result.output);
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void EmbeddingChunksWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  auto result = Napi::Object::New(env);
+  const size_t row = _format.RowElements(_result.n_embd);
+  auto offsets = Napi::Uint32Array::New(env, _result.n_rows + 1);
+  for (size_t i = 0; i <= _result.n_rows; i++) {
+    offsets[i] = static_cast<uint32_t>(i * row);
+  }
+  auto spans = Napi::Uint32Array::New(env, _result.spans.size());
+  for (size_t i = 0; i < _result.spans.size(); i++) {
+    spans[i] = _result.spans[i];
+  }
+  result.Set("embeddings", _format.ToTypedArray(env, _result.output));
+  result.Set("offsets", offsets);
+  result.Set("n_embd",
+             Napi::Number::New(env, _format.OutputDim(_result.n_embd)));
+  result.Set("chunks", spans);
+  result.Set("n_tokens",
+             Napi::Number::New(env, static_cast<double>(_result.n_tokens)));
+  Napi::Promise::Deferred::Resolve(result);
+}
+
+void EmbeddingChunksWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "EmbeddingCache.h"
+#include "EmbeddingFormat.h"
+#include "SessionState.h"
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <memory>
+#include <vector>
+
+enum class ChunkAggregate { NONE, MEAN, WEIGHTED };
+
+struct EmbeddingChunksOptions {
+  size_t chunk_tokens = 0; // 0 fills the batch
+  size_t overlap_tokens = 0;
+  ChunkAggregate aggregate = ChunkAggregate::NONE;
+  size_t max_batch_tokens = 0;
+};
+
+struct EmbeddingChunksResult {
+  std::vector<float> embeddings; // [n_rows * n_embd]
+  size_t n_rows = 0;
+  size_t n_embd = 0;
+  std::vector<uint32_t> spans; // [start, end) document token range per chunk
+  size_t n_tokens = 0;
+  std::vector<uint8_t> output; // embeddings encoded as EmbeddingFormat
+};
+
+// Embeds a document longer than the context: tokenizes it once, splits the
+// tokens into overlapping windows, and embeds the windows as one batched
+// run. Returns each window's embedding, or with an aggregate, one pooled
+// document embedding.
+class EmbeddingChunksWorker : public Napi::AsyncWorker,
+                              public Napi::Promise::Deferred {
+public:
+  EmbeddingChunksWorker(const Napi::CallbackInfo &info,
+                        rnllama::llama_rn_context *rn_ctx, std::string text,
+                        EmbeddingFormat format, EmbeddingChunksOptions options);
+
+  void SetCache(std::shared_ptr<EmbeddingCache> cache) {
+    _cache = std::move(cache);
+  }
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  std::string _text;
+  EmbeddingFormat _format;
+  EmbeddingChunksOptions _options;
+  std::shared_ptr<EmbeddingCache> _cache;
+  EmbeddingChunksResult _result;
+  std::shared_ptr<ContextGate> _gate;
+};
@@ -0,0 +1,147 @@
+#include "EmbeddingFormat.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// The loops below are kept branch-free over contiguous rows so the compiler
+// vectorizes them; f16 conversion goes through ggml's SIMD row converter.
+
+static void QuantizeInt8(const float *__restrict in, size_t n,
+                         int8_t *__restrict out) {
+  for (size_t i = 0; i < n; i++) {
+    const float v = std::min(127.0f, std::max(-127.0f, in[i] * 127.0f));
+    out[i] = static_cast<int8_t>(v + (v >= 0.0f ? 0.5f : -0.5f));
+  }
+}
+
+static void QuantizeBinary(const float *__restrict in, size_t n,
+                           uint8_t *__restrict out) {
+  const size_t n_full = n / 8;
+  for (size_t b = 0; b < n_full; b++) {
+    const float *x = in + b * 8;
+    out[b] = static_cast<uint8_t>(
+        (x[0] > 0.0f) << 7 | (x[1] > 0.0f) << 6 | (x[2] > 0.0f) << 5 |
+        (x[3] > 0.0f) << 4 | (x[4] > 0.0f) << 3 | (x[5] > 0.0f) << 2 |
+        (x[6] > 0.0f) << 1 | (x[7] > 0.0f));
+  }
+  if (n % 8 != 0) {
+    uint8_t last = 0;
+    for (size_t k = 0; k < n % 8; k++) {
+      last |= static_cast<uint8_t>((in[n_full * 8 + k] > 0.0f) << (7 - k));
+    }
+    out[n_full] = last;
+  }
+}
+
+size_t EmbeddingFormat::OutputDim(size_t n_embd) const {
+  return dim == 0 ? n_embd : std::min(dim, n_embd);
+}
+
+size_t EmbeddingFormat::RowElements(size_t n_embd) const {
+  const size_t n = OutputDim(n_embd);
+  return quant == EmbeddingQuant::BINARY ? (n + 7) / 8 : n;
+}
+
+size_t EmbeddingFormat::RowBytes(size_t n_embd) const {
+  const size_t n = RowElements(n_embd);
+  switch (quant) {
+  case EmbeddingQuant::F32:
+    return n * sizeof(float);
+  case EmbeddingQuant::F16:
+    return n * sizeof(ggml_fp16_t);
+  default:
+    return n;
+  }
+}
+
+void EmbeddingFormat::Apply(const float *embd, size_t n_rows, size_t n_embd,
+                            std::vector<uint8_t> &out) const {
+  if (n_rows > 0 && dim > n_embd) {
+    throw std::runtime_error("embd_dim " + std::to_string(dim) +
+                             " exceeds the embedding size " +
+                             std::to_string(n_embd));
+  }
+  const size_t n = OutputDim(n_embd);
+  const size_t row_bytes = RowBytes(n_embd);
+  out.resize(n_rows * row_bytes);
+
+  // Renormalize the truncated prefix; full vectors are already normalized
+  const bool renormalize = n < n_embd && embd_normalize >= 0;
+  std::vector<float> row(renormalize ? n : 0);
+  for (size_t r = 0; r < n_rows; r++) {
+    const float *src = embd + r * n_embd;
+    if (renormalize) {
+      common_embd_normalize(src, row.data(), static_cast<int>(n),
+                            embd_normalize);
+      src = row.data();
+    }
+    uint8_t *dst = out.data() + r * row_bytes;
+    switch (quant) {
+    case EmbeddingQuant::F32:
+      memcpy(dst, src, row_bytes);
+      break;
+    case EmbeddingQuant::F16:
+      ggml_fp32_to_fp16_row(src, reinterpret_cast<ggml_fp16_t *>(dst),
+                            static_cast<int64_t>(n));
+      break;
+    case EmbeddingQuant::INT8:
+      QuantizeInt8(src, n, reinterpret_cast<int8_t *>(dst));
+      break;
+    case EmbeddingQuant::BINARY:
+      QuantizeBinary(src, n, dst);
+      break;
+    }
+  }
+}
+
+Napi::Value EmbeddingFormat::ToTypedArray(
+    Napi::Env env, const std::vector<uint8_t> &data) const {
+  auto buffer = Napi::ArrayBuffer::New(env, data.size());
+  if (!data.empty()) {
+    memcpy(buffer.Data(), data.data(), data.size());
+  }
+  switch (quant) {
+  case EmbeddingQuant::F16:
+    return Napi::Uint16Array::New(env, data.size() / sizeof(uint16_t), buffer,
+                                  0);
+  case EmbeddingQuant::INT8:
+    return Napi::Int8Array::New(env, data.size(), buffer, 0);
+  case EmbeddingQuant::BINARY:
+    return Napi::Uint8Array::New(env, data.size(), buffer, 0);
+  default:
+    return Napi::Float32Array::New(env, data.size() / sizeof(float), buffer,
+                                   0);
+  }
+}
+
+bool ParseEmbeddingFormat(const Napi::Object &options, EmbeddingFormat &format,
+                          std::string &error) {
+  format.embd_normalize = get_option<int32_t>(options, "embd_normalize", 2);
+  const int32_t dim = get_option<int32_t>(options, "embd_dim", 0);
+  if (dim < 0) {
+    error = "embd_dim must not be negative";
+    return false;
+  }
+  format.dim = static_cast<size_t>(dim);
+
+  const auto quant = get_option<std::string>(options, "embd_quant", "f32");
+  if (quant == "f32") {
+    format.quant = EmbeddingQuant::F32;
+  } else if (quant == "f16") {
+    format.quant = EmbeddingQuant::F16;
+  } else if (quant == "int8") {
+    // p-norms with p >= 1 bound every component to [-1, 1]; raw outputs and
+    // max-abs normalization (scaled to int16) would saturate at +-127
+    if (format.embd_normalize < 1) {
+      error = "embd_quant 'int8' needs embd_normalize >= 1";
+      return false;
+    }
+    format.quant = EmbeddingQuant::INT8;
+  } else if (quant == "binary") {
+    format.quant = EmbeddingQuant::BINARY;
+  } else {
+    error = "embd_quant must be one of 'f32', 'f16', 'int8', 'binary'";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "common.hpp"
+#include <string>
+#include <vector>
+
+enum class EmbeddingQuant { F32, F16, INT8, BINARY };
+
+// Output shape of returned embeddings: optional Matryoshka truncation to the
+// first `dim` dimensions (renormalized with `embd_normalize`), then encoding
+// as f32, f16 (IEEE half bits), int8 (components scaled by 127; only offered
+// with p-norm normalization, which keeps them in [-1, 1]) or binary (sign
+// bits packed MSB first).
+struct EmbeddingFormat {
+  size_t dim = 0; // 0 keeps every dimension
+  int32_t embd_normalize = 2;
+  EmbeddingQuant quant = EmbeddingQuant::F32;
+
+  // Dimensions kept from an n_embd vector
+  size_t OutputDim(size_t n_embd) const;
+  // Typed array elements per output vector (bytes for binary)
+  size_t RowElements(size_t n_embd) const;
+  size_t RowBytes(size_t n_embd) const;
+
+  // Formats `n_rows` vectors of n_embd floats into `out`, which is resized
+  // to n_rows * RowBytes(n_embd). Throws if `dim` exceeds n_embd.
+  void Apply(const float *embd, size_t n_rows, size_t n_embd,
+             std::vector<uint8_t> &out) const;
+
+  // Float32Array, Uint16Array, Int8Array or Uint8Array over a copy of `data`
+  Napi::Value ToTypedArray(Napi::Env env,
+                           const std::vector<uint8_t> &data) const;
+};
+
+// Reads embd_normalize, embd_dim and embd_quant. Returns false with `error`
+// set when an option is invalid.
+bool ParseEmbeddingFormat(const Napi::Object &options, EmbeddingFormat &format,
+                          std::string &error);
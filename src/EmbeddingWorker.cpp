@@ -1,18 +1,42 @@
 #include "EmbeddingWorker.h"
 #include "LlamaContext.h"
 
+std::vector<float> EmbedText(rnllama::llama_rn_context *rn_ctx,
+                             const std::string &text, common_params &params,
+                             EmbeddingCache *cache) {
+  EmbeddingKey key;
+  if (cache != nullptr) {
+    key = EmbeddingCacheKey(common_tokenize(rn_ctx->ctx, text, true, true),
+                            llama_pooling_type(rn_ctx->ctx),
+                            params.embd_normalize);
+    if (auto cached = GetCachedEmbedding(*cache, key)) {
+      return cached->embd;
+    }
+  }
+
+  rn_ctx->params.prompt = text;
+  rn_ctx->params.n_predict = 0;
+  auto embedding = rn_ctx->completion->embedding(params);
+
+  if (cache != nullptr && !embedding.empty()) {
+    PutCachedEmbedding(*cache, key, embedding);
+  }
+  return embedding;
+}
+
 EmbeddingWorker::EmbeddingWorker(const Napi::CallbackInfo &info,
                                  rnllama::llama_rn_context* rn_ctx, std::string text,
-                                 common_params &params)
+                                 common_params &params, EmbeddingFormat format)
     : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx), _text(text),
-      _params(params) {}
+      _params(params), _format(format) {}
 
 void EmbeddingWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
   try {
-    _rn_ctx->params.prompt = _text;
-    _rn_ctx->params.n_predict = 0;
-
-    _result.embedding = _rn_ctx->completion->embedding(_params);
+    const auto embedding = EmbedText(_rn_ctx, _text, _params, _cache.get());
+    _format.Apply(embedding.data(), 1, embedding.size(), _result.embedding);
   } catch (const std::exception &e) {
     SetError(e.what());
   }
@@ -20,11 +44,8 @@ void EmbeddingWorker::Execute() {
 
 void EmbeddingWorker::OnOK() {
   auto result = Napi::Object::New(Napi::AsyncWorker::Env());
-  auto embedding = Napi::Float32Array::New(Napi::AsyncWorker::Env(),
-                                           _result.embedding.size());
-  memcpy(embedding.Data(), _result.embedding.data(),
-         _result.embedding.size() * sizeof(float));
-  result.Set("embedding", embedding);
+  result.Set("embedding", _format.ToTypedArray(Napi::AsyncWorker::Env(),
+                                               _result.embedding));
   Napi::Promise::Deferred::Resolve(result);
 }
 
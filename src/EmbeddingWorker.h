@@ -1,16 +1,38 @@
+#pragma once
+
+#include "EmbeddingCache.h"
+#include "EmbeddingFormat.h"
+#include "SessionState.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
+#include <memory>
 #include <vector>
 
 struct EmbeddingResult {
-  std::vector<float> embedding;
+  std::vector<uint8_t> embedding; // encoded as EmbeddingFormat
 };
 
+// Embeds `text` through rn-llama, consulting `cache` (when not null) by the
+// text's tokens first and storing the result on a miss.
+std::vector<float> EmbedText(rnllama::llama_rn_context *rn_ctx,
+                             const std::string &text, common_params &params,
+                             EmbeddingCache *cache);
+
 class EmbeddingWorker : public Napi::AsyncWorker,
                         public Napi::Promise::Deferred {
 public:
   EmbeddingWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx,
-                  std::string text, common_params &params);
+                  std::string text, common_params &params,
+                  EmbeddingFormat format);
+
+  void SetCache(std::shared_ptr<EmbeddingCache> cache) {
+    _cache = std::move(cache);
+  }
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
 
 protected:
   void Execute();
@@ -21,5 +43,8 @@ private:
   rnllama::llama_rn_context* _rn_ctx;
   std::string _text;
   common_params _params;
+  EmbeddingFormat _format;
+  std::shared_ptr<EmbeddingCache> _cache;
   EmbeddingResult _result;
+  std::shared_ptr<ContextGate> _gate;
 };
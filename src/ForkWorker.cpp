@@ -0,0 +1,308 @@
+#include "ForkWorker.h"
+#include "rn-llama/rn-completion.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+struct SamplerDeleter {
+  void operator()(common_sampler *sampler) const {
+    common_sampler_free(sampler);
+  }
+};
+
+double Elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Log-probability of `token` under the logits the sampler saw at `idx`
+double TokenLogprob(llama_context *ctx, int32_t idx, int32_t n_vocab,
+                    llama_token token) {
+  const float *logits = llama_get_logits_ith(ctx, idx);
+  const float max_logit = *std::max_element(logits, logits + n_vocab);
+  double sum = 0;
+  for (int32_t i = 0; i < n_vocab; i++) {
+    sum += std::exp(static_cast<double>(logits[i] - max_logit));
+  }
+  return logits[token] - max_logit - std::log(sum);
+}
+
+// Cells one sequence can use: all of them with a unified KV cache, otherwise
+// its own stream
+size_t SeqContextSize(rnllama::llama_rn_context *rn_ctx) {
+  const size_t n_ctx = llama_n_ctx(rn_ctx->ctx);
+  return rn_ctx->params.kv_unified ? n_ctx
+                                   : n_ctx / llama_n_seq_max(rn_ctx->ctx);
+}
+
+} // namespace
+
+ForkWorker::ForkWorker(const Napi::CallbackInfo &info,
+                       rnllama::llama_rn_context *rn_ctx, common_params params,
+                       ForkOptions options)
+    : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx),
+      _params(std::move(params)), _options(std::move(options)) {}
+
+size_t ForkWorker::Prefill(const std::vector<llama_token> &prompt) {
+  llama_context *ctx = _rn_ctx->ctx;
+  auto *memory = llama_get_memory(ctx);
+  auto completion = _rn_ctx->completion;
+
+  // The last prompt token is always evaluated: its logits start every branch
+  const auto &prev = completion->embd;
+  const size_t n_prev = std::min(prev.size(), prompt.size() - 1);
+  size_t n_done =
+      std::mismatch(prev.begin(), prev.begin() + n_prev, prompt.begin()).first -
+      prev.begin();
+  completion->embd.clear();
+  completion->n_past = 0;
+  if (!llama_memory_seq_rm(memory, 0, n_done, -1)) {
+    llama_memory_seq_rm(memory, 0, -1, -1);
+    n_done = 0;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const int32_t n_batch = std::max<int32_t>(llama_n_batch(ctx), 1);
+  llama_batch batch = llama_batch_init(n_batch, 0, 1);
+  while (n_done < prompt.size()) {
+    const size_t n_eval = std::min<size_t>(n_batch, prompt.size() - n_done);
+    common_batch_clear(batch);
+    for (size_t i = 0; i < n_eval; i++) {
+      const size_t pos = n_done + i;
+      common_batch_add(batch, prompt[pos], static_cast<llama_pos>(pos), {0},
+                       pos + 1 == prompt.size());
+    }
+    if (llama_decode(ctx, batch) != 0) {
+      llama_batch_free(batch);
+      throw std::runtime_error("Failed to evaluate the prompt");
+    }
+    n_done += n_eval;
+    _prompt_n += n_eval;
+  }
+  llama_batch_free(batch);
+  _prompt_ms = Elapsed(start);
+  return prompt.size();
+}
+
+void ForkWorker::Generate(size_t n_prompt) {
+  llama_context *ctx = _rn_ctx->ctx;
+  auto *memory = llama_get_memory(ctx);
+  const llama_vocab *vocab = llama_model_get_vocab(_rn_ctx->model);
+  const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+  const size_t n_ctx_seq = SeqContextSize(_rn_ctx);
+  const size_t n = static_cast<size_t>(_options.n_branches);
+  const auto &prompt = _rn_ctx->completion->embd;
+
+  std::vector<std::unique_ptr<common_sampler, SamplerDeleter>> samplers;
+  for (size_t b = 0; b < n; b++) {
+    auto sampling = _params.sampling;
+    if (sampling.seed != LLAMA_DEFAULT_SEED) {
+      sampling.seed += static_cast<uint32_t>(b);
+    }
+    samplers.emplace_back(common_sampler_init(_rn_ctx->model, sampling));
+    if (!samplers.back()) {
+      throw std::runtime_error("Failed to initialize sampling");
+    }
+    // Penalties look back into the prompt
+    for (const llama_token token : prompt) {
+      common_sampler_accept(samplers.back().get(), token, false);
+    }
+  }
+  for (size_t b = 1; b < n; b++) {
+    llama_memory_seq_rm(memory, static_cast<llama_seq_id>(b), -1, -1);
+    llama_memory_seq_cp(memory, 0, static_cast<llama_seq_id>(b), -1, -1);
+  }
+
+  _branches.assign(n, ForkBranch());
+  // Logits index of each live branch in the last batch; -1 is the prompt's
+  std::vector<int32_t> idx(n, -1);
+  std::vector<bool> live(n, true);
+  auto finish = [&](size_t b) {
+    live[b] = false;
+    llama_memory_seq_rm(memory, static_cast<llama_seq_id>(b), n_prompt, -1);
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  llama_batch batch = llama_batch_init(static_cast<int32_t>(n), 0, 1);
+  for (size_t step = 1;; step++) {
+    std::vector<size_t> pending;
+    for (size_t b = 0; b < n; b++) {
+      if (!live[b]) {
+        continue;
+      }
+      auto &branch = _branches[b];
+      const llama_token token =
+          common_sampler_sample(samplers[b].get(), ctx, idx[b]);
+      branch.logprob += TokenLogprob(ctx, idx[b], n_vocab, token);
+      common_sampler_accept(samplers[b].get(), token, true);
+      branch.tokens.push_back(token);
+      _predicted_n++;
+
+      if (llama_vocab_is_eog(vocab, token) && !_params.sampling.ignore_eos) {
+        branch.stopped_eos = true;
+        finish(b);
+        continue;
+      }
+      const std::string piece = common_token_to_piece(ctx, token);
+      branch.text += piece;
+      for (const auto &word : _options.stop_words) {
+        if (word.empty()) {
+          continue;
+        }
+        const size_t from =
+            branch.text.size() > piece.size() + word.size()
+                ? branch.text.size() - piece.size() - word.size()
+                : 0;
+        const size_t pos = branch.text.find(word, from);
+        if (pos != std::string::npos) {
+          branch.text.resize(pos);
+          branch.stopped_word = true;
+          break;
+        }
+      }
+      if (branch.stopped_word) {
+        finish(b);
+        continue;
+      }
+      const size_t n_generated = branch.tokens.size();
+      if ((_params.n_predict >= 0 &&
+           n_generated >= static_cast<size_t>(_params.n_predict)) ||
+          n_prompt + n_generated >= n_ctx_seq) {
+        branch.stopped_limit = true;
+        finish(b);
+        continue;
+      }
+      pending.push_back(b);
+    }
+
+    // Keep the branches with the best mean log-probability
+    const size_t keep = static_cast<size_t>(_options.keep_branches);
+    if (keep > 0 && pending.size() > keep && _options.prune_interval > 0 &&
+        step % static_cast<size_t>(_options.prune_interval) == 0) {
+      auto mean = [this](size_t b) {
+        return _branches[b].logprob / _branches[b].tokens.size();
+      };
+      std::stable_sort(pending.begin(), pending.end(),
+                       [&](size_t a, size_t b) { return mean(a) > mean(b); });
+      for (size_t i = keep; i < pending.size(); i++) {
+        _branches[pending[i]].pruned = true;
+        finish(pending[i]);
+      }
+      pending.resize(keep);
+    }
+    if (_stop) {
+      for (const size_t b : pending) {
+        _branches[b].stopped_limit = true;
+        finish(b);
+      }
+      pending.clear();
+    }
+    if (pending.empty()) {
+      break;
+    }
+
+    common_batch_clear(batch);
+    for (const size_t b : pending) {
+      const size_t pos = n_prompt + _branches[b].tokens.size() - 1;
+      idx[b] = batch.n_tokens;
+      common_batch_add(batch, _branches[b].tokens.back(),
+                       static_cast<llama_pos>(pos),
+                       {static_cast<llama_seq_id>(b)}, true);
+    }
+    if (llama_decode(ctx, batch) != 0) {
+      // Out of KV cells: what the branches have so far is the result
+      for (const size_t b : pending) {
+        _branches[b].stopped_limit = true;
+        finish(b);
+      }
+      break;
+    }
+  }
+  llama_batch_free(batch);
+  _predicted_ms = Elapsed(start);
+}
+
+void ForkWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
+  llama_context *ctx = _rn_ctx->ctx;
+  auto *memory = llama_get_memory(ctx);
+  try {
+    // Tokenized like loadPrompt so a later completion reuses the prefix
+    const auto prompt = common_tokenize(ctx, _params.prompt, true, true);
+    if (prompt.empty()) {
+      throw std::runtime_error("Empty prompt");
+    }
+    if (prompt.size() >= SeqContextSize(_rn_ctx)) {
+      throw std::runtime_error("Prompt does not fit in the context");
+    }
+    const size_t n_prompt = Prefill(prompt);
+    _rn_ctx->completion->embd = prompt;
+    _rn_ctx->completion->n_past = static_cast<llama_pos>(n_prompt);
+    _rn_ctx->setMediaHashes({});
+    Generate(n_prompt);
+
+    // Leave only the prompt, like a completion that was rolled back
+    for (size_t b = 1; b < _branches.size(); b++) {
+      llama_memory_seq_rm(memory, static_cast<llama_seq_id>(b), -1, -1);
+    }
+    if (!llama_memory_seq_rm(memory, 0, n_prompt, -1)) {
+      // Recurrent state cannot be rolled back to the prompt
+      llama_memory_seq_rm(memory, 0, -1, -1);
+      _rn_ctx->completion->embd.clear();
+      _rn_ctx->completion->n_past = 0;
+    }
+  } catch (const std::exception &e) {
+    llama_memory_clear(memory, true);
+    _rn_ctx->completion->embd.clear();
+    _rn_ctx->completion->n_past = 0;
+    SetError(e.what());
+  }
+  if (_onComplete) {
+    _onComplete();
+  }
+}
+
+void ForkWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  auto branches = Napi::Array::New(env, _branches.size());
+  for (size_t b = 0; b < _branches.size(); b++) {
+    const auto &branch = _branches[b];
+    auto item = Napi::Object::New(env);
+    item.Set("index", Napi::Number::New(env, static_cast<double>(b)));
+    item.Set("text", Napi::String::New(env, branch.text));
+    auto tokens = Napi::Array::New(env, branch.tokens.size());
+    for (size_t i = 0; i < branch.tokens.size(); i++) {
+      tokens.Set(i, Napi::Number::New(env, branch.tokens[i]));
+    }
+    item.Set("tokens", tokens);
+    item.Set("logprob", Napi::Number::New(env, branch.logprob));
+    item.Set("stopped_eos", Napi::Boolean::New(env, branch.stopped_eos));
+    item.Set("stopped_word", Napi::Boolean::New(env, branch.stopped_word));
+    item.Set("stopped_limit", Napi::Boolean::New(env, branch.stopped_limit));
+    item.Set("pruned", Napi::Boolean::New(env, branch.pruned));
+    branches.Set(b, item);
+  }
+
+  auto timings = Napi::Object::New(env);
+  timings.Set("prompt_n", Napi::Number::New(env, static_cast<double>(_prompt_n)));
+  timings.Set("prompt_ms", Napi::Number::New(env, _prompt_ms));
+  timings.Set("predicted_n",
+              Napi::Number::New(env, static_cast<double>(_predicted_n)));
+  timings.Set("predicted_ms", Napi::Number::New(env, _predicted_ms));
+
+  auto result = Napi::Object::New(env);
+  result.Set("branches", branches);
+  result.Set("timings", timings);
+  Napi::Promise::Deferred::Resolve(result);
+}
+
+void ForkWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
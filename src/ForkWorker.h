@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SessionState.h"
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct ForkOptions {
+  // Number of branches; sequences 0..n_branches-1 are used
+  int32_t n_branches = 2;
+  // Prune down to this many live branches (0 keeps all)
+  int32_t keep_branches = 0;
+  // Tokens generated between pruning rounds
+  int32_t prune_interval = 16;
+  std::vector<std::string> stop_words;
+};
+
+struct ForkBranch {
+  std::string text;
+  std::vector<llama_token> tokens;
+  // Sum of the log-probabilities of the sampled tokens
+  double logprob = 0;
+  bool stopped_eos = false;
+  bool stopped_word = false;
+  bool stopped_limit = false;
+  bool pruned = false;
+};
+
+// fork(n, options): evaluates the prompt once into sequence 0, copies it to
+// n - 1 more sequences (llama_memory_seq_cp; cells are shared with a unified
+// KV cache) and decodes all branches together, one token per live branch per
+// batch, each with its own sampler seeded `seed + branch`. Every
+// `prune_interval` tokens the branches with the lowest mean log-probability
+// are dropped down to `keep_branches` and their cells freed. Afterwards the
+// context keeps only the prompt, so the next completion reuses it.
+class ForkWorker : public Napi::AsyncWorker, public Napi::Promise::Deferred {
+public:
+  ForkWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context *rn_ctx,
+             common_params params, ForkOptions options);
+
+  // Ends every branch after the current step, as stopped by limit
+  void SetStop() { _stop = true; }
+  void OnComplete(std::function<void()> cb) { _onComplete = std::move(cb); }
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  // Evaluates the prompt into sequence 0, reusing what memory holds, and
+  // returns its length
+  size_t Prefill(const std::vector<llama_token> &prompt);
+  void Generate(size_t n_prompt);
+
+  rnllama::llama_rn_context *_rn_ctx;
+  common_params _params;
+  ForkOptions _options;
+  std::shared_ptr<ContextGate> _gate;
+  std::atomic<bool> _stop{false};
+  std::function<void()> _onComplete;
+  std::vector<ForkBranch> _branches;
+  size_t _prompt_n = 0;
+  double _prompt_ms = 0;
+  size_t _predicted_n = 0;
+  double _predicted_ms = 0;
+};
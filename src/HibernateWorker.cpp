@@ -0,0 +1,133 @@
+#include "HibernateWorker.h"
+#include "rn-llama/rn-completion.h"
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+void FreeContext(rnllama::llama_rn_context *rn_ctx) {
+  if (rn_ctx->ctx == nullptr) {
+    return;
+  }
+  if (rn_ctx->llama_init && rn_ctx->llama_init->context() == rn_ctx->ctx) {
+    // Owned by the load result until the first hibernation
+    rn_ctx->llama_init->free_context();
+  } else {
+    llama_free(rn_ctx->ctx);
+  }
+  rn_ctx->ctx = nullptr;
+}
+
+} // namespace
+
+bool WakeContext(rnllama::llama_rn_context *rn_ctx, const std::string &path) {
+  if (rn_ctx->ctx != nullptr) {
+    return true;
+  }
+  llama_context_params cparams = common_context_params_to_llama(rn_ctx->params);
+  rn_ctx->ctx = llama_init_from_model(rn_ctx->model, cparams);
+  if (rn_ctx->ctx == nullptr) {
+    return false;
+  }
+  auto lora = rn_ctx->getLoadedLoraAdapters();
+  if (!lora.empty()) {
+    common_set_adapter_lora(rn_ctx->ctx, lora);
+  }
+  SessionTokens session;
+  try {
+    LoadMappedSession(rn_ctx, path, session.tokens);
+  } catch (const std::exception &) {
+    // LoadMappedSession leaves the memory cleared: start cold
+    session.tokens.clear();
+  }
+  // Also drops the token history of a cold start
+  ApplyRestoredSession(rn_ctx, std::move(session));
+  std::remove(path.c_str());
+  return true;
+}
+
+void DeleteContext(rnllama::llama_rn_context *rn_ctx) {
+  if (rn_ctx->ctx != nullptr && rn_ctx->llama_init &&
+      rn_ctx->llama_init->context() != rn_ctx->ctx) {
+    FreeContext(rn_ctx);
+  }
+  delete rn_ctx;
+}
+
+HibernateWorker::HibernateWorker(Napi::Env env,
+                                 rnllama::llama_rn_context *rn_ctx,
+                                 std::string path,
+                                 std::shared_ptr<ContextGate> after,
+                                 std::shared_ptr<ContextGate> done)
+    : AsyncWorker(env), Deferred(env), _rn_ctx(rn_ctx),
+      _path(std::move(path)), _after(std::move(after)),
+      _done(std::move(done)) {}
+
+void HibernateWorker::Execute() {
+  if (_after) {
+    _after->Wait();
+  }
+  try {
+    if (_rn_ctx->ctx && _rn_ctx->completion &&
+        !_rn_ctx->completion->embd.empty()) {
+      WriteSession(CaptureSession(_rn_ctx), _path, SessionSaveOptions());
+    }
+  } catch (const std::exception &) {
+    // Waking then starts cold, which only costs re-evaluating the prompt
+    std::remove(_path.c_str());
+  }
+  try {
+    FreeContext(_rn_ctx);
+  } catch (const std::exception &e) {
+    SetError(std::string("Error during context hibernation: ") + e.what());
+  }
+  _done->Open();
+}
+
+void HibernateWorker::OnOK() {
+  Resolve(Napi::Number::New(AsyncWorker::Env(), 0));
+}
+
+void HibernateWorker::OnError(const Napi::Error &err) { Reject(err.Value()); }
+
+WakeWorker::WakeWorker(Napi::Env env, rnllama::llama_rn_context *rn_ctx,
+                       Hibernation hibernation,
+                       std::shared_ptr<ContextGate> done,
+                       std::function<void(bool, double)> on_woken)
+    : AsyncWorker(env), _rn_ctx(rn_ctx), _hibernation(std::move(hibernation)),
+      _done(std::move(done)), _on_woken(std::move(on_woken)) {}
+
+Napi::Promise WakeWorker::AddWaiter() {
+  _waiters.push_back(Napi::Promise::Deferred::New(AsyncWorker::Env()));
+  return _waiters.back().Promise();
+}
+
+void WakeWorker::Execute() {
+  const auto start = std::chrono::steady_clock::now();
+  // Usually open already; otherwise the state is still being written
+  _hibernation.done->Wait();
+  if (!WakeContext(_rn_ctx, _hibernation.path)) {
+    SetError("Failed to wake hibernated context");
+    _done->Open();
+    return;
+  }
+  _wake_ms = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start)
+                 .count();
+  _done->Open();
+}
+
+void WakeWorker::OnOK() {
+  Napi::Env env = AsyncWorker::Env();
+  _on_woken(true, _wake_ms);
+  for (auto &waiter : _waiters) {
+    waiter.Resolve(Napi::Number::New(env, _wake_ms));
+  }
+}
+
+void WakeWorker::OnError(const Napi::Error &err) {
+  _on_woken(false, 0);
+  for (auto &waiter : _waiters) {
+    waiter.Reject(err.Value());
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "SessionState.h"
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Where a hibernated context keeps its state. `done` opens once the state
+// file is written and the context freed.
+struct Hibernation {
+  std::string path;
+  std::shared_ptr<ContextGate> done;
+};
+
+// Creates the context of a hibernated `rn_ctx` from its loaded model again,
+// re-applies its LoRA adapters and restores the state file at `path`, which
+// is removed once read. Does nothing when the context exists already. Returns
+// false, keeping the file, when the context could not be created.
+bool WakeContext(rnllama::llama_rn_context *rn_ctx, const std::string &path);
+
+// Deletes `rn_ctx`, first freeing a context created by WakeContext, which
+// the model load result does not own.
+void DeleteContext(rnllama::llama_rn_context *rn_ctx);
+
+// hibernate(): writes the context state to `path` in the plain session
+// format and frees the llama_context, KV cache and compute buffers included.
+// The model, chat templates and LoRA adapters stay loaded. `done` is opened
+// once the context is gone; the state file is left out when there is no
+// token history to keep.
+class HibernateWorker : public Napi::AsyncWorker,
+                        public Napi::Promise::Deferred {
+public:
+  HibernateWorker(Napi::Env env, rnllama::llama_rn_context *rn_ctx,
+                  std::string path, std::shared_ptr<ContextGate> after,
+                  std::shared_ptr<ContextGate> done);
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  std::string _path;
+  std::shared_ptr<ContextGate> _after;
+  std::shared_ptr<ContextGate> _done;
+};
+
+// wake(): runs WakeContext off the JS thread. `done` opens when it finishes
+// either way. `on_woken` runs on the JS thread before the waiters settle,
+// with whether the context was created.
+class WakeWorker : public Napi::AsyncWorker {
+public:
+  WakeWorker(Napi::Env env, rnllama::llama_rn_context *rn_ctx,
+             Hibernation hibernation, std::shared_ptr<ContextGate> done,
+             std::function<void(bool, double)> on_woken);
+
+  // Promise settled with the wake, one per call that waits on it
+  Napi::Promise AddWaiter();
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  Hibernation _hibernation;
+  std::shared_ptr<ContextGate> _done;
+  std::function<void(bool, double)> _on_woken;
+  std::vector<Napi::Promise::Deferred> _waiters;
+  double _wake_ms = 0;
+};
@@ -28,6 +28,78 @@ Napi::Array TokenProbsToArray(Napi::Env env, llama_context* ctx, const std::vect
   return result;
 }
 
+Napi::Array ToolCallsToArray(Napi::Env env,
+                             const std::vector<common_chat_tool_call> &calls) {
+  Napi::Array tool_calls = Napi::Array::New(env);
+  for (size_t i = 0; i < calls.size(); i++) {
+    const auto &tc = calls[i];
+    Napi::Object tool_call = Napi::Object::New(env);
+    tool_call.Set("type", "function");
+    Napi::Object function = Napi::Object::New(env);
+    function.Set("name", tc.name);
+    function.Set("arguments", tc.arguments);
+    tool_call.Set("function", function);
+    if (!tc.id.empty()) {
+      tool_call.Set("id", tc.id);
+    }
+    tool_calls.Set(i, tool_call);
+  }
+  return tool_calls;
+}
+
+// Partial completion payload, delivered through the token callback or a
+// LlamaTokenStream. Pooled per completion so the per-token path reuses buffers.
+struct CompletionTokenChunk
+    : public PooledTokenStreamChunk<CompletionTokenChunk> {
+  std::string token;
+  std::string content;
+  std::string reasoning_content;
+  std::vector<common_chat_tool_call> tool_calls;
+  std::string accumulated_text;
+  std::vector<rnllama::completion_token_output> completion_probabilities;
+  llama_context *ctx = nullptr;
+
+  void Reset() {
+    token.clear();
+    content.clear();
+    reasoning_content.clear();
+    tool_calls.clear();
+    accumulated_text.clear();
+    completion_probabilities.clear();
+    ctx = nullptr;
+  }
+
+  Napi::Value ToValue(Napi::Env env) override {
+    auto obj = Napi::Object::New(env);
+    obj.Set("token", Napi::String::New(env, token));
+    if (!content.empty()) {
+      obj.Set("content", Napi::String::New(env, content));
+    }
+    if (!reasoning_content.empty()) {
+      obj.Set("reasoning_content", Napi::String::New(env, reasoning_content));
+    }
+    if (!tool_calls.empty()) {
+      obj.Set("tool_calls", ToolCallsToArray(env, tool_calls));
+    }
+    obj.Set("accumulated_text", Napi::String::New(env, accumulated_text));
+
+    // Add completion_probabilities if available
+    if (!completion_probabilities.empty()) {
+      obj.Set("completion_probabilities",
+              TokenProbsToArray(env, ctx, completion_probabilities));
+    }
+    return obj;
+  }
+};
+
+// Byte length of a token's piece, measured in a stack buffer instead of
+// materialising a std::string for every generated token.
+static size_t TokenPieceSize(const llama_vocab *vocab, llama_token token) {
+  char buf[128];
+  const int32_t n =
+      llama_token_to_piece(vocab, token, buf, sizeof(buf), 0, true);
+  return n < 0 ? static_cast<size_t>(-n) : static_cast<size_t>(n);
+}
 
 LlamaCompletionWorker::LlamaCompletionWorker(
     const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx,
@@ -38,16 +110,18 @@ LlamaCompletionWorker::LlamaCompletionWorker(
     const std::string &generation_prompt,
     std::string reasoning_format,
     const std::string &chat_parser,
-    const std::vector<std::string> &media_paths,
+    std::vector<MediaInput> media_paths,
     bool has_vocoder,
-    const std::string &prefill_text)
+    const std::string &prefill_text,
+    std::shared_ptr<TokenRingBuffer> stream)
     : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx),
       _params(params), _stop_words(stop_words), _chat_format(chat_format),
       _generation_prompt(generation_prompt),
       _reasoning_format(reasoning_format),
       _chat_parser(chat_parser),
-      _media_paths(media_paths),
+      _media(std::move(media_paths)),
       _prefill_text(prefill_text),
+      _stream(std::move(stream)),
       _has_vocoder(has_vocoder) {
   if (!callback.IsEmpty()) {
     _tsfn = Napi::ThreadSafeFunction::New(info.Env(), callback,
@@ -64,6 +138,9 @@ LlamaCompletionWorker::~LlamaCompletionWorker() {
 
 
 void LlamaCompletionWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
   try {
     // Check if vocab_only mode is enabled - if so, return empty result
     if (_params.vocab_only) {
@@ -98,6 +175,9 @@ void LlamaCompletionWorker::Execute() {
     _rn_ctx->params.ctx_shift = _params.ctx_shift;
     _rn_ctx->params.embedding = _params.embedding;
 
+    // Buffer inputs are encoded here rather than on the JS thread
+    _media_paths = ResolveMediaPaths(_media);
+
     // Set prefill text
     completion->prefill_text = rnllama::utf8_sanitize(_prefill_text);
 
@@ -113,6 +193,23 @@ void LlamaCompletionWorker::Execute() {
       return;
     }
 
+    // Evaluate media first through the encoder cache, overlapping encoding
+    // with decoding when asked; loadPrompt then reuses that prefix like a
+    // restored session.
+    if (_media_prefill && !_media.empty()) {
+      PrefillMedia(_rn_ctx, _media_cache.get(), _media_cache_key,
+                   _params.prompt, _media, _media_paths, _async_media_encode);
+    }
+
+    // Restore the longest prefix another request or process already
+    // evaluated, so loadPrompt only evaluates what follows it
+    if (_prefix_cache && _media.empty()) {
+      PrefillPrefix(_rn_ctx, *_prefix_cache, _params.prompt);
+    }
+    if (_checkpoint_cache && _media.empty()) {
+      PrefillCheckpoints(_rn_ctx, *_checkpoint_cache, _params.prompt);
+    }
+
     // Load prompt (handles both text-only and multimodal)
     completion->loadPrompt(_media_paths);
 
@@ -132,7 +229,9 @@ void LlamaCompletionWorker::Execute() {
     // Main completion loop
     int token_count = 0;
     const int max_tokens = _params.n_predict < 0 ? std::numeric_limits<int>::max() : _params.n_predict;
-    size_t sent_count = 0;
+    const llama_vocab *vocab = llama_model_get_vocab(_rn_ctx->model);
+    StreamTextCursor cursor;
+    auto chunk_pool = std::make_shared<ObjectPool<CompletionTokenChunk>>();
     while (completion->has_next_token && !_interrupted && token_count < max_tokens) {
       // Get next token using rn-llama completion
       rnllama::completion_token_output token_output = completion->doCompletion();
@@ -149,59 +248,68 @@ void LlamaCompletionWorker::Execute() {
         continue;
       }
 
-      std::string token_text = common_token_to_piece(_rn_ctx->ctx, token_output.tok);
-      size_t pos = std::min(sent_count, completion->generated_text.size());
-      const std::string str_test = completion->generated_text.substr(pos);
+      const size_t token_size = TokenPieceSize(vocab, token_output.tok);
+      const auto &stop_words = _rn_ctx->params.antiprompt;
 
       bool is_stop_full = false;
-      size_t stop_pos = completion->findStoppingStrings(
-          str_test, token_text.size(), rnllama::STOP_FULL);
+      const std::string *stop_word = nullptr;
+      size_t stop_pos = cursor.FindStop(completion->generated_text, stop_words,
+                                        token_size, false, &stop_word);
       if (stop_pos != std::string::npos) {
+        // What findStoppingStrings records for STOP_FULL
         is_stop_full = true;
+        completion->stopping_word = *stop_word;
+        completion->stopped_word = true;
+        completion->has_next_token = false;
+        const size_t pos = cursor.Position(completion->generated_text);
         completion->generated_text.erase(
             completion->generated_text.begin() + pos + stop_pos,
             completion->generated_text.end());
-        pos = std::min(sent_count, completion->generated_text.size());
       } else {
-        stop_pos = completion->findStoppingStrings(
-            str_test, token_text.size(), rnllama::STOP_PARTIAL);
+        stop_pos = cursor.FindStop(completion->generated_text, stop_words,
+                                   token_size, true);
       }
 
       if (stop_pos == std::string::npos ||
           (!completion->has_next_token && !is_stop_full && stop_pos > 0)) {
-        const std::string to_send = completion->generated_text.substr(pos);
-        sent_count += to_send.size();
+        const std::string_view to_send = cursor.Unsent(completion->generated_text);
+        cursor.Advance(to_send.size());
 
         // Handle streaming callback
-        if (!_has_callback) {
+        if (!_has_callback && !_stream) {
           continue;
         }
 
-        struct TokenData {
-          std::string token;
-          std::string content;
-          std::string reasoning_content;
-          std::vector<common_chat_tool_call> tool_calls;
-          std::string accumulated_text;
-          std::vector<rnllama::completion_token_output> completion_probabilities;
-          llama_context* ctx;
-        };
-
         rnllama::completion_chat_output partial_output;
+        bool parsed = true;
         try {
           partial_output = completion->parseChatOutput(true);
         } catch (const std::exception &) {
-          partial_output.accumulated_text =
-              completion->prefill_text + completion->generated_text;
+          parsed = false;
+        }
+
+        TokenStreamChunkPtr chunk(chunk_pool->Acquire());
+        auto *token_data = static_cast<CompletionTokenChunk *>(chunk.get());
+        token_data->token.assign(to_send.data(), to_send.size());
+        token_data->content = std::move(partial_output.content);
+        token_data->reasoning_content =
+            std::move(partial_output.reasoning_content);
+        token_data->tool_calls = std::move(partial_output.tool_calls);
+        if (parsed) {
+          token_data->accumulated_text =
+              std::move(partial_output.accumulated_text);
+        } else {
+          token_data->accumulated_text.assign(completion->prefill_text)
+              .append(completion->generated_text);
         }
+        token_data->ctx = _rn_ctx->ctx;
 
         // Extract completion probabilities if n_probs > 0, similar to iOS implementation
-        std::vector<rnllama::completion_token_output> probs_output;
         if (_rn_ctx->params.sampling.n_probs > 0) {
           size_t probs_pos = std::min(_sent_token_probs_index, completion->generated_token_probs.size());
           size_t probs_stop_pos = completion->generated_token_probs.size();
           if (probs_pos < probs_stop_pos) {
-            probs_output = std::vector<rnllama::completion_token_output>(
+            token_data->completion_probabilities.assign(
               completion->generated_token_probs.begin() + probs_pos,
               completion->generated_token_probs.begin() + probs_stop_pos
             );
@@ -209,52 +317,19 @@ void LlamaCompletionWorker::Execute() {
           _sent_token_probs_index = probs_stop_pos;
         }
 
-        TokenData *token_data = new TokenData{
-          to_send,
-          partial_output.content,
-          partial_output.reasoning_content,
-          partial_output.tool_calls,
-          partial_output.accumulated_text,
-          probs_output,
-          _rn_ctx->ctx
-        };
-
-        _tsfn.BlockingCall(token_data, [](Napi::Env env, Napi::Function jsCallback,
-                                          TokenData *data) {
-          auto obj = Napi::Object::New(env);
-          obj.Set("token", Napi::String::New(env, data->token));
-          if (!data->content.empty()) {
-            obj.Set("content", Napi::String::New(env, data->content));
-          }
-          if (!data->reasoning_content.empty()) {
-            obj.Set("reasoning_content", Napi::String::New(env, data->reasoning_content));
-          }
-          if (!data->tool_calls.empty()) {
-            Napi::Array tool_calls = Napi::Array::New(env);
-            for (size_t i = 0; i < data->tool_calls.size(); i++) {
-              const auto &tc = data->tool_calls[i];
-              Napi::Object tool_call = Napi::Object::New(env);
-              tool_call.Set("type", "function");
-              Napi::Object function = Napi::Object::New(env);
-              function.Set("name", tc.name);
-              function.Set("arguments", tc.arguments);
-              tool_call.Set("function", function);
-              if (!tc.id.empty()) {
-                tool_call.Set("id", tc.id);
-              }
-              tool_calls.Set(i, tool_call);
-            }
-            obj.Set("tool_calls", tool_calls);
-          }
-          obj.Set("accumulated_text", Napi::String::New(env, data->accumulated_text));
-
-          // Add completion_probabilities if available
-          if (!data->completion_probabilities.empty()) {
-            obj.Set("completion_probabilities", TokenProbsToArray(env, data->ctx, data->completion_probabilities));
+        if (_stream) {
+          // Blocks while the consumer is behind, pausing only this generation.
+          if (!_stream->Push(std::move(chunk))) {
+            _interrupted = true;
           }
+          continue;
+        }
 
-          delete data;
-          jsCallback.Call({obj});
+        _tsfn.BlockingCall(chunk.release(),
+                           [](Napi::Env env, Napi::Function jsCallback,
+                              TokenStreamChunk *data) {
+          TokenStreamChunkPtr chunk(data);
+          jsCallback.Call({chunk->ToValue(env)});
         });
       }
     }
@@ -448,12 +523,22 @@ void LlamaCompletionWorker::OnOK() {
   timingsResult.Set("predicted_per_second",
                     Napi::Number::New(Napi::AsyncWorker::Env(),
                                       predicted_per_second));
+  if (_wake_ms > 0) {
+    timingsResult.Set("wake_ms", Napi::Number::New(Napi::AsyncWorker::Env(),
+                                                   _wake_ms));
+  }
 
   result.Set("timings", timingsResult);
 
+  if (_stream) {
+    _stream->Finish();
+  }
   Napi::Promise::Deferred::Resolve(result);
 }
 
 void LlamaCompletionWorker::OnError(const Napi::Error &err) {
+  if (_stream) {
+    _stream->Finish();
+  }
   Napi::Promise::Deferred::Reject(err.Value());
 }
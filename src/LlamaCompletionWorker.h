@@ -1,11 +1,22 @@
 #pragma once
 
 #include "common.hpp"
+#include "CheckpointCache.h"
+#include "MediaCache.h"
+#include "MediaInput.h"
+#include "PrefixCache.h"
+#include "SessionState.h"
+#include "TokenStream.h"
 #include "rn-llama/rn-llama.h"
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <napi.h>
 
+// Converts parsed tool calls to the OpenAI-style array used in results
+Napi::Array ToolCallsToArray(Napi::Env env,
+                             const std::vector<common_chat_tool_call> &calls);
+
 struct CompletionResult {
   std::string text = "";
   bool truncated = false;
@@ -24,9 +35,10 @@ public:
                         const std::string &generation_prompt,
                         std::string reasoning_format,
                         const std::string &chat_parser = "",
-                        const std::vector<std::string> &media_paths = {},
+                        std::vector<MediaInput> media_paths = {},
                         bool has_vocoder = false,
-                        const std::string &prefill_text = "");
+                        const std::string &prefill_text = "",
+                        std::shared_ptr<TokenRingBuffer> stream = nullptr);
 
   ~LlamaCompletionWorker();
 
@@ -34,7 +46,44 @@ public:
 
   void OnComplete(std::function<void()> cb) { _onComplete = cb; }
 
-  void SetStop() { _interrupted = true; }
+  // Evaluate media chunks through PrefillMedia before loadPrompt, encoding
+  // them in the background when `async_encode`. Encoder outputs are looked
+  // up in / stored to `cache` when it is set.
+  void SetMediaPrefill(std::shared_ptr<MediaEmbeddingCache> cache,
+                       const std::string &key_prefix, bool async_encode) {
+    _media_prefill = true;
+    _media_cache = std::move(cache);
+    _media_cache_key = key_prefix;
+    _async_media_encode = async_encode;
+  }
+
+  // Resume text prompts from the longest prefix in `cache` and store shared
+  // prefixes to it before loadPrompt
+  void SetPrefixCache(std::shared_ptr<PrefixCache> cache) {
+    _prefix_cache = std::move(cache);
+  }
+
+  // Same for recurrent/hybrid models, restoring and taking checkpoints
+  // through `cache`
+  void SetCheckpointCache(std::shared_ptr<CheckpointCache> cache) {
+    _checkpoint_cache = std::move(cache);
+  }
+
+  // Time the call spent waking a hibernated context; reported as
+  // timings.wake_ms when non-zero
+  void SetWakeTime(double ms) { _wake_ms = ms; }
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+  void SetStop() {
+    _interrupted = true;
+    if (_stream) {
+      _stream->Abort();
+    }
+  }
 
 protected:
   void Execute() override;
@@ -50,12 +99,22 @@ private:
   std::string _generation_prompt;
   std::string _reasoning_format;
   std::string _chat_parser;
+  std::vector<MediaInput> _media;
   std::vector<std::string> _media_paths;
+  bool _media_prefill = false;
+  std::shared_ptr<MediaEmbeddingCache> _media_cache;
+  std::string _media_cache_key;
+  bool _async_media_encode = false;
+  std::shared_ptr<PrefixCache> _prefix_cache;
+  std::shared_ptr<CheckpointCache> _checkpoint_cache;
+  std::shared_ptr<ContextGate> _gate;
+  double _wake_ms = 0;
   std::string _prefill_text;
   std::function<void()> _onComplete;
   bool _has_callback = false;
   bool _interrupted = false;
   Napi::ThreadSafeFunction _tsfn;
+  std::shared_ptr<TokenRingBuffer> _stream;
   bool _has_vocoder;
   size_t _sent_token_probs_index = 0;
   struct {
@@ -1,13 +1,23 @@
 #include "LlamaContext.h"
 #include "DisposeWorker.h"
+#include "EmbeddingBatchWorker.h"
+#include "EmbeddingChunksWorker.h"
 #include "EmbeddingWorker.h"
+#include "ForkWorker.h"
+#include "HibernateWorker.h"
 #include "RerankWorker.h"
+#include "TokenEmbeddingWorker.h"
 #include "LlamaCompletionWorker.h"
 #include "LoadSessionWorker.h"
 #include "SaveSessionWorker.h"
+#include "SessionState.h"
 #include "TokenizeWorker.h"
+#include "TokenizeBatchWorker.h"
 #include "DetokenizeWorker.h"
 #include "DecodeAudioTokenWorker.h"
+#include "MediaInput.h"
+#include "TokenStream.h"
+#include "VectorIndex.h"
 #include "ggml.h"
 #include "gguf.h"
 #include "chat.h"
@@ -16,9 +26,13 @@
 #include "llama-impl.h"
 
 #include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <list>
 #include <mutex>
 #include <queue>
+#include <random>
 
 using namespace rnllama;
 
@@ -133,47 +147,86 @@ void LlamaContext::Init(Napi::Env env, Napi::Object &exports) {
        InstanceMethod<&LlamaContext::GetFormattedChat>(
            "getFormattedChat",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::Completion>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::Completion>>(
            "completion",
            static_cast<napi_property_attributes>(napi_enumerable)),
        InstanceMethod<&LlamaContext::StopCompletion>(
            "stopCompletion",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::Tokenize>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::Fork>>(
+           "fork", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::Tokenize>>(
            "tokenize", static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::Detokenize>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::TokenizeBatch>>(
+           "tokenizeBatch",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::CountTokens>>(
+           "countTokens",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::Detokenize>>(
            "detokenize",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::Embedding>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::Embedding>>(
            "embedding", static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::Rerank>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::EmbeddingBatch>>(
+           "embeddingBatch",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::EmbeddingChunks>>(
+           "embeddingChunks",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::EmbeddingTokens>>(
+           "embeddingTokens",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::MaxSim>>(
+           "maxSim", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::GetEmbeddingCacheStats>(
+           "getEmbeddingCacheStats",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::ClearEmbeddingCache>(
+           "clearEmbeddingCache",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::SaveEmbeddingCache>(
+           "saveEmbeddingCache",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::Rerank>>(
            "rerank", static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::SaveSession>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::SaveSession>>(
            "saveSession",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::LoadSession>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::LoadSession>>(
            "loadSession",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::ApplyLoraAdapters>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::GetSessionState>>(
+           "getSessionState",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::SetSessionState>>(
+           "setSessionState",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::AwakeVoid<&LlamaContext::ApplyLoraAdapters>>(
            "applyLoraAdapters",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::RemoveLoraAdapters>(
+       InstanceMethod<&LlamaContext::AwakeVoid<&LlamaContext::RemoveLoraAdapters>>(
            "removeLoraAdapters",
            static_cast<napi_property_attributes>(napi_enumerable)),
        InstanceMethod<&LlamaContext::GetLoadedLoraAdapters>(
            "getLoadedLoraAdapters",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::InitMultimodal>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::InitMultimodal>>(
            "initMultimodal",
            static_cast<napi_property_attributes>(napi_enumerable)),
        InstanceMethod<&LlamaContext::IsMultimodalEnabled>(
            "isMultimodalEnabled",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::ReleaseMultimodal>(
+       InstanceMethod<&LlamaContext::IfAwake<&LlamaContext::ReleaseMultimodal>>(
            "releaseMultimodal",
            static_cast<napi_property_attributes>(napi_enumerable)),
        InstanceMethod<&LlamaContext::Release>(
            "release", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Hibernate>(
+           "hibernate",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Wake>(
+           "wake", static_cast<napi_property_attributes>(napi_enumerable)),
        StaticMethod<&LlamaContext::ModelInfo>(
            "loadModelInfo",
            static_cast<napi_property_attributes>(napi_enumerable)),
@@ -186,10 +239,10 @@ void LlamaContext::Init(Napi::Env env, Napi::Object &exports) {
        InstanceMethod<&LlamaContext::GetMultimodalSupport>(
            "getMultimodalSupport",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::InitVocoder>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::InitVocoder>>(
            "initVocoder",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::ReleaseVocoder>(
+       InstanceMethod<&LlamaContext::IfAwake<&LlamaContext::ReleaseVocoder>>(
            "releaseVocoder",
            static_cast<napi_property_attributes>(napi_enumerable)),
        InstanceMethod<&LlamaContext::IsVocoderEnabled>(
@@ -204,59 +257,75 @@ void LlamaContext::Init(Napi::Env env, Napi::Object &exports) {
        InstanceMethod<&LlamaContext::GetAudioSampleRate>(
            "getAudioSampleRate",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::CreateSpeaker>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::CreateSpeaker>>(
            "createSpeaker",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::BakeSpeaker>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::BakeSpeaker>>(
            "bakeSpeaker",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::ReleaseSpeaker>(
+       InstanceMethod<&LlamaContext::IfAwake<&LlamaContext::ReleaseSpeaker>>(
            "releaseSpeaker",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::DecodeAudioTokens>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::DecodeAudioTokens>>(
            "decodeAudioTokens",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::DecodeAudioEmbeddings>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::DecodeAudioEmbeddings>>(
            "decodeAudioEmbeddings",
            static_cast<napi_property_attributes>(napi_enumerable)),
        // Parallel decoding methods
-       InstanceMethod<&LlamaContext::EnableParallelMode>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::EnableParallelMode>>(
            "enableParallelMode",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::DisableParallelMode>(
+       InstanceMethod<&LlamaContext::IfAwake<&LlamaContext::DisableParallelMode>>(
            "disableParallelMode",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::QueueCompletion>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::QueueCompletion>>(
            "queueCompletion",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::QueueEmbedding>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::QueueMediaCompletion>>(
+           "queueMediaCompletion",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::QueueEmbedding>>(
            "queueEmbedding",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::QueueRerank>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::QueueRerank>>(
            "queueRerank",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::CancelRequest>(
+       InstanceMethod<&LlamaContext::IfAwake<&LlamaContext::CancelRequest>>(
            "cancelRequest",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::GetParallelStatus>(
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::GetSequenceState>>(
+           "getSequenceState",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::SaveSequenceState>>(
+           "saveSequenceState",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::GetParallelStatus>>(
            "getParallelStatus",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::SubscribeParallelStatus>(
+       InstanceMethod<&LlamaContext::AwakeSync<&LlamaContext::SubscribeParallelStatus>>(
            "subscribeParallelStatus",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::UnsubscribeParallelStatus>(
+       InstanceMethod<&LlamaContext::IfAwake<&LlamaContext::UnsubscribeParallelStatus>>(
            "unsubscribeParallelStatus",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::ClearCache>(
+       InstanceMethod<&LlamaContext::AwakeVoid<&LlamaContext::ClearCache>>(
            "clearCache",
            static_cast<napi_property_attributes>(napi_enumerable)),
-       InstanceMethod<&LlamaContext::Bench>(
+       InstanceMethod<&LlamaContext::GetMediaCacheStats>(
+           "getMediaCacheStats",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::ClearMediaCache>(
+           "clearMediaCache",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::GetStateCacheStats>(
+           "getStateCacheStats",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaContext::Awake<&LlamaContext::Bench>>(
            "bench",
            static_cast<napi_property_attributes>(napi_enumerable))});
-  Napi::FunctionReference *constructor = new Napi::FunctionReference();
-  *constructor = Napi::Persistent(func);
 #if NAPI_VERSION > 5
-  env.SetInstanceData(constructor);
+  env.GetInstanceData<AddonData>()->llama_context = Napi::Persistent(func);
 #endif
   exports.Set("LlamaContext", func);
 }
@@ -505,15 +574,107 @@ LlamaContext::LlamaContext(const Napi::CallbackInfo &info)
     _rn_ctx->applyLoraAdapters(lora);
   }
 
+  // Byte budget for cached embedding results (0 disables), warmed from
+  // embedding_cache_path when it holds a cache for this model
+  const double embedding_cache_size =
+      get_option<double>(options, "embedding_cache_size", 0);
+  if (_rn_ctx && embedding_cache_size > 0) {
+    _embedding_cache = std::make_shared<EmbeddingCache>(
+        static_cast<size_t>(embedding_cache_size));
+    _embedding_cache_fingerprint =
+        EmbeddingCacheFingerprint(_rn_ctx->model, _rn_ctx->params.model.path);
+    _embedding_cache_path =
+        get_option<std::string>(options, "embedding_cache_path", "");
+    if (!_embedding_cache_path.empty()) {
+      LoadEmbeddingCache(*_embedding_cache, _embedding_cache_path,
+                         _embedding_cache_fingerprint);
+    }
+  }
+
+  // Prompt-prefix state shared through a directory, e.g. by every process
+  // serving this model on a host
+  _prefix_cache_dir = get_option<std::string>(options, "prefix_cache_dir", "");
+  _prefix_cache_block_size = static_cast<size_t>(std::max<int32_t>(
+      get_option<int32_t>(options, "prefix_cache_block_size", 256), 1));
+
+  // Recurrent/hybrid checkpoints spilled to disk beyond the in-memory
+  // state cache budget
+  _checkpoint_cache_dir = get_option<std::string>(options, "state_cache_dir", "");
+  _checkpoint_interval = static_cast<size_t>(std::max<int32_t>(
+      get_option<int32_t>(options, "state_cache_interval", 512), 1));
+  _checkpoint_budget = static_cast<size_t>(std::max<int32_t>(
+                           get_option<int32_t>(options,
+                                               "state_cache_disk_budget_mb",
+                                               4096),
+                           0)) *
+                       1024 * 1024;
+  // Test-only: checkpoint attention models too, so the disk tier can be
+  // exercised with a small attention fixture
+  const char *checkpoint_force = std::getenv("LLAMA_NODE_STATE_CACHE_FORCE");
+  _checkpoint_force = checkpoint_force != nullptr &&
+                      std::string(checkpoint_force) == "1";
+
+  // Idle contexts free their KV and compute buffers, keeping the state on
+  // disk until the next call
+  _hibernate_after_ms =
+      std::max(get_option<double>(options, "hibernate_after_ms", 0), 0.0);
+  _hibernate_dir = get_option<std::string>(options, "hibernate_dir", "");
+
   _info = common_params_get_system_info(params);
 }
 
+std::shared_ptr<PrefixCache> LlamaContext::GetPrefixCache() {
+  if (_prefix_cache_dir.empty() || !_rn_ctx || !_rn_ctx->ctx ||
+      !PrefixCacheSupported(_rn_ctx)) {
+    return nullptr;
+  }
+  const uint64_t fingerprint = PrefixCache::Fingerprint(_rn_ctx);
+  if (!_prefix_cache || _prefix_cache->fingerprint() != fingerprint) {
+    _prefix_cache = std::make_shared<PrefixCache>(
+        _prefix_cache_dir, fingerprint, _prefix_cache_block_size);
+  }
+  return _prefix_cache;
+}
+
+std::shared_ptr<CheckpointCache> LlamaContext::GetCheckpointCache() {
+  if (_checkpoint_cache_dir.empty() || _checkpoint_budget == 0 || !_rn_ctx ||
+      !_rn_ctx->ctx ||
+      !(_checkpoint_force || CheckpointCacheSupported(_rn_ctx))) {
+    return nullptr;
+  }
+  const uint64_t fingerprint = PrefixCache::Fingerprint(_rn_ctx);
+  if (!_checkpoint_cache || _checkpoint_cache->fingerprint() != fingerprint) {
+    _checkpoint_cache = std::make_shared<CheckpointCache>(
+        _checkpoint_cache_dir, fingerprint, _checkpoint_interval,
+        _checkpoint_budget);
+  }
+  return _checkpoint_cache;
+}
+
+std::shared_ptr<MediaPrefillContext> LlamaContext::GetMediaPrefill() {
+  if (!_rn_ctx || !_rn_ctx->parallel_mode_enabled ||
+      _rn_ctx->mtmd_wrapper == nullptr) {
+    return nullptr;
+  }
+  if (!_media_prefill) {
+    _media_prefill =
+        std::make_shared<MediaPrefillContext>(_rn_ctx, _slot_loop_pause);
+  }
+  return _media_prefill;
+}
+
 LlamaContext::~LlamaContext() {
   // Invalidate the context to prevent use-after-free in async callbacks
   if (_context_valid) {
     _context_valid->store(false);
   }
 
+  if (_hibernation) {
+    // Opens once the state is written and any wake stops reading it
+    _context_gate->Wait();
+    std::remove(_hibernation->path.c_str());
+  }
+
   // Interrupt model loading if in progress
   if (_rn_ctx) {
     _rn_ctx->is_load_interrupted = true;
@@ -523,7 +684,7 @@ LlamaContext::~LlamaContext() {
   // If _rn_ctx is still not null here, it means disposal was not properly initiated
   if (_rn_ctx) {
     try {
-      delete _rn_ctx;
+      DeleteContext(_rn_ctx);
       _rn_ctx = nullptr;
     } catch (...) {
       // Ignore errors during cleanup to avoid crashes in destructor
@@ -633,6 +794,7 @@ Napi::Value LlamaContext::GetModelInfo(const Napi::CallbackInfo &info) {
   if (!_rn_ctx || !_rn_ctx->model) {
     Napi::TypeError::New(info.Env(), "Model not loaded")
         .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
   }
   char desc[1024];
   auto model = _rn_ctx->model;
@@ -839,20 +1001,20 @@ Napi::Value LlamaContext::GetFormattedChat(const Napi::CallbackInfo &info) {
 }
 
 // completion(options: LlamaCompletionOptions, onToken?: (token: string) =>
-// void): Promise<LlamaCompletionResult>
+// void, stream?: LlamaTokenStream): Promise<LlamaCompletionResult>
 Napi::Value LlamaContext::Completion(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   if (info.Length() < 1 || !info[0].IsObject()) {
     Napi::TypeError::New(env, "Object expected").ThrowAsJavaScriptException();
   }
-  if (info.Length() >= 2 && !info[1].IsFunction()) {
+  if (info.Length() >= 2 && !is_nil(info[1]) && !info[1].IsFunction()) {
     Napi::TypeError::New(env, "Function expected").ThrowAsJavaScriptException();
   }
   if (!_rn_ctx) {
     Napi::TypeError::New(env, "Context is disposed")
         .ThrowAsJavaScriptException();
   }
-  if (_wip != nullptr) {
+  if (_wip != nullptr || _fork != nullptr) {
     Napi::TypeError::New(env, "Another completion is in progress")
         .ThrowAsJavaScriptException();
   }
@@ -866,17 +1028,13 @@ Napi::Value LlamaContext::Completion(const Napi::CallbackInfo &info) {
     }
   }
 
-  // Process media_paths parameter
-  std::vector<std::string> media_paths;
-  if (options.Has("media_paths")) {
-    if (options.Get("media_paths").IsArray()) {
-      auto media_paths_array = options.Get("media_paths").As<Napi::Array>();
-      for (size_t i = 0; i < media_paths_array.Length(); i++) {
-        media_paths.push_back(media_paths_array.Get(i).ToString().Utf8Value());
-      }
-    } else if (options.Get("media_paths").IsString()) {
-      media_paths.push_back(options.Get("media_paths").ToString().Utf8Value());
-    }
+  // Process media_paths parameter (paths, data URLs or Buffers)
+  std::vector<MediaInput> media_paths;
+  std::string media_error;
+  if (options.Has("media_paths") &&
+      !ParseMediaInputs(options.Get("media_paths"), media_paths, media_error)) {
+    Napi::TypeError::New(env, media_error).ThrowAsJavaScriptException();
+    return env.Undefined();
   }
 
   // Check if multimodal is enabled when media_paths are provided
@@ -1102,43 +1260,7 @@ Napi::Value LlamaContext::Completion(const Napi::CallbackInfo &info) {
 
   std::string prefill_text = get_option<std::string>(options, "prefill_text", "");
 
-  params.n_predict = get_option<int32_t>(options, "n_predict", -1);
-  params.sampling.temp = get_option<float>(options, "temperature", 0.80f);
-  params.sampling.top_k = get_option<int32_t>(options, "top_k", 40);
-  params.sampling.top_p = get_option<float>(options, "top_p", 0.95f);
-  params.sampling.min_p = get_option<float>(options, "min_p", 0.05f);
-  params.sampling.mirostat = get_option<int32_t>(options, "mirostat", 0.00f);
-  params.sampling.mirostat_tau =
-      get_option<float>(options, "mirostat_tau", 5.00f);
-  params.sampling.mirostat_eta =
-      get_option<float>(options, "mirostat_eta", 0.10f);
-  params.sampling.penalty_last_n =
-      get_option<int32_t>(options, "penalty_last_n", 64);
-  params.sampling.penalty_repeat =
-      get_option<float>(options, "penalty_repeat", 1.00f);
-  params.sampling.penalty_freq =
-      get_option<float>(options, "penalty_freq", 0.00f);
-  params.sampling.penalty_present =
-      get_option<float>(options, "penalty_present", 0.00f);
-  params.sampling.typ_p = get_option<float>(options, "typical_p", 1.00f);
-  params.sampling.xtc_threshold =
-      get_option<float>(options, "xtc_threshold", 0.00f);
-  params.sampling.xtc_probability =
-      get_option<float>(options, "xtc_probability", 0.10f);
-  params.sampling.dry_multiplier =
-      get_option<float>(options, "dry_multiplier", 1.75f);
-  params.sampling.dry_base = get_option<float>(options, "dry_base", 2);
-  params.sampling.dry_allowed_length =
-      get_option<float>(options, "dry_allowed_length", -1);
-  params.sampling.dry_penalty_last_n =
-      get_option<float>(options, "dry_penalty_last_n", 0);
-  params.sampling.top_n_sigma =
-      get_option<float>(options, "top_n_sigma", -1.0f);
-  params.sampling.ignore_eos = get_option<bool>(options, "ignore_eos", false);
-  params.n_keep = get_option<int32_t>(options, "n_keep", 0);
-  params.sampling.seed =
-      get_option<int32_t>(options, "seed", LLAMA_DEFAULT_SEED);
-  params.sampling.n_probs = get_option<int32_t>(options, "n_probs", 0);
+  apply_sampling_options(options, params);
 
   // Output token embeddings during generation (TTS continuous-latent /
   // embedding-driven flows).
@@ -1152,14 +1274,46 @@ Napi::Value LlamaContext::Completion(const Napi::CallbackInfo &info) {
   }
 
   Napi::Function callback;
-  if (info.Length() >= 2) {
+  if (info.Length() >= 2 && info[1].IsFunction()) {
     callback = info[1].As<Napi::Function>();
   }
 
+  // Tokens go to the stream instead of the callback when one is given.
+  std::shared_ptr<TokenRingBuffer> stream;
+  if (info.Length() >= 3 && !is_nil(info[2])) {
+    stream = LlamaTokenStream::FromValue(info[2]);
+    if (!stream) {
+      Napi::TypeError::New(env, "LlamaTokenStream expected")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // Text prompts resume from / populate the on-disk prefix cache
+  std::shared_ptr<PrefixCache> prefix_cache;
+  std::shared_ptr<CheckpointCache> checkpoint_cache;
+  if (media_paths.empty() && !embedding_mode &&
+      _rn_ctx->tts_wrapper == nullptr) {
+    prefix_cache = GetPrefixCache();
+    checkpoint_cache = GetCheckpointCache();
+  }
+
   auto *worker =
       new LlamaCompletionWorker(info, _rn_ctx, callback, params, stop_words,
-                                chat_format, generation_prompt, reasoning_format, chat_parser, media_paths,
-                                _rn_ctx->has_vocoder, prefill_text);
+                                chat_format, generation_prompt, reasoning_format, chat_parser, std::move(media_paths),
+                                _rn_ctx->has_vocoder, prefill_text, stream);
+  if (_media_cache || _async_media_encode) {
+    worker->SetMediaPrefill(_media_cache, _media_cache_key,
+                            _async_media_encode);
+  }
+  if (prefix_cache) {
+    worker->SetPrefixCache(std::move(prefix_cache));
+  }
+  if (checkpoint_cache) {
+    worker->SetCheckpointCache(std::move(checkpoint_cache));
+  }
+  worker->SetWakeTime(_wake_ms);
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   _wip = worker;
   worker->OnComplete([this]() { _wip = nullptr; });
@@ -1171,9 +1325,86 @@ void LlamaContext::StopCompletion(const Napi::CallbackInfo &info) {
   if (_wip != nullptr) {
     _wip->SetStop();
   }
+  if (_fork != nullptr) {
+    _fork->SetStop();
+  }
+}
+
+// fork(n: number, options: LlamaForkOptions): Promise<LlamaForkResult>
+Napi::Value LlamaContext::Fork(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsObject()) {
+    Napi::TypeError::New(env, "Number and object expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (_wip != nullptr || _fork != nullptr) {
+    Napi::TypeError::New(env, "Another completion is in progress")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (_rn_ctx->slot_manager != nullptr) {
+    Napi::TypeError::New(env, "fork is not available in parallel mode")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto options = info[1].As<Napi::Object>();
+
+  ForkOptions fork_options;
+  fork_options.n_branches = info[0].ToNumber().Int32Value();
+  const int32_t n_seq_max = llama_n_seq_max(_rn_ctx->ctx);
+  if (fork_options.n_branches < 1 || fork_options.n_branches > n_seq_max) {
+    Napi::TypeError::New(
+        env, format_string("fork needs 1 to %d branches; load the context "
+                           "with n_parallel >= n for more",
+                           n_seq_max))
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  fork_options.keep_branches = get_option<int32_t>(options, "keep_branches", 0);
+  fork_options.prune_interval =
+      get_option<int32_t>(options, "prune_interval", 16);
+  if (options.Has("stop") && options.Get("stop").IsArray()) {
+    auto stop_words_array = options.Get("stop").As<Napi::Array>();
+    for (size_t i = 0; i < stop_words_array.Length(); i++) {
+      fork_options.stop_words.push_back(
+          stop_words_array.Get(i).ToString().Utf8Value());
+    }
+  }
+
+  common_params params = _rn_ctx->params;
+  params.prompt = get_option<std::string>(options, "prompt", "");
+  if (params.prompt.empty()) {
+    Napi::TypeError::New(env, "Prompt is required")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  params.sampling.grammar = {};
+  params.sampling.generation_prompt.clear();
+  params.sampling.grammar_triggers.clear();
+  params.sampling.preserved_tokens.clear();
+  auto grammar = get_option<std::string>(options, "grammar", "");
+  if (!grammar.empty()) {
+    params.sampling.grammar = {COMMON_GRAMMAR_TYPE_USER, grammar};
+  }
+  reset_reasoning_budget(params.sampling);
+  apply_sampling_options(options, params);
+
+  auto *worker =
+      new ForkWorker(info, _rn_ctx, std::move(params), std::move(fork_options));
+  worker->SetContextGate(_context_gate);
+  worker->Queue();
+  _fork = worker;
+  worker->OnComplete([this]() { _fork = nullptr; });
+  return worker->Promise();
 }
 
-// tokenize(text: string, ): Promise<TokenizeResult>
+// tokenize(text: string, media_paths?: Array<string | Uint8Array>): Promise<TokenizeResult>
 Napi::Value LlamaContext::Tokenize(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   if (info.Length() < 1 || !info[0].IsString()) {
@@ -1184,17 +1415,87 @@ Napi::Value LlamaContext::Tokenize(const Napi::CallbackInfo &info) {
         .ThrowAsJavaScriptException();
   }
   auto text = info[0].ToString().Utf8Value();
-  std::vector<std::string> media_paths;
+  std::vector<MediaInput> media_paths;
 
   if (info.Length() >= 2 && info[1].IsArray()) {
     // Direct array format: tokenize(text, [media_paths])
-    auto media_paths_array = info[1].As<Napi::Array>();
-    for (size_t i = 0; i < media_paths_array.Length(); i++) {
-      media_paths.push_back(media_paths_array.Get(i).ToString().Utf8Value());
+    std::string media_error;
+    if (!ParseMediaInputs(info[1], media_paths, media_error)) {
+      Napi::TypeError::New(env, media_error).ThrowAsJavaScriptException();
+      return env.Undefined();
     }
   }
 
   auto *worker = new TokenizeWorker(info, _rn_ctx, text, media_paths);
+  worker->SetContextGate(_context_gate);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// Reads (texts: string[], options?: { add_special?, parse_special? })
+static bool ParseTokenizeBatchArgs(const Napi::CallbackInfo &info,
+                                   std::vector<std::string> &texts,
+                                   TokenizeOptions &options) {
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    return false;
+  }
+  auto array = info[0].As<Napi::Array>();
+  texts.reserve(array.Length());
+  for (size_t i = 0; i < array.Length(); i++) {
+    texts.push_back(array.Get(i).ToString().Utf8Value());
+  }
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    auto params = info[1].As<Napi::Object>();
+    options.add_special = get_option<bool>(params, "add_special", false);
+    options.parse_special = get_option<bool>(params, "parse_special", false);
+  }
+  return true;
+}
+
+// tokenizeBatch(texts: string[], options?: { add_special?, parse_special? }):
+//   Promise<{ tokens: Int32Array, offsets: Uint32Array }>
+Napi::Value LlamaContext::TokenizeBatch(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  std::vector<std::string> texts;
+  TokenizeOptions options;
+  if (!ParseTokenizeBatchArgs(info, texts, options)) {
+    Napi::TypeError::New(env, "Array of strings expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  options.n_threads = std::max(1, _rn_ctx->params.cpuparams.n_threads);
+  auto *worker = new TokenizeBatchWorker(
+      env, llama_model_get_vocab(_rn_ctx->model), std::move(texts), options,
+      false);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// countTokens(texts: string[], options?: { add_special?, parse_special? }):
+//   Promise<Uint32Array>
+Napi::Value LlamaContext::CountTokens(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  std::vector<std::string> texts;
+  TokenizeOptions options;
+  if (!ParseTokenizeBatchArgs(info, texts, options)) {
+    Napi::TypeError::New(env, "Array of strings expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  options.n_threads = std::max(1, _rn_ctx->params.cpuparams.n_threads);
+  auto *worker = new TokenizeBatchWorker(
+      env, llama_model_get_vocab(_rn_ctx->model), std::move(texts), options,
+      true);
   worker->Queue();
   return worker->Promise();
 }
@@ -1216,6 +1517,7 @@ Napi::Value LlamaContext::Detokenize(const Napi::CallbackInfo &info) {
   }
 
   auto *worker = new DetokenizeWorker(info, _rn_ctx, token_ids);
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   return worker->Promise();
 }
@@ -1235,16 +1537,267 @@ Napi::Value LlamaContext::Embedding(const Napi::CallbackInfo &info) {
     options = info[1].As<Napi::Object>();
   }
 
+  EmbeddingFormat format;
+  std::string error;
+  if (!ParseEmbeddingFormat(options, format, error)) {
+    Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
   common_params embdParams;
   embdParams.embedding = true;
-  embdParams.embd_normalize = get_option<int32_t>(options, "embd_normalize", 2);
+  embdParams.embd_normalize = format.embd_normalize;
   auto text = info[0].ToString().Utf8Value();
-  auto *worker = new EmbeddingWorker(info, _rn_ctx, text, embdParams);
+  auto *worker = new EmbeddingWorker(info, _rn_ctx, text, embdParams, format);
+  worker->SetCache(_embedding_cache);
+  worker->SetContextGate(_context_gate);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// embeddingBatch(texts: string[], params?: { embd_normalize?, embd_dim?, embd_quant?, max_batch_tokens?,
+//   index?: LlamaVectorIndex, ids?: number[] }):
+//   Promise<{ embeddings: Float32Array | Uint16Array | Int8Array | Uint8Array, offsets: Uint32Array, n_embd: number }>
+Napi::Value LlamaContext::EmbeddingBatch(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "Array of strings expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto texts_array = info[0].As<Napi::Array>();
+  std::vector<std::string> texts;
+  texts.reserve(texts_array.Length());
+  for (size_t i = 0; i < texts_array.Length(); i++) {
+    texts.push_back(texts_array.Get(i).ToString().Utf8Value());
+  }
+  auto options = Napi::Object::New(env);
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    options = info[1].As<Napi::Object>();
+  }
+
+  EmbeddingFormat format;
+  std::string error;
+  if (!ParseEmbeddingFormat(options, format, error)) {
+    Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  common_params embdParams;
+  embdParams.embedding = true;
+  embdParams.embd_normalize = format.embd_normalize;
+  const auto max_batch_tokens =
+      get_option<int32_t>(options, "max_batch_tokens", 0);
+  std::shared_ptr<VectorStore> index;
+  std::vector<int64_t> ids;
+  if (options.Has("index") && !is_nil(options.Get("index"))) {
+    index = LlamaVectorIndex::FromValue(options.Get("index"));
+    auto ids_value = options.Get("ids");
+    if (!index || !ids_value.IsArray() ||
+        ids_value.As<Napi::Array>().Length() != texts.size()) {
+      Napi::TypeError::New(env, "index must be a LlamaVectorIndex with one id "
+                                "per text in ids")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    auto ids_array = ids_value.As<Napi::Array>();
+    for (size_t i = 0; i < ids_array.Length(); i++) {
+      ids.push_back(ids_array.Get(i).ToNumber().Int64Value());
+    }
+  }
+  auto *worker = new EmbeddingBatchWorker(
+      info, _rn_ctx, std::move(texts), embdParams, format,
+      static_cast<size_t>(std::max<int32_t>(0, max_batch_tokens)));
+  worker->SetCache(_embedding_cache);
+  if (index) {
+    worker->SetIndex(std::move(index), std::move(ids));
+  }
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   return worker->Promise();
 }
 
-// rerank(query: string, documents: string[], params?: object): Promise<RerankResult[]>
+// embeddingChunks(text: string, params?: { embd_normalize?, embd_dim?, embd_quant?, max_batch_tokens?,
+//   chunk_tokens?, overlap_tokens?, aggregate?: 'none' | 'mean' | 'weighted' }):
+//   Promise<{ embeddings, offsets: Uint32Array, n_embd: number, chunks: Uint32Array, n_tokens: number }>
+Napi::Value LlamaContext::EmbeddingChunks(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto text = info[0].ToString().Utf8Value();
+  auto options = Napi::Object::New(env);
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    options = info[1].As<Napi::Object>();
+  }
+
+  EmbeddingFormat format;
+  std::string error;
+  if (!ParseEmbeddingFormat(options, format, error)) {
+    Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  EmbeddingChunksOptions chunk_options;
+  chunk_options.chunk_tokens = static_cast<size_t>(
+      std::max<int32_t>(0, get_option<int32_t>(options, "chunk_tokens", 0)));
+  chunk_options.overlap_tokens = static_cast<size_t>(
+      std::max<int32_t>(0, get_option<int32_t>(options, "overlap_tokens", 0)));
+  chunk_options.max_batch_tokens = static_cast<size_t>(std::max<int32_t>(
+      0, get_option<int32_t>(options, "max_batch_tokens", 0)));
+  const auto aggregate = get_option<std::string>(options, "aggregate", "none");
+  if (aggregate == "none") {
+    chunk_options.aggregate = ChunkAggregate::NONE;
+  } else if (aggregate == "mean") {
+    chunk_options.aggregate = ChunkAggregate::MEAN;
+  } else if (aggregate == "weighted") {
+    chunk_options.aggregate = ChunkAggregate::WEIGHTED;
+  } else {
+    Napi::TypeError::New(env,
+                         "aggregate must be one of 'none', 'mean', 'weighted'")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto *worker = new EmbeddingChunksWorker(info, _rn_ctx, std::move(text),
+                                           format, chunk_options);
+  worker->SetCache(_embedding_cache);
+  worker->SetContextGate(_context_gate);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// embeddingTokens(text: string, params?: { embd_normalize? }):
+//   Promise<{ embeddings: Float32Array, n_tokens: number, n_embd: number }>
+Napi::Value LlamaContext::EmbeddingTokens(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto options = Napi::Object::New(env);
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    options = info[1].As<Napi::Object>();
+  }
+  auto *worker = new TokenEmbeddingWorker(
+      info, _rn_ctx, info[0].ToString().Utf8Value(),
+      get_option<int32_t>(options, "embd_normalize", 2));
+  worker->SetContextGate(_context_gate);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// maxSim(query: Float32Array, documents: Float32Array[]): Promise<Float32Array>
+Napi::Value LlamaContext::MaxSim(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsTypedArray() || !info[1].IsArray()) {
+    Napi::TypeError::New(env, "Query Float32Array and documents array expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  const size_t n_embd = llama_model_n_embd(_rn_ctx->model);
+  // Copied so the worker never reads JS memory off the main thread
+  auto read_matrix = [&](const Napi::Value &value, std::vector<float> &out) {
+    if (!value.IsTypedArray() ||
+        value.As<Napi::TypedArray>().TypedArrayType() != napi_float32_array) {
+      return false;
+    }
+    auto array = value.As<Napi::Float32Array>();
+    if (array.ElementLength() % n_embd != 0) {
+      return false;
+    }
+    out.assign(array.Data(), array.Data() + array.ElementLength());
+    return true;
+  };
+  std::vector<float> query;
+  auto documents_array = info[1].As<Napi::Array>();
+  std::vector<std::vector<float>> documents(documents_array.Length());
+  bool valid = read_matrix(info[0], query);
+  for (size_t i = 0; valid && i < documents.size(); i++) {
+    valid = read_matrix(documents_array.Get(i), documents[i]);
+  }
+  if (!valid) {
+    Napi::TypeError::New(env, "Token matrices must be Float32Arrays of n_embd " +
+                                  std::to_string(n_embd) + " columns")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto *worker =
+      new MaxSimWorker(env, std::move(query), std::move(documents), n_embd);
+  worker->Queue();
+  return worker->Promise();
+}
+
+static Napi::Object CacheStatsToObject(Napi::Env env, const CacheStats &stats) {
+  auto result = Napi::Object::New(env);
+  result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+  result.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+  result.Set("evictions",
+             Napi::Number::New(env, static_cast<double>(stats.evictions)));
+  result.Set("entries", Napi::Number::New(env, static_cast<double>(stats.entries)));
+  result.Set("bytes", Napi::Number::New(env, static_cast<double>(stats.bytes)));
+  result.Set("budget", Napi::Number::New(env, static_cast<double>(stats.budget)));
+  return result;
+}
+
+// getEmbeddingCacheStats(): { hits, misses, evictions, entries, bytes, budget }
+Napi::Value
+LlamaContext::GetEmbeddingCacheStats(const Napi::CallbackInfo &info) {
+  CacheStats stats;
+  if (_embedding_cache) {
+    stats = _embedding_cache->Stats();
+  }
+  return CacheStatsToObject(info.Env(), stats);
+}
+
+// clearEmbeddingCache(): void
+void LlamaContext::ClearEmbeddingCache(const Napi::CallbackInfo &info) {
+  if (_embedding_cache) {
+    _embedding_cache->Clear();
+  }
+}
+
+// saveEmbeddingCache(path?: string): Promise<number>
+Napi::Value LlamaContext::SaveEmbeddingCache(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!_embedding_cache) {
+    Napi::TypeError::New(env, "Embedding cache is not enabled")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  std::string path = _embedding_cache_path;
+  if (info.Length() >= 1 && info[0].IsString()) {
+    path = info[0].ToString().Utf8Value();
+  }
+  if (path.empty()) {
+    Napi::TypeError::New(env, "Path expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto *worker = new SaveEmbeddingCacheWorker(info, _embedding_cache, path,
+                                              _embedding_cache_fingerprint);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// rerank(query: string, documents: string[], params?: { normalize?, top_k?, threshold?, max_doc_tokens?, max_batch_tokens? }): Promise<RerankResult[]>
 Napi::Value LlamaContext::Rerank(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   if (info.Length() < 2 || !info[0].IsString() || !info[1].IsArray()) {
@@ -1273,12 +1826,23 @@ Napi::Value LlamaContext::Rerank(const Napi::CallbackInfo &info) {
   rerankParams.embedding = true;
   rerankParams.embd_normalize = get_option<int32_t>(options, "normalize", -1);
 
-  auto *worker = new RerankWorker(info, _rn_ctx, query, documents, rerankParams);
+  RerankOptions rerankOptions;
+  rerankOptions.top_k = get_option<int32_t>(options, "top_k", 0);
+  rerankOptions.threshold =
+      get_option<float>(options, "threshold", rerankOptions.threshold);
+  rerankOptions.max_doc_tokens = static_cast<size_t>(
+      std::max<int32_t>(0, get_option<int32_t>(options, "max_doc_tokens", 0)));
+  rerankOptions.max_batch_tokens = static_cast<size_t>(std::max<int32_t>(
+      0, get_option<int32_t>(options, "max_batch_tokens", 0)));
+
+  auto *worker = new RerankWorker(info, _rn_ctx, query, documents, rerankParams,
+                                  rerankOptions);
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   return worker->Promise();
 }
 
-// saveSession(path: string): Promise<void> throws error
+// saveSession(path: string, options?: { compression?: 'none' | 'lz4' | 'zstd', compression_level?: number, delta?: boolean, compact_ratio?: number, snapshot?: boolean }): Promise<{ bytes_written, file_size, compacted }> throws error
 Napi::Value LlamaContext::SaveSession(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   if (info.Length() < 1 || !info[0].IsString()) {
@@ -1294,12 +1858,52 @@ Napi::Value LlamaContext::SaveSession(const Napi::CallbackInfo &info) {
         .ThrowAsJavaScriptException();
   }
 #endif
-  auto *worker = new SaveSessionWorker(info, _rn_ctx);
+  SessionSaveOptions save_options;
+  if (info.Length() > 1 && info[1].IsObject()) {
+    auto options = info[1].As<Napi::Object>();
+    const std::string name =
+        get_option<std::string>(options, "compression", "none");
+    if (!ParseSessionCodec(name, save_options.codec)) {
+      Napi::TypeError::New(env, "compression must be 'none', 'lz4' or 'zstd'")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    if (!SessionCodecAvailable(save_options.codec)) {
+      Napi::Error::New(env, "This build does not include " + name +
+                                " session compression")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    save_options.level =
+        get_option<int32_t>(options, "compression_level", save_options.level);
+    save_options.delta = get_option<bool>(options, "delta", false);
+    save_options.compact_ratio =
+        get_option<double>(options, "compact_ratio", save_options.compact_ratio);
+    save_options.snapshot = get_option<bool>(options, "snapshot", false);
+  }
+  if (save_options.delta &&
+      _rn_ctx->params.flash_attn_type == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+    // The transposed V cache changes throughout the state on every turn
+    Napi::TypeError::New(env, "delta session files need flash attention "
+                              "(flash_attn_type 'on' or 'auto')")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto *worker = new SaveSessionWorker(info, _rn_ctx, save_options);
+  if (save_options.snapshot) {
+    // Later work on the context only waits for the copy, not the write
+    auto gate = std::make_shared<ContextGate>();
+    worker->SetContextGates(_context_gate, gate);
+    _context_gate = gate;
+  } else {
+    worker->SetContextGates(_context_gate, nullptr);
+  }
   worker->Queue();
   return worker->Promise();
 }
 
 // loadSession(path: string): Promise<{ count }> throws error
+// Compressed and delta session files are detected from their header.
 Napi::Value LlamaContext::LoadSession(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   if (info.Length() < 1 || !info[0].IsString()) {
@@ -1316,6 +1920,54 @@ Napi::Value LlamaContext::LoadSession(const Napi::CallbackInfo &info) {
   }
 #endif
   auto *worker = new LoadSessionWorker(info, _rn_ctx);
+  worker->SetContextGate(_context_gate);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// getSessionState(): Promise<Buffer>
+Napi::Value LlamaContext::GetSessionState(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+#ifdef GGML_USE_VULKAN
+  if (_rn_ctx->params.n_gpu_layers > 0) {
+    Napi::TypeError::New(env, "Vulkan cannot save session")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+#endif
+  auto *worker = new GetSessionStateWorker(env, _rn_ctx);
+  worker->SetContextGate(_context_gate);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// setSessionState(state: Buffer): Promise<number>
+Napi::Value LlamaContext::SetSessionState(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsBuffer()) {
+    Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!_rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+#ifdef GGML_USE_VULKAN
+  if (_rn_ctx->params.n_gpu_layers > 0) {
+    Napi::TypeError::New(env, "Vulkan cannot load session")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+#endif
+  auto *worker = new SetSessionStateWorker(env, _rn_ctx,
+                                           info[0].As<Napi::Buffer<uint8_t>>());
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   return worker->Promise();
 }
@@ -1354,6 +2006,7 @@ LlamaContext::GetLoadedLoraAdapters(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   if (!_rn_ctx) {
     Napi::TypeError::New(env, "Context is disposed").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
   auto lora = _rn_ctx->getLoadedLoraAdapters();
   Napi::Array lora_adapters = Napi::Array::New(env, lora.size());
@@ -1372,6 +2025,9 @@ Napi::Value LlamaContext::Release(const Napi::CallbackInfo &info) {
   if (_wip != nullptr) {
     _wip->SetStop();
   }
+  if (_fork != nullptr) {
+    _fork->SetStop();
+  }
 
   // stop_processing_loop
   if (_rn_ctx && _rn_ctx->slot_manager) {
@@ -1385,10 +2041,160 @@ Napi::Value LlamaContext::Release(const Napi::CallbackInfo &info) {
   }
 
   auto *worker = new DisposeWorker(info, _rn_ctx, &_rn_ctx);
+  if (_hibernation) {
+    // The llama_context is already freed; drop its state once it is written
+    worker->SetRemoveFile(_hibernation->path);
+    _hibernation.reset();
+  }
+  // Frees its private context while the model is still loaded
+  _media_prefill.reset();
+  // Resolve once queued prefix cache writes are on disk
+  worker->SetPrefixCache(std::move(_prefix_cache));
+  worker->SetCheckpointCache(std::move(_checkpoint_cache));
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   return worker->Promise();
 }
 
+// hibernate(): Promise<number>
+// Resolves 0 once the context is hibernated, otherwise how many ms to wait
+// before trying again: it has not been idle for hibernate_after_ms, work is
+// pending, or it holds state a session file does not capture.
+Napi::Value LlamaContext::Hibernate(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  double retry_ms = 0;
+  if (_rn_ctx != nullptr && !_hibernation) {
+    const double idle_ms = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() -
+                               _activity->last_used)
+                               .count();
+    const bool busy = _wip != nullptr || _fork != nullptr ||
+                      _waking != nullptr || _activity->pending > 0;
+    const bool restorable = _rn_ctx->slot_manager == nullptr &&
+                            !_rn_ctx->isMultimodalEnabled() &&
+                            !_rn_ctx->has_vocoder &&
+                            _rn_ctx->tts_wrapper == nullptr;
+    if (busy || !restorable) {
+      retry_ms = std::max(_hibernate_after_ms, 1000.0);
+    } else if (idle_ms < _hibernate_after_ms) {
+      retry_ms = _hibernate_after_ms - idle_ms;
+    }
+  }
+  if (_rn_ctx == nullptr || _hibernation || retry_ms > 0) {
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Resolve(Napi::Number::New(env, retry_ms));
+    return deferred.Promise();
+  }
+
+  auto hibernation = std::make_unique<Hibernation>();
+  std::random_device rd;
+  char name[48];
+  snprintf(name, sizeof(name), "llama-node-%08x%08x.session", rd(), rd());
+  std::error_code ec;
+  const auto dir = _hibernate_dir.empty()
+                       ? std::filesystem::temp_directory_path(ec)
+                       : std::filesystem::path(_hibernate_dir);
+  hibernation->path = (dir / name).string();
+  hibernation->done = std::make_shared<ContextGate>();
+
+  auto *worker = new HibernateWorker(env, _rn_ctx, hibernation->path,
+                                     _context_gate, hibernation->done);
+  _context_gate = hibernation->done;
+  _hibernation = std::move(hibernation);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// wake(): Promise<number>
+// Rebuilds a hibernated context ahead of the next call. Resolves with the ms
+// the wake took, 0 when the context is awake already.
+Napi::Value LlamaContext::Wake(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  _activity->last_used = std::chrono::steady_clock::now();
+  if (!_hibernation) {
+    auto deferred = Napi::Promise::Deferred::New(env);
+    deferred.Resolve(Napi::Number::New(env, 0));
+    return deferred.Promise();
+  }
+  return TrackActivity(StartWake(env));
+}
+
+Napi::Promise LlamaContext::StartWake(Napi::Env env) {
+  if (_waking == nullptr) {
+    auto done = std::make_shared<ContextGate>();
+    auto valid = _context_valid;
+    _waking = new WakeWorker(
+        env, _rn_ctx, *_hibernation, done, [this, valid](bool woken, double) {
+          if (!valid->load()) {
+            return;
+          }
+          _waking = nullptr;
+          // Unset already when released or woken by a sync call meanwhile
+          if (woken) {
+            _hibernation.reset();
+          }
+        });
+    // Released or destroyed contexts wait for the load to finish
+    _context_gate = done;
+    _waking->Queue();
+  }
+  return _waking->AddWaiter();
+}
+
+Napi::Value LlamaContext::AfterWake(const Napi::CallbackInfo &info,
+                                    Napi::Function method) {
+  Napi::Env env = info.Env();
+  // Bound in JS so the arguments and `this` live until the wake is done
+  std::vector<napi_value> args = {info.This()};
+  for (size_t i = 0; i < info.Length(); i++) {
+    args.push_back(info[i]);
+  }
+  auto bound = std::make_shared<Napi::FunctionReference>(Napi::Persistent(
+      method.Get("bind").As<Napi::Function>().Call(method, args)
+          .As<Napi::Function>()));
+  auto call = Napi::Function::New(
+      env, [this, bound](const Napi::CallbackInfo &ci) -> Napi::Value {
+        _wake_ms = ci[0].ToNumber().DoubleValue();
+        auto result = bound->Call({});
+        _wake_ms = 0;
+        return result;
+      });
+  auto waking = StartWake(env);
+  return waking.Get("then").As<Napi::Function>().Call(waking, {call});
+}
+
+bool LlamaContext::WakeSync(Napi::Env env) {
+  _activity->last_used = std::chrono::steady_clock::now();
+  if (!_hibernation) {
+    return true;
+  }
+  // Opens once the state is written, or once the wake in flight is done
+  _context_gate->Wait();
+  if (!WakeContext(_rn_ctx, _hibernation->path)) {
+    Napi::Error::New(env, "Failed to wake hibernated context")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  _hibernation.reset();
+  return true;
+}
+
+Napi::Value LlamaContext::TrackActivity(Napi::Value result) {
+  if (!result.IsPromise()) {
+    return result;
+  }
+  auto activity = _activity;
+  activity->pending++;
+  auto settled = Napi::Function::New(
+      result.Env(), [activity](const Napi::CallbackInfo &) {
+        activity->pending--;
+        activity->last_used = std::chrono::steady_clock::now();
+      });
+  auto promise = result.As<Napi::Object>();
+  promise.Get("then").As<Napi::Function>().Call(promise, {settled, settled});
+  return result;
+}
+
 // Cleanup function for the logging system
 // This is exposed externally for module cleanup
 extern "C" void cleanup_logging() {
@@ -1399,7 +2205,7 @@ extern "C" void cleanup_logging() {
 }
 
 
-// initMultimodal(options: { path: string, use_gpu?: boolean, image_min_tokens?: number, image_max_tokens?: number }): boolean
+// initMultimodal(options: { path: string, use_gpu?: boolean, image_min_tokens?: number, image_max_tokens?: number, media_cache_size?: number, async_media_encode?: boolean }): boolean
 Napi::Value LlamaContext::InitMultimodal(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
@@ -1442,6 +2248,23 @@ Napi::Value LlamaContext::InitMultimodal(const Napi::CallbackInfo &info) {
     return Napi::Boolean::New(env, false);
   }
 
+  // Byte budget for cached media encoder outputs (0 disables)
+  const double media_cache_size =
+      get_option<double>(options, "media_cache_size", 0);
+  if (media_cache_size > 0) {
+    if (_media_cache) {
+      _media_cache->SetBudget(static_cast<size_t>(media_cache_size));
+    } else {
+      _media_cache = std::make_shared<MediaEmbeddingCache>(
+          static_cast<size_t>(media_cache_size));
+    }
+  } else {
+    _media_cache.reset();
+  }
+  _media_cache_key = mmproj_path + "|" + std::to_string(image_min_tokens) +
+                     "|" + std::to_string(image_max_tokens);
+  _async_media_encode = get_option<bool>(options, "async_media_encode", false);
+
   console_log(env, "Multimodal context initialized successfully with mmproj: " +
                        mmproj_path);
   return Napi::Boolean::New(env, true);
@@ -1449,7 +2272,9 @@ Napi::Value LlamaContext::InitMultimodal(const Napi::CallbackInfo &info) {
 
 // isMultimodalEnabled(): boolean
 Napi::Value LlamaContext::IsMultimodalEnabled(const Napi::CallbackInfo &info) {
-  return Napi::Boolean::New(info.Env(), _rn_ctx->isMultimodalEnabled());
+  // Hibernated contexts never have a projector loaded
+  return Napi::Boolean::New(info.Env(),
+                            _rn_ctx && _rn_ctx->isMultimodalEnabled());
 }
 
 // getMultimodalSupport(): Promise<{ vision: boolean, audio: boolean }>
@@ -1457,7 +2282,7 @@ Napi::Value LlamaContext::GetMultimodalSupport(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   auto result = Napi::Object::New(env);
 
-  if (_rn_ctx->isMultimodalEnabled()) {
+  if (_rn_ctx && _rn_ctx->isMultimodalEnabled()) {
     result.Set("vision",
                Napi::Boolean::New(env, _rn_ctx->isMultimodalSupportVision()));
     result.Set("audio", Napi::Boolean::New(env, _rn_ctx->isMultimodalSupportAudio()));
@@ -1471,7 +2296,49 @@ Napi::Value LlamaContext::GetMultimodalSupport(const Napi::CallbackInfo &info) {
 
 // releaseMultimodal(): void
 void LlamaContext::ReleaseMultimodal(const Napi::CallbackInfo &info) {
+  _media_prefill.reset();
   _rn_ctx->releaseMultimodal();
+  if (_media_cache) {
+    _media_cache->Clear();
+  }
+}
+
+// getMediaCacheStats(): { hits, misses, evictions, entries, bytes, budget }
+Napi::Value LlamaContext::GetMediaCacheStats(const Napi::CallbackInfo &info) {
+  MediaCacheStats stats;
+  if (_media_cache) {
+    stats = _media_cache->Stats();
+  }
+  return CacheStatsToObject(info.Env(), stats);
+}
+
+// clearMediaCache(): void
+void LlamaContext::ClearMediaCache(const Napi::CallbackInfo &info) {
+  if (_media_cache) {
+    _media_cache->Clear();
+  }
+}
+
+// getStateCacheStats(): { hits, misses, stores, evictions, entries, bytes,
+//                         budget, restore_ms }
+Napi::Value LlamaContext::GetStateCacheStats(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  CheckpointCacheStats stats;
+  stats.budget = _checkpoint_budget;
+  if (_checkpoint_cache) {
+    stats = _checkpoint_cache->Stats();
+  }
+  CacheStats counters;
+  counters.hits = stats.hits;
+  counters.misses = stats.misses;
+  counters.evictions = stats.evictions;
+  counters.entries = stats.entries;
+  counters.bytes = stats.bytes;
+  counters.budget = stats.budget;
+  auto result = CacheStatsToObject(env, counters);
+  result.Set("stores", Napi::Number::New(env, static_cast<double>(stats.stores)));
+  result.Set("restore_ms", Napi::Number::New(env, stats.restore_ms));
+  return result;
 }
 
 rnllama::tts_type LlamaContext::getTTSType(Napi::Env env, nlohmann::json speaker) {
@@ -1519,7 +2386,7 @@ void LlamaContext::ReleaseVocoder(const Napi::CallbackInfo &info) {
 // isVocoderEnabled(): boolean
 Napi::Value LlamaContext::IsVocoderEnabled(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
-  return Napi::Boolean::New(env, _rn_ctx->isVocoderEnabled());
+  return Napi::Boolean::New(env, _rn_ctx && _rn_ctx->isVocoderEnabled());
 }
 
 // getFormattedAudioCompletion(speaker: string|null, text: string, speakerId?: number): object
@@ -1710,6 +2577,7 @@ Napi::Value LlamaContext::DecodeAudioTokens(const Napi::CallbackInfo &info) {
   }
 
   auto *worker = new DecodeAudioTokenWorker(info, _rn_ctx, tokens);
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   return worker->Promise();
 }
@@ -1744,6 +2612,7 @@ Napi::Value LlamaContext::DecodeAudioEmbeddings(const Napi::CallbackInfo &info)
 
   auto *worker =
       new DecodeAudioTokenWorker(info, _rn_ctx, std::move(embeddings), embedding_dim);
+  worker->SetContextGate(_context_gate);
   worker->Queue();
   return worker->Promise();
 }
@@ -1,4 +1,10 @@
 #include "common.hpp"
+#include "CheckpointCache.h"
+#include "EmbeddingCache.h"
+#include "HibernateWorker.h"
+#include "MediaCache.h"
+#include "PrefixCache.h"
+#include "SessionState.h"
 #include "tools/mtmd/clip.h"
 #include "tools/mtmd/mtmd.h"
 #include "rn-llama/rn-llama.h"
@@ -7,11 +13,13 @@
 #include "rn-llama/rn-slot.h"
 #include "rn-llama/rn-slot-manager.h"
 #include <atomic>
+#include <chrono>
 #include <memory>
 
 using namespace rnllama;
 
 class LlamaCompletionWorker;
+class ForkWorker;
 
 struct vocoder_context {
   common_params params;
@@ -35,22 +43,88 @@ private:
   Napi::Value GetFormattedChat(const Napi::CallbackInfo &info);
   Napi::Value Completion(const Napi::CallbackInfo &info);
   void StopCompletion(const Napi::CallbackInfo &info);
+  Napi::Value Fork(const Napi::CallbackInfo &info);
   Napi::Value Tokenize(const Napi::CallbackInfo &info);
+  Napi::Value TokenizeBatch(const Napi::CallbackInfo &info);
+  Napi::Value CountTokens(const Napi::CallbackInfo &info);
   Napi::Value Detokenize(const Napi::CallbackInfo &info);
   Napi::Value Embedding(const Napi::CallbackInfo &info);
+  Napi::Value EmbeddingBatch(const Napi::CallbackInfo &info);
+  Napi::Value EmbeddingChunks(const Napi::CallbackInfo &info);
+  Napi::Value EmbeddingTokens(const Napi::CallbackInfo &info);
+  Napi::Value MaxSim(const Napi::CallbackInfo &info);
+  Napi::Value GetEmbeddingCacheStats(const Napi::CallbackInfo &info);
+  void ClearEmbeddingCache(const Napi::CallbackInfo &info);
+  Napi::Value SaveEmbeddingCache(const Napi::CallbackInfo &info);
   Napi::Value Rerank(const Napi::CallbackInfo &info);
   Napi::Value SaveSession(const Napi::CallbackInfo &info);
   Napi::Value LoadSession(const Napi::CallbackInfo &info);
+  Napi::Value GetSessionState(const Napi::CallbackInfo &info);
+  Napi::Value SetSessionState(const Napi::CallbackInfo &info);
   void ApplyLoraAdapters(const Napi::CallbackInfo &info);
   void RemoveLoraAdapters(const Napi::CallbackInfo &info);
   Napi::Value GetLoadedLoraAdapters(const Napi::CallbackInfo &info);
   Napi::Value Release(const Napi::CallbackInfo &info);
+  Napi::Value Hibernate(const Napi::CallbackInfo &info);
+
+  // Every method that uses the context goes through these. Async methods
+  // called on a hibernated context run once a WakeWorker has rebuilt it, and
+  // a returned promise counts as pending work until it settles so the context
+  // never hibernates under it. Sync methods rebuild it on the JS thread, which
+  // only allocates the context since the model stays loaded, or do nothing
+  // when there is nothing to undo. Methods that only read the model or its
+  // chat templates are not wrapped.
+  template <Napi::Value (LlamaContext::*Method)(const Napi::CallbackInfo &)>
+  Napi::Value Awake(const Napi::CallbackInfo &info) {
+    _activity->last_used = std::chrono::steady_clock::now();
+    if (!_hibernation) {
+      _wake_ms = 0;
+      return TrackActivity((this->*Method)(info));
+    }
+    auto method = Napi::Function::New(
+        info.Env(), [this](const Napi::CallbackInfo &ci) -> Napi::Value {
+          return (this->*Method)(ci);
+        });
+    return TrackActivity(AfterWake(info, method));
+  }
+  template <Napi::Value (LlamaContext::*Method)(const Napi::CallbackInfo &)>
+  Napi::Value AwakeSync(const Napi::CallbackInfo &info) {
+    if (!WakeSync(info.Env())) {
+      return info.Env().Undefined();
+    }
+    return (this->*Method)(info);
+  }
+  template <void (LlamaContext::*Method)(const Napi::CallbackInfo &)>
+  void AwakeVoid(const Napi::CallbackInfo &info) {
+    if (WakeSync(info.Env())) {
+      (this->*Method)(info);
+    }
+  }
+  template <void (LlamaContext::*Method)(const Napi::CallbackInfo &)>
+  void IfAwake(const Napi::CallbackInfo &info) {
+    if (!_hibernation) {
+      (this->*Method)(info);
+    }
+  }
+  // wake(): Promise<number>
+  Napi::Value Wake(const Napi::CallbackInfo &info);
+  // Queues a WakeWorker, or joins the one in flight; resolves with its ms
+  Napi::Promise StartWake(Napi::Env env);
+  // Calls `method` with the arguments of `info` once the context is awake
+  Napi::Value AfterWake(const Napi::CallbackInfo &info, Napi::Function method);
+  // Wakes the context on the JS thread, joining a wake in flight. Throws a JS
+  // exception and returns false when the context cannot be created.
+  bool WakeSync(Napi::Env env);
+  Napi::Value TrackActivity(Napi::Value result);
 
   // Multimodal methods
   Napi::Value InitMultimodal(const Napi::CallbackInfo &info);
   Napi::Value IsMultimodalEnabled(const Napi::CallbackInfo &info);
   Napi::Value GetMultimodalSupport(const Napi::CallbackInfo &info);
   void ReleaseMultimodal(const Napi::CallbackInfo &info);
+  Napi::Value GetMediaCacheStats(const Napi::CallbackInfo &info);
+  Napi::Value GetStateCacheStats(const Napi::CallbackInfo &info);
+  void ClearMediaCache(const Napi::CallbackInfo &info);
 
   // TTS methods
   rnllama::tts_type getTTSType(Napi::Env env, nlohmann::json speaker = nullptr);
@@ -70,9 +144,12 @@ private:
   Napi::Value EnableParallelMode(const Napi::CallbackInfo &info);
   void DisableParallelMode(const Napi::CallbackInfo &info);
   Napi::Value QueueCompletion(const Napi::CallbackInfo &info);
+  Napi::Value QueueMediaCompletion(const Napi::CallbackInfo &info);
   Napi::Value QueueEmbedding(const Napi::CallbackInfo &info);
   Napi::Value QueueRerank(const Napi::CallbackInfo &info);
   void CancelRequest(const Napi::CallbackInfo &info);
+  Napi::Value GetSequenceState(const Napi::CallbackInfo &info);
+  Napi::Value SaveSequenceState(const Napi::CallbackInfo &info);
   Napi::Value GetParallelStatus(const Napi::CallbackInfo &info);
   Napi::Value SubscribeParallelStatus(const Napi::CallbackInfo &info);
   void UnsubscribeParallelStatus(const Napi::CallbackInfo &info);
@@ -87,6 +164,7 @@ private:
   std::vector<std::string> _used_devices;
   Napi::Object _meta;
   LlamaCompletionWorker *_wip = nullptr;
+  ForkWorker *_fork = nullptr;
 
   // Use rn-llama context instead of direct llama.cpp types
   llama_rn_context *_rn_ctx = nullptr;
@@ -95,6 +173,73 @@ private:
   // Shared pointer ensures callbacks can safely check if context is still alive
   std::shared_ptr<std::atomic<bool>> _context_valid;
 
+  // Embedding result cache, enabled by the embedding_cache_size option and
+  // optionally persisted to embedding_cache_path.
+  std::shared_ptr<EmbeddingCache> _embedding_cache;
+  std::string _embedding_cache_path;
+  uint64_t _embedding_cache_fingerprint = 0;
+
+  // Prompt-prefix state cache on disk, enabled by prefix_cache_dir. Created
+  // on first use and again whenever parallel mode changes the KV layout.
+  std::shared_ptr<PrefixCache> GetPrefixCache();
+  std::shared_ptr<PrefixCache> _prefix_cache;
+  std::string _prefix_cache_dir;
+  size_t _prefix_cache_block_size = 256;
+
+  // Disk tier of recurrent/hybrid state checkpoints, enabled by
+  // state_cache_dir. Created on first use like the prefix cache.
+  std::shared_ptr<CheckpointCache> GetCheckpointCache();
+  std::shared_ptr<CheckpointCache> _checkpoint_cache;
+  std::string _checkpoint_cache_dir;
+  size_t _checkpoint_interval = 512;
+  size_t _checkpoint_budget = 0;
+  bool _checkpoint_force = false;
+
+  // Closed while the latest snapshot saveSession copies the state; work on
+  // the context queued after it waits on it.
+  std::shared_ptr<ContextGate> _context_gate;
+  // Shared by every worker that stops the parallel slot loop
+  std::shared_ptr<SlotLoopPause> _slot_loop_pause =
+      std::make_shared<SlotLoopPause>();
+  // Filled by finished parallel completions for getSequenceState
+  std::shared_ptr<SlotRequestLog> _slot_requests =
+      std::make_shared<SlotRequestLog>();
+
+  // Set while the context is hibernated (hibernate_after_ms or hibernate()):
+  // _rn_ctx keeps the model but its llama_context is freed, with the state
+  // in this file. Stays set until the wake is done; _waking is the one in
+  // flight.
+  std::unique_ptr<Hibernation> _hibernation;
+  WakeWorker *_waking = nullptr;
+  // Touched on the JS thread only
+  struct Activity {
+    size_t pending = 0;
+    std::chrono::steady_clock::time_point last_used =
+        std::chrono::steady_clock::now();
+  };
+  std::shared_ptr<Activity> _activity = std::make_shared<Activity>();
+  double _hibernate_after_ms = 0;
+  std::string _hibernate_dir;
+  // Time the current call spent waking the context, reported in timings
+  double _wake_ms = 0;
+
+  // Shared by queueCompletion and queueMediaCompletion; `async` resolves the
+  // requestId through a Promise once media is evaluated off the slot loop.
+  Napi::Value QueueCompletionRequest(const Napi::CallbackInfo &info, bool async);
+  // Evaluates queued media prompts off the slot loop. Created on first use in
+  // parallel mode and dropped with it.
+  std::shared_ptr<MediaPrefillContext> GetMediaPrefill();
+  std::shared_ptr<MediaPrefillContext> _media_prefill;
+
+  // Media encoder output cache, enabled by initMultimodal's media_cache_size.
+  // The key prefix identifies the projector and its image token limits.
+  std::shared_ptr<MediaEmbeddingCache> _media_cache;
+  std::string _media_cache_key;
+  // Encode media on a background thread while the prompt text before it is
+  // decoded (initMultimodal's async_media_encode), both for completion() and
+  // for queued media prefixes evaluated off the slot loop.
+  bool _async_media_encode = false;
+
   // Progress callback support for model loading
   Napi::ThreadSafeFunction _progress_tsfn;
 };
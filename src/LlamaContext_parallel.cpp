@@ -1,6 +1,10 @@
 // Parallel decoding methods implementation for LlamaContext
 
 #include "LlamaContext.h"
+#include "LlamaCompletionWorker.h"
+#include "MediaInput.h"
+#include "SessionState.h"
+#include "TokenStream.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
 #include "rn-llama/rn-completion.h"
@@ -8,7 +12,10 @@
 #include "rn-llama/rn-slot-manager.h"
 #include "common.h"
 #include "json-schema-to-grammar.h"
+#include <algorithm>
 #include <atomic>
+#include <cstdio>
+#include <functional>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <napi.h>
@@ -52,6 +59,182 @@ struct ManagedThreadSafeFunction {
   std::atomic<bool> closed{false};
 };
 
+// Evaluates the media prefix of a queued completion off the JS thread and
+// the slot loop (MediaPrefillContext), then queues it from OnOK and resolves
+// { requestId }. Models and prompts the prefill does not cover are tokenized
+// with media paths instead, and the slot evaluates the media itself.
+class QueueMediaWorker : public Napi::AsyncWorker,
+                         public Napi::Promise::Deferred {
+public:
+  typedef std::function<int32_t(const std::vector<llama_token> &,
+                                const std::vector<std::string> &,
+                                const std::string &, size_t)>
+      QueueFn;
+
+  QueueMediaWorker(Napi::Env env, llama_rn_context *rn_ctx,
+                   std::shared_ptr<std::atomic<bool>> context_valid,
+                   std::string prompt, std::vector<MediaInput> media,
+                   QueueFn queue)
+      : AsyncWorker(env), Deferred(env), _rn_ctx(rn_ctx),
+        _context_valid(std::move(context_valid)), _prompt(std::move(prompt)),
+        _media(std::move(media)), _queue(std::move(queue)) {}
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+  // Evaluates the media prefix on `prefill` for the context's current KV
+  // layout and adapters, through the context's media encoder cache
+  void SetPrefill(std::shared_ptr<MediaPrefillContext> prefill,
+                  std::shared_ptr<MediaEmbeddingCache> cache,
+                  std::string cache_key, bool async_encode) {
+    _prefill = std::move(prefill);
+    _cache = std::move(cache);
+    _cache_key = std::move(cache_key);
+    _async_encode = async_encode;
+    _fingerprint = PrefixCache::Fingerprint(_rn_ctx);
+    _lora = _rn_ctx->getLoadedLoraAdapters();
+  }
+
+protected:
+  void Execute() override {
+    if (_gate) {
+      _gate->Wait();
+    }
+    if (!_context_valid->load()) {
+      SetError("Context was released");
+      return;
+    }
+    try {
+      if (_prefill &&
+          _prefill->Prefill(_prompt, _media, _cache.get(), _cache_key,
+                            _async_encode, _fingerprint, std::move(_lora),
+                            _prefilled)) {
+        return;
+      }
+      _media_paths = ResolveMediaPaths(_media);
+      _prefilled.tokens = _rn_ctx->tokenize(_prompt, _media_paths).tokens;
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Napi::AsyncWorker::Env();
+    if (!_context_valid->load()) {
+      RemoveState();
+      Napi::Promise::Deferred::Reject(
+          Napi::Error::New(env, "Context was released").Value());
+      return;
+    }
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("requestId",
+               Napi::Number::New(env, _queue(_prefilled.tokens, _media_paths,
+                                             _prefilled.state_path,
+                                             _prefilled.state_size)));
+    Napi::Promise::Deferred::Resolve(result);
+  }
+
+  void OnError(const Napi::Error &err) override {
+    RemoveState();
+    Napi::Promise::Deferred::Reject(err.Value());
+  }
+
+private:
+  void RemoveState() {
+    if (!_prefilled.state_path.empty()) {
+      std::remove(_prefilled.state_path.c_str());
+    }
+  }
+
+  llama_rn_context *_rn_ctx;
+  std::shared_ptr<std::atomic<bool>> _context_valid;
+  std::string _prompt;
+  std::vector<MediaInput> _media;
+  QueueFn _queue;
+  std::shared_ptr<MediaPrefillContext> _prefill;
+  std::shared_ptr<MediaEmbeddingCache> _cache;
+  std::string _cache_key;
+  bool _async_encode = false;
+  uint64_t _fingerprint = 0;
+  std::vector<common_adapter_lora_info> _lora;
+  std::vector<std::string> _media_paths;
+  PrefilledMedia _prefilled;
+  std::shared_ptr<ContextGate> _gate;
+};
+
+// Partial slot output, delivered through the queue callback or a
+// LlamaTokenStream. Pooled per request so the slot loop reuses buffers.
+struct SlotTokenChunk : public PooledTokenStreamChunk<SlotTokenChunk> {
+  completion_token_output token;
+  int32_t chat_format = 0;
+  std::string accumulated_text;
+  std::string content;
+  std::string reasoning_content;
+  std::vector<common_chat_tool_call> tool_calls;
+
+  void Reset() {
+    token.text.clear();
+    token.probs.clear();
+    accumulated_text.clear();
+    content.clear();
+    reasoning_content.clear();
+    tool_calls.clear();
+  }
+
+  Napi::Value ToValue(Napi::Env env) override {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("requestId", Napi::Number::New(env, token.request_id));
+    result.Set("token", Napi::String::New(env, token.text));
+
+    if (!token.probs.empty()) {
+      Napi::Array probs = Napi::Array::New(env);
+      for (size_t i = 0; i < token.probs.size(); i++) {
+        Napi::Object prob = Napi::Object::New(env);
+        prob.Set("tok", Napi::Number::New(env, token.probs[i].tok));
+        prob.Set("prob", Napi::Number::New(env, token.probs[i].prob));
+        probs.Set(i, prob);
+      }
+      result.Set("probs", probs);
+    }
+
+    // Add chat format metadata
+    if (chat_format > 0) {
+      result.Set("chat_format", Napi::Number::New(env, chat_format));
+
+      // Add parsed content if available
+      if (!content.empty()) {
+        result.Set("content", Napi::String::New(env, content));
+      }
+      if (!reasoning_content.empty()) {
+        result.Set("reasoning_content", Napi::String::New(env, reasoning_content));
+      }
+      if (!tool_calls.empty()) {
+        result.Set("tool_calls", ToolCallsToArray(env, tool_calls));
+      }
+    }
+    return result;
+  }
+
+  // Parsed fields are snapshots of the whole output, so the newest wins; the
+  // token text and probabilities are deltas and accumulate.
+  bool Merge(TokenStreamChunk &next) override {
+    auto *other = dynamic_cast<SlotTokenChunk *>(&next);
+    if (other == nullptr) {
+      return false;
+    }
+    token.text += other->token.text;
+    token.probs.insert(token.probs.end(), other->token.probs.begin(),
+                       other->token.probs.end());
+    accumulated_text = std::move(other->accumulated_text);
+    content = std::move(other->content);
+    reasoning_content = std::move(other->reasoning_content);
+    tool_calls = std::move(other->tool_calls);
+    return true;
+  }
+};
+
 }  // namespace
 
 // EnableParallelMode(params: { n_parallel: number, n_batch?: number }): boolean
@@ -70,6 +253,7 @@ Napi::Value LlamaContext::EnableParallelMode(const Napi::CallbackInfo &info) {
 
   try {
     _rn_ctx->enableParallelMode(n_parallel, n_batch);
+    _slot_requests->Clear();
 
     // Start the processing loop after enabling parallel mode
     if (_rn_ctx->parallel_mode_enabled && _rn_ctx->slot_manager != nullptr) {
@@ -85,13 +269,25 @@ Napi::Value LlamaContext::EnableParallelMode(const Napi::CallbackInfo &info) {
 
 // DisableParallelMode(): void
 void LlamaContext::DisableParallelMode(const Napi::CallbackInfo &info) {
+  _media_prefill.reset();
+  _slot_requests->Clear();
   if (_rn_ctx) {
     _rn_ctx->disableParallelMode();
   }
 }
 
-// QueueCompletion(params: object): { requestId: number }
+// QueueCompletion(params: object, callback?: Function, stream?: LlamaTokenStream): { requestId: number }
 Napi::Value LlamaContext::QueueCompletion(const Napi::CallbackInfo &info) {
+  return QueueCompletionRequest(info, false);
+}
+
+// QueueMediaCompletion(params: object, callback?: Function, stream?: LlamaTokenStream): Promise<{ requestId: number }>
+Napi::Value LlamaContext::QueueMediaCompletion(const Napi::CallbackInfo &info) {
+  return QueueCompletionRequest(info, true);
+}
+
+Napi::Value LlamaContext::QueueCompletionRequest(const Napi::CallbackInfo &info,
+                                                 bool async) {
   Napi::Env env = info.Env();
 
   if (!_rn_ctx) {
@@ -116,20 +312,27 @@ Napi::Value LlamaContext::QueueCompletion(const Napi::CallbackInfo &info) {
     }
   }
 
-  std::vector<std::string> media_paths;
-  if (options.Has("media_paths")) {
-    if (options.Get("media_paths").IsArray()) {
-      auto media_paths_array = options.Get("media_paths").As<Napi::Array>();
-      for (size_t i = 0; i < media_paths_array.Length(); i++) {
-        media_paths.push_back(media_paths_array.Get(i).ToString().Utf8Value());
-      }
-    } else if (options.Get("media_paths").IsString()) {
-      media_paths.push_back(options.Get("media_paths").ToString().Utf8Value());
-    }
+  // queueMediaCompletion evaluates media on a worker thread before queueing;
+  // queueCompletion hands media paths to the slot like before.
+  std::vector<MediaInput> media_inputs;
+  std::string media_error;
+  if (options.Has("media_paths") &&
+      !ParseMediaInputs(options.Get("media_paths"), media_inputs, media_error)) {
+    Napi::TypeError::New(env, media_error).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!async && std::any_of(media_inputs.begin(), media_inputs.end(),
+                            [](const MediaInput &input) {
+                              return input.data != nullptr;
+                            })) {
+    Napi::TypeError::New(env, "Buffer media_paths entries need "
+                              "queueMediaCompletion()")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
   }
 
   // Check if multimodal is enabled when media_paths are provided
-  if (!media_paths.empty() && !(_rn_ctx->has_multimodal && _rn_ctx->mtmd_wrapper != nullptr)) {
+  if (!media_inputs.empty() && !(_rn_ctx->has_multimodal && _rn_ctx->mtmd_wrapper != nullptr)) {
     Napi::Error::New(env, "Multimodal support must be enabled via "
                           "initMultimodal to use media_paths")
         .ThrowAsJavaScriptException();
@@ -153,7 +356,7 @@ Napi::Value LlamaContext::QueueCompletion(const Napi::CallbackInfo &info) {
     return env.Undefined();
   }
 
-  if (!media_paths.empty() &&
+  if (!media_inputs.empty() &&
       speculative_has_type(params.speculative, COMMON_SPECULATIVE_TYPE_DRAFT_MTP)) {
     Napi::Error::New(env, "MTP speculative decoding currently supports text-only queued completions")
         .ThrowAsJavaScriptException();
@@ -365,43 +568,7 @@ Napi::Value LlamaContext::QueueCompletion(const Napi::CallbackInfo &info) {
   int32_t save_state_size = get_option<int32_t>(options, "save_state_size", -1);
 
   // ALL Sampling parameters
-  params.n_predict = get_option<int32_t>(options, "n_predict", -1);
-  params.sampling.temp = get_option<float>(options, "temperature", 0.80f);
-  params.sampling.top_k = get_option<int32_t>(options, "top_k", 40);
-  params.sampling.top_p = get_option<float>(options, "top_p", 0.95f);
-  params.sampling.min_p = get_option<float>(options, "min_p", 0.05f);
-  params.sampling.mirostat = get_option<int32_t>(options, "mirostat", 0.00f);
-  params.sampling.mirostat_tau =
-      get_option<float>(options, "mirostat_tau", 5.00f);
-  params.sampling.mirostat_eta =
-      get_option<float>(options, "mirostat_eta", 0.10f);
-  params.sampling.penalty_last_n =
-      get_option<int32_t>(options, "penalty_last_n", 64);
-  params.sampling.penalty_repeat =
-      get_option<float>(options, "penalty_repeat", 1.00f);
-  params.sampling.penalty_freq =
-      get_option<float>(options, "penalty_freq", 0.00f);
-  params.sampling.penalty_present =
-      get_option<float>(options, "penalty_present", 0.00f);
-  params.sampling.typ_p = get_option<float>(options, "typical_p", 1.00f);
-  params.sampling.xtc_threshold =
-      get_option<float>(options, "xtc_threshold", 0.00f);
-  params.sampling.xtc_probability =
-      get_option<float>(options, "xtc_probability", 0.10f);
-  params.sampling.dry_multiplier =
-      get_option<float>(options, "dry_multiplier", 1.75f);
-  params.sampling.dry_base = get_option<float>(options, "dry_base", 2);
-  params.sampling.dry_allowed_length =
-      get_option<float>(options, "dry_allowed_length", -1);
-  params.sampling.dry_penalty_last_n =
-      get_option<float>(options, "dry_penalty_last_n", 0);
-  params.sampling.top_n_sigma =
-      get_option<float>(options, "top_n_sigma", -1.0f);
-  params.sampling.ignore_eos = get_option<bool>(options, "ignore_eos", false);
-  params.n_keep = get_option<int32_t>(options, "n_keep", 0);
-  params.sampling.seed =
-      get_option<int32_t>(options, "seed", LLAMA_DEFAULT_SEED);
-  params.sampling.n_probs = get_option<int32_t>(options, "n_probs", 0);
+  apply_sampling_options(options, params);
 
   // DRY sequence breakers
   if (options.Has("dry_sequence_breakers") && options.Get("dry_sequence_breakers").IsArray()) {
@@ -432,9 +599,6 @@ Napi::Value LlamaContext::QueueCompletion(const Napi::CallbackInfo &info) {
   // Handle reasoning format
   common_reasoning_format reasoning_format_enum = common_reasoning_format_from_name(reasoning_format);
 
-  // Tokenize prompt
-  auto tokenize_result = _rn_ctx->tokenize(prompt, media_paths);
-
   // Create callback wrapper
   std::shared_ptr<ManagedThreadSafeFunction> tsfn_holder;
   bool hasCallback = info.Length() > 1 && info[1].IsFunction();
@@ -448,251 +612,292 @@ Napi::Value LlamaContext::QueueCompletion(const Napi::CallbackInfo &info) {
                                       1));
   }
 
+  // Optional bounded stream for token delivery; the callback still receives
+  // the final result.
+  std::shared_ptr<TokenRingBuffer> stream;
+  if (info.Length() > 2 && !is_nil(info[2])) {
+    stream = LlamaTokenStream::FromValue(info[2]);
+    if (!stream) {
+      Napi::TypeError::New(env, "LlamaTokenStream expected")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  auto chunk_pool = std::make_shared<ObjectPool<SlotTokenChunk>>();
+
   // Capture validity flag and slot_manager to prevent use-after-free
   auto context_valid = _context_valid;
   auto slot_manager = _rn_ctx->slot_manager;
+  auto slot_requests = _slot_requests;
+  auto media_prefill = media_inputs.empty() ? nullptr : GetMediaPrefill();
+
+  // Queues the tokenized request, starting from `media_state_path` when its
+  // media prefix is evaluated already. Runs on the JS thread, so the
+  // requestId is known before any callback for it can arrive.
+  auto queue = [=](const std::vector<llama_token> &tokens,
+                   const std::vector<std::string> &media_paths,
+                   const std::string &media_state_path,
+                   size_t media_state_size) mutable {
+    if (!media_state_path.empty()) {
+      load_state_path = media_state_path;
+      load_state_size = static_cast<int32_t>(media_state_size);
+    }
+    // The slot runs the projector on the loop; see MediaPrefillContext
+    if (media_prefill && !media_paths.empty()) {
+      media_prefill->BeginSlotMedia();
+    }
 
-  // Queue the request
-  int32_t requestId = _rn_ctx->slot_manager->queue_request(
-    params,
-    tokenize_result.tokens,
-    media_paths,
-    prompt,
-    chat_format,
-    reasoning_format_enum,
-    generation_prompt,
-    chat_parser,
-    prefill_text,
-    load_state_path,
-    save_state_path,
-    save_prompt_state_path,
-    load_state_size,
-    save_state_size,
-    [tsfn_holder, hasCallback, chat_format, context_valid, slot_manager](const completion_token_output& token) {
-      if (!hasCallback) return;
-
-      struct TokenData {
-        completion_token_output token;
-        int32_t chat_format;
-        std::string accumulated_text;
-        std::string content;
-        std::string reasoning_content;
-        std::vector<common_chat_tool_call> tool_calls;
-      };
-
-      auto callback = [](Napi::Env env, Napi::Function jsCallback, TokenData* data) {
-        Napi::Object result = Napi::Object::New(env);
-        result.Set("requestId", Napi::Number::New(env, data->token.request_id));
-        result.Set("token", Napi::String::New(env, data->token.text));
-
-        if (!data->token.probs.empty()) {
-          Napi::Array probs = Napi::Array::New(env);
-          for (size_t i = 0; i < data->token.probs.size(); i++) {
-            Napi::Object prob = Napi::Object::New(env);
-            prob.Set("tok", Napi::Number::New(env, data->token.probs[i].tok));
-            prob.Set("prob", Napi::Number::New(env, data->token.probs[i].prob));
-            probs.Set(i, prob);
-          }
-          result.Set("probs", probs);
+    // Without a state of the caller's own, start from the longest prefix in
+    // the on-disk cache and have the slot save shared prefixes to it
+    std::shared_ptr<PrefixCache> prefix_cache;
+    uint64_t prefix_store_key = 0;
+    std::string prefix_store_path;
+    if (media_paths.empty() && load_state_path.empty() &&
+        save_prompt_state_path.empty()) {
+      prefix_cache = GetPrefixCache();
+    }
+    if (prefix_cache) {
+      const auto plan = prefix_cache->Lookup(tokens, 0);
+      if (plan.hit > 0) {
+        load_state_path = prefix_cache->SlotStatePath(plan.hit_key);
+        if (!load_state_path.empty()) {
+          load_state_size = static_cast<int32_t>(plan.hit);
         }
+      }
+      if (plan.store > 0) {
+        prefix_store_key = plan.store_key;
+        prefix_store_path = prefix_cache->SlotTempPath(plan.store_key);
+        save_prompt_state_path = prefix_store_path;
+      }
+    }
 
-        // Add chat format metadata
-        if (data->chat_format > 0) {
-          result.Set("chat_format", Napi::Number::New(env, data->chat_format));
-
-          // Add parsed content if available
-          if (!data->content.empty()) {
-            result.Set("content", Napi::String::New(env, data->content));
-          }
-          if (!data->reasoning_content.empty()) {
-            result.Set("reasoning_content", Napi::String::New(env, data->reasoning_content));
-          }
-          if (!data->tool_calls.empty()) {
-            Napi::Array tool_calls = Napi::Array::New(env);
-            for (size_t i = 0; i < data->tool_calls.size(); i++) {
-              const auto &tc = data->tool_calls[i];
-              Napi::Object tool_call = Napi::Object::New(env);
-              tool_call.Set("type", "function");
-              Napi::Object function = Napi::Object::New(env);
-              function.Set("name", tc.name);
-              function.Set("arguments", tc.arguments);
-              tool_call.Set("function", function);
-              if (!tc.id.empty()) {
-                tool_call.Set("id", tc.id);
-              }
-              tool_calls.Set(i, tool_call);
+    return slot_manager->queue_request(
+      params,
+      tokens,
+      media_paths,
+      prompt,
+      chat_format,
+      reasoning_format_enum,
+      generation_prompt,
+      chat_parser,
+      prefill_text,
+      load_state_path,
+      save_state_path,
+      save_prompt_state_path,
+      load_state_size,
+      save_state_size,
+      [tsfn_holder, hasCallback, stream, chunk_pool, chat_format, context_valid, slot_manager](const completion_token_output& token) {
+        if (!hasCallback && !stream) return;
+
+        TokenStreamChunkPtr chunk(chunk_pool->Acquire());
+        auto *data = static_cast<SlotTokenChunk *>(chunk.get());
+        // Copy-assign into the pooled payload reuses its string/vector capacity
+        data->token = token;
+        data->chat_format = chat_format;
+
+        // For chat format, try to parse partial output
+        // Check context validity to prevent use-after-free
+        if (chat_format > 0 && context_valid && context_valid->load() && slot_manager != nullptr) {
+          // Get the slot for this request to access accumulated text
+          auto slot = slot_manager->get_slot_by_request_id(token.request_id);
+          if (slot != nullptr) {
+            try {
+              // Use slot's own parseChatOutput method
+              auto partial_output = slot->parseChatOutput(true);
+
+              data->accumulated_text = std::move(partial_output.accumulated_text);
+              data->content = std::move(partial_output.content);
+              data->reasoning_content = std::move(partial_output.reasoning_content);
+              data->tool_calls = std::move(partial_output.tool_calls);
+            } catch (const std::exception &e) {
+              // Silently ignore parse errors for partial output
             }
-            result.Set("tool_calls", tool_calls);
           }
         }
 
-        // Always use consistent callback format with error as first parameter
-        jsCallback.Call({env.Null(), result});
-        delete data;
-      };
-
-      auto* data = new TokenData;
-      data->token = token;
-      data->chat_format = chat_format;
-
-      // For chat format, try to parse partial output
-      // Check context validity to prevent use-after-free
-      if (chat_format > 0 && context_valid && context_valid->load() && slot_manager != nullptr) {
-        // Get the slot for this request to access accumulated text
-        auto slot = slot_manager->get_slot_by_request_id(token.request_id);
-        if (slot != nullptr) {
-          try {
-            // Use slot's own parseChatOutput method
-            auto partial_output = slot->parseChatOutput(true);
-
-            data->accumulated_text = partial_output.accumulated_text;
-            data->content = partial_output.content;
-            data->reasoning_content = partial_output.reasoning_content;
-            data->tool_calls = partial_output.tool_calls;
-          } catch (const std::exception &e) {
-            // Silently ignore parse errors for partial output
-          }
+        if (stream) {
+          // This runs on the shared processing loop, which cannot pause one
+          // slot: a slow or abandoned consumer gets its pending tokens
+          // coalesced instead of stalling the other slots.
+          stream->PushOrMerge(std::move(chunk));
+          return;
         }
-      }
 
-      auto status = tsfn_holder->tsfn.BlockingCall(data, callback);
-      if (status != napi_ok) {
-        delete data;
-      }
-    },
-    [tsfn_holder, hasCallback](llama_rn_slot* slot) {
-      if (!hasCallback) return;
+        auto callback = [](Napi::Env env, Napi::Function jsCallback, TokenStreamChunk* data) {
+          TokenStreamChunkPtr chunk(data);
+          // Always use consistent callback format with error as first parameter
+          jsCallback.Call({env.Null(), chunk->ToValue(env)});
+        };
 
-      struct CompletionResult {
-        int32_t request_id;
-        std::string text;
+        auto* raw = chunk.release();
+        auto status = tsfn_holder->tsfn.BlockingCall(raw, callback);
+        if (status != napi_ok) {
+          raw->Release();
+        }
+      },
+      [tsfn_holder, hasCallback, stream, prefix_cache, prefix_store_key,
+       prefix_store_path, media_prefill, slot_media = !media_paths.empty(),
+       media_state_path, slot_requests](llama_rn_slot* slot) {
+        slot_requests->Record(slot->id, slot->request_id);
+        if (stream) {
+          stream->Finish();
+        }
+        if (!prefix_store_path.empty()) {
+          prefix_cache->Ingest(prefix_store_key, prefix_store_path);
+        }
+        if (media_prefill && slot_media) {
+          media_prefill->EndSlotMedia();
+        }
+        if (!media_state_path.empty()) {
+          std::remove(media_state_path.c_str());
+        }
+        if (!hasCallback) return;
+
+        struct CompletionResult {
+          int32_t request_id;
+          int32_t slot_id;
+          std::string text;
+          std::string content;
+          std::string reasoning_content;
+          std::vector<common_chat_tool_call> tool_calls;
+          bool stopped_eos;
+          bool stopped_limit;
+          bool stopped_word;
+          bool context_full;
+          int32_t chat_format;
+          size_t tokens_evaluated;
+          size_t tokens_predicted;
+          size_t draft_tokens;
+          size_t draft_tokens_accepted;
+          rnllama::slot_timings timings;
+        };
+
+        // Parse chat output if chat format is enabled
         std::string content;
         std::string reasoning_content;
         std::vector<common_chat_tool_call> tool_calls;
-        bool stopped_eos;
-        bool stopped_limit;
-        bool stopped_word;
-        bool context_full;
-        int32_t chat_format;
-        size_t tokens_evaluated;
-        size_t tokens_predicted;
-        size_t draft_tokens;
-        size_t draft_tokens_accepted;
-        rnllama::slot_timings timings;
-      };
 
-      // Parse chat output if chat format is enabled
-      std::string content;
-      std::string reasoning_content;
-      std::vector<common_chat_tool_call> tool_calls;
-
-      if (slot->current_chat_format > 0) {
-        try {
-          // Use slot's own parseChatOutput method
-          auto final_output = slot->parseChatOutput(false);
-
-          content = final_output.content;
-          reasoning_content = final_output.reasoning_content;
-          tool_calls = final_output.tool_calls;
-        } catch (const std::exception &e) {
-          // Silently ignore parse errors for now - we still have the raw text
-        }
-      }
-
-      // Get timings from slot
-      rnllama::slot_timings slot_timings = slot->get_timings();
-
-      auto* result_data = new CompletionResult{
-        slot->request_id,
-        slot->generated_text,
-        content,
-        reasoning_content,
-        tool_calls,
-        slot->stopped_eos,
-        slot->stopped_limit,
-        slot->stopped_word,
-        slot->context_full,
-        slot->current_chat_format,
-        static_cast<size_t>(slot->n_decoded),
-        slot->num_tokens_predicted,
-        slot->num_draft_tokens,
-        slot->num_draft_tokens_accepted,
-        slot_timings
-      };
+        if (slot->current_chat_format > 0) {
+          try {
+            // Use slot's own parseChatOutput method
+            auto final_output = slot->parseChatOutput(false);
 
-      auto callback = [](Napi::Env env, Napi::Function jsCallback, CompletionResult* data) {
-        Napi::Object result = Napi::Object::New(env);
-        result.Set("requestId", Napi::Number::New(env, data->request_id));
-        result.Set("text", Napi::String::New(env, data->text));
-        result.Set("stopped_eos", Napi::Boolean::New(env, data->stopped_eos));
-        result.Set("stopped_limit", Napi::Boolean::New(env, data->stopped_limit));
-        result.Set("stopped_word", Napi::Boolean::New(env, data->stopped_word));
-        result.Set("context_full", Napi::Boolean::New(env, data->context_full));
-        result.Set("tokens_evaluated", Napi::Number::New(env, data->tokens_evaluated));
-        result.Set("tokens_predicted", Napi::Number::New(env, data->tokens_predicted));
-        if (data->draft_tokens > 0 || data->draft_tokens_accepted > 0) {
-          result.Set("draft_tokens", Napi::Number::New(env, data->draft_tokens));
-          result.Set("draft_tokens_accepted", Napi::Number::New(env, data->draft_tokens_accepted));
+            content = final_output.content;
+            reasoning_content = final_output.reasoning_content;
+            tool_calls = final_output.tool_calls;
+          } catch (const std::exception &e) {
+            // Silently ignore parse errors for now - we still have the raw text
+          }
         }
-        result.Set("chat_format", Napi::Number::New(env, data->chat_format));
 
-        // Add parsed content if available
-        if (!data->content.empty()) {
-          result.Set("content", Napi::String::New(env, data->content));
-        }
+        // Get timings from slot
+        rnllama::slot_timings slot_timings = slot->get_timings();
+
+        auto* result_data = new CompletionResult{
+          slot->request_id,
+          slot->id,
+          slot->generated_text,
+          content,
+          reasoning_content,
+          tool_calls,
+          slot->stopped_eos,
+          slot->stopped_limit,
+          slot->stopped_word,
+          slot->context_full,
+          slot->current_chat_format,
+          static_cast<size_t>(slot->n_decoded),
+          slot->num_tokens_predicted,
+          slot->num_draft_tokens,
+          slot->num_draft_tokens_accepted,
+          slot_timings
+        };
+
+        auto callback = [](Napi::Env env, Napi::Function jsCallback, CompletionResult* data) {
+          Napi::Object result = Napi::Object::New(env);
+          result.Set("requestId", Napi::Number::New(env, data->request_id));
+          result.Set("slot_id", Napi::Number::New(env, data->slot_id));
+          result.Set("text", Napi::String::New(env, data->text));
+          result.Set("stopped_eos", Napi::Boolean::New(env, data->stopped_eos));
+          result.Set("stopped_limit", Napi::Boolean::New(env, data->stopped_limit));
+          result.Set("stopped_word", Napi::Boolean::New(env, data->stopped_word));
+          result.Set("context_full", Napi::Boolean::New(env, data->context_full));
+          result.Set("tokens_evaluated", Napi::Number::New(env, data->tokens_evaluated));
+          result.Set("tokens_predicted", Napi::Number::New(env, data->tokens_predicted));
+          if (data->draft_tokens > 0 || data->draft_tokens_accepted > 0) {
+            result.Set("draft_tokens", Napi::Number::New(env, data->draft_tokens));
+            result.Set("draft_tokens_accepted", Napi::Number::New(env, data->draft_tokens_accepted));
+          }
+          result.Set("chat_format", Napi::Number::New(env, data->chat_format));
 
-        if (!data->reasoning_content.empty()) {
-          result.Set("reasoning_content", Napi::String::New(env, data->reasoning_content));
-        }
+          // Add parsed content if available
+          if (!data->content.empty()) {
+            result.Set("content", Napi::String::New(env, data->content));
+          }
 
-        // Convert tool calls to JavaScript format
-        if (!data->tool_calls.empty()) {
-          Napi::Array tool_calls = Napi::Array::New(env);
-          for (size_t i = 0; i < data->tool_calls.size(); i++) {
-            const auto &tc = data->tool_calls[i];
-            Napi::Object tool_call = Napi::Object::New(env);
-            tool_call.Set("type", "function");
-            Napi::Object function = Napi::Object::New(env);
-            function.Set("name", tc.name);
-            function.Set("arguments", tc.arguments);
-            tool_call.Set("function", function);
-            if (!tc.id.empty()) {
-              tool_call.Set("id", tc.id);
-            }
-            tool_calls.Set(i, tool_call);
+          if (!data->reasoning_content.empty()) {
+            result.Set("reasoning_content", Napi::String::New(env, data->reasoning_content));
           }
-          result.Set("tool_calls", tool_calls);
-        }
 
-        // Add timings
-        Napi::Object timingsObj = Napi::Object::New(env);
-        timingsObj.Set("cache_n", Napi::Number::New(env, data->timings.cache_n));
-        timingsObj.Set("prompt_n", Napi::Number::New(env, data->timings.prompt_n));
-        timingsObj.Set("prompt_ms", Napi::Number::New(env, data->timings.prompt_ms));
-        timingsObj.Set("prompt_per_token_ms", Napi::Number::New(env, data->timings.prompt_per_token_ms));
-        timingsObj.Set("prompt_per_second", Napi::Number::New(env, data->timings.prompt_per_second));
-        timingsObj.Set("predicted_n", Napi::Number::New(env, data->timings.predicted_n));
-        timingsObj.Set("predicted_ms", Napi::Number::New(env, data->timings.predicted_ms));
-        timingsObj.Set("predicted_per_token_ms", Napi::Number::New(env, data->timings.predicted_per_token_ms));
-        timingsObj.Set("predicted_per_second", Napi::Number::New(env, data->timings.predicted_per_second));
-        result.Set("timings", timingsObj);
+          // Convert tool calls to JavaScript format
+          if (!data->tool_calls.empty()) {
+            result.Set("tool_calls", ToolCallsToArray(env, data->tool_calls));
+          }
 
-        jsCallback.Call({env.Null(), result});
-        delete data;
-      };
+          // Add timings
+          Napi::Object timingsObj = Napi::Object::New(env);
+          timingsObj.Set("cache_n", Napi::Number::New(env, data->timings.cache_n));
+          timingsObj.Set("prompt_n", Napi::Number::New(env, data->timings.prompt_n));
+          timingsObj.Set("prompt_ms", Napi::Number::New(env, data->timings.prompt_ms));
+          timingsObj.Set("prompt_per_token_ms", Napi::Number::New(env, data->timings.prompt_per_token_ms));
+          timingsObj.Set("prompt_per_second", Napi::Number::New(env, data->timings.prompt_per_second));
+          timingsObj.Set("predicted_n", Napi::Number::New(env, data->timings.predicted_n));
+          timingsObj.Set("predicted_ms", Napi::Number::New(env, data->timings.predicted_ms));
+          timingsObj.Set("predicted_per_token_ms", Napi::Number::New(env, data->timings.predicted_per_token_ms));
+          timingsObj.Set("predicted_per_second", Napi::Number::New(env, data->timings.predicted_per_second));
+          result.Set("timings", timingsObj);
+
+          jsCallback.Call({env.Null(), result});
+          delete data;
+        };
+
+        auto status = tsfn_holder->tsfn.BlockingCall(result_data, callback);
+        if (status != napi_ok) {
+          delete result_data;
+        }
 
-      auto status = tsfn_holder->tsfn.BlockingCall(result_data, callback);
-      if (status != napi_ok) {
-        delete result_data;
+        tsfn_holder->release();
       }
-
-      tsfn_holder->release();
+    );
+  };
+
+  if (async && !media_inputs.empty()) {
+    auto *worker = new QueueMediaWorker(env, _rn_ctx, context_valid, prompt,
+                                        std::move(media_inputs), queue);
+    worker->SetContextGate(_context_gate);
+    // A state of the caller's own is loaded instead
+    if (media_prefill && load_state_path.empty()) {
+      worker->SetPrefill(media_prefill, _media_cache, _media_cache_key,
+                         _async_media_encode);
     }
-  );
+    worker->Queue();
+    return worker->Promise();
+  }
 
+  std::vector<std::string> media_paths;
+  for (const auto &input : media_inputs) {
+    media_paths.push_back(input.path);
+  }
+  const int32_t requestId =
+      queue(_rn_ctx->tokenize(prompt, media_paths).tokens, media_paths, "", 0);
   Napi::Object result = Napi::Object::New(env);
   result.Set("requestId", Napi::Number::New(env, requestId));
-  return result;
+  if (!async) {
+    return result;
+  }
+  auto deferred = Napi::Promise::Deferred::New(env);
+  deferred.Resolve(result);
+  return deferred.Promise();
 }
 
 // QueueEmbedding(text: string, params?: object): { requestId: number }
@@ -717,7 +922,15 @@ Napi::Value LlamaContext::QueueEmbedding(const Napi::CallbackInfo &info) {
     params = info[1].As<Napi::Object>();
   }
 
-  int embd_normalize = get_option<int32_t>(params, "embd_normalize", 2);
+  EmbeddingFormat format;
+  std::string format_error;
+  if (!ParseEmbeddingFormat(params, format, format_error)) {
+    Napi::TypeError::New(env, format_error).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  int embd_normalize = format.embd_normalize;
+  // Plain number arrays unless a compact output was requested
+  const bool typed_output = format.dim > 0 || format.quant != EmbeddingQuant::F32;
 
   // Tokenize text
   const llama_vocab* vocab = llama_model_get_vocab(_rn_ctx->model);
@@ -743,38 +956,80 @@ Napi::Value LlamaContext::QueueEmbedding(const Napi::CallbackInfo &info) {
                                       1));
   }
 
-  // Queue embedding request
-  int32_t requestId = _rn_ctx->slot_manager->queue_embedding_request(
-    tokens,
-    embd_normalize,
-    [tsfn_holder, hasCallback](int32_t requestId, const std::vector<float>& embedding) {
-      if (!hasCallback) return;
+  auto deliver = [tsfn_holder, hasCallback, format, typed_output](int32_t requestId, const std::vector<float>& embedding) {
+    if (!hasCallback) return;
 
-      struct EmbeddingData {
-        int32_t requestId;
-        std::vector<float> embedding;
-      };
+    struct EmbeddingData {
+      int32_t requestId;
+      std::vector<float> embedding;
+      EmbeddingFormat format;
+      std::vector<uint8_t> output;
+      std::string error;
+    };
 
-      auto callback = [](Napi::Env env, Napi::Function jsCallback, EmbeddingData* data) {
-        Napi::Object result = Napi::Object::New(env);
-        result.Set("requestId", Napi::Number::New(env, data->requestId));
+    auto callback = [](Napi::Env env, Napi::Function jsCallback, EmbeddingData* data) {
+      if (!data->error.empty()) {
+        jsCallback.Call({Napi::Error::New(env, data->error).Value(), env.Null()});
+        delete data;
+        return;
+      }
+      Napi::Object result = Napi::Object::New(env);
+      result.Set("requestId", Napi::Number::New(env, data->requestId));
 
+      if (!data->output.empty()) {
+        result.Set("embedding", data->format.ToTypedArray(env, data->output));
+      } else {
         Napi::Array embeddingArray = Napi::Array::New(env);
         for (size_t i = 0; i < data->embedding.size(); i++) {
           embeddingArray.Set(i, Napi::Number::New(env, data->embedding[i]));
         }
         result.Set("embedding", embeddingArray);
+      }
 
-        jsCallback.Call({env.Null(), result});
-        delete data;
-      };
+      jsCallback.Call({env.Null(), result});
+      delete data;
+    };
 
-      auto* data = new EmbeddingData{requestId, embedding};
-      auto status = tsfn_holder->tsfn.BlockingCall(data, callback);
-      if (status != napi_ok) {
-        delete data;
+    auto* data = new EmbeddingData{requestId, {}, format, {}, {}};
+    if (typed_output) {
+      try {
+        format.Apply(embedding.data(), 1, embedding.size(), data->output);
+      } catch (const std::exception &e) {
+        data->error = e.what();
       }
-      tsfn_holder->release();
+    } else {
+      data->embedding = embedding;
+    }
+    auto status = tsfn_holder->tsfn.BlockingCall(data, callback);
+    if (status != napi_ok) {
+      delete data;
+    }
+    tsfn_holder->release();
+  };
+
+  // Cache hits are delivered without queueing, with requestId -1
+  auto cache = _embedding_cache;
+  EmbeddingKey cache_key;
+  if (cache) {
+    cache_key = EmbeddingCacheKey(tokens, llama_pooling_type(_rn_ctx->ctx),
+                                  embd_normalize);
+    if (auto cached = GetCachedEmbedding(*cache, cache_key)) {
+      deliver(-1, cached->embd);
+      Napi::Object result = Napi::Object::New(env);
+      result.Set("requestId", Napi::Number::New(env, -1));
+      return result;
+    }
+  }
+
+  // Queue embedding request
+  int32_t requestId = _rn_ctx->slot_manager->queue_embedding_request(
+    tokens,
+    embd_normalize,
+    [deliver, cache, cache_key](int32_t requestId, const std::vector<float>& embedding) {
+      if (cache && !embedding.empty()) {
+        PutCachedEmbedding(*cache, cache_key, embedding);
+      }
+      deliver(requestId, embedding);
     }
   );
 
@@ -880,6 +1135,82 @@ void LlamaContext::CancelRequest(const Napi::CallbackInfo &info) {
   }
 }
 
+// Shared by getSequenceState and saveSequenceState; `to_file` takes a path
+// as the second argument.
+static Napi::Value QueueSequenceState(const Napi::CallbackInfo &info,
+                                      llama_rn_context *rn_ctx,
+                                      std::shared_ptr<SlotLoopPause> pause,
+                                      std::shared_ptr<SlotRequestLog> requests,
+                                      std::shared_ptr<ContextGate> gate,
+                                      bool to_file) {
+  Napi::Env env = info.Env();
+
+  if (!rn_ctx) {
+    Napi::TypeError::New(env, "Context is disposed").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  if (!rn_ctx->parallel_mode_enabled || !rn_ctx->slot_manager) {
+    Napi::TypeError::New(env, "Parallel mode is not enabled. Call enableParallelMode() first.")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  // A request id, or { slot_id } for a slot whatever it last served
+  int32_t request_id = -1;
+  int32_t slot_id = -1;
+  if (info.Length() >= 1 && info[0].IsNumber()) {
+    request_id = info[0].ToNumber().Int32Value();
+  } else if (info.Length() >= 1 && info[0].IsObject()) {
+    slot_id = get_option<int32_t>(info[0].As<Napi::Object>(), "slot_id", -1);
+  }
+  if (request_id < 0 && slot_id < 0) {
+    Napi::TypeError::New(env, "Request ID or { slot_id } expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  std::string path;
+  if (to_file) {
+    if (info.Length() < 2 || !info[1].IsString()) {
+      Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    path = info[1].ToString().Utf8Value();
+    if (path.empty()) {
+      Napi::TypeError::New(env, "Path must not be empty").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+#ifdef GGML_USE_VULKAN
+  if (rn_ctx->params.n_gpu_layers > 0) {
+    Napi::TypeError::New(env, "Vulkan cannot save session")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+#endif
+
+  auto *worker = new SequenceStateWorker(env, rn_ctx, std::move(pause),
+                                         std::move(requests), request_id,
+                                         slot_id, std::move(path));
+  worker->SetContextGate(std::move(gate));
+  worker->Queue();
+  return worker->Promise();
+}
+
+// GetSequenceState(target: number | { slot_id: number }): Promise<Buffer>
+Napi::Value LlamaContext::GetSequenceState(const Napi::CallbackInfo &info) {
+  return QueueSequenceState(info, _rn_ctx, _slot_loop_pause, _slot_requests,
+                            _context_gate, false);
+}
+
+// SaveSequenceState(target: number | { slot_id: number }, path: string): Promise<number>
+Napi::Value LlamaContext::SaveSequenceState(const Napi::CallbackInfo &info) {
+  return QueueSequenceState(info, _rn_ctx, _slot_loop_pause, _slot_requests,
+                            _context_gate, true);
+}
+
 // GetParallelStatus(): ParallelStatus
 Napi::Value LlamaContext::GetParallelStatus(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
@@ -1,7 +1,6 @@
 #include "LoadSessionWorker.h"
 #include "LlamaContext.h"
-
-#include <algorithm>
+#include "SessionState.h"
 
 LoadSessionWorker::LoadSessionWorker(const Napi::CallbackInfo &info,
                                      rnllama::llama_rn_context* rn_ctx)
@@ -9,6 +8,9 @@ LoadSessionWorker::LoadSessionWorker(const Napi::CallbackInfo &info,
       _rn_ctx(rn_ctx) {}
 
 void LoadSessionWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
   try {
     if (!_rn_ctx || !_rn_ctx->ctx || !_rn_ctx->completion) {
       SetError("Context or completion not initialized");
@@ -21,65 +23,26 @@ void LoadSessionWorker::Execute() {
       return;
     }
 
-    std::vector<llama_token> tokens(llama_n_ctx(_rn_ctx->ctx));
-    if (!llama_state_load_file(_rn_ctx->ctx, _path.c_str(), tokens.data(),
-                               tokens.size(), &count)) {
-      SetError("Failed to load session");
-      return;
+    std::vector<llama_token> tokens;
+    if (IsDeltaSessionFile(_path)) {
+      tokens = LoadDeltaSession(_rn_ctx, _path);
+    } else if (IsCompressedSessionFile(_path)) {
+      tokens = LoadCompressedSession(_rn_ctx, _path);
+    } else if (!LoadMappedSession(_rn_ctx, _path, tokens)) {
+      tokens.resize(llama_n_ctx(_rn_ctx->ctx));
+      if (!llama_state_load_file(_rn_ctx->ctx, _path.c_str(), tokens.data(),
+                                 tokens.size(), &count)) {
+        SetError("Failed to load session");
+        return;
+      }
+      tokens.resize(count);
     }
     // Keep LLAMA_TOKEN_NULL placeholders: they represent media positions in
     // the restored memory.
-    tokens.resize(count);
-
-    // Legacy multimodal or token-limited files may contain a token list that
-    // does not match the restored memory. Reconcile it now so the next decode
-    // either resumes safely or starts cold instead of failing later.
-    auto *memory = llama_get_memory(_rn_ctx->ctx);
-    const llama_pos n_tokens = static_cast<llama_pos>(tokens.size());
-    const llama_pos pos_max = llama_memory_seq_pos_max(memory, 0);
-    const bool tokens_have_media =
-        std::find(tokens.begin(), tokens.end(), LLAMA_TOKEN_NULL) != tokens.end();
-    const bool mrope_media =
-        rnllama::model_uses_mrope(_rn_ctx->model) && tokens_have_media;
-    bool resumable =
-        pos_max + 1 == n_tokens ||
-        (mrope_media && pos_max >= 0 && pos_max + 1 < n_tokens);
-
-    if (!resumable && pos_max + 1 > n_tokens) {
-      resumable = llama_memory_seq_rm(memory, 0, n_tokens, -1) &&
-                  llama_memory_seq_pos_max(memory, 0) + 1 == n_tokens;
-      if (resumable) {
-        // A rolled-back SWA cache is only reusable if it still contains the
-        // full attention window ending at n_tokens.
-        const bool recurrent_or_hybrid =
-            llama_model_is_recurrent(_rn_ctx->model) ||
-            llama_model_is_hybrid(_rn_ctx->model);
-        const int32_t n_swa =
-            _rn_ctx->params.swa_full ? 0 : llama_model_n_swa(_rn_ctx->model);
-        if (n_swa > 0 && !recurrent_or_hybrid) {
-          const llama_pos pos_min = llama_memory_seq_pos_min(memory, 0);
-          const llama_pos pos_min_threshold =
-              std::max<llama_pos>(0, n_tokens - n_swa);
-          resumable = pos_min == 0 ||
-                      (pos_min > 0 && pos_min < pos_min_threshold);
-        }
-      }
-    }
-
-    if (!resumable) {
-      llama_memory_seq_rm(memory, 0, 0, -1);
-      tokens.clear();
-    }
-
-    // Missing or malformed metadata fails closed: processMedia will reprocess
-    // media rather than reusing memory whose identity cannot be verified.
-    _rn_ctx->setMediaHashes(tokens.empty()
-                                ? std::vector<std::string>{}
-                                : rnllama::read_state_meta(_path));
-
-    count = tokens.size();
-    _rn_ctx->completion->embd = std::move(tokens);
-    _rn_ctx->completion->n_past = static_cast<llama_pos>(count);
+    SessionTokens session;
+    session.tokens = std::move(tokens);
+    session.media_hashes = rnllama::read_state_meta(_path);
+    count = ApplyRestoredSession(_rn_ctx, std::move(session));
   } catch (const std::exception &e) {
     SetError(e.what());
   }
@@ -1,3 +1,4 @@
+#include "SessionState.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
 
@@ -6,6 +7,9 @@ class LoadSessionWorker : public Napi::AsyncWorker,
 public:
   LoadSessionWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx);
 
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) { _gate = std::move(gate); }
+
 protected:
   void Execute();
   void OnOK();
@@ -15,4 +19,5 @@ private:
   std::string _path;
   rnllama::llama_rn_context* _rn_ctx;
   size_t count = 0;
+  std::shared_ptr<ContextGate> _gate;
 };
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct CacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+  size_t budget = 0;
+};
+
+// Thread-safe LRU of immutable values bounded by a byte budget. Value must
+// expose `size_t Bytes() const`; values larger than the budget are not kept.
+template <typename Key, typename Value> class ByteLruCache {
+public:
+  explicit ByteLruCache(size_t budget_bytes) : _budget(budget_bytes) {}
+
+  std::shared_ptr<const Value> Get(const Key &key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+      _misses++;
+      return nullptr;
+    }
+    _hits++;
+    _lru.splice(_lru.begin(), _lru, it->second);
+    return it->second->second;
+  }
+
+  void Put(const Key &key, std::shared_ptr<const Value> value) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!value || value->Bytes() > _budget) {
+      return;
+    }
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+      _bytes -= it->second->second->Bytes();
+      _lru.erase(it->second);
+      _index.erase(it);
+    }
+    _bytes += value->Bytes();
+    _lru.emplace_front(key, std::move(value));
+    _index[key] = _lru.begin();
+    EvictLocked();
+  }
+
+  void SetBudget(size_t budget_bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budget = budget_bytes;
+    EvictLocked();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lru.clear();
+    _index.clear();
+    _bytes = 0;
+  }
+
+  CacheStats Stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    CacheStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.evictions = _evictions;
+    stats.entries = _index.size();
+    stats.bytes = _bytes;
+    stats.budget = _budget;
+    return stats;
+  }
+
+  // Entries from least to most recently used, so Put-ing them back in the
+  // same order restores the recency order.
+  std::vector<std::pair<Key, std::shared_ptr<const Value>>> Snapshot() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::vector<std::pair<Key, std::shared_ptr<const Value>>>(
+        _lru.rbegin(), _lru.rend());
+  }
+
+private:
+  void EvictLocked() {
+    while (_bytes > _budget && !_lru.empty()) {
+      auto &victim = _lru.back();
+      _bytes -= victim.second->Bytes();
+      _index.erase(victim.first);
+      _lru.pop_back();
+      _evictions++;
+    }
+  }
+
+  typedef std::pair<Key, std::shared_ptr<const Value>> Entry;
+
+  std::mutex _mutex;
+  std::list<Entry> _lru; // most recently used first
+  std::unordered_map<Key, typename std::list<Entry>::iterator> _index;
+  size_t _bytes = 0;
+  size_t _budget;
+  uint64_t _hits = 0;
+  uint64_t _misses = 0;
+  uint64_t _evictions = 0;
+};
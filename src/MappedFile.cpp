@@ -0,0 +1,137 @@
+#include "MappedFile.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path, bool sequential) {
+  (void)sequential;
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ |
+                                                            FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    _mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping != nullptr) {
+      _data = static_cast<const uint8_t *>(
+          MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+      if (_data != nullptr) {
+        _size = static_cast<size_t>(size.QuadPart);
+      } else {
+        CloseHandle(_mapping);
+        _mapping = nullptr;
+      }
+    }
+  }
+  // The view keeps the file open
+  CloseHandle(file);
+}
+
+bool SyncFile(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  const bool ok = FlushFileBuffers(file) != 0;
+  CloseHandle(file);
+  return ok;
+}
+
+void MappedFile::Reset() {
+  if (_data != nullptr) {
+    UnmapViewOfFile(_data);
+  }
+  if (_mapping != nullptr) {
+    CloseHandle(_mapping);
+  }
+  _data = nullptr;
+  _size = 0;
+  _mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path, bool sequential) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      _data = static_cast<const uint8_t *>(addr);
+      _size = static_cast<size_t>(st.st_size);
+      if (sequential) {
+        madvise(addr, _size, MADV_SEQUENTIAL);
+        madvise(addr, _size, MADV_WILLNEED);
+      }
+    }
+  }
+  // The mapping keeps the file open
+  close(fd);
+}
+
+bool SyncFile(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  const bool ok = fsync(fd) == 0;
+  close(fd);
+  if (!ok) {
+    return false;
+  }
+  const auto slash = path.find_last_of('/');
+  const std::string dir =
+      slash == std::string::npos ? "." : path.substr(0, slash + 1);
+  const int dir_fd = open(dir.c_str(), O_RDONLY);
+  if (dir_fd >= 0) {
+    // Not every filesystem supports syncing a directory
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  return true;
+}
+
+void MappedFile::Reset() {
+  if (_data != nullptr) {
+    munmap(const_cast<uint8_t *>(_data), _size);
+  }
+  _data = nullptr;
+  _size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() { Reset(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    Reset();
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+#ifdef _WIN32
+    std::swap(_mapping, other._mapping);
+#endif
+  }
+  return *this;
+}
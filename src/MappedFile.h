@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory map of a whole file. Empty files and open failures leave
+// the map invalid. `sequential` asks the OS to read ahead aggressively for a
+// single front-to-back pass. Move-only.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path, bool sequential = false);
+  ~MappedFile();
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool Valid() const { return _data != nullptr; }
+  const uint8_t *Data() const { return _data; }
+  size_t Size() const { return _size; }
+
+private:
+  void Reset();
+
+  const uint8_t *_data = nullptr;
+  size_t _size = 0;
+#ifdef _WIN32
+  void *_mapping = nullptr;
+#endif
+};
+
+// Flushes `path` to stable storage, and on POSIX also its directory entry so
+// a newly created or renamed file survives a crash.
+bool SyncFile(const std::string &path);
@@ -0,0 +1,680 @@
+#include "MediaCache.h"
+#include "SessionDelta.h"
+#include "tools/mtmd/mtmd-helper.h"
+#include "tools/mtmd/mtmd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static bool DecodeBase64(const char *src, size_t len, std::vector<uint8_t> &out) {
+  auto value = [](char c) -> int {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+' || c == '-') return 62;
+    if (c == '/' || c == '_') return 63;
+    return -1;
+  };
+  out.clear();
+  out.reserve(len / 4 * 3);
+  uint32_t acc = 0;
+  int bits = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (src[i] == '=') {
+      break;
+    }
+    const int v = value(src[i]);
+    if (v < 0) {
+      return false;
+    }
+    acc = (acc << 6) | static_cast<uint32_t>(v);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<uint8_t>((acc >> bits) & 0xFF));
+    }
+  }
+  return true;
+}
+
+// Raw bytes of one media input: borrowed from its Buffer, or read from the
+// data URL / file. Hashed for the cache key and, on a miss, decoded once.
+struct MediaSource {
+  std::vector<uint8_t> owned;
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  std::string key;
+};
+
+static bool ReadMediaSource(const MediaInput &input, MediaSource &source) {
+  if (input.data != nullptr) {
+    source.data = input.data;
+    source.size = input.size;
+    return true;
+  }
+  const std::string &path = input.path;
+  if (path.compare(0, 5, "data:") == 0) {
+    const auto marker = path.find(";base64,");
+    if (marker == std::string::npos) {
+      return false;
+    }
+    const size_t start = marker + 8;
+    if (!DecodeBase64(path.data() + start, path.size() - start,
+                      source.owned)) {
+      return false;
+    }
+  } else {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      return false;
+    }
+    source.owned.assign(std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>());
+  }
+  source.data = source.owned.data();
+  source.size = source.owned.size();
+  return true;
+}
+
+// Evaluates `n_tokens` encoder outputs at `n_past` on sequence 0, the way
+// mtmd_helper_decode_image_chunk does for a chunk.
+static bool DecodeEmbeddings(llama_context *ctx, const float *embd,
+                             size_t n_tokens, size_t n_embd, size_t n_past,
+                             int32_t n_batch, bool non_causal) {
+  if (non_causal) {
+    llama_set_causal_attn(ctx, false);
+  }
+  llama_batch batch = llama_batch_init(n_batch, static_cast<int32_t>(n_embd), 1);
+  bool ok = true;
+  for (size_t i = 0; ok && i < n_tokens; i += n_batch) {
+    const int32_t n = static_cast<int32_t>(std::min<size_t>(n_batch, n_tokens - i));
+    batch.n_tokens = n;
+    memcpy(batch.embd, embd + i * n_embd, n * n_embd * sizeof(float));
+    for (int32_t j = 0; j < n; j++) {
+      batch.pos[j] = static_cast<llama_pos>(n_past + i + j);
+      batch.n_seq_id[j] = 1;
+      batch.seq_id[j][0] = 0;
+      batch.logits[j] = false;
+    }
+    ok = llama_decode(ctx, batch) == 0;
+  }
+  llama_batch_free(batch);
+  if (non_causal) {
+    llama_set_causal_attn(ctx, true);
+  }
+  return ok;
+}
+
+namespace {
+
+// Runs the projector over one chunk and appends its output to `embd`
+typedef std::function<bool(const mtmd_input_chunk *, std::vector<float> &)>
+    ChunkEncoder;
+
+// One media input still to evaluate: its cached encoder output, or the
+// chunks to encode into one. `entry` carries what is stored alongside it.
+struct MediaEncodeJob {
+  std::vector<const mtmd_input_chunk *> chunks;
+  std::string key;
+  MediaEmbedding entry;
+  std::shared_ptr<const MediaEmbedding> result;
+  bool done = false;
+};
+
+// Runs the projector over pending jobs. In the background it works on its own
+// thread, so encoding media input k+1 overlaps with llama_decode of the text
+// and embeddings before it, and the destructor stops after the current chunk
+// and joins. Otherwise Wait encodes the job itself.
+class MediaEncodeThread {
+public:
+  MediaEncodeThread(ChunkEncoder encode, MediaEmbeddingCache *cache,
+                    std::vector<MediaEncodeJob> &jobs, bool background)
+      : _encode(std::move(encode)), _cache(cache), _jobs(jobs) {
+    if (background) {
+      _thread = std::thread([this]() { Run(); });
+    }
+  }
+
+  ~MediaEncodeThread() {
+    _cancelled = true;
+    if (_thread.joinable()) {
+      _thread.join();
+    }
+  }
+
+  // Encoder output for job `i`, or null if encoding failed.
+  std::shared_ptr<const MediaEmbedding> Wait(size_t i) {
+    if (!_thread.joinable()) {
+      Encode(_jobs[i]);
+      return _jobs[i].result;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    _ready.wait(lock, [&]() { return _jobs[i].done; });
+    return _jobs[i].result;
+  }
+
+private:
+  void Run() {
+    for (auto &job : _jobs) {
+      Encode(job);
+    }
+  }
+
+  void Encode(MediaEncodeJob &job) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (job.done) {
+        return;
+      }
+    }
+    auto encoded = std::make_shared<MediaEmbedding>(std::move(job.entry));
+    for (const auto *chunk : job.chunks) {
+      if (_cancelled || !_encode(chunk, encoded->embd)) {
+        encoded.reset();
+        break;
+      }
+      const size_t n = mtmd_input_chunk_get_n_tokens(chunk);
+      encoded->n_tokens += n;
+      encoded->slices.push_back(n);
+    }
+    if (encoded && _cache != nullptr) {
+      _cache->Put(job.key, encoded);
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      job.result = std::move(encoded);
+      job.done = true;
+    }
+    _ready.notify_all();
+  }
+
+  ChunkEncoder _encode;
+  MediaEmbeddingCache *_cache;
+  std::vector<MediaEncodeJob> &_jobs;
+  std::atomic<bool> _cancelled{false};
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  std::thread _thread;
+};
+
+// A run of the prompt that is either text or one media chunk
+struct PromptSegment {
+  size_t start = 0;
+  size_t end = 0;
+  bool media = false;
+  // Media only: owning input and token offset into its encoder output
+  size_t input = 0;
+  size_t offset = 0;
+};
+
+// A prompt as mtmd lays it out: flattened tokens with LLAMA_TOKEN_NULL at
+// media positions, cut into text runs and media chunks.
+struct MediaLayout {
+  std::vector<MediaSource> sources;
+  std::vector<std::shared_ptr<const MediaEmbedding>> cached;
+  // Bitmaps of misses, and zero-filled ones of the cached size for hits
+  std::vector<mtmd::bitmap_ptr> bitmaps;
+  mtmd::input_chunks_ptr chunks;
+  std::vector<llama_token> tokens;
+  std::vector<PromptSegment> segments;
+  // Chunks of each input, in prompt order
+  std::vector<std::vector<const mtmd_input_chunk *>> input_chunks;
+  size_t media_start = 0;
+  size_t media_end = 0;
+  // rn-llama's hash of each input, when known
+  std::vector<std::string> hashes;
+  bool add_special = false;
+};
+
+} // namespace
+
+// M-RoPE positions differ from token offsets, and rewinding recurrent memory
+// is not possible; both are left to rn-llama.
+static bool MediaPrefillSupported(rnllama::llama_rn_context *rn_ctx) {
+  if (rn_ctx->mtmd_wrapper == nullptr) {
+    return false;
+  }
+  mtmd_context *mtmd_ctx = rn_ctx->mtmd_wrapper->mtmd_ctx;
+  return mtmd_ctx != nullptr && !mtmd_decode_use_mrope(mtmd_ctx) &&
+         !llama_model_is_recurrent(rn_ctx->model) &&
+         !llama_model_is_hybrid(rn_ctx->model);
+}
+
+static ChunkEncoder DirectEncoder(mtmd_context *mtmd_ctx, size_t n_embd) {
+  return [mtmd_ctx, n_embd](const mtmd_input_chunk *chunk,
+                            std::vector<float> &embd) {
+    if (mtmd_encode_chunk(mtmd_ctx, chunk) != 0) {
+      return false;
+    }
+    const size_t n = mtmd_input_chunk_get_n_tokens(chunk);
+    const float *out = mtmd_get_output_embd(mtmd_ctx);
+    embd.insert(embd.end(), out, out + n * n_embd);
+    return true;
+  };
+}
+
+// Reads every input and keys it by its bytes for `cache`
+static bool ReadMediaSources(const std::vector<MediaInput> &media,
+                             MediaEmbeddingCache *cache,
+                             const std::string &key_prefix,
+                             MediaLayout &layout) {
+  layout.sources.resize(media.size());
+  layout.cached.resize(media.size());
+  for (size_t i = 0; i < media.size(); i++) {
+    auto &source = layout.sources[i];
+    if (!ReadMediaSource(media[i], source)) {
+      return false;
+    }
+    char hash[40];
+    snprintf(hash, sizeof(hash), "%016llx-%zu",
+             static_cast<unsigned long long>(
+                 ContentHash64(source.data, source.size)),
+             source.size);
+    source.key = key_prefix + "\n" + hash;
+    if (cache != nullptr) {
+      layout.cached[i] = cache->Get(source.key);
+    }
+  }
+  return true;
+}
+
+// Lays `prompt` out with mtmd. Misses are decoded into bitmaps straight from
+// their bytes; a hit only needs a bitmap of its size, since the layout does
+// not depend on the pixels. Returns false when mtmd rejects the prompt or it
+// has no media chunk.
+static bool LayoutMedia(mtmd_context *mtmd_ctx, const std::string &prompt,
+                        bool add_special, MediaLayout &layout) {
+  const size_t n_inputs = layout.sources.size();
+  if (layout.bitmaps.empty()) {
+    for (size_t i = 0; i < n_inputs; i++) {
+      const auto &cached = layout.cached[i];
+      mtmd::bitmap_ptr bitmap;
+      if (cached && cached->audio) {
+        std::vector<float> samples(cached->nx);
+        bitmap.reset(mtmd_bitmap_init_from_audio(samples.size(), samples.data()));
+      } else if (cached) {
+        std::vector<unsigned char> pixels(size_t(cached->nx) * cached->ny * 3);
+        bitmap.reset(mtmd_bitmap_init(cached->nx, cached->ny, pixels.data()));
+      } else {
+        bitmap.reset(mtmd_helper_bitmap_init_from_buf(
+            mtmd_ctx, layout.sources[i].data, layout.sources[i].size));
+      }
+      if (!bitmap) {
+        return false;
+      }
+      mtmd_bitmap_set_id(bitmap.get(), std::to_string(i).c_str());
+      layout.bitmaps.push_back(std::move(bitmap));
+    }
+  }
+  layout.add_special = add_special;
+  std::vector<const mtmd_bitmap *> bitmaps;
+  for (const auto &bitmap : layout.bitmaps) {
+    bitmaps.push_back(bitmap.get());
+  }
+  layout.chunks.reset(mtmd_input_chunks_init());
+  mtmd_input_text text;
+  text.text = prompt.c_str();
+  text.add_special = add_special;
+  text.parse_special = true;
+  if (mtmd_tokenize(mtmd_ctx, layout.chunks.get(), &text, bitmaps.data(),
+                    bitmaps.size()) != 0) {
+    return false;
+  }
+
+  layout.tokens.clear();
+  layout.segments.clear();
+  layout.input_chunks.assign(n_inputs, {});
+  std::vector<size_t> offsets(n_inputs, 0);
+  for (size_t i = 0; i < mtmd_input_chunks_size(layout.chunks.get()); i++) {
+    const auto *chunk = mtmd_input_chunks_get(layout.chunks.get(), i);
+    PromptSegment segment;
+    segment.start = layout.tokens.size();
+    if (mtmd_input_chunk_get_type(chunk) == MTMD_INPUT_CHUNK_TYPE_TEXT) {
+      size_t n = 0;
+      const llama_token *text_tokens = mtmd_input_chunk_get_tokens_text(chunk, &n);
+      layout.tokens.insert(layout.tokens.end(), text_tokens, text_tokens + n);
+    } else {
+      const char *id = mtmd_input_chunk_get_id(chunk);
+      const size_t input = id != nullptr ? std::strtoul(id, nullptr, 10) : 0;
+      if (id == nullptr || input >= n_inputs) {
+        return false;
+      }
+      const size_t n = mtmd_input_chunk_get_n_tokens(chunk);
+      segment.media = true;
+      segment.input = input;
+      segment.offset = offsets[input];
+      offsets[input] += n;
+      layout.tokens.insert(layout.tokens.end(), n, LLAMA_TOKEN_NULL);
+      layout.input_chunks[input].push_back(chunk);
+    }
+    segment.end = layout.tokens.size();
+    layout.segments.push_back(segment);
+  }
+
+  layout.media_start = layout.tokens.size();
+  layout.media_end = 0;
+  for (const auto &segment : layout.segments) {
+    if (segment.media) {
+      layout.media_start = std::min(layout.media_start, segment.start);
+      layout.media_end = segment.end;
+    }
+  }
+  // A cached output sliced differently than the projector now slices its
+  // input cannot be reused, and its bitmap cannot be encoded
+  for (size_t i = 0; i < n_inputs; i++) {
+    if (!layout.cached[i]) {
+      continue;
+    }
+    std::vector<size_t> slices;
+    for (const auto *chunk : layout.input_chunks[i]) {
+      slices.push_back(mtmd_input_chunk_get_n_tokens(chunk));
+    }
+    if (layout.cached[i]->slices != slices) {
+      return false;
+    }
+  }
+  return layout.media_end > 0;
+}
+
+// Evaluates the layout from `n_done` up to the end of its last media chunk on
+// sequence 0 of `ctx`. Cached encoder outputs are decoded directly; the rest
+// are encoded in prompt order, on a background thread when `async_encode`,
+// and stored to `cache`. Returns how far evaluation got.
+static size_t EvaluateMedia(llama_context *ctx, mtmd_context *mtmd_ctx,
+                            MediaEmbeddingCache *cache, MediaLayout &layout,
+                            size_t n_done, int32_t n_batch,
+                            const ChunkEncoder &encode, bool async_encode) {
+  const size_t n_embd = llama_model_n_embd_inp(llama_get_model(ctx));
+  const bool non_causal = mtmd_decode_use_non_causal(mtmd_ctx);
+  const size_t n_inputs = layout.sources.size();
+
+  std::vector<size_t> input_end(n_inputs, 0);
+  for (const auto &segment : layout.segments) {
+    if (segment.media) {
+      input_end[segment.input] = segment.end;
+    }
+  }
+  std::vector<MediaEncodeJob> jobs(n_inputs);
+  for (size_t i = 0; i < n_inputs; i++) {
+    jobs[i].key = layout.sources[i].key;
+    const mtmd_bitmap *bitmap = layout.bitmaps[i].get();
+    jobs[i].entry.nx = mtmd_bitmap_get_nx(bitmap);
+    jobs[i].entry.ny = mtmd_bitmap_get_ny(bitmap);
+    jobs[i].entry.audio = mtmd_bitmap_is_audio(bitmap);
+    if (layout.hashes.size() == n_inputs) {
+      jobs[i].entry.hash = layout.hashes[i];
+    }
+    jobs[i].entry.add_special = layout.add_special;
+    jobs[i].result = layout.cached[i];
+    // Inputs wholly inside the kept prefix need no encoder output
+    jobs[i].done = layout.cached[i] != nullptr || input_end[i] <= n_done;
+    if (!jobs[i].done) {
+      jobs[i].chunks = layout.input_chunks[i];
+    }
+  }
+  MediaEncodeThread encoder(encode, cache, jobs, async_encode);
+
+  const auto &tokens = layout.tokens;
+  for (const auto &segment : layout.segments) {
+    if (n_done >= layout.media_end) {
+      break;
+    }
+    if (segment.end <= n_done) {
+      continue;
+    }
+    if (!segment.media) {
+      for (size_t j = n_done; j < segment.end; j += n_batch) {
+        const int32_t n_eval =
+            static_cast<int32_t>(std::min<size_t>(n_batch, segment.end - j));
+        if (llama_decode(ctx, llama_batch_get_one(
+                                  const_cast<llama_token *>(tokens.data() + j),
+                                  n_eval)) != 0) {
+          return n_done;
+        }
+        n_done += n_eval;
+      }
+      continue;
+    }
+
+    // Meanwhile a background encoder has moved on to the next media input
+    auto embd = encoder.Wait(segment.input);
+    if (!embd || embd->n_tokens < segment.offset + (segment.end - segment.start)) {
+      return n_done;
+    }
+    if (!DecodeEmbeddings(ctx, embd->embd.data() + segment.offset * n_embd,
+                          segment.end - segment.start, n_embd, n_done, n_batch,
+                          non_causal)) {
+      return n_done;
+    }
+    n_done = segment.end;
+  }
+  return n_done;
+}
+
+bool PrefillMedia(rnllama::llama_rn_context *rn_ctx,
+                  MediaEmbeddingCache *cache, const std::string &key_prefix,
+                  const std::string &prompt,
+                  const std::vector<MediaInput> &media,
+                  const std::vector<std::string> &media_paths,
+                  bool async_encode) {
+  if (media.size() != media_paths.size() || !MediaPrefillSupported(rn_ctx)) {
+    return false;
+  }
+  mtmd_context *mtmd_ctx = rn_ctx->mtmd_wrapper->mtmd_ctx;
+
+  MediaLayout layout;
+  if (!ReadMediaSources(media, cache, key_prefix, layout)) {
+    return false;
+  }
+  // Entries stored by an earlier completion carry rn-llama's hash and
+  // special-token handling, so a prompt made only of those is laid out
+  // without decoding anything
+  bool known = !layout.cached.empty();
+  for (const auto &entry : layout.cached) {
+    known = known && entry && !entry->hash.empty() &&
+            entry->add_special == layout.cached[0]->add_special;
+  }
+  if (known) {
+    for (const auto &entry : layout.cached) {
+      layout.hashes.push_back(entry->hash);
+    }
+    if (!LayoutMedia(mtmd_ctx, prompt, layout.cached[0]->add_special, layout)) {
+      return false;
+    }
+  } else {
+    // rn-llama's view of the prompt: flattened tokens and the media hashes
+    // loadPrompt compares against. Hashes are treated as opaque. Its
+    // special-token handling is found by comparing layouts.
+    auto tokenized = rn_ctx->tokenize(prompt, media_paths);
+    bool matched = false;
+    for (bool add_special : {false, true}) {
+      if (LayoutMedia(mtmd_ctx, prompt, add_special, layout) &&
+          layout.tokens == tokenized.tokens) {
+        matched = true;
+        break;
+      }
+    }
+    if (!matched) {
+      return false;
+    }
+    layout.hashes = std::move(tokenized.bitmap_hashes);
+  }
+  const auto &tokens = layout.tokens;
+  const auto &hashes = layout.hashes;
+  const size_t media_start = layout.media_start;
+  const size_t media_end = layout.media_end;
+
+  // Reuse whatever prefix is already in memory, as loadPrompt would. Media
+  // counts as kept only if the whole hash list is unchanged.
+  auto completion = rn_ctx->completion;
+  const auto &prev_tokens = completion->embd;
+  size_t n_keep =
+      std::mismatch(prev_tokens.begin(),
+                    prev_tokens.begin() + std::min(prev_tokens.size(), tokens.size()),
+                    tokens.begin())
+          .first -
+      prev_tokens.begin();
+  if (rn_ctx->getMediaHashes() != hashes) {
+    n_keep = std::min(n_keep, media_start);
+  }
+  for (const auto &segment : layout.segments) {
+    if (segment.media && segment.start < n_keep && n_keep < segment.end) {
+      n_keep = segment.start;
+    }
+  }
+  // Nothing to encode, or no trailing text for loadPrompt to produce logits
+  // from: leave it to rn-llama.
+  if (n_keep >= media_end || media_end >= tokens.size()) {
+    return false;
+  }
+
+  auto *memory = llama_get_memory(rn_ctx->ctx);
+  // A truncated sliding-window cache may no longer hold the window ending at
+  // n_keep, so start over rather than reason about it.
+  const bool swa = !rn_ctx->params.swa_full && llama_model_n_swa(rn_ctx->model) > 0;
+  if (swa || !llama_memory_seq_rm(memory, 0, n_keep, -1)) {
+    llama_memory_seq_rm(memory, 0, 0, -1);
+    n_keep = 0;
+  }
+
+  const size_t n_embd = llama_model_n_embd_inp(rn_ctx->model);
+  size_t n_done = EvaluateMedia(rn_ctx->ctx, mtmd_ctx, cache, layout, n_keep,
+                                rn_ctx->params.n_batch,
+                                DirectEncoder(mtmd_ctx, n_embd), async_encode);
+
+  // Publish the evaluated prefix so loadPrompt resumes after it. Hash lists
+  // cannot be split, so a failure part-way keeps only the text before the
+  // first media chunk.
+  const bool complete = n_done >= media_end;
+  if (!complete) {
+    n_done = std::min(n_done, media_start);
+  }
+  llama_memory_seq_rm(memory, 0, n_done, -1);
+  completion->embd.assign(tokens.begin(), tokens.begin() + n_done);
+  completion->n_past = static_cast<llama_pos>(n_done);
+  rn_ctx->setMediaHashes(complete ? hashes : std::vector<std::string>());
+  return true;
+}
+
+MediaPrefillContext::MediaPrefillContext(rnllama::llama_rn_context *rn_ctx,
+                                         std::shared_ptr<SlotLoopPause> pause)
+    : _rn_ctx(rn_ctx), _pause(std::move(pause)) {
+  std::random_device rd;
+  char name[48];
+  snprintf(name, sizeof(name), "llama-node-media-%08x%08x", rd(), rd());
+  std::error_code ec;
+  _dir = (fs::temp_directory_path(ec) / name).string();
+}
+
+MediaPrefillContext::~MediaPrefillContext() {
+  if (_ctx != nullptr) {
+    llama_free(_ctx);
+  }
+  std::error_code ec;
+  fs::remove_all(_dir, ec);
+}
+
+void MediaPrefillContext::BeginSlotMedia() {
+  std::lock_guard<std::mutex> lock(_encode_mutex);
+  _slot_media++;
+}
+
+void MediaPrefillContext::EndSlotMedia() { _slot_media--; }
+
+bool MediaPrefillContext::Prefill(const std::string &prompt,
+                                  const std::vector<MediaInput> &media,
+                                  MediaEmbeddingCache *cache,
+                                  const std::string &key_prefix,
+                                  bool async_encode, uint64_t fingerprint,
+                                  std::vector<common_adapter_lora_info> lora,
+                                  PrefilledMedia &out) {
+  if (!MediaPrefillSupported(_rn_ctx)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_ctx == nullptr || _fingerprint != fingerprint) {
+    if (_ctx != nullptr) {
+      llama_free(_ctx);
+      _ctx = nullptr;
+    }
+    for (const auto &adapter : lora) {
+      if (adapter.ptr == nullptr) {
+        return false;
+      }
+    }
+    // One slot's worth of the same cache layout, so the saved sequence
+    // loads into any slot
+    const auto &params = _rn_ctx->params;
+    const uint32_t n_seq = params.kv_unified ? 1 : llama_n_seq_max(_rn_ctx->ctx);
+    llama_context_params cparams = common_context_params_to_llama(params);
+    cparams.n_ctx = llama_n_ctx(_rn_ctx->ctx) / n_seq;
+    cparams.n_seq_max = 1;
+    cparams.embeddings = false;
+    _ctx = llama_init_from_model(_rn_ctx->model, cparams);
+    if (_ctx == nullptr) {
+      return false;
+    }
+    common_set_adapter_lora(_ctx, lora);
+    _fingerprint = fingerprint;
+  }
+
+  // Tokenized like loadPrompt, BOS included
+  mtmd_context *mtmd_ctx = _rn_ctx->mtmd_wrapper->mtmd_ctx;
+  MediaLayout layout;
+  if (!ReadMediaSources(media, cache, key_prefix, layout) ||
+      !LayoutMedia(mtmd_ctx, prompt, true, layout) ||
+      layout.media_end >= layout.tokens.size()) {
+    return false;
+  }
+
+  // The slot loop may be running the projector for a request queued with
+  // media paths; take turns with it.
+  const size_t n_embd = llama_model_n_embd_inp(_rn_ctx->model);
+  ChunkEncoder direct = DirectEncoder(mtmd_ctx, n_embd);
+  ChunkEncoder encode = [this, direct](const mtmd_input_chunk *chunk,
+                                       std::vector<float> &embd) {
+    std::lock_guard<std::mutex> lock(_encode_mutex);
+    const bool paused = _slot_media.load() > 0;
+    if (paused) {
+      _pause->Acquire(_rn_ctx);
+    }
+    const bool ok = direct(chunk, embd);
+    if (paused) {
+      _pause->Release(_rn_ctx);
+    }
+    return ok;
+  };
+
+  llama_memory_clear(llama_get_memory(_ctx), true);
+  const size_t n_done = EvaluateMedia(_ctx, mtmd_ctx, cache, layout, 0,
+                                      llama_n_batch(_ctx), encode,
+                                      async_encode);
+  if (n_done < layout.media_end) {
+    return false;
+  }
+
+  std::error_code ec;
+  fs::create_directories(_dir, ec);
+  const std::string path =
+      (fs::path(_dir) / (std::to_string(_files++) + ".seq")).string();
+  if (llama_state_seq_save_file(_ctx, path.c_str(), 0, layout.tokens.data(),
+                                layout.media_end) == 0) {
+    fs::remove(path, ec);
+    return false;
+  }
+  out.tokens = std::move(layout.tokens);
+  out.state_path = path;
+  out.state_size = layout.media_end;
+  return true;
+}
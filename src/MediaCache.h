@@ -0,0 +1,116 @@
+#pragma once
+
+#include "LruCache.h"
+#include "MediaInput.h"
+#include "SessionState.h"
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Encoder outputs for one media input, over all the chunks it was split into
+// (image slices, audio windows).
+struct MediaEmbedding {
+  std::vector<float> embd;
+  size_t n_tokens = 0;
+  // Tokens in each chunk, in prompt order
+  std::vector<size_t> slices;
+  // Decoded size (audio: samples in nx), enough to lay the input out again
+  // without decoding it
+  uint32_t nx = 0;
+  uint32_t ny = 0;
+  bool audio = false;
+  // rn-llama's hash of the decoded input and the special-token handling its
+  // tokenize used; hash is empty for entries stored by queued prompts
+  std::string hash;
+  bool add_special = false;
+
+  size_t Bytes() const { return embd.size() * sizeof(float); }
+};
+
+typedef CacheStats MediaCacheStats;
+
+// Media encoder outputs keyed by projector + hash of the raw media bytes, so a
+// hit needs no image decode. One per context and one byte budget, shared by
+// completion() and queued media prompts (MediaPrefillContext).
+typedef ByteLruCache<std::string, MediaEmbedding> MediaEmbeddingCache;
+
+// Evaluates the prompt up to the end of its last media chunk on sequence 0,
+// then hands the evaluated prefix to rn-llama the same way a loaded session
+// does, so loadPrompt only evaluates the trailing text. With `async_encode`
+// media chunks are encoded on a background thread while the text before them
+// is decoded, otherwise in turn with it. Encoder outputs are taken from /
+// stored to `cache` when it is not null.
+// Misses are decoded into bitmaps straight from the input's bytes and
+// tokenized by rn-llama for its media hashes; a prompt whose inputs all hit
+// is laid out from the cached sizes and hashes without decoding anything.
+// loadPrompt, which takes media by path only, still decodes each input once
+// to check the prefix.
+// Returns false without touching memory when the model or prompt layout is
+// not supported; loadPrompt then processes the media as usual. A failure
+// part-way publishes the text before the first media chunk.
+bool PrefillMedia(rnllama::llama_rn_context *rn_ctx,
+                  MediaEmbeddingCache *cache, const std::string &key_prefix,
+                  const std::string &prompt,
+                  const std::vector<MediaInput> &media,
+                  const std::vector<std::string> &media_paths,
+                  bool async_encode);
+
+// A queued prompt whose media prefix is evaluated and saved for a slot
+struct PrefilledMedia {
+  // Whole prompt, LLAMA_TOKEN_NULL at media positions
+  std::vector<llama_token> tokens;
+  // llama_state_seq_save_file of the first `state_size` tokens
+  std::string state_path;
+  size_t state_size = 0;
+};
+
+// Evaluates queued media prompts off the parallel slot loop. rn-llama's slots
+// encode media inline, stalling every other slot for the duration, so media
+// prompts are instead decoded from their bytes, encoded and evaluated up to
+// the end of their last media chunk on a private context of the same model
+// and KV layout. The sequence is saved to a file the slot loads like a
+// cached prompt state, leaving it only the trailing text. One prompt at a
+// time; the context is created on first use.
+class MediaPrefillContext {
+public:
+  MediaPrefillContext(rnllama::llama_rn_context *rn_ctx,
+                      std::shared_ptr<SlotLoopPause> pause);
+  // Frees the private context and removes state files left on disk
+  ~MediaPrefillContext();
+
+  // Evaluates `prompt` and writes the state file, taking encoder outputs
+  // from / storing them to `cache` and overlapping encoding with decoding
+  // when `async_encode`, like PrefillMedia; hits are not decoded.
+  // `fingerprint` and `lora` describe the context's current KV layout and
+  // adapters (PrefixCache::Fingerprint), read on the JS thread. Returns false
+  // without writing anything for models and prompts it does not cover; those
+  // go to the slot as media paths.
+  bool Prefill(const std::string &prompt, const std::vector<MediaInput> &media,
+               MediaEmbeddingCache *cache, const std::string &key_prefix,
+               bool async_encode, uint64_t fingerprint,
+               std::vector<common_adapter_lora_info> lora,
+               PrefilledMedia &out);
+
+  // Bracket a request that hands media paths to a slot, which then runs the
+  // projector on the slot loop. While any is in flight, Prefill encodes with
+  // the loop paused rather than share the projector with it. Begin waits for
+  // a chunk being encoded to finish.
+  void BeginSlotMedia();
+  void EndSlotMedia();
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  std::shared_ptr<SlotLoopPause> _pause;
+  std::mutex _mutex;
+  llama_context *_ctx = nullptr;
+  uint64_t _fingerprint = 0;
+  std::string _dir;
+  size_t _files = 0;
+  // Held while a chunk is encoded
+  std::mutex _encode_mutex;
+  std::atomic<int> _slot_media{0};
+};
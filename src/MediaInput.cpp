@@ -0,0 +1,117 @@
+#include "MediaInput.h"
+#include <cstring>
+
+// Detects the container from magic bytes; rn-llama picks the image or audio
+// path from the data URL's mime type.
+static const char *SniffMediaMime(const uint8_t *data, size_t size) {
+  auto starts_with = [&](size_t offset, const char *magic, size_t n) {
+    return size >= offset + n && memcmp(data + offset, magic, n) == 0;
+  };
+  if (starts_with(0, "\x89PNG", 4)) return "image/png";
+  if (starts_with(0, "\xFF\xD8\xFF", 3)) return "image/jpeg";
+  if (starts_with(0, "GIF8", 4)) return "image/gif";
+  if (starts_with(0, "RIFF", 4) && starts_with(8, "WEBP", 4)) return "image/webp";
+  if (starts_with(0, "RIFF", 4) && starts_with(8, "WAVE", 4)) return "audio/wav";
+  if (starts_with(0, "BM", 2)) return "image/bmp";
+  if (starts_with(0, "ID3", 3)) return "audio/mpeg";
+  if (starts_with(0, "fLaC", 4)) return "audio/flac";
+  if (size >= 2 && data[0] == 0xFF && (data[1] & 0xE0) == 0xE0) {
+    return "audio/mpeg";
+  }
+  return nullptr;
+}
+
+static bool ParseMediaInput(const Napi::Value &value, MediaInput &input,
+                            std::string &error) {
+  if (value.IsString()) {
+    input.path = value.As<Napi::String>().Utf8Value();
+    return true;
+  }
+  if (value.IsTypedArray() &&
+      value.As<Napi::TypedArray>().TypedArrayType() == napi_uint8_array) {
+    // Covers Buffer as well; only the pointer is kept, the bytes are not
+    // copied here.
+    auto array = value.As<Napi::Uint8Array>();
+    input.data = array.Data();
+    input.size = array.ByteLength();
+    const char *mime = SniffMediaMime(input.data, input.size);
+    if (mime == nullptr) {
+      error = "Unsupported media buffer format";
+      return false;
+    }
+    input.mime = mime;
+    input.pin = std::make_shared<Napi::ObjectReference>(
+        Napi::Persistent(value.As<Napi::Object>()));
+    return true;
+  }
+  error = "media_paths entries must be strings, Buffers or Uint8Arrays";
+  return false;
+}
+
+bool ParseMediaInputs(const Napi::Value &value, std::vector<MediaInput> &out,
+                      std::string &error) {
+  if (is_nil(value)) {
+    return true;
+  }
+  if (value.IsArray()) {
+    auto array = value.As<Napi::Array>();
+    for (size_t i = 0; i < array.Length(); i++) {
+      MediaInput input;
+      if (!ParseMediaInput(array.Get(i), input, error)) {
+        return false;
+      }
+      out.push_back(std::move(input));
+    }
+    return true;
+  }
+  MediaInput input;
+  if (!ParseMediaInput(value, input, error)) {
+    return false;
+  }
+  out.push_back(std::move(input));
+  return true;
+}
+
+static void AppendBase64(std::string &out, const uint8_t *data, size_t size) {
+  static const char table[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const size_t start = out.size();
+  out.resize(start + (size + 2) / 3 * 4);
+  char *dst = &out[start];
+  size_t i = 0;
+  for (; i + 2 < size; i += 3) {
+    const uint32_t n = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    *dst++ = table[(n >> 18) & 63];
+    *dst++ = table[(n >> 12) & 63];
+    *dst++ = table[(n >> 6) & 63];
+    *dst++ = table[n & 63];
+  }
+  if (i < size) {
+    uint32_t n = data[i] << 16;
+    if (i + 1 < size) {
+      n |= data[i + 1] << 8;
+    }
+    *dst++ = table[(n >> 18) & 63];
+    *dst++ = table[(n >> 12) & 63];
+    *dst++ = i + 1 < size ? table[(n >> 6) & 63] : '=';
+    *dst++ = '=';
+  }
+}
+
+std::vector<std::string>
+ResolveMediaPaths(const std::vector<MediaInput> &inputs) {
+  std::vector<std::string> paths;
+  paths.reserve(inputs.size());
+  for (const auto &input : inputs) {
+    if (input.data == nullptr) {
+      paths.push_back(input.path);
+      continue;
+    }
+    std::string url;
+    url.reserve(5 + input.mime.size() + 8 + (input.size + 2) / 3 * 4);
+    url.append("data:").append(input.mime).append(";base64,");
+    AppendBase64(url, input.data, input.size);
+    paths.push_back(std::move(url));
+  }
+  return paths;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// One media_paths entry: a file path / data URL, or bytes borrowed from a JS
+// Buffer / Uint8Array. The backing object stays pinned until the input is
+// destroyed, which must happen on the JS thread (e.g. in a worker's dtor).
+struct MediaInput {
+  std::string path;
+  std::string mime;
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  std::shared_ptr<Napi::ObjectReference> pin;
+};
+
+// Reads `string | Buffer | Uint8Array` or an array of them. Returns false and
+// sets `error` on unsupported entries. JS thread only.
+bool ParseMediaInputs(const Napi::Value &value, std::vector<MediaInput> &out,
+                      std::string &error);
+
+// Converts inputs into the strings rn-llama accepts: byte inputs become
+// base64 data URLs. Only for media rn-llama evaluates itself (tokenize,
+// loadPrompt, slots of models MediaPrefillContext does not cover), since it
+// takes media by path only. Linear in the media size, so call it from a
+// worker's Execute, never on the JS thread.
+std::vector<std::string>
+ResolveMediaPaths(const std::vector<MediaInput> &inputs);
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Thread-safe free list for objects handed between a producer thread and the
+// JS thread. Recycled objects keep their string/vector capacity, so a steady
+// stream of payloads stops allocating once the pool is warm.
+//
+// T must be default-constructible, expose `std::shared_ptr<ObjectPool<T>>
+// pool` and implement Reset(). Create pools with std::make_shared.
+template <typename T>
+class ObjectPool : public std::enable_shared_from_this<ObjectPool<T>> {
+public:
+  explicit ObjectPool(size_t max_idle = 64) : _max_idle(max_idle) {}
+
+  ~ObjectPool() {
+    for (auto *item : _idle) {
+      delete item;
+    }
+  }
+
+  T *Acquire() {
+    T *item = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!_idle.empty()) {
+        item = _idle.back();
+        _idle.pop_back();
+      }
+    }
+    if (item == nullptr) {
+      item = new T();
+    }
+    item->pool = this->shared_from_this();
+    return item;
+  }
+
+  void Recycle(T *item) {
+    item->pool.reset();
+    item->Reset();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_idle.size() < _max_idle) {
+        _idle.push_back(item);
+        return;
+      }
+    }
+    delete item;
+  }
+
+private:
+  size_t _max_idle;
+  std::mutex _mutex;
+  std::vector<T *> _idle;
+};
+
+// Tracks how much of a growing generated text has been streamed out and
+// searches the unsent tail for stop words in place.
+class StreamTextCursor {
+public:
+  size_t Position(const std::string &text) const {
+    return std::min(_sent, text.size());
+  }
+
+  std::string_view Unsent(const std::string &text) const {
+    return std::string_view(text).substr(Position(text));
+  }
+
+  // Same search as rn-llama's findStoppingStrings over the unsent tail,
+  // without copying it: the earliest full match among the words that can
+  // end in the last token, or with `partial`, the earliest position where
+  // the tail ends in a prefix of a word. Returns a position in the tail and
+  // sets `word` to the match.
+  size_t FindStop(const std::string &text,
+                  const std::vector<std::string> &words,
+                  size_t last_token_size, bool partial,
+                  const std::string **word = nullptr) const {
+    const std::string_view tail = Unsent(text);
+    size_t stop_pos = std::string::npos;
+    for (const auto &candidate : words) {
+      size_t pos;
+      if (partial) {
+        pos = FindPartial(candidate, tail);
+      } else {
+        const size_t span = candidate.size() + last_token_size;
+        pos = tail.find(candidate, tail.size() > span ? tail.size() - span : 0);
+      }
+      if (pos != std::string::npos &&
+          (stop_pos == std::string::npos || pos < stop_pos)) {
+        stop_pos = pos;
+        if (word != nullptr) {
+          *word = &candidate;
+        }
+      }
+    }
+    return stop_pos;
+  }
+
+  void Advance(size_t n) { _sent += n; }
+
+private:
+  // Start of the longest suffix of `text` that is a prefix of `stop`
+  static size_t FindPartial(std::string_view stop, std::string_view text) {
+    if (text.empty() || stop.empty()) {
+      return std::string::npos;
+    }
+    for (size_t n = std::min(stop.size(), text.size()); n > 0; n--) {
+      if (stop[n - 1] == text.back() &&
+          text.compare(text.size() - n, n, stop.substr(0, n)) == 0) {
+        return text.size() - n;
+      }
+    }
+    return std::string::npos;
+  }
+
+  size_t _sent = 0;
+};
@@ -0,0 +1,467 @@
+#include "PrefixCache.h"
+#include "EmbeddingCache.h"
+#include "MappedFile.h"
+#include "SessionDelta.h"
+#include "rn-llama/rn-completion.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[4] = {'L', 'N', 'P', 'C'};
+const uint32_t kVersion = 1;
+
+struct ManifestHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t n_tokens;
+  uint32_t n_chunks;
+  uint64_t state_size;
+};
+
+struct ManifestChunk {
+  uint64_t hash;
+  uint64_t size;
+};
+
+struct Manifest {
+  std::vector<llama_token> tokens;
+  std::vector<ManifestChunk> chunks;
+  uint64_t state_size = 0;
+};
+
+// Layout: header, tokens, chunks, then the hash of everything before it
+bool ReadManifest(const std::string &path, uint64_t key, Manifest &manifest) {
+  MappedFile file(path);
+  if (!file.Valid() || file.Size() < sizeof(ManifestHeader) + sizeof(uint64_t)) {
+    return false;
+  }
+  const size_t body = file.Size() - sizeof(uint64_t);
+  uint64_t checksum;
+  memcpy(&checksum, file.Data() + body, sizeof(checksum));
+  if (ContentHash64(file.Data(), body) != checksum) {
+    return false;
+  }
+  ManifestHeader header;
+  memcpy(&header, file.Data(), sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.key != key ||
+      body != sizeof(header) + header.n_tokens * sizeof(llama_token) +
+                  header.n_chunks * sizeof(ManifestChunk)) {
+    return false;
+  }
+  const uint8_t *p = file.Data() + sizeof(header);
+  manifest.tokens.resize(header.n_tokens);
+  memcpy(manifest.tokens.data(), p, header.n_tokens * sizeof(llama_token));
+  p += header.n_tokens * sizeof(llama_token);
+  manifest.chunks.resize(header.n_chunks);
+  memcpy(manifest.chunks.data(), p, header.n_chunks * sizeof(ManifestChunk));
+  manifest.state_size = header.state_size;
+  return true;
+}
+
+} // namespace
+
+PrefixCache::PrefixCache(const std::string &dir, uint64_t fingerprint,
+                         size_t block_size)
+    : _root((fs::path(dir) / Hex(fingerprint)).string()),
+      _fingerprint(fingerprint), _block_size(std::max<size_t>(block_size, 1)) {
+  std::random_device rd;
+  _tmp_suffix = "." + Hex((static_cast<uint64_t>(rd()) << 32) | rd());
+  std::error_code ec;
+  fs::create_directories(_root, ec);
+  _thread = std::thread([this]() { Run(); });
+}
+
+PrefixCache::~PrefixCache() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _cv.notify_all();
+  _thread.join();
+}
+
+uint64_t PrefixCache::Fingerprint(rnllama::llama_rn_context *rn_ctx) {
+  const auto &params = rn_ctx->params;
+  const uint32_t n_seq = params.kv_unified ? 1 : llama_n_seq_max(rn_ctx->ctx);
+  // State written with a different K/V type, V layout, stream count or
+  // stream size does not restore, so keep those in separate directories.
+  const uint64_t layout[7] = {
+      EmbeddingCacheFingerprint(rn_ctx->model, params.model.path),
+      static_cast<uint64_t>(params.cache_type_k),
+      static_cast<uint64_t>(params.cache_type_v),
+      static_cast<uint64_t>(params.flash_attn_type),
+      n_seq,
+      llama_n_ctx(rn_ctx->ctx) / n_seq,
+      LLAMA_STATE_SEQ_VERSION};
+  uint64_t hash = ContentHash64(reinterpret_cast<const uint8_t *>(layout),
+                                sizeof(layout));
+  // Adapters change every layer's KV, so each set gets its own directory
+  for (const auto &lora : rn_ctx->getLoadedLoraAdapters()) {
+    std::vector<uint8_t> desc(lora.path.begin(), lora.path.end());
+    const auto *scale = reinterpret_cast<const uint8_t *>(&lora.scale);
+    desc.insert(desc.end(), scale, scale + sizeof(lora.scale));
+    const uint64_t pair[2] = {hash, ContentHash64(desc.data(), desc.size())};
+    hash = ContentHash64(reinterpret_cast<const uint8_t *>(pair), sizeof(pair));
+  }
+  return hash;
+}
+
+std::string PrefixCache::Path(uint64_t key, const char *suffix) const {
+  return (fs::path(_root) / (Hex(key) + suffix)).string();
+}
+
+std::string PrefixCache::ChunkPath(uint64_t hash) const {
+  const std::string name = Hex(hash);
+  return (fs::path(_root) / "chunks" / name.substr(0, 2) / name).string();
+}
+
+PrefixCache::Plan PrefixCache::Lookup(const std::vector<llama_token> &tokens,
+                                      size_t min_tokens) {
+  Plan plan;
+  if (tokens.size() <= _block_size) {
+    return plan;
+  }
+  const size_t n_blocks = (tokens.size() - 1) / _block_size;
+  std::vector<uint64_t> keys(n_blocks);
+  uint64_t key = _fingerprint;
+  for (size_t i = 0; i < n_blocks; i++) {
+    key = BlockKey(key, tokens.data() + i * _block_size, _block_size);
+    keys[i] = key;
+  }
+
+  std::vector<uint64_t> unseen;
+  std::error_code ec;
+  for (size_t i = n_blocks; i-- > 0;) {
+    const size_t boundary = (i + 1) * _block_size;
+    if (fs::exists(Path(keys[i], ".prefix"), ec)) {
+      if (boundary > min_tokens) {
+        plan.hit = boundary;
+        plan.hit_key = keys[i];
+      }
+      break;
+    }
+    if (fs::exists(Path(keys[i], ".seen"), ec)) {
+      if (plan.store == 0) {
+        plan.store = boundary;
+        plan.store_key = keys[i];
+      }
+    } else {
+      unseen.push_back(keys[i]);
+    }
+  }
+  if (!unseen.empty()) {
+    Enqueue([this, unseen]() {
+      for (const uint64_t key : unseen) {
+        std::ofstream(Path(key, ".seen"), std::ios::binary | std::ios::app);
+      }
+    });
+  }
+  return plan;
+}
+
+size_t PrefixCache::Read(uint64_t key, const std::vector<llama_token> &tokens,
+                         std::vector<uint8_t> &state) {
+  Manifest manifest;
+  if (!ReadManifest(Path(key, ".prefix"), key, manifest)) {
+    return 0;
+  }
+  const size_t n = std::min(tokens.size(), manifest.tokens.size());
+  const size_t common =
+      std::mismatch(tokens.begin(), tokens.begin() + n, manifest.tokens.begin())
+          .first -
+      tokens.begin();
+  if (common == 0) {
+    return 0;
+  }
+
+  state.resize(static_cast<size_t>(manifest.state_size));
+  size_t offset = 0;
+  for (const auto &chunk : manifest.chunks) {
+    MappedFile file(ChunkPath(chunk.hash));
+    if (!file.Valid() || file.Size() != chunk.size ||
+        chunk.size > state.size() - offset ||
+        ContentHash64(file.Data(), file.Size()) != chunk.hash) {
+      return 0;
+    }
+    memcpy(state.data() + offset, file.Data(), file.Size());
+    offset += file.Size();
+  }
+  return offset == state.size() ? common : 0;
+}
+
+bool PrefixCache::WriteFile(const std::string &path, const void *data,
+                            size_t size) {
+  std::error_code ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+  const std::string tmp_path =
+      path + _tmp_suffix + "-" + std::to_string(_tmp_counter++) + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(static_cast<const char *>(data),
+              static_cast<std::streamsize>(size));
+    out.close();
+    if (!out) {
+      fs::remove(tmp_path, ec);
+      return false;
+    }
+  }
+  // Another writer may have renamed identical content into place first
+  fs::rename(tmp_path, path, ec);
+  if (ec) {
+    fs::remove(tmp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+void PrefixCache::WriteState(uint64_t key,
+                             const std::vector<llama_token> &tokens,
+                             const uint8_t *state, size_t size) {
+  std::vector<ManifestChunk> chunks;
+  size_t start = 0;
+  std::error_code ec;
+  for (const size_t end : ContentChunkEnds(state, size)) {
+    ManifestChunk chunk = {ContentHash64(state + start, end - start),
+                           end - start};
+    const std::string path = ChunkPath(chunk.hash);
+    if (fs::file_size(path, ec) != chunk.size &&
+        !WriteFile(path, state + start, end - start)) {
+      return;
+    }
+    chunks.push_back(chunk);
+    start = end;
+  }
+
+  // The manifest goes last, so it never names a chunk that is not on disk
+  ManifestHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.key = key;
+  header.n_tokens = static_cast<uint32_t>(tokens.size());
+  header.n_chunks = static_cast<uint32_t>(chunks.size());
+  header.state_size = size;
+  std::vector<uint8_t> out(sizeof(header));
+  memcpy(out.data(), &header, sizeof(header));
+  const auto *token_bytes = reinterpret_cast<const uint8_t *>(tokens.data());
+  out.insert(out.end(), token_bytes,
+             token_bytes + tokens.size() * sizeof(llama_token));
+  const auto *chunk_bytes = reinterpret_cast<const uint8_t *>(chunks.data());
+  out.insert(out.end(), chunk_bytes,
+             chunk_bytes + chunks.size() * sizeof(ManifestChunk));
+  const uint64_t checksum = ContentHash64(out.data(), out.size());
+  const auto *checksum_bytes = reinterpret_cast<const uint8_t *>(&checksum);
+  out.insert(out.end(), checksum_bytes, checksum_bytes + sizeof(checksum));
+  WriteFile(Path(key, ".prefix"), out.data(), out.size());
+}
+
+void PrefixCache::WriteSlotState(uint64_t key) {
+  Manifest manifest;
+  if (!ReadManifest(Path(key, ".prefix"), key, manifest)) {
+    return;
+  }
+  std::vector<uint8_t> state;
+  if (Read(key, manifest.tokens, state) == 0) {
+    return;
+  }
+  // llama_state_seq_save_file layout
+  const uint32_t header[3] = {LLAMA_STATE_SEQ_MAGIC, LLAMA_STATE_SEQ_VERSION,
+                              static_cast<uint32_t>(manifest.tokens.size())};
+  const size_t tokens_size = manifest.tokens.size() * sizeof(llama_token);
+  std::vector<uint8_t> out(sizeof(header) + tokens_size + state.size());
+  memcpy(out.data(), header, sizeof(header));
+  memcpy(out.data() + sizeof(header), manifest.tokens.data(), tokens_size);
+  memcpy(out.data() + sizeof(header) + tokens_size, state.data(), state.size());
+  WriteFile(Path(key, ".seq"), out.data(), out.size());
+}
+
+void PrefixCache::Store(uint64_t key, std::vector<llama_token> tokens,
+                        std::vector<uint8_t> state) {
+  auto tokens_ptr = std::make_shared<std::vector<llama_token>>(std::move(tokens));
+  auto state_ptr = std::make_shared<std::vector<uint8_t>>(std::move(state));
+  Enqueue([this, key, tokens_ptr, state_ptr]() {
+    WriteState(key, *tokens_ptr, state_ptr->data(), state_ptr->size());
+  });
+}
+
+void PrefixCache::Ingest(uint64_t key, const std::string &path) {
+  Enqueue([this, key, path]() {
+    bool stored = false;
+    {
+      MappedFile file(path);
+      uint32_t header[3];
+      if (file.Valid() && file.Size() >= sizeof(header)) {
+        memcpy(header, file.Data(), sizeof(header));
+        const size_t tokens_size = header[2] * sizeof(llama_token);
+        if (header[0] == LLAMA_STATE_SEQ_MAGIC &&
+            header[1] == LLAMA_STATE_SEQ_VERSION &&
+            file.Size() > sizeof(header) + tokens_size) {
+          std::vector<llama_token> tokens(header[2]);
+          memcpy(tokens.data(), file.Data() + sizeof(header), tokens_size);
+          const size_t offset = sizeof(header) + tokens_size;
+          WriteState(key, tokens, file.Data() + offset, file.Size() - offset);
+          stored = true;
+        }
+      }
+    }
+    std::error_code ec;
+    if (stored) {
+      // Already in the slot format: keep it as the slot state
+      fs::rename(path, Path(key, ".seq"), ec);
+    }
+    if (!stored || ec) {
+      fs::remove(path, ec);
+    }
+  });
+}
+
+std::string PrefixCache::SlotStatePath(uint64_t key) {
+  const std::string path = Path(key, ".seq");
+  std::error_code ec;
+  if (fs::exists(path, ec)) {
+    return path;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_pending_slot_states.insert(key).second) {
+      return "";
+    }
+  }
+  Enqueue([this, key]() {
+    WriteSlotState(key);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending_slot_states.erase(key);
+  });
+  return "";
+}
+
+std::string PrefixCache::SlotTempPath(uint64_t key) {
+  return Path(key, ".seq") + _tmp_suffix + "-" +
+         std::to_string(_tmp_counter++) + ".tmp";
+}
+
+void PrefixCache::Enqueue(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(std::move(job));
+  }
+  _cv.notify_all();
+}
+
+void PrefixCache::Flush() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cv.wait(lock, [this]() { return _jobs.empty() && !_busy; });
+}
+
+void PrefixCache::Run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _cv.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+    if (_jobs.empty()) {
+      return;
+    }
+    auto job = std::move(_jobs.front());
+    _jobs.pop_front();
+    _busy = true;
+    lock.unlock();
+    try {
+      job();
+    } catch (const std::exception &) {
+      // A failed write only costs a future miss
+    }
+    lock.lock();
+    _busy = false;
+    _cv.notify_all();
+  }
+}
+
+bool PrefixCacheSupported(rnllama::llama_rn_context *rn_ctx) {
+  const llama_model *model = rn_ctx->model;
+  return !llama_model_is_recurrent(model) && !llama_model_is_hybrid(model) &&
+         (rn_ctx->params.swa_full || llama_model_n_swa(model) == 0);
+}
+
+bool PrefillPrefix(rnllama::llama_rn_context *rn_ctx, PrefixCache &cache,
+                   const std::string &prompt) {
+  if (!PrefixCacheSupported(rn_ctx)) {
+    return false;
+  }
+  // Same tokens loadPrompt evaluates, BOS included, or no block would match
+  const auto tokens = common_tokenize(rn_ctx->ctx, prompt, true, true);
+  // loadPrompt truncates prompts that do not fit; leave those to it
+  if (tokens.empty() || tokens.size() >= llama_n_ctx(rn_ctx->ctx)) {
+    return false;
+  }
+
+  auto completion = rn_ctx->completion;
+  const auto &prev_tokens = completion->embd;
+  const size_t n_prev = std::min(prev_tokens.size(), tokens.size() - 1);
+  size_t n_done = std::mismatch(prev_tokens.begin(), prev_tokens.begin() + n_prev,
+                                tokens.begin())
+                      .first -
+                  prev_tokens.begin();
+  const auto plan = cache.Lookup(tokens, n_done);
+  if (plan.hit == 0 && plan.store == 0) {
+    return false;
+  }
+
+  llama_context *ctx = rn_ctx->ctx;
+  auto *memory = llama_get_memory(ctx);
+  std::vector<uint8_t> state;
+  if (plan.hit > 0) {
+    const size_t n =
+        std::min(cache.Read(plan.hit_key, tokens, state), tokens.size() - 1);
+    if (n > n_done) {
+      // A failed restore leaves sequence 0 empty
+      n_done = llama_state_seq_set_data(ctx, state.data(), state.size(), 0) ==
+                       state.size()
+                   ? n
+                   : 0;
+    }
+  }
+  if (!llama_memory_seq_rm(memory, 0, n_done, -1)) {
+    llama_memory_seq_rm(memory, 0, 0, -1);
+    n_done = 0;
+  }
+
+  if (plan.store > 0) {
+    const int32_t n_batch = rn_ctx->params.n_batch;
+    bool ok = true;
+    while (ok && n_done < plan.store) {
+      const int32_t n_eval =
+          static_cast<int32_t>(std::min<size_t>(n_batch, plan.store - n_done));
+      ok = llama_decode(ctx, llama_batch_get_one(
+                                 const_cast<llama_token *>(tokens.data() + n_done),
+                                 n_eval)) == 0;
+      if (ok) {
+        n_done += n_eval;
+      }
+    }
+    if (ok) {
+      state.resize(llama_state_seq_get_size(ctx, 0));
+      state.resize(llama_state_seq_get_data(ctx, state.data(), state.size(), 0));
+      if (!state.empty()) {
+        cache.Store(plan.store_key,
+                    std::vector<llama_token>(tokens.begin(),
+                                             tokens.begin() + n_done),
+                    std::move(state));
+      }
+    }
+  }
+
+  // Publish the evaluated prefix so loadPrompt resumes after it
+  llama_memory_seq_rm(memory, 0, n_done, -1);
+  completion->embd.assign(tokens.begin(), tokens.begin() + n_done);
+  completion->n_past = static_cast<llama_pos>(n_done);
+  rn_ctx->setMediaHashes({});
+  return true;
+}
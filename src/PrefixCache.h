@@ -0,0 +1,123 @@
+#pragma once
+
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// On-disk cache of prompt-prefix KV state, shared by every process that
+// points at the same directory with the same model and cache layout.
+//
+// Prompts are cut into fixed-size token blocks and each block boundary gets
+// a rolling key: the hash of the previous key and the block's tokens, seeded
+// with the fingerprint. Sequence state is split into content-defined chunks
+// (ContentChunkEnds) stored once under their content hash, so prefixes that
+// share a system prompt share most of their bytes on disk. A manifest per key
+// lists the state's tokens and chunks.
+//
+// A boundary is stored the second time any process sees it, i.e. once it is
+// known to be shared, and looked up on every later prompt. Files are written
+// to a temporary name and renamed into place, so concurrent writers of the
+// same content race harmlessly and readers only see complete files. Reads
+// go through mmap and verify the chunk hashes; anything unreadable is a
+// miss.
+//
+// <dir>/<fingerprint>/<key>.prefix   manifest
+// <dir>/<fingerprint>/<key>.seen     boundary marker (empty)
+// <dir>/<fingerprint>/<key>.seq      slot-loadable state (parallel mode)
+// <dir>/<fingerprint>/chunks/<hh>/<hash>
+class PrefixCache {
+public:
+  PrefixCache(const std::string &dir, uint64_t fingerprint, size_t block_size);
+  // Finishes queued writes
+  ~PrefixCache();
+
+  struct Plan {
+    // Longest boundary with a manifest, 0 if none
+    size_t hit = 0;
+    uint64_t hit_key = 0;
+    // Deepest shared boundary past `hit` that has no manifest yet, 0 if none
+    size_t store = 0;
+    uint64_t store_key = 0;
+  };
+
+  // Looks up the boundaries of `tokens` that leave at least one token to
+  // evaluate and marks them as seen. Only prefixes longer than `min_tokens`
+  // count as hits; shorter ones are already in memory.
+  Plan Lookup(const std::vector<llama_token> &tokens, size_t min_tokens);
+
+  // Restores the state stored under `key` into `state` and returns how many
+  // leading tokens it has in common with `tokens`, or 0 on a miss.
+  size_t Read(uint64_t key, const std::vector<llama_token> &tokens,
+              std::vector<uint8_t> &state);
+
+  // Queues writing sequence `state` for `tokens` under `key`
+  void Store(uint64_t key, std::vector<llama_token> tokens,
+             std::vector<uint8_t> state);
+
+  // Queues storing a llama_state_seq_save_file written by a slot under
+  // `key`. The file becomes the key's slot state (SlotStatePath).
+  void Ingest(uint64_t key, const std::string &path);
+
+  // Path of a slot-loadable state file for `key`, or empty when there is
+  // none yet; one is then built in the background from the manifest.
+  std::string SlotStatePath(uint64_t key);
+
+  // Unique temporary path for a slot to save the state of `key` to
+  std::string SlotTempPath(uint64_t key);
+
+  // Blocks until queued writes are on disk
+  void Flush();
+
+  uint64_t fingerprint() const { return _fingerprint; }
+
+  // Identifies the model file, the applied LoRA adapters and the KV cache
+  // layout of a context
+  static uint64_t Fingerprint(rnllama::llama_rn_context *rn_ctx);
+
+private:
+  std::string Path(uint64_t key, const char *suffix) const;
+  std::string ChunkPath(uint64_t hash) const;
+  void Enqueue(std::function<void()> job);
+  void Run();
+
+  void WriteState(uint64_t key, const std::vector<llama_token> &tokens,
+                  const uint8_t *state, size_t size);
+  void WriteSlotState(uint64_t key);
+  // Writes `size` bytes to `path` through a temporary file
+  bool WriteFile(const std::string &path, const void *data, size_t size);
+
+  std::string _root;
+  uint64_t _fingerprint;
+  size_t _block_size;
+  std::string _tmp_suffix;
+  std::atomic<uint64_t> _tmp_counter{0};
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque<std::function<void()>> _jobs;
+  std::unordered_set<uint64_t> _pending_slot_states;
+  bool _busy = false;
+  bool _stopping = false;
+  std::thread _thread;
+};
+
+// False for models whose memory cannot be cut back to a block boundary:
+// recurrent and hybrid models, and sliding-window caches without swa_full.
+bool PrefixCacheSupported(rnllama::llama_rn_context *rn_ctx);
+
+// Restores the longest cached prefix of `prompt` into sequence 0 and, when
+// the prompt crosses a shared boundary that is not cached yet, evaluates up
+// to it and queues its state for storing. The evaluated prefix is handed to
+// rn-llama like a loaded session, so loadPrompt resumes after it. Returns
+// false without touching memory for prompts, models or cache layouts the
+// cache does not cover.
+bool PrefillPrefix(rnllama::llama_rn_context *rn_ctx, PrefixCache &cache,
+                   const std::string &prompt);
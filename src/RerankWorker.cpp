@@ -1,17 +1,106 @@
 #include "RerankWorker.h"
+#include "EmbeddingBatchWorker.h"
 #include "LlamaContext.h"
+#include <algorithm>
+#include <stdexcept>
 
 RerankWorker::RerankWorker(const Napi::CallbackInfo &info,
                            rnllama::llama_rn_context* rn_ctx, std::string query,
                            std::vector<std::string> documents,
-                           common_params &params)
+                           common_params &params, RerankOptions options)
     : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx), _query(query),
-      _documents(documents), _params(params) {}
+      _documents(documents), _params(params), _options(options) {}
+
+// Scores all documents with the query tokenized once, packing
+// [BOS] query [EOS] [SEP] document [EOS] sequences into shared decodes.
+std::vector<float> RerankWorker::ScoreBatched() {
+  CheckPackedContext(_rn_ctx);
+  const llama_vocab *vocab = llama_model_get_vocab(_rn_ctx->model);
+  const auto query = common_tokenize(vocab, _query, false, true);
+
+  std::vector<llama_token> prefix;
+  if (llama_vocab_get_add_bos(vocab)) {
+    prefix.push_back(llama_vocab_bos(vocab));
+  }
+  prefix.insert(prefix.end(), query.begin(), query.end());
+  if (llama_vocab_get_add_eos(vocab)) {
+    prefix.push_back(llama_vocab_eos(vocab));
+  }
+  if (llama_vocab_get_add_sep(vocab)) {
+    prefix.push_back(llama_vocab_sep(vocab));
+  }
+  const size_t n_suffix = llama_vocab_get_add_eos(vocab) ? 1 : 0;
+
+  const size_t limit =
+      EmbeddingBatchTokenLimit(_rn_ctx->ctx, _options.max_batch_tokens);
+  if (prefix.size() + n_suffix >= limit) {
+    throw std::runtime_error("Query does not fit in the batch size");
+  }
+  size_t doc_budget = limit - prefix.size() - n_suffix;
+  if (_options.max_doc_tokens > 0) {
+    doc_budget = std::min(doc_budget, _options.max_doc_tokens);
+  }
+
+  std::vector<std::vector<llama_token>> sequences;
+  sequences.reserve(_documents.size());
+  for (const auto &document : _documents) {
+    auto doc = common_tokenize(vocab, document, false, true);
+    if (doc.size() > doc_budget) {
+      doc.resize(doc_budget);
+    }
+    std::vector<llama_token> sequence;
+    sequence.reserve(prefix.size() + doc.size() + n_suffix);
+    sequence.insert(sequence.end(), prefix.begin(), prefix.end());
+    sequence.insert(sequence.end(), doc.begin(), doc.end());
+    if (n_suffix > 0) {
+      sequence.push_back(llama_vocab_eos(vocab));
+    }
+    sequences.push_back(std::move(sequence));
+  }
+
+  std::vector<float> out;
+  size_t n_out = 0;
+  EmbedSequences(_rn_ctx, sequences, _options.max_batch_tokens,
+                 _params.embd_normalize, out, n_out);
+  std::vector<float> scores(_documents.size());
+  for (size_t i = 0; i < scores.size(); i++) {
+    scores[i] = out[i * n_out];
+  }
+  return scores;
+}
 
 void RerankWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
   try {
-    std::vector<float> scores = _rn_ctx->completion->rerank(_query, _documents);
-    _result.scores = scores;
+    std::vector<float> scores;
+    // Rerankers driven by a prompt template are formatted by rn-llama
+    if (llama_pooling_type(_rn_ctx->ctx) == LLAMA_POOLING_TYPE_RANK &&
+        llama_model_chat_template(_rn_ctx->model, "rerank") == nullptr) {
+      scores = ScoreBatched();
+    } else {
+      scores = _rn_ctx->completion->rerank(_query, _documents);
+    }
+
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < scores.size(); i++) {
+      if (scores[i] >= _options.threshold) {
+        indices.push_back(i);
+      }
+    }
+    if (_options.top_k > 0 &&
+        indices.size() > static_cast<size_t>(_options.top_k)) {
+      std::partial_sort(indices.begin(), indices.begin() + _options.top_k,
+                        indices.end(), [&](size_t a, size_t b) {
+                          return scores[a] > scores[b];
+                        });
+      indices.resize(_options.top_k);
+    }
+    for (size_t i : indices) {
+      _result.scores.push_back(scores[i]);
+      _result.indices.push_back(i);
+    }
   } catch (const std::exception &e) {
     SetError(e.what());
   }
@@ -20,18 +109,18 @@ void RerankWorker::Execute() {
 void RerankWorker::OnOK() {
   Napi::Env env = Napi::AsyncWorker::Env();
   auto result = Napi::Array::New(env, _result.scores.size());
-  
+
   // Create result array with score and index, similar to llama.rn
   for (size_t i = 0; i < _result.scores.size(); i++) {
     auto item = Napi::Object::New(env);
     item.Set("score", Napi::Number::New(env, _result.scores[i]));
-    item.Set("index", Napi::Number::New(env, (int)i));
+    item.Set("index", Napi::Number::New(env, (int)_result.indices[i]));
     result.Set(i, item);
   }
-  
+
   Napi::Promise::Deferred::Resolve(result);
 }
 
 void RerankWorker::OnError(const Napi::Error &err) {
   Napi::Promise::Deferred::Reject(err.Value());
-} 
\ No newline at end of file
+}
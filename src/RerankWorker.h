@@ -1,17 +1,37 @@
+#include "SessionState.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
+#include <limits>
+#include <memory>
 #include <vector>
 
+struct RerankOptions {
+  // Keep only the best `top_k` documents (0 keeps all)
+  int32_t top_k = 0;
+  // Drop documents scoring below this
+  float threshold = -std::numeric_limits<float>::infinity();
+  // Truncate each document to this many tokens (0: whatever fits the batch)
+  size_t max_doc_tokens = 0;
+  // Tokens per decode when packing (query, document) pairs (0: n_batch)
+  size_t max_batch_tokens = 0;
+};
+
 struct RerankResult {
   std::vector<float> scores;
+  std::vector<size_t> indices;
 };
 
 class RerankWorker : public Napi::AsyncWorker,
                      public Napi::Promise::Deferred {
 public:
   RerankWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx,
-               std::string query, std::vector<std::string> documents, 
-               common_params &params);
+               std::string query, std::vector<std::string> documents,
+               common_params &params, RerankOptions options);
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
 
 protected:
   void Execute();
@@ -19,9 +39,13 @@ protected:
   void OnError(const Napi::Error &err);
 
 private:
+  std::vector<float> ScoreBatched();
+
   rnllama::llama_rn_context* _rn_ctx;
   std::string _query;
   std::vector<std::string> _documents;
   common_params _params;
+  RerankOptions _options;
   RerankResult _result;
-}; 
\ No newline at end of file
+  std::shared_ptr<ContextGate> _gate;
+};
@@ -1,53 +1,81 @@
 #include "SaveSessionWorker.h"
 #include "LlamaContext.h"
-
-#include <algorithm>
+#include "SessionState.h"
+#include <filesystem>
 
 SaveSessionWorker::SaveSessionWorker(const Napi::CallbackInfo &info,
-                                     rnllama::llama_rn_context* rn_ctx)
+                                     rnllama::llama_rn_context* rn_ctx,
+                                     SessionSaveOptions options)
     : AsyncWorker(info.Env()), Deferred(info.Env()), _path(info[0].ToString()),
-      _rn_ctx(rn_ctx) {}
+      _rn_ctx(rn_ctx), _options(options) {}
 
 void SaveSessionWorker::Execute() {
+  if (_after) {
+    _after->Wait();
+  }
+  SessionSnapshot snapshot;
   try {
     if (!_rn_ctx || !_rn_ctx->ctx || !_rn_ctx->completion) {
-      SetError("Context or completion not initialized");
-      return;
+      throw std::runtime_error("Context or completion not initialized");
     }
     if (_rn_ctx->slot_manager != nullptr) {
       // The single-completion token history does not describe the parallel
       // slots' sequences, so a whole-context save would be inconsistent.
-      SetError("Session save is not supported while parallel mode is enabled");
-      return;
+      throw std::runtime_error(
+          "Session save is not supported while parallel mode is enabled");
     }
 
-    // Keep LLAMA_TOKEN_NULL media placeholders: llama_state_save_file
-    // serializes the whole memory, so its token list must cover the same
-    // positions for the session to remain resumable.
-    const auto &tokens = _rn_ctx->completion->embd;
-
-    // Remove stale metadata before overwriting the state file. If the save is
-    // interrupted, no metadata is safer than metadata for a different state.
-    rnllama::write_state_meta(_path, {});
+    if (_options.snapshot || _options.delta ||
+        _options.codec != SessionCodec::NONE) {
+      snapshot = CaptureSession(_rn_ctx);
+    } else {
+      // Placeholder tokens identify media positions but not the media
+      // itself; the hashes are persisted alongside so a later load can
+      // verify reuse.
+      const auto session = CaptureSessionTokens(_rn_ctx);
+      const auto &tokens = session.tokens;
 
-    if (!llama_state_save_file(_rn_ctx->ctx, _path.c_str(), tokens.data(),
-                               tokens.size())) {
-      SetError("Failed to save session");
-      return;
+      // Remove stale metadata before overwriting the state file. If the save
+      // is interrupted, no metadata is safer than metadata for a different
+      // state.
+      rnllama::write_state_meta(_path, {});
+      if (!llama_state_save_file(_rn_ctx->ctx, _path.c_str(), tokens.data(),
+                                 tokens.size())) {
+        throw std::runtime_error("Failed to save session");
+      }
+      rnllama::write_state_meta(_path, session.media_hashes);
+      _result.file_size = std::filesystem::file_size(_path);
+      _result.bytes_written = _result.file_size;
     }
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
 
-    // Placeholder tokens identify media positions but not the media itself.
-    // Persist the hashes alongside the state so a later load can verify reuse.
-    const bool media_retained =
-        std::find(tokens.begin(), tokens.end(), LLAMA_TOKEN_NULL) != tokens.end();
-    rnllama::write_state_meta(
-        _path, media_retained ? _rn_ctx->getMediaHashes()
-                              : std::vector<std::string>{});
+  // Only the copy is used from here on, so queued work can have the context
+  if (_release) {
+    _release->Open();
+  }
+  if (!snapshot.data) {
+    return;
+  }
+  try {
+    rnllama::write_state_meta(_path, {});
+    _result = WriteSession(snapshot, _path, _options);
+    rnllama::write_state_meta(_path, snapshot.session.media_hashes);
   } catch (const std::exception &e) {
     SetError(e.what());
   }
 }
 
-void SaveSessionWorker::OnOK() { Resolve(AsyncWorker::Env().Undefined()); }
+void SaveSessionWorker::OnOK() {
+  Napi::Env env = AsyncWorker::Env();
+  auto result = Napi::Object::New(env);
+  result.Set("bytes_written",
+             Napi::Number::New(env, static_cast<double>(_result.bytes_written)));
+  result.Set("file_size",
+             Napi::Number::New(env, static_cast<double>(_result.file_size)));
+  result.Set("compacted", Napi::Boolean::New(env, _result.compacted));
+  Resolve(result);
+}
 
 void SaveSessionWorker::OnError(const Napi::Error &err) { Reject(err.Value()); }
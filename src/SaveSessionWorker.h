@@ -1,10 +1,20 @@
+#include "SessionState.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
 
 class SaveSessionWorker : public Napi::AsyncWorker,
                           public Napi::Promise::Deferred {
 public:
-  SaveSessionWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx);
+  SaveSessionWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx,
+                    SessionSaveOptions options = {});
+
+  // Waits on `after` before using the context and opens `release` as soon
+  // as the state is copied (snapshot mode) or saved.
+  void SetContextGates(std::shared_ptr<ContextGate> after,
+                       std::shared_ptr<ContextGate> release) {
+    _after = std::move(after);
+    _release = std::move(release);
+  }
 
 protected:
   void Execute();
@@ -14,4 +24,8 @@ protected:
 private:
   std::string _path;
   rnllama::llama_rn_context* _rn_ctx;
+  SessionSaveOptions _options;
+  DeltaSaveResult _result;
+  std::shared_ptr<ContextGate> _after;
+  std::shared_ptr<ContextGate> _release;
 };
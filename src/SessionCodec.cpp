@@ -0,0 +1,263 @@
+#include "SessionCodec.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <limits>
+#include <lz4.h>
+#include <stdexcept>
+
+#ifdef LLAMA_NODE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+const char kMagic[4] = {'L', 'N', 'S', 'Z'};
+const uint32_t kVersion = 1;
+
+struct SessionFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t codec;
+  uint32_t chunk_size;
+  uint64_t raw_size;
+};
+
+// Splits 2-byte lanes into planes: low bytes first, then high bytes. An odd
+// trailing byte is copied as is.
+void Shuffle2(const uint8_t *src, size_t size, uint8_t *dst) {
+  const size_t half = size / 2;
+  for (size_t i = 0; i < half; i++) {
+    dst[i] = src[2 * i];
+    dst[half + i] = src[2 * i + 1];
+  }
+  if (size & 1) {
+    dst[size - 1] = src[size - 1];
+  }
+}
+
+void Unshuffle2(const uint8_t *src, size_t size, uint8_t *dst) {
+  const size_t half = size / 2;
+  for (size_t i = 0; i < half; i++) {
+    dst[2 * i] = src[i];
+    dst[2 * i + 1] = src[half + i];
+  }
+  if (size & 1) {
+    dst[size - 1] = src[size - 1];
+  }
+}
+
+size_t CompressBound(SessionCodec codec, size_t size) {
+#ifdef LLAMA_NODE_ZSTD
+  if (codec == SessionCodec::ZSTD) {
+    return ZSTD_compressBound(size);
+  }
+#endif
+  (void)codec;
+  return static_cast<size_t>(LZ4_compressBound(static_cast<int>(size)));
+}
+
+// Returns 0 when the chunk does not compress
+size_t CompressChunk(SessionCodec codec, int level, const uint8_t *src,
+                     size_t size, uint8_t *dst, size_t capacity) {
+#ifdef LLAMA_NODE_ZSTD
+  if (codec == SessionCodec::ZSTD) {
+    const size_t n = ZSTD_compress(dst, capacity, src, size, level);
+    return ZSTD_isError(n) ? 0 : n;
+  }
+#endif
+  (void)codec;
+  (void)level;
+  const int n = LZ4_compress_default(
+      reinterpret_cast<const char *>(src), reinterpret_cast<char *>(dst),
+      static_cast<int>(size),
+      static_cast<int>(std::min<size_t>(capacity, std::numeric_limits<int>::max())));
+  return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+bool DecompressChunk(SessionCodec codec, const uint8_t *src, size_t size,
+                     uint8_t *dst, size_t raw_size) {
+#ifdef LLAMA_NODE_ZSTD
+  if (codec == SessionCodec::ZSTD) {
+    const size_t n = ZSTD_decompress(dst, raw_size, src, size);
+    return !ZSTD_isError(n) && n == raw_size;
+  }
+#endif
+  if (codec == SessionCodec::LZ4) {
+    if (size > LZ4_MAX_INPUT_SIZE || raw_size > LZ4_MAX_INPUT_SIZE) {
+      return false;
+    }
+    const int n = LZ4_decompress_safe(reinterpret_cast<const char *>(src),
+                                      reinterpret_cast<char *>(dst),
+                                      static_cast<int>(size),
+                                      static_cast<int>(raw_size));
+    return n >= 0 && static_cast<size_t>(n) == raw_size;
+  }
+  return false;
+}
+
+} // namespace
+
+bool ParseSessionCodec(const std::string &name, SessionCodec &codec) {
+  if (name == "none") {
+    codec = SessionCodec::NONE;
+  } else if (name == "lz4") {
+    codec = SessionCodec::LZ4;
+  } else if (name == "zstd") {
+    codec = SessionCodec::ZSTD;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *SessionCodecName(SessionCodec codec) {
+  switch (codec) {
+  case SessionCodec::LZ4:
+    return "lz4";
+  case SessionCodec::ZSTD:
+    return "zstd";
+  default:
+    return "none";
+  }
+}
+
+bool SessionCodecAvailable(SessionCodec codec) {
+#ifndef LLAMA_NODE_ZSTD
+  if (codec == SessionCodec::ZSTD) {
+    return false;
+  }
+#endif
+  (void)codec;
+  return true;
+}
+
+bool EncodeSessionChunk(SessionCodec codec, int level, const uint8_t *src,
+                        size_t size, std::vector<uint8_t> &scratch,
+                        std::vector<uint8_t> &out) {
+  if (codec == SessionCodec::NONE || !SessionCodecAvailable(codec)) {
+    return false;
+  }
+  scratch.resize(size);
+  Shuffle2(src, size, scratch.data());
+  out.resize(CompressBound(codec, size));
+  const size_t n =
+      CompressChunk(codec, level, scratch.data(), size, out.data(), out.size());
+  if (n == 0 || n >= size) {
+    return false;
+  }
+  out.resize(n);
+  return true;
+}
+
+bool DecodeSessionChunk(SessionCodec codec, const uint8_t *src, size_t size,
+                        uint8_t *dst, size_t raw_size,
+                        std::vector<uint8_t> &scratch) {
+  if (size >= raw_size || !SessionCodecAvailable(codec)) {
+    return false;
+  }
+  scratch.resize(raw_size);
+  if (!DecompressChunk(codec, src, size, scratch.data(), raw_size)) {
+    return false;
+  }
+  Unshuffle2(scratch.data(), raw_size, dst);
+  return true;
+}
+
+bool IsCompressedSessionFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(kMagic)];
+  return in.read(magic, sizeof(magic)) &&
+         memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+size_t WriteCompressedSessionFile(const std::string &path, SessionCodec codec,
+                                  int level, const uint8_t *data,
+                                  size_t size) {
+  if (codec == SessionCodec::NONE || !SessionCodecAvailable(codec)) {
+    throw std::runtime_error(std::string("Session compression '") +
+                             SessionCodecName(codec) + "' is not available");
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  SessionFileHeader header = {};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.codec = static_cast<uint32_t>(codec);
+  header.chunk_size = kSessionChunkSize;
+  header.raw_size = size;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  size_t written = sizeof(header);
+
+  // Only one chunk's worth of scratch space is held at a time
+  std::vector<uint8_t> scratch;
+  std::vector<uint8_t> compressed;
+  for (size_t offset = 0; offset < size; offset += kSessionChunkSize) {
+    const size_t n = std::min<size_t>(size - offset, kSessionChunkSize);
+    const bool packed =
+        EncodeSessionChunk(codec, level, data + offset, n, scratch, compressed);
+    const uint8_t *payload = packed ? compressed.data() : data + offset;
+    const size_t stored = packed ? compressed.size() : n;
+    const uint32_t frame[2] = {static_cast<uint32_t>(n),
+                               static_cast<uint32_t>(stored)};
+    out.write(reinterpret_cast<const char *>(frame), sizeof(frame));
+    out.write(reinterpret_cast<const char *>(payload), stored);
+    written += sizeof(frame) + stored;
+  }
+  if (!out.flush()) {
+    throw std::runtime_error("Failed to write " + path);
+  }
+  return written;
+}
+
+std::vector<uint8_t> ReadCompressedSessionFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  SessionFileHeader header = {};
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  const auto codec = static_cast<SessionCodec>(header.codec);
+  if (!in || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.chunk_size == 0) {
+    throw std::runtime_error("Not a compressed session file: " + path);
+  }
+  if (codec == SessionCodec::NONE || !SessionCodecAvailable(codec)) {
+    throw std::runtime_error(std::string("Session compression '") +
+                             SessionCodecName(codec) + "' is not available");
+  }
+
+  std::vector<uint8_t> data(static_cast<size_t>(header.raw_size));
+  std::vector<uint8_t> stored_buf;
+  std::vector<uint8_t> scratch;
+  size_t offset = 0;
+  while (offset < data.size()) {
+    uint32_t frame[2];
+    in.read(reinterpret_cast<char *>(frame), sizeof(frame));
+    const size_t raw = frame[0];
+    const size_t stored = frame[1];
+    if (!in || raw == 0 || raw > header.chunk_size ||
+        raw > data.size() - offset || stored > raw) {
+      throw std::runtime_error("Corrupt compressed session file: " + path);
+    }
+    if (stored == raw) {
+      in.read(reinterpret_cast<char *>(data.data() + offset), raw);
+    } else {
+      stored_buf.resize(stored);
+      in.read(reinterpret_cast<char *>(stored_buf.data()), stored);
+      if (!in || !DecodeSessionChunk(codec, stored_buf.data(), stored,
+                                     data.data() + offset, raw, scratch)) {
+        throw std::runtime_error("Corrupt compressed session file: " + path);
+      }
+    }
+    if (!in) {
+      throw std::runtime_error("Truncated compressed session file: " + path);
+    }
+    offset += raw;
+  }
+  return data;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compression for session files. Kept free of N-API and llama types so the
+// benchmarks can link it directly.
+enum class SessionCodec : uint32_t { NONE = 0, LZ4 = 1, ZSTD = 2 };
+
+// Parses 'none', 'lz4' or 'zstd'. Returns false for unknown names.
+bool ParseSessionCodec(const std::string &name, SessionCodec &codec);
+const char *SessionCodecName(SessionCodec codec);
+// lz4 is always built in (upstream lz4 from src/lz4, block format); zstd
+// only in builds configured with LLAMA_NODE_ZSTD
+bool SessionCodecAvailable(SessionCodec codec);
+
+// Byte-shuffles and compresses one chunk into `out`. Returns false when the
+// codec is NONE or unavailable, or the chunk does not shrink; store it raw.
+bool EncodeSessionChunk(SessionCodec codec, int level, const uint8_t *src,
+                        size_t size, std::vector<uint8_t> &scratch,
+                        std::vector<uint8_t> &out);
+// Inverse of EncodeSessionChunk. Returns false on corrupt input.
+bool DecodeSessionChunk(SessionCodec codec, const uint8_t *src, size_t size,
+                        uint8_t *dst, size_t raw_size,
+                        std::vector<uint8_t> &scratch);
+
+// Compressed file layout: "LNSZ", version, codec, chunk size, uint64 raw size,
+// then one frame per chunk as { uint32 raw, uint32 stored, bytes }. Chunks
+// are byte-shuffled into 2-byte lanes before compression, which separates
+// the exponent and mantissa bytes of F16 KV data. A frame whose stored size
+// equals its raw size holds the chunk uncompressed.
+static const uint32_t kSessionChunkSize = 1 << 20;
+
+// True when `path` starts with the compressed file magic
+bool IsCompressedSessionFile(const std::string &path);
+
+// Streams `data` to `path` one chunk at a time. `level` is passed to zstd
+// and ignored by lz4. Returns the file size; throws on I/O errors.
+size_t WriteCompressedSessionFile(const std::string &path, SessionCodec codec,
+                                  int level, const uint8_t *data, size_t size);
+
+// Reads and decompresses a file written by WriteCompressedSessionFile,
+// one chunk at a time. Throws on I/O errors or corrupt input.
+std::vector<uint8_t> ReadCompressedSessionFile(const std::string &path);
@@ -0,0 +1,446 @@
+#include "SessionDelta.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+static const size_t kMinChunk = 8 << 10;
+static const size_t kMaxChunk = 128 << 10;
+// Top 15 bits of the gear hash: ~32 KiB past the minimum on average
+static const uint64_t kBoundaryMask = 0xfffe000000000000ULL;
+
+static inline uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+uint64_t ContentHash64(const uint8_t *data, size_t size) {
+  uint64_t hash = Mix(size ^ 0x9e3779b97f4a7c15ULL);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ Mix(word)) * 0x9e3779b97f4a7c15ULL;
+    hash = (hash << 31) | (hash >> 33);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, size - i);
+  return Mix(hash ^ Mix(tail));
+}
+
+std::string Hex(uint64_t value) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(value));
+  return buf;
+}
+
+uint64_t BlockKey(uint64_t prev, const int32_t *tokens, size_t n) {
+  const uint64_t words[2] = {
+      prev, ContentHash64(reinterpret_cast<const uint8_t *>(tokens),
+                          n * sizeof(int32_t))};
+  return ContentHash64(reinterpret_cast<const uint8_t *>(words), sizeof(words));
+}
+
+namespace {
+
+struct GearTable {
+  uint64_t values[256];
+  GearTable() {
+    uint64_t seed = 0;
+    for (auto &value : values) {
+      seed += 0x9e3779b97f4a7c15ULL;
+      value = Mix(seed);
+    }
+  }
+};
+
+} // namespace
+
+std::vector<size_t> ContentChunkEnds(const uint8_t *data, size_t size) {
+  static const GearTable gear;
+  std::vector<size_t> ends;
+  size_t start = 0;
+  while (start < size) {
+    const size_t limit = std::min(size, start + kMaxChunk);
+    size_t i = std::min(limit, start + kMinChunk);
+    uint64_t h = 0;
+    for (; i < limit; i++) {
+      h = (h << 1) + gear.values[data[i]];
+      if ((h & kBoundaryMask) == 0) {
+        i++;
+        break;
+      }
+    }
+    ends.push_back(i);
+    start = i;
+  }
+  return ends;
+}
+
+namespace {
+
+const char kMagic[4] = {'L', 'N', 'S', 'D'};
+const uint32_t kVersion = 1;
+const uint32_t kSegmentTag = 0x31474553; // "SEG1"
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+};
+
+struct SegmentHeader {
+  uint32_t tag;
+  uint32_t reserved;
+  uint64_t payload_size;
+  uint64_t meta_size;
+  uint64_t meta_hash;
+};
+
+// `hash` identifies the raw bytes for reuse; `stored_hash` checks the bytes
+// on disk.
+struct DeltaChunk {
+  uint64_t offset;
+  uint64_t hash;
+  uint64_t stored_hash;
+  uint32_t raw;
+  uint32_t stored;
+  uint32_t codec;
+  uint32_t reserved;
+};
+
+struct SessionLog {
+  std::vector<int32_t> tokens;
+  std::vector<DeltaChunk> chunks;
+  uint64_t state_size = 0;
+  uint64_t end = sizeof(FileHeader); // end of the newest intact segment
+  size_t n_segments = 0;
+};
+
+template <typename T> void Put(std::vector<uint8_t> &out, const T &value) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T> bool Take(const uint8_t *&p, const uint8_t *end, T &value) {
+  if (static_cast<size_t>(end - p) < sizeof(T)) {
+    return false;
+  }
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+bool ReadAt(std::ifstream &in, uint64_t offset, void *dst, size_t size) {
+  in.clear();
+  in.seekg(static_cast<std::streamoff>(offset));
+  in.read(static_cast<char *>(dst), static_cast<std::streamsize>(size));
+  return static_cast<bool>(in);
+}
+
+struct SegmentMeta {
+  uint32_t n_keep = 0;
+  std::vector<int32_t> tokens; // appended after the first n_keep
+  uint64_t state_size = 0;
+  std::vector<DeltaChunk> chunks;
+};
+
+std::vector<uint8_t> EncodeMeta(const SegmentMeta &meta) {
+  std::vector<uint8_t> out;
+  Put(out, meta.n_keep);
+  Put(out, static_cast<uint32_t>(meta.tokens.size()));
+  const auto *tokens = reinterpret_cast<const uint8_t *>(meta.tokens.data());
+  out.insert(out.end(), tokens, tokens + meta.tokens.size() * sizeof(int32_t));
+  Put(out, meta.state_size);
+  Put(out, static_cast<uint32_t>(meta.chunks.size()));
+  Put(out, uint32_t(0));
+  const auto *chunks = reinterpret_cast<const uint8_t *>(meta.chunks.data());
+  out.insert(out.end(), chunks,
+             chunks + meta.chunks.size() * sizeof(DeltaChunk));
+  return out;
+}
+
+// Stops after the token delta unless `with_chunks` is set
+bool DecodeMeta(const uint8_t *p, size_t size, bool with_chunks,
+                SegmentMeta &meta) {
+  const uint8_t *end = p + size;
+  uint32_t n_new = 0;
+  if (!Take(p, end, meta.n_keep) || !Take(p, end, n_new) ||
+      n_new > static_cast<size_t>(end - p) / sizeof(int32_t)) {
+    return false;
+  }
+  meta.tokens.resize(n_new);
+  memcpy(meta.tokens.data(), p, n_new * sizeof(int32_t));
+  p += n_new * sizeof(int32_t);
+  if (!with_chunks) {
+    return true;
+  }
+  uint32_t n_chunks = 0, reserved = 0;
+  if (!Take(p, end, meta.state_size) || !Take(p, end, n_chunks) ||
+      !Take(p, end, reserved) ||
+      n_chunks > static_cast<size_t>(end - p) / sizeof(DeltaChunk)) {
+    return false;
+  }
+  meta.chunks.resize(n_chunks);
+  memcpy(meta.chunks.data(), p, n_chunks * sizeof(DeltaChunk));
+  return true;
+}
+
+// Walks the segment headers. Only the newest segment can be torn, so its meta
+// and the payloads it introduced are verified, and it is dropped if they do
+// not match. Returns false if `path` is missing or not a delta session file.
+bool ReadLog(const std::string &path, SessionLog &log) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return false;
+  }
+  const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+  FileHeader header = {};
+  if (!ReadAt(in, 0, &header, sizeof(header)) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion) {
+    return false;
+  }
+
+  std::vector<std::pair<uint64_t, SegmentHeader>> segments;
+  uint64_t pos = sizeof(FileHeader);
+  while (pos + sizeof(SegmentHeader) <= file_size) {
+    SegmentHeader segment = {};
+    if (!ReadAt(in, pos, &segment, sizeof(segment)) ||
+        segment.tag != kSegmentTag) {
+      break;
+    }
+    const uint64_t body = file_size - pos - sizeof(SegmentHeader);
+    if (segment.payload_size > body ||
+        segment.meta_size > body - segment.payload_size) {
+      break;
+    }
+    segments.emplace_back(pos, segment);
+    pos += sizeof(SegmentHeader) + segment.payload_size + segment.meta_size;
+  }
+
+  std::vector<uint8_t> buffer;
+  while (!segments.empty()) {
+    const auto &last = segments.back();
+    const uint64_t payload_start = last.first + sizeof(SegmentHeader);
+    const uint64_t meta_start = payload_start + last.second.payload_size;
+    SegmentMeta meta;
+    buffer.resize(last.second.meta_size);
+    bool intact = ReadAt(in, meta_start, buffer.data(), buffer.size()) &&
+                  ContentHash64(buffer.data(), buffer.size()) ==
+                      last.second.meta_hash &&
+                  DecodeMeta(buffer.data(), buffer.size(), true, meta);
+    for (size_t i = 0; intact && i < meta.chunks.size(); i++) {
+      const auto &chunk = meta.chunks[i];
+      if (chunk.offset < payload_start || chunk.offset >= meta_start) {
+        continue;
+      }
+      buffer.resize(chunk.stored);
+      intact = chunk.offset + chunk.stored <= meta_start &&
+               ReadAt(in, chunk.offset, buffer.data(), buffer.size()) &&
+               ContentHash64(buffer.data(), buffer.size()) == chunk.stored_hash;
+    }
+    if (intact) {
+      log.chunks = std::move(meta.chunks);
+      log.state_size = meta.state_size;
+      log.end = meta_start + last.second.meta_size;
+      break;
+    }
+    segments.pop_back();
+  }
+
+  // Replay the token deltas, reading only the head of each meta
+  log.n_segments = segments.size();
+  for (const auto &segment : segments) {
+    const uint64_t meta_start =
+        segment.first + sizeof(SegmentHeader) + segment.second.payload_size;
+    uint32_t counts[2] = {0, 0};
+    SegmentMeta meta;
+    bool ok = ReadAt(in, meta_start, counts, sizeof(counts)) &&
+              counts[0] <= log.tokens.size() &&
+              counts[1] <= (segment.second.meta_size - sizeof(counts)) /
+                               sizeof(int32_t);
+    if (ok) {
+      buffer.resize(sizeof(counts) + counts[1] * sizeof(int32_t));
+      ok = ReadAt(in, meta_start, buffer.data(), buffer.size()) &&
+           DecodeMeta(buffer.data(), buffer.size(), false, meta);
+    }
+    if (!ok) {
+      throw std::runtime_error("Corrupt delta session file: " + path);
+    }
+    log.tokens.resize(meta.n_keep);
+    log.tokens.insert(log.tokens.end(), meta.tokens.begin(), meta.tokens.end());
+  }
+  return true;
+}
+
+} // namespace
+
+bool IsDeltaSessionFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(kMagic)];
+  return in.read(magic, sizeof(magic)) &&
+         memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+DeltaSaveResult AppendDeltaSession(const std::string &path,
+                                   const std::vector<int32_t> &tokens,
+                                   const uint8_t *state, size_t state_size,
+                                   SessionCodec codec, int level,
+                                   double compact_ratio) {
+  SessionLog log;
+  bool append = ReadLog(path, log) && log.n_segments > 0;
+  if (append) {
+    // Older segments only hold dead chunks and token history once the newest
+    // chunk list stops referencing them
+    uint64_t live = 0;
+    for (const auto &chunk : log.chunks) {
+      live += chunk.stored;
+    }
+    append = static_cast<double>(log.end) <=
+             compact_ratio * static_cast<double>(live + sizeof(FileHeader));
+  }
+
+  std::unordered_map<uint64_t, DeltaChunk> known;
+  if (append) {
+    for (const auto &chunk : log.chunks) {
+      known.emplace(chunk.hash, chunk);
+    }
+  }
+
+  SegmentMeta meta;
+  meta.state_size = state_size;
+  if (append) {
+    const auto mismatch = std::mismatch(log.tokens.begin(), log.tokens.end(),
+                                        tokens.begin(), tokens.end());
+    meta.n_keep = static_cast<uint32_t>(mismatch.first - log.tokens.begin());
+  }
+  meta.tokens.assign(tokens.begin() + meta.n_keep, tokens.end());
+
+  const std::string write_path = append ? path : path + ".tmp";
+  const uint64_t segment_start = append ? log.end : sizeof(FileHeader);
+  if (append) {
+    // Drop a torn tail before appending after it
+    std::filesystem::resize_file(path, log.end);
+  }
+  std::fstream out(write_path, append ? std::ios::binary | std::ios::in |
+                                            std::ios::out
+                                      : std::ios::binary | std::ios::out |
+                                            std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Failed to open " + write_path);
+  }
+  if (!append) {
+    FileHeader header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+
+  // The placeholder header has no tag until the segment is complete
+  SegmentHeader segment = {};
+  out.seekp(static_cast<std::streamoff>(segment_start));
+  out.write(reinterpret_cast<const char *>(&segment), sizeof(segment));
+  uint64_t offset = segment_start + sizeof(SegmentHeader);
+
+  std::vector<uint8_t> scratch;
+  std::vector<uint8_t> encoded;
+  size_t start = 0;
+  for (const size_t end : ContentChunkEnds(state, state_size)) {
+    const uint8_t *raw = state + start;
+    const size_t raw_size = end - start;
+    start = end;
+    const uint64_t hash = ContentHash64(raw, raw_size);
+    auto it = known.find(hash);
+    if (it != known.end() && it->second.raw == raw_size) {
+      meta.chunks.push_back(it->second);
+      continue;
+    }
+    const bool packed =
+        EncodeSessionChunk(codec, level, raw, raw_size, scratch, encoded);
+    const uint8_t *stored = packed ? encoded.data() : raw;
+    DeltaChunk chunk = {};
+    chunk.offset = offset;
+    chunk.hash = hash;
+    chunk.raw = static_cast<uint32_t>(raw_size);
+    chunk.stored = static_cast<uint32_t>(packed ? encoded.size() : raw_size);
+    chunk.stored_hash = ContentHash64(stored, chunk.stored);
+    chunk.codec =
+        static_cast<uint32_t>(packed ? codec : SessionCodec::NONE);
+    out.write(reinterpret_cast<const char *>(stored), chunk.stored);
+    offset += chunk.stored;
+    known[hash] = chunk;
+    meta.chunks.push_back(chunk);
+  }
+
+  const auto encoded_meta = EncodeMeta(meta);
+  out.write(reinterpret_cast<const char *>(encoded_meta.data()),
+            encoded_meta.size());
+  segment.payload_size = offset - segment_start - sizeof(SegmentHeader);
+  segment.meta_size = encoded_meta.size();
+  segment.meta_hash = ContentHash64(encoded_meta.data(), encoded_meta.size());
+  if (!out.flush()) {
+    throw std::runtime_error("Failed to write " + write_path);
+  }
+  segment.tag = kSegmentTag;
+  out.seekp(static_cast<std::streamoff>(segment_start));
+  out.write(reinterpret_cast<const char *>(&segment), sizeof(segment));
+  out.close();
+  if (!out) {
+    throw std::runtime_error("Failed to write " + write_path);
+  }
+  if (!append && std::rename(write_path.c_str(), path.c_str()) != 0) {
+    std::remove(write_path.c_str());
+    throw std::runtime_error("Failed to replace " + path);
+  }
+
+  DeltaSaveResult result;
+  result.file_size = offset + encoded_meta.size();
+  result.bytes_written = result.file_size - segment_start;
+  result.compacted = !append;
+  return result;
+}
+
+void ReadDeltaSession(const std::string &path, std::vector<int32_t> &tokens,
+                      std::vector<uint8_t> &state) {
+  SessionLog log;
+  if (!ReadLog(path, log)) {
+    throw std::runtime_error("Not a delta session file: " + path);
+  }
+  if (log.n_segments == 0) {
+    throw std::runtime_error("No intact segment in delta session file: " +
+                             path);
+  }
+  std::ifstream in(path, std::ios::binary);
+  state.resize(static_cast<size_t>(log.state_size));
+  std::vector<uint8_t> stored;
+  std::vector<uint8_t> scratch;
+  size_t offset = 0;
+  for (const auto &chunk : log.chunks) {
+    stored.resize(chunk.stored);
+    bool ok = chunk.raw <= state.size() - offset &&
+              chunk.stored <= chunk.raw &&
+              ReadAt(in, chunk.offset, stored.data(), stored.size()) &&
+              ContentHash64(stored.data(), stored.size()) == chunk.stored_hash;
+    if (ok && chunk.stored == chunk.raw) {
+      memcpy(state.data() + offset, stored.data(), chunk.raw);
+    } else if (ok) {
+      ok = DecodeSessionChunk(static_cast<SessionCodec>(chunk.codec),
+                              stored.data(), stored.size(),
+                              state.data() + offset, chunk.raw, scratch);
+    }
+    if (!ok) {
+      throw std::runtime_error("Corrupt delta session file: " + path);
+    }
+    offset += chunk.raw;
+  }
+  if (offset != state.size()) {
+    throw std::runtime_error("Corrupt delta session file: " + path);
+  }
+  tokens = std::move(log.tokens);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "SessionCodec.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Append-only session files for conversations that grow turn by turn.
+//
+// The serialized state is split into content-defined chunks (gear hash, 8 to
+// 128 KiB, ~32 KiB average), so appending KV rows only changes the chunks
+// around each insertion point. Every save appends one segment holding the
+// token delta since the previous save, the chunks not already in the file,
+// and the chunk list of the full state. Loading replays the token deltas and
+// assembles the newest chunk list. When dead chunks from older segments
+// outweigh `compact_ratio` times the live ones, the file is rewritten with a
+// single segment instead.
+//
+// File: "LNSD", version, then segments of
+//   { uint32 tag, uint32 reserved, uint64 payload size, uint64 meta size,
+//     uint64 meta hash }, payloads, meta
+// where meta is { uint32 n_keep, uint32 n_new, tokens[n_new], uint64 state
+// size, uint32 n_chunks, uint32 reserved, DeltaChunk[n_chunks] }. The tag is
+// written last, so a torn append is ignored on the next read.
+//
+// Appends only stay small when new KV rows land at the end of each tensor in
+// the state, which holds for K and for V with flash attention. Without it the
+// V cache is stored transposed (one row per embedding channel across all
+// cells), so every row grows on each turn and nearly every chunk changes;
+// saveSession rejects `delta` when flash attention is disabled.
+
+// 64-bit content hash used to identify chunks
+uint64_t ContentHash64(const uint8_t *data, size_t size);
+
+// `value` as 16 lowercase hex digits, for cache file names
+std::string Hex(uint64_t value);
+
+// Key of a token block chained to the key of the blocks before it (`prev`),
+// so equal keys mean equal prefixes. Shared by the prefix and checkpoint
+// caches; `tokens` are llama_token values.
+uint64_t BlockKey(uint64_t prev, const int32_t *tokens, size_t n);
+
+// End offsets of the content-defined chunks of `data`. Boundaries depend only
+// on the bytes just before them, so they realign right after an insertion.
+std::vector<size_t> ContentChunkEnds(const uint8_t *data, size_t size);
+
+// Also returned by WriteSession for the other formats, with `bytes_written`
+// equal to `file_size`.
+struct DeltaSaveResult {
+  size_t bytes_written = 0;
+  size_t file_size = 0;
+  bool compacted = false;
+};
+
+bool IsDeltaSessionFile(const std::string &path);
+
+// Appends `tokens` and `state` to the file at `path`, creating or compacting
+// it as needed. New chunks go through `codec`. Throws on I/O errors.
+DeltaSaveResult AppendDeltaSession(const std::string &path,
+                                   const std::vector<int32_t> &tokens,
+                                   const uint8_t *state, size_t state_size,
+                                   SessionCodec codec, int level,
+                                   double compact_ratio);
+
+// Reads the newest intact segment. Throws on I/O errors or corrupt chunks.
+void ReadDeltaSession(const std::string &path, std::vector<int32_t> &tokens,
+                      std::vector<uint8_t> &state);
@@ -0,0 +1,567 @@
+#include "SessionState.h"
+#include "MappedFile.h"
+#include "rn-llama/rn-slot-manager.h"
+#include "rn-llama/rn-slot.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static const char kMagic[4] = {'L', 'N', 'S', 'S'};
+static const uint32_t kVersion = 1;
+
+SessionTokens CaptureSessionTokens(rnllama::llama_rn_context *rn_ctx) {
+  SessionTokens session;
+  // Keep LLAMA_TOKEN_NULL media placeholders: the serialized memory covers
+  // their positions, so the token list must too.
+  session.tokens = rn_ctx->completion->embd;
+  const bool media_retained =
+      std::find(session.tokens.begin(), session.tokens.end(),
+                LLAMA_TOKEN_NULL) != session.tokens.end();
+  if (media_retained) {
+    session.media_hashes = rn_ctx->getMediaHashes();
+  }
+  return session;
+}
+
+size_t ApplyRestoredSession(rnllama::llama_rn_context *rn_ctx,
+                            SessionTokens session) {
+  auto &tokens = session.tokens;
+  // Legacy multimodal or token-limited states may contain a token list that
+  // does not match the restored memory. Reconcile it now so the next decode
+  // either resumes safely or starts cold instead of failing later.
+  auto *memory = llama_get_memory(rn_ctx->ctx);
+  const llama_pos n_tokens = static_cast<llama_pos>(tokens.size());
+  const llama_pos pos_max = llama_memory_seq_pos_max(memory, 0);
+  const bool tokens_have_media =
+      std::find(tokens.begin(), tokens.end(), LLAMA_TOKEN_NULL) != tokens.end();
+  const bool mrope_media =
+      rnllama::model_uses_mrope(rn_ctx->model) && tokens_have_media;
+  bool resumable = pos_max + 1 == n_tokens ||
+                   (mrope_media && pos_max >= 0 && pos_max + 1 < n_tokens);
+
+  if (!resumable && pos_max + 1 > n_tokens) {
+    resumable = llama_memory_seq_rm(memory, 0, n_tokens, -1) &&
+                llama_memory_seq_pos_max(memory, 0) + 1 == n_tokens;
+    if (resumable) {
+      // A rolled-back SWA cache is only reusable if it still contains the
+      // full attention window ending at n_tokens.
+      const bool recurrent_or_hybrid = llama_model_is_recurrent(rn_ctx->model) ||
+                                       llama_model_is_hybrid(rn_ctx->model);
+      const int32_t n_swa =
+          rn_ctx->params.swa_full ? 0 : llama_model_n_swa(rn_ctx->model);
+      if (n_swa > 0 && !recurrent_or_hybrid) {
+        const llama_pos pos_min = llama_memory_seq_pos_min(memory, 0);
+        const llama_pos pos_min_threshold =
+            std::max<llama_pos>(0, n_tokens - n_swa);
+        resumable =
+            pos_min == 0 || (pos_min > 0 && pos_min < pos_min_threshold);
+      }
+    }
+  }
+
+  if (!resumable) {
+    llama_memory_seq_rm(memory, 0, 0, -1);
+    tokens.clear();
+  }
+
+  // Missing or malformed metadata fails closed: processMedia will reprocess
+  // media rather than reusing memory whose identity cannot be verified.
+  rn_ctx->setMediaHashes(tokens.empty() ? std::vector<std::string>{}
+                                        : std::move(session.media_hashes));
+
+  const size_t count = tokens.size();
+  rn_ctx->completion->embd = std::move(tokens);
+  rn_ctx->completion->n_past = static_cast<llama_pos>(count);
+  return count;
+}
+
+size_t SessionHeaderSize(const SessionTokens &session) {
+  size_t size = sizeof(kMagic) + 3 * sizeof(uint32_t) +
+                session.tokens.size() * sizeof(llama_token);
+  for (const auto &hash : session.media_hashes) {
+    size += sizeof(uint32_t) + hash.size();
+  }
+  return size + sizeof(uint64_t);
+}
+
+void WriteSessionHeader(const SessionTokens &session, uint64_t state_size,
+                        uint8_t *out) {
+  auto put = [&out](const void *src, size_t n) {
+    memcpy(out, src, n);
+    out += n;
+  };
+  const uint32_t n_tokens = static_cast<uint32_t>(session.tokens.size());
+  const uint32_t n_hashes = static_cast<uint32_t>(session.media_hashes.size());
+  put(kMagic, sizeof(kMagic));
+  put(&kVersion, sizeof(kVersion));
+  put(&n_tokens, sizeof(n_tokens));
+  put(&n_hashes, sizeof(n_hashes));
+  put(session.tokens.data(), n_tokens * sizeof(llama_token));
+  for (const auto &hash : session.media_hashes) {
+    const uint32_t length = static_cast<uint32_t>(hash.size());
+    put(&length, sizeof(length));
+    put(hash.data(), length);
+  }
+  put(&state_size, sizeof(state_size));
+}
+
+SessionTokens ReadSessionHeader(const uint8_t *data, size_t size,
+                                const uint8_t *&state, size_t &state_size) {
+  const uint8_t *end = data + size;
+  auto take = [&data, end](void *dst, size_t n) {
+    if (static_cast<size_t>(end - data) < n) {
+      throw std::runtime_error("Session state is truncated");
+    }
+    memcpy(dst, data, n);
+    data += n;
+  };
+  char magic[sizeof(kMagic)];
+  uint32_t version = 0, n_tokens = 0, n_hashes = 0;
+  take(magic, sizeof(magic));
+  take(&version, sizeof(version));
+  if (memcmp(magic, kMagic, sizeof(kMagic)) != 0 || version != kVersion) {
+    throw std::runtime_error("Not a session state");
+  }
+  take(&n_tokens, sizeof(n_tokens));
+  take(&n_hashes, sizeof(n_hashes));
+  if (n_tokens > static_cast<size_t>(end - data) / sizeof(llama_token)) {
+    throw std::runtime_error("Session state is truncated");
+  }
+  SessionTokens session;
+  session.tokens.resize(n_tokens);
+  take(session.tokens.data(), n_tokens * sizeof(llama_token));
+  for (uint32_t i = 0; i < n_hashes; i++) {
+    uint32_t length = 0;
+    take(&length, sizeof(length));
+    if (length > static_cast<size_t>(end - data)) {
+      throw std::runtime_error("Session state is truncated");
+    }
+    session.media_hashes.emplace_back(reinterpret_cast<const char *>(data),
+                                      length);
+    data += length;
+  }
+  uint64_t n_state = 0;
+  take(&n_state, sizeof(n_state));
+  if (n_state > static_cast<uint64_t>(end - data)) {
+    throw std::runtime_error("Session state is truncated");
+  }
+  state = data;
+  state_size = static_cast<size_t>(n_state);
+  return session;
+}
+
+// A partial restore leaves the memory undefined, so a failure starts cold
+static void SetStateOrClear(rnllama::llama_rn_context *rn_ctx,
+                            const uint8_t *state, size_t size,
+                            const char *error) {
+  if (llama_state_set_data(rn_ctx->ctx, state, size) == 0) {
+    llama_memory_clear(llama_get_memory(rn_ctx->ctx), true);
+    rn_ctx->completion->embd.clear();
+    rn_ctx->completion->n_past = 0;
+    throw std::runtime_error(error);
+  }
+}
+
+SessionSnapshot CaptureSession(rnllama::llama_rn_context *rn_ctx) {
+  SessionSnapshot snapshot;
+  snapshot.session = CaptureSessionTokens(rn_ctx);
+  const auto &tokens = snapshot.session.tokens;
+  const uint32_t header[3] = {LLAMA_SESSION_MAGIC, LLAMA_SESSION_VERSION,
+                              static_cast<uint32_t>(tokens.size())};
+  snapshot.state_offset =
+      sizeof(header) + tokens.size() * sizeof(llama_token);
+  const size_t state_size = llama_state_get_size(rn_ctx->ctx);
+  // Left uninitialized: zero-filling would double the time the context is
+  // held for a large KV cache
+  snapshot.data.reset(new uint8_t[snapshot.state_offset + state_size]);
+  memcpy(snapshot.data.get(), header, sizeof(header));
+  memcpy(snapshot.data.get() + sizeof(header), tokens.data(),
+         tokens.size() * sizeof(llama_token));
+  const size_t written = llama_state_get_data(
+      rn_ctx->ctx, snapshot.data.get() + snapshot.state_offset, state_size);
+  if (written == 0 && state_size > 0) {
+    throw std::runtime_error("Failed to read session state");
+  }
+  snapshot.size = snapshot.state_offset + written;
+  return snapshot;
+}
+
+DeltaSaveResult WriteSession(const SessionSnapshot &snapshot,
+                             const std::string &path,
+                             const SessionSaveOptions &options) {
+  const uint8_t *data = snapshot.data.get();
+  if (options.delta) {
+    const auto result = AppendDeltaSession(
+        path, snapshot.session.tokens, data + snapshot.state_offset,
+        snapshot.size - snapshot.state_offset, options.codec, options.level,
+        options.compact_ratio);
+    if (options.snapshot && !SyncFile(path)) {
+      throw std::runtime_error("Failed to sync session file");
+    }
+    return result;
+  }
+
+  // Snapshots replace the file only once the new one is on disk, so a crash
+  // mid-write keeps the previous save intact.
+  const std::string target = options.snapshot ? path + ".tmp" : path;
+  if (options.codec != SessionCodec::NONE) {
+    WriteCompressedSessionFile(target, options.codec, options.level, data,
+                               snapshot.size);
+  } else {
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(data),
+              static_cast<std::streamsize>(snapshot.size));
+    out.close();
+    if (!out) {
+      throw std::runtime_error("Failed to save session");
+    }
+  }
+  if (options.snapshot) {
+    std::error_code ec;
+    bool ok = SyncFile(target);
+    if (ok) {
+      std::filesystem::rename(target, path, ec);
+      ok = !ec && SyncFile(path);
+    }
+    if (!ok) {
+      std::filesystem::remove(target, ec);
+      throw std::runtime_error("Failed to sync session file");
+    }
+  }
+  DeltaSaveResult result;
+  result.file_size = std::filesystem::file_size(path);
+  result.bytes_written = result.file_size;
+  return result;
+}
+
+void ContextGate::Open() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _open = true;
+  }
+  _cv.notify_all();
+}
+
+void ContextGate::Wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cv.wait(lock, [this]() { return _open; });
+}
+
+void SlotLoopPause::Acquire(rnllama::llama_rn_context *rn_ctx) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_holders++ == 0) {
+    rn_ctx->slot_manager->stop_processing_loop();
+  }
+}
+
+void SlotLoopPause::Release(rnllama::llama_rn_context *rn_ctx) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  // Not restarted if parallel mode was disabled in the meantime
+  if (--_holders == 0 && rn_ctx->parallel_mode_enabled &&
+      rn_ctx->slot_manager != nullptr) {
+    rn_ctx->slot_manager->start_processing_loop();
+  }
+}
+
+void SlotRequestLog::Record(int32_t slot_id, int32_t request_id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _requests[slot_id] = request_id;
+}
+
+int32_t SlotRequestLog::Find(int32_t request_id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (const auto &entry : _requests) {
+    if (entry.second == request_id) {
+      return entry.first;
+    }
+  }
+  return -1;
+}
+
+void SlotRequestLog::Clear() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _requests.clear();
+}
+
+std::vector<llama_token>
+LoadCompressedSession(rnllama::llama_rn_context *rn_ctx,
+                      const std::string &path) {
+  const auto data = ReadCompressedSessionFile(path);
+  uint32_t header[3] = {0, 0, 0};
+  if (data.size() < sizeof(header)) {
+    throw std::runtime_error("Failed to load session");
+  }
+  memcpy(header, data.data(), sizeof(header));
+  const size_t n_tokens = header[2];
+  if (header[0] != LLAMA_SESSION_MAGIC || header[1] != LLAMA_SESSION_VERSION ||
+      n_tokens > llama_n_ctx(rn_ctx->ctx) ||
+      n_tokens > (data.size() - sizeof(header)) / sizeof(llama_token)) {
+    throw std::runtime_error("Failed to load session");
+  }
+  std::vector<llama_token> tokens(n_tokens);
+  memcpy(tokens.data(), data.data() + sizeof(header),
+         n_tokens * sizeof(llama_token));
+  const size_t offset = sizeof(header) + n_tokens * sizeof(llama_token);
+  SetStateOrClear(rn_ctx, data.data() + offset, data.size() - offset,
+                  "Failed to load session");
+  return tokens;
+}
+
+bool LoadMappedSession(rnllama::llama_rn_context *rn_ctx,
+                       const std::string &path,
+                       std::vector<llama_token> &tokens) {
+  MappedFile file(path, true);
+  if (!file.Valid()) {
+    return false;
+  }
+  uint32_t header[3] = {0, 0, 0};
+  if (file.Size() < sizeof(header)) {
+    throw std::runtime_error("Failed to load session");
+  }
+  memcpy(header, file.Data(), sizeof(header));
+  const size_t n_tokens = header[2];
+  if (header[0] != LLAMA_SESSION_MAGIC || header[1] != LLAMA_SESSION_VERSION ||
+      n_tokens > llama_n_ctx(rn_ctx->ctx) ||
+      n_tokens > (file.Size() - sizeof(header)) / sizeof(llama_token)) {
+    throw std::runtime_error("Failed to load session");
+  }
+  tokens.resize(n_tokens);
+  memcpy(tokens.data(), file.Data() + sizeof(header),
+         n_tokens * sizeof(llama_token));
+  const size_t offset = sizeof(header) + n_tokens * sizeof(llama_token);
+  SetStateOrClear(rn_ctx, file.Data() + offset, file.Size() - offset,
+                  "Failed to load session");
+  return true;
+}
+
+std::vector<llama_token> LoadDeltaSession(rnllama::llama_rn_context *rn_ctx,
+                                          const std::string &path) {
+  std::vector<llama_token> tokens;
+  std::vector<uint8_t> state;
+  ReadDeltaSession(path, tokens, state);
+  if (tokens.size() > llama_n_ctx(rn_ctx->ctx)) {
+    throw std::runtime_error("Failed to load session");
+  }
+  SetStateOrClear(rn_ctx, state.data(), state.size(), "Failed to load session");
+  return tokens;
+}
+
+void CheckSessionContext(rnllama::llama_rn_context *rn_ctx) {
+  if (!rn_ctx || !rn_ctx->ctx || !rn_ctx->completion) {
+    throw std::runtime_error("Context or completion not initialized");
+  }
+  if (rn_ctx->slot_manager != nullptr) {
+    // The whole-context state holds every parallel slot's sequence, which
+    // the single-completion token history does not describe.
+    throw std::runtime_error(
+        "Session state is not supported while parallel mode is enabled");
+  }
+}
+
+GetSessionStateWorker::GetSessionStateWorker(Napi::Env env,
+                                             rnllama::llama_rn_context *rn_ctx)
+    : AsyncWorker(env), Deferred(env), _rn_ctx(rn_ctx) {}
+
+GetSessionStateWorker::~GetSessionStateWorker() { free(_data); }
+
+void GetSessionStateWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
+  try {
+    CheckSessionContext(_rn_ctx);
+    const auto session = CaptureSessionTokens(_rn_ctx);
+    const size_t header = SessionHeaderSize(session);
+    const size_t state_size = llama_state_get_size(_rn_ctx->ctx);
+    _data = static_cast<uint8_t *>(malloc(header + state_size));
+    if (_data == nullptr) {
+      throw std::runtime_error("Failed to allocate " +
+                               std::to_string(header + state_size) +
+                               " bytes for the session state");
+    }
+    const size_t written =
+        llama_state_get_data(_rn_ctx->ctx, _data + header, state_size);
+    if (written == 0 && state_size > 0) {
+      throw std::runtime_error("Failed to read session state");
+    }
+    WriteSessionHeader(session, written, _data);
+    _size = header + written;
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void GetSessionStateWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  // Hand the allocation to the Buffer instead of copying a multi-GB state.
+  // Runtimes that forbid external buffers (V8 sandbox) get a copy, and the
+  // finalizer frees the original right away.
+  auto buffer = Napi::Buffer<uint8_t>::NewOrCopy(
+      env, _data, _size, [](Napi::Env, uint8_t *data) { free(data); });
+  _data = nullptr;
+  Napi::Promise::Deferred::Resolve(buffer);
+}
+
+void GetSessionStateWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
+
+SetSessionStateWorker::SetSessionStateWorker(Napi::Env env,
+                                             rnllama::llama_rn_context *rn_ctx,
+                                             Napi::Buffer<uint8_t> buffer)
+    : AsyncWorker(env), Deferred(env), _rn_ctx(rn_ctx),
+      _buffer_ref(Napi::Persistent(buffer)), _data(buffer.Data()),
+      _size(buffer.Length()) {}
+
+void SetSessionStateWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
+  try {
+    CheckSessionContext(_rn_ctx);
+    const uint8_t *state = nullptr;
+    size_t state_size = 0;
+    auto session = ReadSessionHeader(_data, _size, state, state_size);
+    SetStateOrClear(_rn_ctx, state, state_size,
+                    "Failed to restore session state");
+    _count = ApplyRestoredSession(_rn_ctx, std::move(session));
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void SetSessionStateWorker::OnOK() {
+  _buffer_ref.Reset();
+  Napi::Promise::Deferred::Resolve(
+      Napi::Number::New(Napi::AsyncWorker::Env(), _count));
+}
+
+void SetSessionStateWorker::OnError(const Napi::Error &err) {
+  _buffer_ref.Reset();
+  Napi::Promise::Deferred::Reject(err.Value());
+}
+
+namespace {
+
+// The slot loop decodes on the shared context from its own thread. Holding
+// it stopped keeps a slot's sequence and token history consistent while
+// they are copied; queued requests wait and resume afterwards.
+class ProcessingLoopPause {
+public:
+  ProcessingLoopPause(SlotLoopPause &pause, rnllama::llama_rn_context *rn_ctx)
+      : _pause(pause), _rn_ctx(rn_ctx) {
+    _pause.Acquire(_rn_ctx);
+  }
+  ~ProcessingLoopPause() { _pause.Release(_rn_ctx); }
+
+private:
+  SlotLoopPause &_pause;
+  rnllama::llama_rn_context *_rn_ctx;
+};
+
+} // namespace
+
+SequenceStateWorker::SequenceStateWorker(Napi::Env env,
+                                         rnllama::llama_rn_context *rn_ctx,
+                                         std::shared_ptr<SlotLoopPause> pause,
+                                         std::shared_ptr<SlotRequestLog> requests,
+                                         int32_t request_id, int32_t slot_id,
+                                         std::string path)
+    : AsyncWorker(env), Deferred(env), _rn_ctx(rn_ctx),
+      _pause(std::move(pause)), _requests(std::move(requests)),
+      _request_id(request_id), _slot_id(slot_id), _path(std::move(path)) {}
+
+SequenceStateWorker::~SequenceStateWorker() { free(_data); }
+
+void SequenceStateWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
+  try {
+    if (!_rn_ctx || !_rn_ctx->ctx || !_rn_ctx->parallel_mode_enabled ||
+        _rn_ctx->slot_manager == nullptr) {
+      throw std::runtime_error(
+          "Parallel mode is not enabled. Call enableParallelMode() first.");
+    }
+    ProcessingLoopPause pause(*_pause, _rn_ctx);
+    auto &slot_manager = _rn_ctx->slot_manager;
+    auto &slots = slot_manager->slots;
+    rnllama::llama_rn_slot *slot = nullptr;
+    if (_slot_id >= 0) {
+      if (static_cast<size_t>(_slot_id) >= slots.size()) {
+        throw std::runtime_error("No slot " + std::to_string(_slot_id));
+      }
+      slot = &slots[_slot_id];
+    } else {
+      slot = slot_manager->get_slot_by_request_id(_request_id);
+    }
+    if (slot == nullptr) {
+      // Finished: the idle slot still holds the sequence unless another
+      // request has been given the slot since
+      const int32_t id = _requests->Find(_request_id);
+      if (id >= 0 && static_cast<size_t>(id) < slots.size() &&
+          (slots[id].request_id == _request_id ||
+           slot_manager->get_slot_by_request_id(slots[id].request_id) !=
+               &slots[id])) {
+        slot = &slots[id];
+      }
+    }
+    if (slot == nullptr) {
+      throw std::runtime_error("No slot holds the sequence of request " +
+                               std::to_string(_request_id));
+    }
+    const llama_seq_id seq_id = slot->id;
+    const std::vector<llama_token> &tokens = slot->cache_tokens;
+    _count = tokens.size();
+
+    if (!_path.empty()) {
+      if (llama_state_seq_save_file(_rn_ctx->ctx, _path.c_str(), seq_id,
+                                    tokens.data(), tokens.size()) == 0) {
+        throw std::runtime_error("Failed to save sequence state");
+      }
+      return;
+    }
+
+    const uint32_t header[3] = {LLAMA_STATE_SEQ_MAGIC, LLAMA_STATE_SEQ_VERSION,
+                                static_cast<uint32_t>(tokens.size())};
+    const size_t header_size =
+        sizeof(header) + tokens.size() * sizeof(llama_token);
+    const size_t state_size = llama_state_seq_get_size(_rn_ctx->ctx, seq_id);
+    _data = static_cast<uint8_t *>(malloc(header_size + state_size));
+    if (_data == nullptr) {
+      throw std::runtime_error("Failed to allocate " +
+                               std::to_string(header_size + state_size) +
+                               " bytes for the sequence state");
+    }
+    memcpy(_data, header, sizeof(header));
+    memcpy(_data + sizeof(header), tokens.data(),
+           tokens.size() * sizeof(llama_token));
+    const size_t written = llama_state_seq_get_data(
+        _rn_ctx->ctx, _data + header_size, state_size, seq_id);
+    if (written == 0 && state_size > 0) {
+      throw std::runtime_error("Failed to read sequence state");
+    }
+    _size = header_size + written;
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void SequenceStateWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  if (!_path.empty()) {
+    Napi::Promise::Deferred::Resolve(Napi::Number::New(env, _count));
+    return;
+  }
+  auto buffer = Napi::Buffer<uint8_t>::NewOrCopy(
+      env, _data, _size, [](Napi::Env, uint8_t *data) { free(data); });
+  _data = nullptr;
+  Napi::Promise::Deferred::Resolve(buffer);
+}
+
+void SequenceStateWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "SessionCodec.h"
+#include "SessionDelta.h"
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Token history and media identity that accompany a serialized state.
+struct SessionTokens {
+  std::vector<llama_token> tokens;
+  std::vector<std::string> media_hashes;
+};
+
+// Current completion tokens, keeping LLAMA_TOKEN_NULL media placeholders,
+// and the media hashes when placeholders are present.
+SessionTokens CaptureSessionTokens(rnllama::llama_rn_context *rn_ctx);
+
+// Installs the token history of a just-restored sequence 0 as the
+// completion prompt. Histories that do not match the restored memory are
+// rolled back or dropped so the next decode resumes safely or starts cold.
+// Returns the number of tokens kept.
+size_t ApplyRestoredSession(rnllama::llama_rn_context *rn_ctx,
+                            SessionTokens session);
+
+// Buffer layout: "LNSS", version, n_tokens, n_hashes, tokens, then each hash
+// as { uint32 length, bytes }, then { uint64 size, llama_state data }.
+// Returns the byte size of everything before the state data.
+size_t SessionHeaderSize(const SessionTokens &session);
+// Writes the header into `out` (SessionHeaderSize bytes).
+void WriteSessionHeader(const SessionTokens &session, uint64_t state_size,
+                        uint8_t *out);
+// Parses a buffer written by WriteSessionHeader. Sets `state` and
+// `state_size` to the state data within it; throws on malformed input.
+SessionTokens ReadSessionHeader(const uint8_t *data, size_t size,
+                                const uint8_t *&state, size_t &state_size);
+
+// saveSession options. `delta` appends to an append-only file (SessionDelta.h)
+// with chunks compressed by `codec`; otherwise `codec` compresses the whole
+// file and NONE writes the plain llama.cpp format. `snapshot` copies the
+// state to host memory, releases the context, then writes and syncs the copy.
+struct SessionSaveOptions {
+  SessionCodec codec = SessionCodec::NONE;
+  int level = 3;
+  bool delta = false;
+  double compact_ratio = 2.0;
+  bool snapshot = false;
+};
+
+// Context state copied to host memory in the llama_state_save_file byte
+// layout; the state data starts at `state_offset`.
+struct SessionSnapshot {
+  SessionTokens session;
+  std::unique_ptr<uint8_t[]> data;
+  size_t size = 0;
+  size_t state_offset = 0;
+};
+
+// Copies the current state and token history. Throws on failure.
+SessionSnapshot CaptureSession(rnllama::llama_rn_context *rn_ctx);
+
+// Writes a snapshot to `path` as `options` select, without touching the
+// context. In snapshot mode the file is synced to disk before returning.
+// Throws on failure.
+DeltaSaveResult WriteSession(const SessionSnapshot &snapshot, const std::string &path,
+                  const SessionSaveOptions &options);
+
+// Closed while a snapshot save copies the context state. Work queued after
+// the save waits on it before using the context.
+class ContextGate {
+public:
+  void Open();
+  void Wait();
+
+private:
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _open = false;
+};
+
+// Keeps the parallel slot loop stopped while any holder needs the context to
+// itself. The loop stops when the first holder arrives and restarts when the
+// last one leaves, so overlapping holders do not restart it under each other.
+class SlotLoopPause {
+public:
+  void Acquire(rnllama::llama_rn_context *rn_ctx);
+  void Release(rnllama::llama_rn_context *rn_ctx);
+
+private:
+  std::mutex _mutex;
+  size_t _holders = 0;
+};
+
+// Last request each parallel slot finished, so its sequence can still be
+// found by request id while the slot stays idle.
+class SlotRequestLog {
+public:
+  void Record(int32_t slot_id, int32_t request_id);
+  // Slot whose last finished request is `request_id`, or -1
+  int32_t Find(int32_t request_id);
+  void Clear();
+
+private:
+  std::mutex _mutex;
+  std::unordered_map<int32_t, int32_t> _requests; // slot id -> request id
+};
+
+// Restores a compressed session file and returns its tokens.
+// Clears the memory and throws if the state cannot be applied.
+std::vector<llama_token>
+LoadCompressedSession(rnllama::llama_rn_context *rn_ctx,
+                      const std::string &path);
+// Restores a plain llama.cpp session file straight from a memory map of it,
+// so the state is copied from the page cache into the KV buffers without a
+// read into an intermediate buffer. Returns false when the file cannot be
+// mapped; throws like llama_state_load_file would fail otherwise.
+bool LoadMappedSession(rnllama::llama_rn_context *rn_ctx,
+                       const std::string &path,
+                       std::vector<llama_token> &tokens);
+// Same for a delta session file, restoring its newest intact segment.
+std::vector<llama_token> LoadDeltaSession(rnllama::llama_rn_context *rn_ctx,
+                                          const std::string &path);
+
+// Throws unless a whole-context state operation is allowed right now.
+void CheckSessionContext(rnllama::llama_rn_context *rn_ctx);
+
+// getSessionState(): resolves a Buffer with the full context state. The
+// state is written straight into memory the Buffer then owns.
+class GetSessionStateWorker : public Napi::AsyncWorker,
+                              public Napi::Promise::Deferred {
+public:
+  GetSessionStateWorker(Napi::Env env, rnllama::llama_rn_context *rn_ctx);
+  ~GetSessionStateWorker();
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  uint8_t *_data = nullptr;
+  size_t _size = 0;
+  std::shared_ptr<ContextGate> _gate;
+};
+
+// setSessionState(buffer): restores a getSessionState() Buffer, reading it
+// in place while a reference keeps it alive. Resolves the token count.
+class SetSessionStateWorker : public Napi::AsyncWorker,
+                              public Napi::Promise::Deferred {
+public:
+  SetSessionStateWorker(Napi::Env env, rnllama::llama_rn_context *rn_ctx,
+                        Napi::Buffer<uint8_t> buffer);
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  Napi::Reference<Napi::Buffer<uint8_t>> _buffer_ref;
+  const uint8_t *_data;
+  size_t _size;
+  size_t _count = 0;
+  std::shared_ptr<ContextGate> _gate;
+};
+
+// getSequenceState(target) / saveSequenceState(target, path): snapshots the
+// sequence of a parallel slot, addressed by `slot_id` when it is not -1, else
+// by the request it is serving or last finished (if no other request has
+// used the slot since). The bytes use the llama_state_seq_save_file layout,
+// so a Buffer written to disk is a valid `load_state_path` for a later
+// request on any slot or process running the same model. An empty `path`
+// resolves a Buffer, otherwise the token count.
+class SequenceStateWorker : public Napi::AsyncWorker,
+                            public Napi::Promise::Deferred {
+public:
+  SequenceStateWorker(Napi::Env env, rnllama::llama_rn_context *rn_ctx,
+                      std::shared_ptr<SlotLoopPause> pause,
+                      std::shared_ptr<SlotRequestLog> requests,
+                      int32_t request_id, int32_t slot_id, std::string path);
+  ~SequenceStateWorker();
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  std::shared_ptr<SlotLoopPause> _pause;
+  std::shared_ptr<SlotRequestLog> _requests;
+  int32_t _request_id;
+  int32_t _slot_id;
+  std::string _path;
+  uint8_t *_data = nullptr;
+  size_t _size = 0;
+  size_t _count = 0;
+  std::shared_ptr<ContextGate> _gate;
+};
@@ -0,0 +1,132 @@
+#include "TokenEmbeddingWorker.h"
+#include "EmbeddingBatchWorker.h"
+#include "LlamaContext.h"
+#include "VectorIndex.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+TokenEmbeddingWorker::TokenEmbeddingWorker(const Napi::CallbackInfo &info,
+                                           rnllama::llama_rn_context *rn_ctx,
+                                           std::string text,
+                                           int32_t embd_normalize)
+    : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx),
+      _text(std::move(text)), _embd_normalize(embd_normalize) {}
+
+void TokenEmbeddingWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
+  // Checked before the memory is touched, which the slots still use
+  try {
+    CheckPackedContext(_rn_ctx);
+  } catch (const std::exception &e) {
+    SetError(e.what());
+    return;
+  }
+  llama_context *ctx = _rn_ctx->ctx;
+  auto *memory = llama_get_memory(ctx);
+  llama_batch batch = {};
+  try {
+    if (llama_pooling_type(ctx) != LLAMA_POOLING_TYPE_NONE) {
+      throw std::runtime_error(
+          "Token embeddings require pooling_type 'none'");
+    }
+    const auto tokens = common_tokenize(ctx, _text, true, true);
+    const size_t limit = EmbeddingBatchTokenLimit(ctx, 0);
+    if (tokens.size() > limit) {
+      throw std::runtime_error("Input has " + std::to_string(tokens.size()) +
+                               " tokens, exceeding the batch size of " +
+                               std::to_string(limit));
+    }
+    _n_embd = llama_model_n_embd(_rn_ctx->model);
+    _embeddings.resize(tokens.size() * _n_embd);
+
+    batch = llama_batch_init(static_cast<int32_t>(tokens.size()), 0, 1);
+    for (size_t i = 0; i < tokens.size(); i++) {
+      common_batch_add(batch, tokens[i], static_cast<llama_pos>(i), {0}, true);
+    }
+    llama_memory_clear(memory, true);
+    if (!tokens.empty() && llama_decode(ctx, batch) != 0) {
+      throw std::runtime_error("Failed to decode token embeddings");
+    }
+    for (size_t i = 0; i < tokens.size(); i++) {
+      const float *embd = llama_get_embeddings_ith(ctx, static_cast<int32_t>(i));
+      if (embd == nullptr) {
+        throw std::runtime_error("Failed to get token embeddings");
+      }
+      common_embd_normalize(embd, _embeddings.data() + i * _n_embd,
+                            static_cast<int>(_n_embd), _embd_normalize);
+    }
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+  if (batch.token != nullptr) {
+    llama_batch_free(batch);
+  }
+  // The cached prompt is gone; make the next completion start over
+  llama_memory_clear(memory, true);
+  _rn_ctx->completion->embd.clear();
+  _rn_ctx->completion->n_past = 0;
+}
+
+void TokenEmbeddingWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  auto embeddings = Napi::Float32Array::New(env, _embeddings.size());
+  if (!_embeddings.empty()) {
+    memcpy(embeddings.Data(), _embeddings.data(),
+           _embeddings.size() * sizeof(float));
+  }
+  auto result = Napi::Object::New(env);
+  result.Set("embeddings", embeddings);
+  result.Set("n_tokens", Napi::Number::New(
+                             env, _n_embd ? _embeddings.size() / _n_embd : 0));
+  result.Set("n_embd", Napi::Number::New(env, _n_embd));
+  Napi::Promise::Deferred::Resolve(result);
+}
+
+void TokenEmbeddingWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
+
+MaxSimWorker::MaxSimWorker(Napi::Env env, std::vector<float> query,
+                           std::vector<std::vector<float>> documents,
+                           size_t n_embd)
+    : AsyncWorker(env), Deferred(env), _query(std::move(query)),
+      _documents(std::move(documents)), _n_embd(n_embd) {}
+
+void MaxSimWorker::Execute() {
+  const size_t n_query = _query.size() / _n_embd;
+  _scores.assign(_documents.size(), 0.0f);
+  for (size_t d = 0; d < _documents.size(); d++) {
+    const auto &doc = _documents[d];
+    const size_t n_doc = doc.size() / _n_embd;
+    if (n_doc == 0) {
+      continue;
+    }
+    float score = 0.0f;
+    for (size_t q = 0; q < n_query; q++) {
+      const float *qv = _query.data() + q * _n_embd;
+      float best = -std::numeric_limits<float>::infinity();
+      for (size_t t = 0; t < n_doc; t++) {
+        best = std::max(best, DotF32(qv, doc.data() + t * _n_embd, _n_embd));
+      }
+      score += best;
+    }
+    _scores[d] = score;
+  }
+}
+
+void MaxSimWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  auto scores = Napi::Float32Array::New(env, _scores.size());
+  for (size_t i = 0; i < _scores.size(); i++) {
+    scores[i] = _scores[i];
+  }
+  Napi::Promise::Deferred::Resolve(scores);
+}
+
+void MaxSimWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "SessionState.h"
+#include "common.hpp"
+#include "rn-llama/rn-llama.h"
+#include <memory>
+#include <vector>
+
+// Per-token embeddings of a text from a context with pooling_type 'none',
+// each normalized with `embd_normalize`.
+class TokenEmbeddingWorker : public Napi::AsyncWorker,
+                             public Napi::Promise::Deferred {
+public:
+  TokenEmbeddingWorker(const Napi::CallbackInfo &info,
+                       rnllama::llama_rn_context *rn_ctx, std::string text,
+                       int32_t embd_normalize);
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  rnllama::llama_rn_context *_rn_ctx;
+  std::string _text;
+  int32_t _embd_normalize;
+  std::vector<float> _embeddings; // [n_tokens * n_embd]
+  size_t _n_embd = 0;
+  std::shared_ptr<ContextGate> _gate;
+};
+
+// ColBERT-style late interaction: for every document, the sum over query
+// tokens of the best dot product with any document token.
+class MaxSimWorker : public Napi::AsyncWorker,
+                     public Napi::Promise::Deferred {
+public:
+  MaxSimWorker(Napi::Env env, std::vector<float> query,
+               std::vector<std::vector<float>> documents, size_t n_embd);
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  std::vector<float> _query;
+  std::vector<std::vector<float>> _documents;
+  size_t _n_embd;
+  std::vector<float> _scores;
+};
@@ -0,0 +1,197 @@
+#include "TokenStream.h"
+
+TokenRingBuffer::TokenRingBuffer(size_t capacity)
+    : _slots(std::max<size_t>(capacity, 1)) {}
+
+// The readable callback only queues a non-blocking call, so it is invoked
+// under the lock; SetReadableCallback(nullptr) then guarantees no call is in
+// flight once it returns.
+void TokenRingBuffer::PushLocked(TokenStreamChunkPtr chunk) {
+  const bool was_empty = _size == 0;
+  _slots[(_head + _size) % _slots.size()] = std::move(chunk);
+  _size++;
+  if (was_empty && _on_readable) {
+    _on_readable();
+  }
+}
+
+bool TokenRingBuffer::Push(TokenStreamChunkPtr chunk) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _not_full.wait(lock,
+                 [this] { return _size < _slots.size() || _aborted.load(); });
+  if (_aborted.load() || _finished) {
+    return false;
+  }
+  PushLocked(std::move(chunk));
+  return true;
+}
+
+bool TokenRingBuffer::PushOrMerge(TokenStreamChunkPtr chunk) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_aborted.load() || _finished) {
+    return false;
+  }
+  if (_size == _slots.size()) {
+    auto &newest = _slots[(_head + _size - 1) % _slots.size()];
+    return newest->Merge(*chunk);
+  }
+  PushLocked(std::move(chunk));
+  return true;
+}
+
+size_t TokenRingBuffer::Pop(std::vector<TokenStreamChunkPtr> &out,
+                            size_t max) {
+  size_t n = 0;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    while (_size > 0 && n < max) {
+      out.push_back(std::move(_slots[_head]));
+      _head = (_head + 1) % _slots.size();
+      _size--;
+      n++;
+    }
+  }
+  if (n > 0) {
+    _not_full.notify_one();
+  }
+  return n;
+}
+
+void TokenRingBuffer::Finish() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_finished) {
+    return;
+  }
+  _finished = true;
+  if (_on_readable) {
+    _on_readable();
+  }
+}
+
+void TokenRingBuffer::Abort() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _aborted = true;
+    for (auto &slot : _slots) {
+      slot.reset();
+    }
+    _size = 0;
+  }
+  _not_full.notify_all();
+}
+
+bool TokenRingBuffer::IsFinished() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return (_finished && _size == 0) || _aborted.load();
+}
+
+void TokenRingBuffer::SetReadableCallback(std::function<void()> cb) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _on_readable = std::move(cb);
+}
+
+void LlamaTokenStream::Init(Napi::Env env, Napi::Object &exports) {
+  Napi::Function func = DefineClass(
+      env, "LlamaTokenStream",
+      {InstanceMethod<&LlamaTokenStream::Read>(
+           "read", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaTokenStream::IsFinished>(
+           "isFinished",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaTokenStream::Close>(
+           "close", static_cast<napi_property_attributes>(napi_enumerable))});
+#if NAPI_VERSION > 5
+  env.GetInstanceData<AddonData>()->token_stream = Napi::Persistent(func);
+#endif
+  exports.Set("LlamaTokenStream", func);
+}
+
+std::shared_ptr<TokenRingBuffer>
+LlamaTokenStream::FromValue(const Napi::Value &value) {
+#if NAPI_VERSION > 5
+  if (!value.IsObject()) {
+    return nullptr;
+  }
+  auto *data = value.Env().GetInstanceData<AddonData>();
+  if (data == nullptr || data->token_stream.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(data->token_stream.Value())) {
+    return nullptr;
+  }
+  return Unwrap(value.As<Napi::Object>())->_buffer;
+#else
+  return nullptr;
+#endif
+}
+
+// constructor({ capacity?: number }, onReadable: () => void)
+LlamaTokenStream::LlamaTokenStream(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<LlamaTokenStream>(info) {
+  Napi::Env env = info.Env();
+  auto options = info.Length() >= 1 && info[0].IsObject()
+                     ? info[0].As<Napi::Object>()
+                     : Napi::Object::New(env);
+  if (info.Length() < 2 || !info[1].IsFunction()) {
+    Napi::TypeError::New(env, "onReadable callback is required")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+  const int32_t capacity = get_option<int32_t>(options, "capacity", 64);
+  _buffer = std::make_shared<TokenRingBuffer>(
+      static_cast<size_t>(std::max<int32_t>(capacity, 1)));
+  _notify_pending = std::make_shared<std::atomic<bool>>(false);
+
+  _tsfn = Napi::ThreadSafeFunction::New(env, info[1].As<Napi::Function>(),
+                                        "LlamaTokenStreamReadable", 0, 1);
+  // The producer (completion worker or slot callback) keeps the loop alive.
+  _tsfn.Unref(env);
+
+  auto tsfn = _tsfn;
+  auto pending = _notify_pending;
+  _buffer->SetReadableCallback([tsfn, pending]() mutable {
+    if (pending->exchange(true)) {
+      return;
+    }
+    auto status = tsfn.NonBlockingCall(
+        [pending](Napi::Env, Napi::Function jsCallback) {
+          pending->store(false);
+          jsCallback.Call({});
+        });
+    if (status != napi_ok) {
+      pending->store(false);
+    }
+  });
+}
+
+LlamaTokenStream::~LlamaTokenStream() {
+  if (_buffer) {
+    _buffer->SetReadableCallback(nullptr);
+    _buffer->Abort();
+    _tsfn.Release();
+  }
+}
+
+// read(max?: number): any[]
+Napi::Value LlamaTokenStream::Read(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  size_t max = _buffer->Capacity();
+  if (info.Length() >= 1 && info[0].IsNumber()) {
+    max = std::max<int32_t>(info[0].ToNumber().Int32Value(), 1);
+  }
+  std::vector<TokenStreamChunkPtr> chunks;
+  _buffer->Pop(chunks, max);
+  Napi::Array result = Napi::Array::New(env, chunks.size());
+  for (size_t i = 0; i < chunks.size(); i++) {
+    result.Set(i, chunks[i]->ToValue(env));
+  }
+  return result;
+}
+
+// isFinished(): boolean
+Napi::Value LlamaTokenStream::IsFinished(const Napi::CallbackInfo &info) {
+  return Napi::Boolean::New(info.Env(), _buffer->IsFinished());
+}
+
+// close(): void
+void LlamaTokenStream::Close(const Napi::CallbackInfo &info) {
+  _buffer->Abort();
+}
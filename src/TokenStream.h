@@ -0,0 +1,106 @@
+#pragma once
+
+#include "ObjectPool.h"
+#include "common.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A streamed completion payload. Converted to a JS value on the main thread
+// when the consumer reads it.
+struct TokenStreamChunk {
+  virtual ~TokenStreamChunk() = default;
+  virtual Napi::Value ToValue(Napi::Env env) = 0;
+  // Fold a newer chunk into this one when the buffer is full and the producer
+  // must not block. Returns false if the chunks cannot be combined.
+  virtual bool Merge(TokenStreamChunk &next) { return false; }
+  // Called instead of delete; pooled chunks return to their pool.
+  virtual void Release() { delete this; }
+};
+
+struct TokenStreamChunkDeleter {
+  void operator()(TokenStreamChunk *chunk) const { chunk->Release(); }
+};
+
+typedef std::unique_ptr<TokenStreamChunk, TokenStreamChunkDeleter>
+    TokenStreamChunkPtr;
+
+// A chunk type recycled through an ObjectPool. Derived types implement
+// Reset() to clear their fields while keeping allocated capacity.
+template <typename T> struct PooledTokenStreamChunk : public TokenStreamChunk {
+  std::shared_ptr<ObjectPool<T>> pool;
+
+  void Release() override {
+    auto owner = std::move(pool);
+    if (owner) {
+      owner->Recycle(static_cast<T *>(this));
+    } else {
+      delete this;
+    }
+  }
+};
+
+// Bounded single-producer / single-consumer queue between a decode thread and
+// a JS async iterator. A full buffer either blocks the producer (pausing only
+// that generation) or, for producers that must never wait, coalesces into the
+// newest chunk.
+class TokenRingBuffer {
+public:
+  explicit TokenRingBuffer(size_t capacity);
+
+  // Blocks while the buffer is full. Returns false once the consumer aborted.
+  bool Push(TokenStreamChunkPtr chunk);
+  // Never blocks: merges into the newest chunk while the buffer is full.
+  // Returns false once the consumer aborted, or if the buffer is full and the
+  // chunk cannot merge, in which case it is dropped.
+  bool PushOrMerge(TokenStreamChunkPtr chunk);
+  // Moves up to `max` chunks into `out` and wakes a blocked producer.
+  size_t Pop(std::vector<TokenStreamChunkPtr> &out, size_t max);
+
+  // Producer side: no more chunks will be pushed.
+  void Finish();
+  // Consumer side: stop accepting chunks and release a blocked producer.
+  void Abort();
+
+  bool IsFinished();
+  bool IsAborted() const { return _aborted.load(); }
+  size_t Capacity() const { return _slots.size(); }
+
+  void SetReadableCallback(std::function<void()> cb);
+
+private:
+  void PushLocked(TokenStreamChunkPtr chunk);
+
+  std::vector<TokenStreamChunkPtr> _slots;
+  size_t _head = 0;
+  size_t _size = 0;
+  bool _finished = false;
+  std::atomic<bool> _aborted{false};
+  std::mutex _mutex;
+  std::condition_variable _not_full;
+  std::function<void()> _on_readable;
+};
+
+// JS handle for a TokenRingBuffer.
+// new LlamaTokenStream({ capacity }, onReadable: () => void)
+class LlamaTokenStream : public Napi::ObjectWrap<LlamaTokenStream> {
+public:
+  LlamaTokenStream(const Napi::CallbackInfo &info);
+  ~LlamaTokenStream();
+  static void Init(Napi::Env env, Napi::Object &exports);
+  // Returns the buffer behind `value` if it is a LlamaTokenStream, else null.
+  static std::shared_ptr<TokenRingBuffer> FromValue(const Napi::Value &value);
+
+private:
+  Napi::Value Read(const Napi::CallbackInfo &info);
+  Napi::Value IsFinished(const Napi::CallbackInfo &info);
+  void Close(const Napi::CallbackInfo &info);
+
+  std::shared_ptr<TokenRingBuffer> _buffer;
+  Napi::ThreadSafeFunction _tsfn;
+  // Coalesces wake-ups so at most one is queued on the JS thread.
+  std::shared_ptr<std::atomic<bool>> _notify_pending;
+};
@@ -0,0 +1,198 @@
+#include "TokenizeBatchWorker.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+// Runs fn(i) for i in [0, n) on up to n_threads threads (the caller being
+// one of them). Items are claimed one at a time so long texts do not leave
+// other threads idle.
+template <typename Fn>
+static void ParallelFor(size_t n, size_t n_threads, const Fn &fn) {
+  n_threads = std::max<size_t>(1, std::min(n_threads, n));
+  std::atomic<size_t> next{0};
+  auto run = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < n_threads; t++) {
+    threads.emplace_back(run);
+  }
+  run();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+// Piece boundaries: offsets of non-space characters that directly follow a
+// newline, roughly `target` bytes apart.
+static std::vector<size_t> SplitPoints(const std::string &text,
+                                       size_t target) {
+  std::vector<size_t> points;
+  size_t pos = target;
+  while (pos < text.size()) {
+    const size_t nl = text.find('\n', pos);
+    if (nl == std::string::npos) {
+      break;
+    }
+    size_t next = nl + 1;
+    while (next < text.size() && IsSpace(text[next])) {
+      next++;
+    }
+    if (next >= text.size()) {
+      break;
+    }
+    if (text[next - 1] == '\n') {
+      points.push_back(next);
+      pos = next + target;
+    } else {
+      // Spaces after the newline would be merged with the next word
+      pos = next;
+    }
+  }
+  return points;
+}
+
+std::vector<llama_token> TokenizeLongText(const llama_vocab *vocab,
+                                          const std::string &text,
+                                          const TokenizeOptions &options) {
+  if (options.n_threads <= 1 || text.size() < kParallelTokenizeMinBytes ||
+      llama_vocab_type(vocab) != LLAMA_VOCAB_TYPE_BPE) {
+    return common_tokenize(vocab, text, options.add_special,
+                           options.parse_special);
+  }
+  // A few pieces per thread keeps the threads busy when pieces vary in cost
+  const size_t target = std::max(kParallelTokenizeMinBytes / 4,
+                                 text.size() / (options.n_threads * 4));
+  auto points = SplitPoints(text, target);
+  if (points.empty()) {
+    return common_tokenize(vocab, text, options.add_special,
+                           options.parse_special);
+  }
+  points.insert(points.begin(), 0);
+  points.push_back(text.size());
+
+  std::vector<std::vector<llama_token>> pieces(points.size() - 1);
+  ParallelFor(pieces.size(), options.n_threads, [&](size_t i) {
+    pieces[i] = common_tokenize(
+        vocab, text.substr(points[i], points[i + 1] - points[i]), false,
+        options.parse_special);
+  });
+
+  // Special tokens go around the whole text, as a single pass adds them
+  std::vector<llama_token> tokens;
+  size_t total = 2;
+  for (const auto &piece : pieces) {
+    total += piece.size();
+  }
+  tokens.reserve(total);
+  if (options.add_special && llama_vocab_get_add_bos(vocab)) {
+    tokens.push_back(llama_vocab_bos(vocab));
+  }
+  for (const auto &piece : pieces) {
+    tokens.insert(tokens.end(), piece.begin(), piece.end());
+  }
+  if (options.add_special && llama_vocab_get_add_eos(vocab)) {
+    tokens.push_back(llama_vocab_eos(vocab));
+  }
+  return tokens;
+}
+
+void TokenizeTexts(const llama_vocab *vocab,
+                   const std::vector<std::string> &texts,
+                   const TokenizeOptions &options,
+                   std::vector<std::vector<llama_token>> &out) {
+  out.assign(texts.size(), {});
+  if (texts.size() == 1) {
+    out[0] = TokenizeLongText(vocab, texts[0], options);
+    return;
+  }
+  ParallelFor(texts.size(), options.n_threads, [&](size_t i) {
+    out[i] = common_tokenize(vocab, texts[i], options.add_special,
+                             options.parse_special);
+  });
+}
+
+void CountTextTokens(const llama_vocab *vocab,
+                     const std::vector<std::string> &texts,
+                     const TokenizeOptions &options,
+                     std::vector<uint32_t> &counts) {
+  counts.assign(texts.size(), 0);
+  if (texts.size() == 1 && texts[0].size() >= kParallelTokenizeMinBytes) {
+    counts[0] = static_cast<uint32_t>(
+        TokenizeLongText(vocab, texts[0], options).size());
+    return;
+  }
+  ParallelFor(texts.size(), options.n_threads, [&](size_t i) {
+    // With no output buffer llama_tokenize returns minus the token count
+    const int32_t n = llama_tokenize(
+        vocab, texts[i].data(), static_cast<int32_t>(texts[i].size()), nullptr,
+        0, options.add_special, options.parse_special);
+    counts[i] = static_cast<uint32_t>(n < 0 ? -n : n);
+  });
+}
+
+TokenizeBatchWorker::TokenizeBatchWorker(Napi::Env env,
+                                         const llama_vocab *vocab,
+                                         std::vector<std::string> texts,
+                                         TokenizeOptions options,
+                                         bool count_only)
+    : AsyncWorker(env), Deferred(env), _vocab(vocab), _texts(std::move(texts)),
+      _options(options), _count_only(count_only) {}
+
+void TokenizeBatchWorker::Execute() {
+  try {
+    if (_count_only) {
+      CountTextTokens(_vocab, _texts, _options, _offsets);
+      return;
+    }
+    std::vector<std::vector<llama_token>> tokens;
+    TokenizeTexts(_vocab, _texts, _options, tokens);
+    _offsets.resize(_texts.size() + 1);
+    size_t total = 0;
+    for (size_t i = 0; i < tokens.size(); i++) {
+      _offsets[i] = static_cast<uint32_t>(total);
+      total += tokens[i].size();
+    }
+    _offsets[tokens.size()] = static_cast<uint32_t>(total);
+    _tokens.resize(total);
+    for (size_t i = 0; i < tokens.size(); i++) {
+      std::copy(tokens[i].begin(), tokens[i].end(),
+                _tokens.begin() + _offsets[i]);
+    }
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void TokenizeBatchWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  auto offsets = Napi::Uint32Array::New(env, _offsets.size());
+  if (!_offsets.empty()) {
+    memcpy(offsets.Data(), _offsets.data(), _offsets.size() * sizeof(uint32_t));
+  }
+  if (_count_only) {
+    Napi::Promise::Deferred::Resolve(offsets);
+    return;
+  }
+  auto tokens = Napi::Int32Array::New(env, _tokens.size());
+  if (!_tokens.empty()) {
+    memcpy(tokens.Data(), _tokens.data(), _tokens.size() * sizeof(int32_t));
+  }
+  auto result = Napi::Object::New(env);
+  result.Set("tokens", tokens);
+  result.Set("offsets", offsets);
+  Napi::Promise::Deferred::Resolve(result);
+}
+
+void TokenizeBatchWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
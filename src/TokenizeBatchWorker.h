@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common.hpp"
+#include <string>
+#include <vector>
+
+struct TokenizeOptions {
+  bool add_special = false;
+  bool parse_special = false;
+  size_t n_threads = 1;
+};
+
+// Texts at least this long are split for parallel tokenization
+const size_t kParallelTokenizeMinBytes = 64 * 1024;
+
+// Tokenizes one text. A long text with a BPE vocab is split where a newline
+// run is followed by a non-space character (BPE pre-tokenizers never merge
+// across that point) and the pieces are tokenized on up to
+// options.n_threads threads; the result is identical to a single pass.
+std::vector<llama_token> TokenizeLongText(const llama_vocab *vocab,
+                                          const std::string &text,
+                                          const TokenizeOptions &options);
+
+// Tokenizes every text with the read-only vocab, spreading texts over up
+// to options.n_threads threads. `out` holds one token vector per text.
+void TokenizeTexts(const llama_vocab *vocab,
+                   const std::vector<std::string> &texts,
+                   const TokenizeOptions &options,
+                   std::vector<std::vector<llama_token>> &out);
+
+// Token count of every text, without keeping the tokens.
+void CountTextTokens(const llama_vocab *vocab,
+                     const std::vector<std::string> &texts,
+                     const TokenizeOptions &options,
+                     std::vector<uint32_t> &counts);
+
+// tokenizeBatch / countTokens: resolves { tokens: Int32Array, offsets:
+// Uint32Array }, or a Uint32Array of counts when `count_only` is set.
+class TokenizeBatchWorker : public Napi::AsyncWorker,
+                            public Napi::Promise::Deferred {
+public:
+  TokenizeBatchWorker(Napi::Env env, const llama_vocab *vocab,
+                      std::vector<std::string> texts, TokenizeOptions options,
+                      bool count_only);
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  const llama_vocab *_vocab;
+  std::vector<std::string> _texts;
+  TokenizeOptions _options;
+  bool _count_only;
+  std::vector<int32_t> _tokens;
+  std::vector<uint32_t> _offsets; // or counts when _count_only
+};
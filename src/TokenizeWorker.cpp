@@ -1,16 +1,31 @@
 #include "TokenizeWorker.h"
 #include "LlamaContext.h"
+#include "TokenizeBatchWorker.h"
+#include <algorithm>
 
 TokenizeWorker::TokenizeWorker(const Napi::CallbackInfo &info,
                                rnllama::llama_rn_context* rn_ctx, std::string text,
-                               std::vector<std::string> media_paths)
+                               std::vector<MediaInput> media_paths)
     : AsyncWorker(info.Env()), Deferred(info.Env()), _rn_ctx(rn_ctx), _text(text),
-      _media_paths(media_paths) {}
+      _media_paths(std::move(media_paths)) {}
 
 void TokenizeWorker::Execute() {
+  if (_gate) {
+    _gate->Wait();
+  }
   try {
+    if (_media_paths.empty() && _text.size() >= kParallelTokenizeMinBytes) {
+      // Same special-token handling as rn-llama, split over threads
+      TokenizeOptions options;
+      options.n_threads = std::max(1, _rn_ctx->params.cpuparams.n_threads);
+      auto tokens = TokenizeLongText(llama_model_get_vocab(_rn_ctx->model),
+                                     _text, options);
+      _result.tokens.assign(tokens.begin(), tokens.end());
+      _result.has_media = false;
+      return;
+    }
     // Use rn-llama tokenize API directly
-    auto result = _rn_ctx->tokenize(_text, _media_paths);
+    auto result = _rn_ctx->tokenize(_text, ResolveMediaPaths(_media_paths));
     
     // Convert llama_token to int32_t
     _result.tokens.resize(result.tokens.size());
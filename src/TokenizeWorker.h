@@ -1,5 +1,8 @@
+#include "MediaInput.h"
+#include "SessionState.h"
 #include "common.hpp"
 #include "rn-llama/rn-llama.h"
+#include <memory>
 #include <vector>
 
 struct TokenizeResult {
@@ -14,7 +17,12 @@ class TokenizeWorker : public Napi::AsyncWorker,
                        public Napi::Promise::Deferred {
 public:
   TokenizeWorker(const Napi::CallbackInfo &info, rnllama::llama_rn_context* rn_ctx,
-                 std::string text, std::vector<std::string> media_paths);
+                 std::string text, std::vector<MediaInput> media_paths);
+
+  // Waits for a pending snapshot save to copy the state first
+  void SetContextGate(std::shared_ptr<ContextGate> gate) {
+    _gate = std::move(gate);
+  }
 
 protected:
   void Execute();
@@ -24,6 +32,7 @@ protected:
 private:
   rnllama::llama_rn_context* _rn_ctx;
   std::string _text;
-  std::vector<std::string> _media_paths;
+  std::vector<MediaInput> _media_paths;
   TokenizeResult _result;
+  std::shared_ptr<ContextGate> _gate;
 };
\ No newline at end of file
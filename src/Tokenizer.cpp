@@ -0,0 +1,211 @@
+#include "Tokenizer.h"
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+std::shared_ptr<llama_model> AcquireVocabModel(const std::string &path) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::weak_ptr<llama_model>> models;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = models.find(path);
+  if (it != models.end()) {
+    if (auto model = it->second.lock()) {
+      return model;
+    }
+  }
+  static std::once_flag backend_once;
+  std::call_once(backend_once, [] { llama_backend_init(); });
+
+  auto params = llama_model_default_params();
+  params.vocab_only = true;
+  params.use_mmap = true;
+  llama_model *raw = llama_model_load_from_file(path.c_str(), params);
+  if (raw == nullptr) {
+    throw std::runtime_error("Failed to load tokenizer from " + path);
+  }
+  std::shared_ptr<llama_model> model(raw, llama_model_free);
+  models[path] = model;
+  return model;
+}
+
+void LlamaTokenizer::Init(Napi::Env env, Napi::Object &exports) {
+  Napi::Function func = DefineClass(
+      env, "LlamaTokenizer",
+      {InstanceMethod<&LlamaTokenizer::Tokenize>(
+           "tokenize", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaTokenizer::Detokenize>(
+           "detokenize",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaTokenizer::CountTokens>(
+           "countTokens",
+           static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaTokenizer::GetInfo>(
+           "getInfo", static_cast<napi_property_attributes>(napi_enumerable)),
+       StaticMethod<&LlamaTokenizer::Load>(
+           "load", static_cast<napi_property_attributes>(napi_enumerable))});
+#if NAPI_VERSION > 5
+  env.GetInstanceData<AddonData>()->tokenizer = Napi::Persistent(func);
+#endif
+  exports.Set("LlamaTokenizer", func);
+}
+
+typedef Napi::External<std::shared_ptr<llama_model>> ModelExternal;
+
+// constructor(path: string)
+LlamaTokenizer::LlamaTokenizer(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<LlamaTokenizer>(info) {
+  Napi::Env env = info.Env();
+  if (info.Length() >= 1 && info[0].IsExternal()) {
+    // From TokenizerLoadWorker
+    _model = *info[0].As<ModelExternal>().Data();
+    _vocab = llama_model_get_vocab(_model.get());
+    return;
+  }
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Path expected").ThrowAsJavaScriptException();
+    return;
+  }
+  try {
+    _model = AcquireVocabModel(info[0].ToString().Utf8Value());
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return;
+  }
+  _vocab = llama_model_get_vocab(_model.get());
+}
+
+// load(path: string): Promise<LlamaTokenizer>
+Napi::Value LlamaTokenizer::Load(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Path expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto *worker =
+      new TokenizerLoadWorker(env, info[0].ToString().Utf8Value());
+  worker->Queue();
+  return worker->Promise();
+}
+
+static void ReadTokenizeOptions(const Napi::CallbackInfo &info, size_t index,
+                                bool &add_special, bool &parse_special) {
+  add_special = false;
+  parse_special = false;
+  if (info.Length() > index && info[index].IsObject()) {
+    auto options = info[index].As<Napi::Object>();
+    add_special = get_option<bool>(options, "add_special", false);
+    parse_special = get_option<bool>(options, "parse_special", false);
+  }
+}
+
+// tokenize(text: string, options?: { add_special?, parse_special? }): Int32Array
+Napi::Value LlamaTokenizer::Tokenize(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  bool add_special, parse_special;
+  ReadTokenizeOptions(info, 1, add_special, parse_special);
+  const auto tokens = common_tokenize(_vocab, info[0].ToString().Utf8Value(),
+                                      add_special, parse_special);
+  auto result = Napi::Int32Array::New(env, tokens.size());
+  if (!tokens.empty()) {
+    memcpy(result.Data(), tokens.data(), tokens.size() * sizeof(llama_token));
+  }
+  return result;
+}
+
+// detokenize(tokens: number[] | Int32Array, options?: { special? }): string
+Napi::Value LlamaTokenizer::Detokenize(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  std::vector<llama_token> tokens;
+  if (info.Length() >= 1 && info[0].IsTypedArray() &&
+      info[0].As<Napi::TypedArray>().TypedArrayType() == napi_int32_array) {
+    auto array = info[0].As<Napi::Int32Array>();
+    tokens.assign(array.Data(), array.Data() + array.ElementLength());
+  } else if (info.Length() >= 1 && info[0].IsArray()) {
+    auto array = info[0].As<Napi::Array>();
+    tokens.reserve(array.Length());
+    for (size_t i = 0; i < array.Length(); i++) {
+      tokens.push_back(array.Get(i).ToNumber().Int32Value());
+    }
+  } else {
+    Napi::TypeError::New(env, "Array or Int32Array expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  const int32_t n_vocab = llama_vocab_n_tokens(_vocab);
+  for (auto token : tokens) {
+    if (token < 0 || token >= n_vocab) {
+      Napi::RangeError::New(env, "Invalid token " + std::to_string(token))
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+  bool special = true;
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    special = get_option<bool>(info[1].As<Napi::Object>(), "special", true);
+  }
+  return Napi::String::New(env, common_detokenize(_vocab, tokens, special));
+}
+
+// countTokens(text: string, options?: { add_special?, parse_special? }): number
+Napi::Value LlamaTokenizer::CountTokens(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  bool add_special, parse_special;
+  ReadTokenizeOptions(info, 1, add_special, parse_special);
+  const auto text = info[0].ToString().Utf8Value();
+  // With no output buffer llama_tokenize returns minus the token count
+  const int32_t n =
+      llama_tokenize(_vocab, text.data(), static_cast<int32_t>(text.size()),
+                     nullptr, 0, add_special, parse_special);
+  return Napi::Number::New(env, n < 0 ? -n : n);
+}
+
+// getInfo(): { n_vocab, bos, eos, add_bos, add_eos }
+Napi::Value LlamaTokenizer::GetInfo(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  auto result = Napi::Object::New(env);
+  result.Set("n_vocab", Napi::Number::New(env, llama_vocab_n_tokens(_vocab)));
+  result.Set("bos", Napi::Number::New(env, llama_vocab_bos(_vocab)));
+  result.Set("eos", Napi::Number::New(env, llama_vocab_eos(_vocab)));
+  result.Set("add_bos",
+             Napi::Boolean::New(env, llama_vocab_get_add_bos(_vocab)));
+  result.Set("add_eos",
+             Napi::Boolean::New(env, llama_vocab_get_add_eos(_vocab)));
+  return result;
+}
+
+TokenizerLoadWorker::TokenizerLoadWorker(Napi::Env env, std::string path)
+    : AsyncWorker(env), Deferred(env), _path(std::move(path)) {}
+
+void TokenizerLoadWorker::Execute() {
+  try {
+    _model = AcquireVocabModel(_path);
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void TokenizerLoadWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+#if NAPI_VERSION > 5
+  auto *data = env.GetInstanceData<AddonData>();
+  auto handle = data->tokenizer.New({ModelExternal::New(env, &_model)});
+  Napi::Promise::Deferred::Resolve(handle);
+#else
+  Napi::Promise::Deferred::Reject(
+      Napi::Error::New(env, "LlamaTokenizer.load requires N-API 6").Value());
+#endif
+}
+
+void TokenizerLoadWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
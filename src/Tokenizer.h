@@ -0,0 +1,46 @@
+#pragma once
+
+#include "common.hpp"
+#include <memory>
+#include <string>
+
+// Vocab-only model shared by every handle (and worker thread) that opened
+// the same path. Only the GGUF metadata is read; no tensors are loaded.
+std::shared_ptr<llama_model> AcquireVocabModel(const std::string &path);
+
+// JS handle for a vocab-only model. LlamaTokenizer.load(path) loads on a
+// worker thread; the constructor loads synchronously unless another handle
+// already holds the model. Methods are synchronous and never touch shared
+// mutable state, so handles in several worker_threads can tokenize at once.
+// new LlamaTokenizer(path)
+class LlamaTokenizer : public Napi::ObjectWrap<LlamaTokenizer> {
+public:
+  LlamaTokenizer(const Napi::CallbackInfo &info);
+  static void Init(Napi::Env env, Napi::Object &exports);
+
+private:
+  static Napi::Value Load(const Napi::CallbackInfo &info);
+  Napi::Value Tokenize(const Napi::CallbackInfo &info);
+  Napi::Value Detokenize(const Napi::CallbackInfo &info);
+  Napi::Value CountTokens(const Napi::CallbackInfo &info);
+  Napi::Value GetInfo(const Napi::CallbackInfo &info);
+
+  std::shared_ptr<llama_model> _model;
+  const llama_vocab *_vocab = nullptr;
+};
+
+// Resolves a LlamaTokenizer once the vocab is loaded
+class TokenizerLoadWorker : public Napi::AsyncWorker,
+                            public Napi::Promise::Deferred {
+public:
+  TokenizerLoadWorker(Napi::Env env, std::string path);
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  std::string _path;
+  std::shared_ptr<llama_model> _model;
+};
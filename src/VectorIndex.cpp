@@ -0,0 +1,696 @@
+#include "VectorIndex.h"
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+
+// File layout (little endian): 64-byte header { magic, version, dim, quant,
+// metric, count }, then count int64 ids and count rows, both padded to 64
+// bytes.
+static const char kMagic[4] = {'L', 'N', 'V', 'I'};
+static const uint32_t kVersion = 1;
+static const size_t kAlign = 64;
+
+struct VectorIndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t dim;
+  uint32_t quant;
+  uint32_t metric;
+  uint32_t reserved;
+  uint64_t count;
+  uint8_t padding[kAlign - 32];
+};
+static_assert(sizeof(VectorIndexHeader) == kAlign, "header must be 64 bytes");
+
+static size_t AlignUp(size_t n) { return (n + kAlign - 1) / kAlign * kAlign; }
+
+// The kernels are written so compilers vectorize them: independent float
+// accumulators for f32, widening integer sums for int8 and 64-bit popcounts
+// for binary rows.
+
+float DotF32(const float *__restrict a, const float *__restrict b, size_t n) {
+  float acc[8] = {0};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (size_t k = 0; k < 8; k++) {
+      acc[k] += a[i + k] * b[i + k];
+    }
+  }
+  float sum = 0.0f;
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  for (size_t k = 0; k < 8; k++) {
+    sum += acc[k];
+  }
+  return sum;
+}
+
+static int32_t DotI8(const int8_t *__restrict a, const int8_t *__restrict b,
+                     size_t n) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+  }
+  return sum;
+}
+
+static inline uint32_t Popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<uint32_t>(__builtin_popcountll(x));
+#else
+  return static_cast<uint32_t>(std::bitset<64>(x).count());
+#endif
+}
+
+static uint32_t Hamming(const uint8_t *a, const uint8_t *b, size_t n_bytes) {
+  uint32_t dist = 0;
+  size_t i = 0;
+  for (; i + 8 <= n_bytes; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    dist += Popcount64(x ^ y);
+  }
+  for (; i < n_bytes; i++) {
+    dist += Popcount64(static_cast<uint64_t>(a[i] ^ b[i]));
+  }
+  return dist;
+}
+
+VectorStore::VectorStore(size_t dim, EmbeddingQuant quant, VectorMetric metric)
+    : _dim(dim), _quant(quant), _metric(metric) {
+  _row_bytes = FormatLocked().RowBytes(_dim);
+}
+
+EmbeddingFormat VectorStore::FormatLocked() const {
+  EmbeddingFormat format;
+  format.quant = _quant;
+  format.embd_normalize = -1;
+  return format;
+}
+
+size_t VectorStore::Dim() {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _dim;
+}
+
+EmbeddingQuant VectorStore::Quant() {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _quant;
+}
+
+VectorMetric VectorStore::Metric() {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _metric;
+}
+
+size_t VectorStore::Size() {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _ids.size();
+}
+
+size_t VectorStore::Bytes() {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _ids.size() * (_row_bytes + sizeof(int64_t));
+}
+
+size_t VectorStore::RowBytes() {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  return _row_bytes;
+}
+
+void VectorStore::CheckDimLocked(size_t dim) {
+  if (_dim == 0 && dim > 0) {
+    _dim = dim;
+    _row_bytes = FormatLocked().RowBytes(_dim);
+  }
+  if (dim != _dim) {
+    throw std::runtime_error("Vector has " + std::to_string(dim) +
+                             " dimensions, index expects " +
+                             std::to_string(_dim));
+  }
+}
+
+void VectorStore::EncodeLocked(const float *vector, size_t dim,
+                               uint8_t *out) const {
+  std::vector<float> row(vector, vector + dim);
+  if (_metric == VectorMetric::COSINE) {
+    common_embd_normalize(vector, row.data(), static_cast<int>(dim), 2);
+  }
+  std::vector<uint8_t> encoded;
+  FormatLocked().Apply(row.data(), 1, dim, encoded);
+  memcpy(out, encoded.data(), encoded.size());
+}
+
+const uint8_t *VectorStore::RowsLocked() const {
+  return _mapped != nullptr ? _mapped : _rows.data();
+}
+
+void VectorStore::UnmapLocked() {
+  if (_mapped == nullptr) {
+    return;
+  }
+  _rows.assign(_mapped, _mapped + _ids.size() * _row_bytes);
+  _mapped = nullptr;
+  _file = MappedFile();
+}
+
+void VectorStore::PutRowLocked(int64_t id, const uint8_t *row) {
+  auto it = _index.find(id);
+  if (it != _index.end()) {
+    memcpy(_rows.data() + it->second * _row_bytes, row, _row_bytes);
+    return;
+  }
+  _index[id] = _ids.size();
+  _ids.push_back(id);
+  _rows.insert(_rows.end(), row, row + _row_bytes);
+}
+
+void VectorStore::AddFloat(const int64_t *ids, const float *vectors, size_t n,
+                           size_t dim, size_t stride) {
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  CheckDimLocked(dim);
+  UnmapLocked();
+  std::vector<uint8_t> row(_row_bytes);
+  _rows.reserve(_rows.size() + n * _row_bytes);
+  for (size_t i = 0; i < n; i++) {
+    EncodeLocked(vectors + i * stride, dim, row.data());
+    PutRowLocked(ids[i], row.data());
+  }
+}
+
+void VectorStore::AddEncoded(const int64_t *ids, const uint8_t *rows,
+                             size_t n) {
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  if (_dim == 0) {
+    throw std::runtime_error("Index dimension is unknown; add f32 vectors "
+                             "first or set dim");
+  }
+  UnmapLocked();
+  _rows.reserve(_rows.size() + n * _row_bytes);
+  for (size_t i = 0; i < n; i++) {
+    PutRowLocked(ids[i], rows + i * _row_bytes);
+  }
+}
+
+size_t VectorStore::Remove(const int64_t *ids, size_t n) {
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  UnmapLocked();
+  size_t removed = 0;
+  for (size_t i = 0; i < n; i++) {
+    auto it = _index.find(ids[i]);
+    if (it == _index.end()) {
+      continue;
+    }
+    // Move the last row into the hole to keep rows contiguous
+    const size_t row = it->second;
+    const size_t last = _ids.size() - 1;
+    _index.erase(it);
+    if (row != last) {
+      _ids[row] = _ids[last];
+      memcpy(_rows.data() + row * _row_bytes, _rows.data() + last * _row_bytes,
+             _row_bytes);
+      _index[_ids[row]] = row;
+    }
+    _ids.pop_back();
+    _rows.resize(_ids.size() * _row_bytes);
+    removed++;
+  }
+  return removed;
+}
+
+void VectorStore::Clear() {
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  _ids.clear();
+  _rows.clear();
+  _mapped = nullptr;
+  _file = MappedFile();
+  _index.clear();
+}
+
+void VectorStore::Search(const std::vector<float> &query_f32,
+                         const std::vector<uint8_t> &query_encoded, size_t k,
+                         std::vector<int64_t> &ids,
+                         std::vector<float> &scores) {
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  ids.clear();
+  scores.clear();
+  const bool encoded = query_f32.empty();
+  if (encoded ? query_encoded.size() != _row_bytes
+              : query_f32.size() != _dim) {
+    throw std::runtime_error("Query does not match the index dimension of " +
+                             std::to_string(_dim));
+  }
+  const size_t n = _ids.size();
+  if (n == 0 || k == 0) {
+    return;
+  }
+  std::vector<uint8_t> query(query_encoded);
+  if (!encoded) {
+    query.resize(_row_bytes);
+    EncodeLocked(query_f32.data(), _dim, query.data());
+  }
+
+  // Keep the best k in a min-heap so the scan does not allocate per row
+  typedef std::pair<float, size_t> Hit;
+  std::priority_queue<Hit, std::vector<Hit>, std::greater<Hit>> best;
+  auto offer = [&](float score, size_t row) {
+    if (best.size() < k) {
+      best.emplace(score, row);
+    } else if (score > best.top().first) {
+      best.pop();
+      best.emplace(score, row);
+    }
+  };
+
+  const uint8_t *rows = RowsLocked();
+  switch (_quant) {
+  case EmbeddingQuant::INT8: {
+    const float scale = 1.0f / (127.0f * 127.0f);
+    const auto *q = reinterpret_cast<const int8_t *>(query.data());
+    for (size_t r = 0; r < n; r++) {
+      const auto *row = reinterpret_cast<const int8_t *>(rows + r * _row_bytes);
+      offer(static_cast<float>(DotI8(q, row, _dim)) * scale, r);
+    }
+    break;
+  }
+  case EmbeddingQuant::BINARY: {
+    const float scale = 2.0f / static_cast<float>(_dim);
+    for (size_t r = 0; r < n; r++) {
+      const uint32_t dist = Hamming(query.data(), rows + r * _row_bytes,
+                                    _row_bytes);
+      offer(1.0f - static_cast<float>(dist) * scale, r);
+    }
+    break;
+  }
+  default: {
+    const auto *q = reinterpret_cast<const float *>(query.data());
+    for (size_t r = 0; r < n; r++) {
+      const auto *row = reinterpret_cast<const float *>(rows + r * _row_bytes);
+      offer(DotF32(q, row, _dim), r);
+    }
+    break;
+  }
+  }
+
+  ids.resize(best.size());
+  scores.resize(best.size());
+  for (size_t i = best.size(); i-- > 0;) {
+    ids[i] = _ids[best.top().second];
+    scores[i] = best.top().first;
+    best.pop();
+  }
+}
+
+size_t VectorStore::Save(const std::string &path) {
+  const std::string tmp_path = path + ".tmp";
+  std::shared_lock<std::shared_mutex> lock(_mutex);
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("Failed to open " + tmp_path);
+    }
+    VectorIndexHeader header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.dim = static_cast<uint32_t>(_dim);
+    header.quant = static_cast<uint32_t>(_quant);
+    header.metric = static_cast<uint32_t>(_metric);
+    header.count = _ids.size();
+    const char zeros[kAlign] = {0};
+    const size_t ids_bytes = _ids.size() * sizeof(int64_t);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(_ids.data()), ids_bytes);
+    out.write(zeros, AlignUp(ids_bytes) - ids_bytes);
+    out.write(reinterpret_cast<const char *>(RowsLocked()),
+              _ids.size() * _row_bytes);
+    if (!out) {
+      throw std::runtime_error("Failed to write " + tmp_path);
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("Failed to replace " + path);
+  }
+  return _ids.size();
+}
+
+size_t VectorStore::Load(const std::string &path) {
+  MappedFile file(path);
+  if (!file.Valid()) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  VectorIndexHeader header = {};
+  if (file.Size() >= sizeof(header)) {
+    memcpy(&header, file.Data(), sizeof(header));
+  }
+  if (file.Size() < sizeof(header) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      header.quant > static_cast<uint32_t>(EmbeddingQuant::BINARY) ||
+      header.metric > static_cast<uint32_t>(VectorMetric::DOT)) {
+    throw std::runtime_error("Not a vector index file: " + path);
+  }
+
+  // Index the ids before taking the lock so searches keep running; the rows
+  // stay in the mapping, 64-byte aligned like the page it starts on
+  EmbeddingFormat format;
+  format.quant = static_cast<EmbeddingQuant>(header.quant);
+  const size_t row_bytes = format.RowBytes(header.dim);
+  const size_t count = static_cast<size_t>(header.count);
+  if (count > (file.Size() - sizeof(header)) / (sizeof(int64_t) + row_bytes)) {
+    throw std::runtime_error("Truncated vector index file: " + path);
+  }
+  const size_t ids_bytes = count * sizeof(int64_t);
+  const size_t rows_offset = sizeof(header) + AlignUp(ids_bytes);
+  if (rows_offset + count * row_bytes > file.Size()) {
+    throw std::runtime_error("Truncated vector index file: " + path);
+  }
+  std::vector<int64_t> ids(count);
+  memcpy(ids.data(), file.Data() + sizeof(header), ids_bytes);
+  std::unordered_map<int64_t, size_t> index;
+  index.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    index[ids[i]] = i;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(_mutex);
+  _dim = header.dim;
+  _quant = format.quant;
+  _metric = static_cast<VectorMetric>(header.metric);
+  _row_bytes = row_bytes;
+  _ids = std::move(ids);
+  _rows.clear();
+  _rows.shrink_to_fit();
+  _file = std::move(file);
+  _mapped = _file.Data() + rows_offset;
+  _index = std::move(index);
+  return count;
+}
+
+static bool ParseQuant(const std::string &name, EmbeddingQuant &quant) {
+  if (name == "f32") {
+    quant = EmbeddingQuant::F32;
+  } else if (name == "int8") {
+    quant = EmbeddingQuant::INT8;
+  } else if (name == "binary") {
+    quant = EmbeddingQuant::BINARY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static const char *QuantName(EmbeddingQuant quant) {
+  switch (quant) {
+  case EmbeddingQuant::INT8:
+    return "int8";
+  case EmbeddingQuant::BINARY:
+    return "binary";
+  default:
+    return "f32";
+  }
+}
+
+static bool ReadIds(const Napi::Value &value, std::vector<int64_t> &ids) {
+  if (!value.IsArray()) {
+    return false;
+  }
+  auto array = value.As<Napi::Array>();
+  ids.resize(array.Length());
+  for (size_t i = 0; i < ids.size(); i++) {
+    ids[i] = array.Get(i).ToNumber().Int64Value();
+  }
+  return true;
+}
+
+void LlamaVectorIndex::Init(Napi::Env env, Napi::Object &exports) {
+  Napi::Function func = DefineClass(
+      env, "LlamaVectorIndex",
+      {InstanceMethod<&LlamaVectorIndex::Info>(
+           "info", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaVectorIndex::Add>(
+           "add", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaVectorIndex::Remove>(
+           "remove", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaVectorIndex::Clear>(
+           "clear", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaVectorIndex::Search>(
+           "search", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaVectorIndex::Save>(
+           "save", static_cast<napi_property_attributes>(napi_enumerable)),
+       InstanceMethod<&LlamaVectorIndex::Load>(
+           "load", static_cast<napi_property_attributes>(napi_enumerable))});
+#if NAPI_VERSION > 5
+  env.GetInstanceData<AddonData>()->vector_index = Napi::Persistent(func);
+#endif
+  exports.Set("LlamaVectorIndex", func);
+}
+
+std::shared_ptr<VectorStore>
+LlamaVectorIndex::FromValue(const Napi::Value &value) {
+#if NAPI_VERSION > 5
+  if (!value.IsObject()) {
+    return nullptr;
+  }
+  auto *data = value.Env().GetInstanceData<AddonData>();
+  if (data == nullptr || data->vector_index.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(data->vector_index.Value())) {
+    return nullptr;
+  }
+  return Unwrap(value.As<Napi::Object>())->_store;
+#else
+  return nullptr;
+#endif
+}
+
+// constructor({ dim?: number, quant?: 'f32' | 'int8' | 'binary', metric?: 'cosine' | 'dot' })
+LlamaVectorIndex::LlamaVectorIndex(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<LlamaVectorIndex>(info) {
+  Napi::Env env = info.Env();
+  auto options = info.Length() >= 1 && info[0].IsObject()
+                     ? info[0].As<Napi::Object>()
+                     : Napi::Object::New(env);
+  const int32_t dim = get_option<int32_t>(options, "dim", 0);
+  EmbeddingQuant quant;
+  if (!ParseQuant(get_option<std::string>(options, "quant", "f32"), quant)) {
+    Napi::TypeError::New(env, "quant must be one of 'f32', 'int8', 'binary'")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+  const auto metric_name = get_option<std::string>(options, "metric", "cosine");
+  if (metric_name != "cosine" && metric_name != "dot") {
+    Napi::TypeError::New(env, "metric must be 'cosine' or 'dot'")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+  _store = std::make_shared<VectorStore>(
+      static_cast<size_t>(std::max<int32_t>(dim, 0)), quant,
+      metric_name == "dot" ? VectorMetric::DOT : VectorMetric::COSINE);
+}
+
+// info(): { dim, quant, metric, size, bytes }
+Napi::Value LlamaVectorIndex::Info(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  auto result = Napi::Object::New(env);
+  result.Set("dim", Napi::Number::New(env, _store->Dim()));
+  result.Set("quant", QuantName(_store->Quant()));
+  result.Set("metric",
+             _store->Metric() == VectorMetric::DOT ? "dot" : "cosine");
+  result.Set("size", Napi::Number::New(env, _store->Size()));
+  result.Set("bytes", Napi::Number::New(env, _store->Bytes()));
+  return result;
+}
+
+// add(ids: number[], vectors: Float32Array | Int8Array | Uint8Array): void
+// Float32Array holds ids.length vectors; Int8Array / Uint8Array rows must
+// already be in the index encoding (embd_quant 'int8' / 'binary').
+Napi::Value LlamaVectorIndex::Add(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  std::vector<int64_t> ids;
+  if (info.Length() < 2 || !ReadIds(info[0], ids) ||
+      !info[1].IsTypedArray()) {
+    Napi::TypeError::New(env, "Ids array and vectors typed array expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (ids.empty()) {
+    return env.Undefined();
+  }
+  auto array = info[1].As<Napi::TypedArray>();
+  try {
+    if (array.TypedArrayType() == napi_float32_array) {
+      auto vectors = array.As<Napi::Float32Array>();
+      if (vectors.ElementLength() % ids.size() != 0) {
+        throw std::runtime_error("Vector count does not match ids");
+      }
+      const size_t dim = vectors.ElementLength() / ids.size();
+      _store->AddFloat(ids.data(), vectors.Data(), ids.size(), dim, dim);
+      return env.Undefined();
+    }
+    const bool matches =
+        (array.TypedArrayType() == napi_int8_array &&
+         _store->Quant() == EmbeddingQuant::INT8) ||
+        (array.TypedArrayType() == napi_uint8_array &&
+         _store->Quant() == EmbeddingQuant::BINARY);
+    if (!matches) {
+      throw std::runtime_error("Vectors must be a Float32Array or match the "
+                               "index quant");
+    }
+    if (array.ByteLength() != ids.size() * _store->RowBytes()) {
+      throw std::runtime_error("Vector count does not match ids");
+    }
+    const auto *data = static_cast<const uint8_t *>(array.ArrayBuffer().Data()) +
+                       array.ByteOffset();
+    _store->AddEncoded(ids.data(), data, ids.size());
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
+// remove(ids: number[]): number
+Napi::Value LlamaVectorIndex::Remove(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  std::vector<int64_t> ids;
+  if (info.Length() < 1 || !ReadIds(info[0], ids)) {
+    Napi::TypeError::New(env, "Ids array expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return Napi::Number::New(env, _store->Remove(ids.data(), ids.size()));
+}
+
+// clear(): void
+void LlamaVectorIndex::Clear(const Napi::CallbackInfo &info) {
+  _store->Clear();
+}
+
+// search(query: Float32Array | Int8Array | Uint8Array, k: number):
+//   Promise<{ ids: Float64Array, scores: Float32Array }>
+Napi::Value LlamaVectorIndex::Search(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 2 || !info[0].IsTypedArray() || !info[1].IsNumber()) {
+    Napi::TypeError::New(env, "Query typed array and k expected")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto array = info[0].As<Napi::TypedArray>();
+  const int32_t k = info[1].ToNumber().Int32Value();
+  std::vector<float> query_f32;
+  std::vector<uint8_t> query_encoded;
+  if (array.TypedArrayType() == napi_float32_array) {
+    auto query = array.As<Napi::Float32Array>();
+    query_f32.assign(query.Data(), query.Data() + query.ElementLength());
+  } else {
+    const bool matches = (array.TypedArrayType() == napi_int8_array &&
+                          _store->Quant() == EmbeddingQuant::INT8) ||
+                         (array.TypedArrayType() == napi_uint8_array &&
+                          _store->Quant() == EmbeddingQuant::BINARY);
+    if (!matches || array.ByteLength() == 0) {
+      Napi::TypeError::New(env, "Query must be a Float32Array or one row in "
+                                "the index quant")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    const auto *data = static_cast<const uint8_t *>(array.ArrayBuffer().Data()) +
+                       array.ByteOffset();
+    query_encoded.assign(data, data + array.ByteLength());
+  }
+  auto *worker = new VectorSearchWorker(
+      env, _store, std::move(query_f32), std::move(query_encoded),
+      static_cast<size_t>(std::max<int32_t>(k, 0)));
+  worker->Queue();
+  return worker->Promise();
+}
+
+// save(path: string): Promise<number>
+Napi::Value LlamaVectorIndex::Save(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Path expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto *worker = new VectorIndexFileWorker(
+      env, _store, info[0].ToString().Utf8Value(), true);
+  worker->Queue();
+  return worker->Promise();
+}
+
+// load(path: string): Promise<number>
+Napi::Value LlamaVectorIndex::Load(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Path expected").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  auto *worker = new VectorIndexFileWorker(
+      env, _store, info[0].ToString().Utf8Value(), false);
+  worker->Queue();
+  return worker->Promise();
+}
+
+VectorSearchWorker::VectorSearchWorker(Napi::Env env,
+                                       std::shared_ptr<VectorStore> store,
+                                       std::vector<float> query_f32,
+                                       std::vector<uint8_t> query_encoded,
+                                       size_t k)
+    : AsyncWorker(env), Deferred(env), _store(std::move(store)),
+      _query_f32(std::move(query_f32)),
+      _query_encoded(std::move(query_encoded)), _k(k) {}
+
+void VectorSearchWorker::Execute() {
+  try {
+    _store->Search(_query_f32, _query_encoded, _k, _ids, _scores);
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void VectorSearchWorker::OnOK() {
+  Napi::Env env = Napi::AsyncWorker::Env();
+  auto ids = Napi::Float64Array::New(env, _ids.size());
+  auto scores = Napi::Float32Array::New(env, _scores.size());
+  for (size_t i = 0; i < _ids.size(); i++) {
+    ids[i] = static_cast<double>(_ids[i]);
+    scores[i] = _scores[i];
+  }
+  auto result = Napi::Object::New(env);
+  result.Set("ids", ids);
+  result.Set("scores", scores);
+  Napi::Promise::Deferred::Resolve(result);
+}
+
+void VectorSearchWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
+
+VectorIndexFileWorker::VectorIndexFileWorker(Napi::Env env,
+                                             std::shared_ptr<VectorStore> store,
+                                             std::string path, bool save)
+    : AsyncWorker(env), Deferred(env), _store(std::move(store)),
+      _path(std::move(path)), _save(save) {}
+
+void VectorIndexFileWorker::Execute() {
+  try {
+    _count = _save ? _store->Save(_path) : _store->Load(_path);
+  } catch (const std::exception &e) {
+    SetError(e.what());
+  }
+}
+
+void VectorIndexFileWorker::OnOK() {
+  Napi::Promise::Deferred::Resolve(
+      Napi::Number::New(Napi::AsyncWorker::Env(), _count));
+}
+
+void VectorIndexFileWorker::OnError(const Napi::Error &err) {
+  Napi::Promise::Deferred::Reject(err.Value());
+}
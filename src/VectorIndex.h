@@ -0,0 +1,142 @@
+#pragma once
+
+#include "EmbeddingFormat.h"
+#include "MappedFile.h"
+#include "common.hpp"
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class VectorMetric { COSINE, DOT };
+
+// Vectorizable f32 dot product shared by the index and MaxSim scoring
+float DotF32(const float *a, const float *b, size_t n);
+
+// Flat (exact) in-memory vector index. Rows are stored contiguously in the
+// index encoding (f32, int8 or binary) and scanned with SIMD-friendly
+// kernels. Scores are higher-is-better: dot product (cosine on normalized
+// rows) for f32 and int8 scaled back to [-1, 1], and 1 - 2 * hamming / dim
+// for binary. Readers share a lock; adds, removes and loads are exclusive.
+// A loaded index searches the rows of the mapped file in place until the
+// first add or remove copies them into memory.
+class VectorStore {
+public:
+  // `dim` 0 takes the dimension from the first added vectors.
+  VectorStore(size_t dim, EmbeddingQuant quant, VectorMetric metric);
+
+  size_t Dim();
+  EmbeddingQuant Quant();
+  VectorMetric Metric();
+  size_t Size();
+  size_t Bytes();
+
+  // Adds `n` f32 vectors of `dim` components spaced `stride` floats apart,
+  // replacing rows with the same id. Normalized first for cosine.
+  void AddFloat(const int64_t *ids, const float *vectors, size_t n,
+                size_t dim, size_t stride);
+  // Adds `n` rows already in the index encoding (RowBytes each).
+  void AddEncoded(const int64_t *ids, const uint8_t *rows, size_t n);
+  // Returns the number of ids that were present.
+  size_t Remove(const int64_t *ids, size_t n);
+  void Clear();
+
+  // Best `k` rows for an f32 query, or for a query already in the index
+  // encoding when `query_f32` is empty. Results are sorted by score; throws
+  // if the query does not match the index dimension.
+  void Search(const std::vector<float> &query_f32,
+              const std::vector<uint8_t> &query_encoded, size_t k,
+              std::vector<int64_t> &ids, std::vector<float> &scores);
+
+  // The file is a 64-byte header followed by the ids and the rows, each
+  // 64-byte aligned, so it can be mapped directly. Throws on I/O errors.
+  size_t Save(const std::string &path);
+  // Replaces the contents, dimension and encoding with those in `path`,
+  // mapping its rows rather than reading them.
+  size_t Load(const std::string &path);
+
+  // Bytes per stored row for the current dimension
+  size_t RowBytes();
+
+private:
+  EmbeddingFormat FormatLocked() const;
+  void EncodeLocked(const float *vector, size_t dim, uint8_t *out) const;
+  void CheckDimLocked(size_t dim);
+  void PutRowLocked(int64_t id, const uint8_t *row);
+  const uint8_t *RowsLocked() const;
+  // Copies mapped rows into _rows before they are modified
+  void UnmapLocked();
+
+  std::shared_mutex _mutex;
+  size_t _dim;
+  EmbeddingQuant _quant;
+  VectorMetric _metric;
+  size_t _row_bytes = 0;
+  std::vector<int64_t> _ids;
+  std::vector<uint8_t> _rows;
+  MappedFile _file;                 // backs the rows after Load
+  const uint8_t *_mapped = nullptr; // rows in _file, or null for _rows
+  std::unordered_map<int64_t, size_t> _index; // id -> row
+};
+
+// JS handle for a VectorStore.
+// new LlamaVectorIndex({ dim?, quant?: 'f32' | 'int8' | 'binary', metric?: 'cosine' | 'dot' })
+class LlamaVectorIndex : public Napi::ObjectWrap<LlamaVectorIndex> {
+public:
+  LlamaVectorIndex(const Napi::CallbackInfo &info);
+  static void Init(Napi::Env env, Napi::Object &exports);
+  // Returns the store behind `value` if it is a LlamaVectorIndex, else null.
+  static std::shared_ptr<VectorStore> FromValue(const Napi::Value &value);
+
+private:
+  Napi::Value Info(const Napi::CallbackInfo &info);
+  Napi::Value Add(const Napi::CallbackInfo &info);
+  Napi::Value Remove(const Napi::CallbackInfo &info);
+  void Clear(const Napi::CallbackInfo &info);
+  Napi::Value Search(const Napi::CallbackInfo &info);
+  Napi::Value Save(const Napi::CallbackInfo &info);
+  Napi::Value Load(const Napi::CallbackInfo &info);
+
+  std::shared_ptr<VectorStore> _store;
+};
+
+class VectorSearchWorker : public Napi::AsyncWorker,
+                           public Napi::Promise::Deferred {
+public:
+  VectorSearchWorker(Napi::Env env, std::shared_ptr<VectorStore> store,
+                     std::vector<float> query_f32,
+                     std::vector<uint8_t> query_encoded, size_t k);
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  std::shared_ptr<VectorStore> _store;
+  std::vector<float> _query_f32;
+  std::vector<uint8_t> _query_encoded;
+  size_t _k;
+  std::vector<int64_t> _ids;
+  std::vector<float> _scores;
+};
+
+// Saves (`save` true) or loads the store at `path`, resolving the row count.
+class VectorIndexFileWorker : public Napi::AsyncWorker,
+                              public Napi::Promise::Deferred {
+public:
+  VectorIndexFileWorker(Napi::Env env, std::shared_ptr<VectorStore> store,
+                        std::string path, bool save);
+
+protected:
+  void Execute();
+  void OnOK();
+  void OnError(const Napi::Error &err);
+
+private:
+  std::shared_ptr<VectorStore> _store;
+  std::string _path;
+  bool _save;
+  size_t _count = 0;
+};
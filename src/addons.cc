@@ -1,4 +1,7 @@
 #include "LlamaContext.h"
+#include "TokenStream.h"
+#include "Tokenizer.h"
+#include "VectorIndex.h"
 #include <napi.h>
 
 // Forward declaration of our cleanup function
@@ -13,7 +16,13 @@ static Napi::Value register_cleanup(const Napi::CallbackInfo &info) {
 }
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+#if NAPI_VERSION > 5
+  env.SetInstanceData(new AddonData());
+#endif
   LlamaContext::Init(env, exports);
+  LlamaTokenStream::Init(env, exports);
+  LlamaVectorIndex::Init(env, exports);
+  LlamaTokenizer::Init(env, exports);
 
   // Register our cleanup handler for module unload
   exports.Set("__registerCleanup", Napi::Function::New(env, register_cleanup));
@@ -15,6 +15,14 @@ namespace rnllama {
 ggml_type kv_cache_type_from_str(const std::string &s);
 }
 
+// Per-environment addon state, registered via env.SetInstanceData in Init.
+struct AddonData {
+  Napi::FunctionReference llama_context;
+  Napi::FunctionReference token_stream;
+  Napi::FunctionReference vector_index;
+  Napi::FunctionReference tokenizer;
+};
+
 typedef std::unique_ptr<common_sampler, decltype(&common_sampler_free)>
     LlamaCppSampling;
 typedef std::unique_ptr<llama_batch, decltype(&llama_batch_free)> LlamaCppBatch;
@@ -335,3 +343,45 @@ static void apply_reasoning_budget(
   }
   sampling.reasoning_budget_activate_immediately = thinking_forced_open;
 }
+
+// Sampling options shared by completion, parallel completion and fork
+static void apply_sampling_options(const Napi::Object &options,
+                                   common_params &params) {
+  params.n_predict = get_option<int32_t>(options, "n_predict", -1);
+  params.sampling.temp = get_option<float>(options, "temperature", 0.80f);
+  params.sampling.top_k = get_option<int32_t>(options, "top_k", 40);
+  params.sampling.top_p = get_option<float>(options, "top_p", 0.95f);
+  params.sampling.min_p = get_option<float>(options, "min_p", 0.05f);
+  params.sampling.mirostat = get_option<int32_t>(options, "mirostat", 0.00f);
+  params.sampling.mirostat_tau =
+      get_option<float>(options, "mirostat_tau", 5.00f);
+  params.sampling.mirostat_eta =
+      get_option<float>(options, "mirostat_eta", 0.10f);
+  params.sampling.penalty_last_n =
+      get_option<int32_t>(options, "penalty_last_n", 64);
+  params.sampling.penalty_repeat =
+      get_option<float>(options, "penalty_repeat", 1.00f);
+  params.sampling.penalty_freq =
+      get_option<float>(options, "penalty_freq", 0.00f);
+  params.sampling.penalty_present =
+      get_option<float>(options, "penalty_present", 0.00f);
+  params.sampling.typ_p = get_option<float>(options, "typical_p", 1.00f);
+  params.sampling.xtc_threshold =
+      get_option<float>(options, "xtc_threshold", 0.00f);
+  params.sampling.xtc_probability =
+      get_option<float>(options, "xtc_probability", 0.10f);
+  params.sampling.dry_multiplier =
+      get_option<float>(options, "dry_multiplier", 1.75f);
+  params.sampling.dry_base = get_option<float>(options, "dry_base", 2);
+  params.sampling.dry_allowed_length =
+      get_option<float>(options, "dry_allowed_length", -1);
+  params.sampling.dry_penalty_last_n =
+      get_option<float>(options, "dry_penalty_last_n", 0);
+  params.sampling.top_n_sigma =
+      get_option<float>(options, "top_n_sigma", -1.0f);
+  params.sampling.ignore_eos = get_option<bool>(options, "ignore_eos", false);
+  params.n_keep = get_option<int32_t>(options, "n_keep", 0);
+  params.sampling.seed =
+      get_option<int32_t>(options, "seed", LLAMA_DEFAULT_SEED);
+  params.sampling.n_probs = get_option<int32_t>(options, "n_probs", 0);
+}
@@ -1,4 +1,5 @@
 import path from 'path'
+import fs from 'fs'
 import waitForExpect from 'wait-for-expect'
 import {
   loadModel,
@@ -6,6 +7,9 @@ import {
   toggleNativeLog,
   addNativeLogListener,
   getBackendDevicesInfo,
+  createVectorIndex,
+  loadVectorIndex,
+  loadTokenizer,
   type JinjaFormattedChatResult,
 } from '../lib'
 
@@ -46,6 +50,425 @@ test('basic completion', async () => {
   await model.release()
 })
 
+test('session state buffers', async () => {
+  const options = {
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+  }
+  const params = {
+    prompt: 'My name is Merve and my favorite',
+    temperature: 0,
+    n_predict: 10,
+    seed: 0,
+  }
+  const source = await loadModel(options)
+  await source.completion(params)
+  const state = await source.getSessionState()
+  expect(state).toBeInstanceOf(Buffer)
+  expect(state.subarray(0, 4).toString()).toBe('LNSS')
+
+  const target = await loadModel(options)
+  const count = await target.setSessionState(state)
+  expect(count).toBeGreaterThan(0)
+  const continued = { ...params, prompt: `${params.prompt} color is` }
+  const restored = await target.completion(continued)
+  const original = await source.completion(continued)
+  expect(restored.text).toBe(original.text)
+  // The restored prefix is not evaluated again
+  expect(restored.timings.prompt_n).toBeLessThan(count)
+
+  await expect(target.setSessionState(Buffer.from('garbage!'))).rejects.toThrow(
+    'Not a session state',
+  )
+  await source.release()
+  await target.release()
+})
+
+test('compressed session files', async () => {
+  const options = {
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+    n_ctx: 1024,
+  }
+  // Repeated text repeats its layer-0 V rows, which lz4 can match
+  const params = {
+    prompt: 'My name is Merve and my favorite '.repeat(12).trim(),
+    temperature: 0,
+    n_predict: 10,
+    seed: 0,
+  }
+  const raw = path.resolve(__dirname, './tmp.raw.sess')
+  const file = path.resolve(__dirname, './tmp.lz4.sess')
+  const source = await loadModel(options)
+  await source.completion(params)
+  await source.saveSession(raw)
+  await source.saveSession(file, { compression: 'lz4' })
+  expect(fs.readFileSync(file).subarray(0, 4).toString()).toBe('LNSZ')
+  expect(fs.statSync(file).size).toBeLessThan(fs.statSync(raw).size)
+
+  const target = await loadModel(options)
+  await target.loadSession(file)
+  const continued = { ...params, prompt: `${params.prompt} color is` }
+  const restored = await target.completion(continued)
+  const original = await source.completion(continued)
+  expect(restored.text).toBe(original.text)
+  // Only the appended words are evaluated; the prompt comes from the file
+  const appended =
+    (await target.tokenize(continued.prompt)).tokens.length -
+    (await target.tokenize(params.prompt)).tokens.length
+  expect(restored.timings.prompt_n).toBeLessThanOrEqual(appended + 1)
+
+  expect(() =>
+    source.saveSession(file, { compression: 'brotli' as any }),
+  ).toThrow("compression must be 'none', 'lz4' or 'zstd'")
+  await source.release()
+  await target.release()
+})
+
+test('delta session files', async () => {
+  // Without flash attention the V cache is transposed and every save would
+  // rewrite the whole state
+  const options = {
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+    n_ctx: 8192,
+    flash_attn_type: 'on' as const,
+  }
+  const file = path.resolve(__dirname, './tmp.delta.sess')
+  fs.rmSync(file, { force: true })
+  const source = await loadModel(options)
+  const params = { temperature: 0, n_predict: 8, seed: 0 }
+  const saveOptions = { delta: true, compact_ratio: 100 }
+  let prompt = 'My name is Merve and my favorite '.repeat(40).trim()
+  let lastPrompt = prompt
+  const turn = async (extra: string) => {
+    lastPrompt = prompt
+    const result = await source.completion({ prompt, ...params })
+    prompt += `${result.text}${extra}`
+    return source.saveSession(file, saveOptions)
+  }
+
+  const first = await turn(' and then')
+  expect(first.compacted).toBe(true)
+  expect(fs.readFileSync(file).subarray(0, 4).toString()).toBe('LNSD')
+
+  // Saving the same state again only appends the chunk list
+  const again = await source.saveSession(file, saveOptions)
+  expect(again.compacted).toBe(false)
+  expect(again.bytes_written).toBeLessThan(4096)
+  expect(again.file_size).toBe(first.file_size + again.bytes_written)
+
+  // Appends grow with the new tokens, not with the whole state
+  const large = await turn(` and then ${'we talked about colors. '.repeat(200)}`)
+  const small = await turn(' and then')
+  expect(large.compacted).toBe(false)
+  expect(small.compacted).toBe(false)
+  expect(small.bytes_written).toBeLessThan(large.bytes_written)
+  expect(fs.statSync(file).size).toBe(small.file_size)
+
+  const target = await loadModel(options)
+  await target.loadSession(file)
+  const next = { prompt, ...params }
+  const restored = await target.completion(next)
+  const original = await source.completion(next)
+  expect(restored.text).toBe(original.text)
+  // The saved prompt and its completion come from the file
+  const appended =
+    (await target.tokenize(prompt)).tokens.length -
+    (await target.tokenize(lastPrompt)).tokens.length
+  expect(restored.timings.prompt_n).toBeLessThanOrEqual(appended + 1)
+
+  // A torn append falls back to the previous save
+  fs.appendFileSync(file, Buffer.alloc(100, 1))
+  await target.loadSession(file)
+  await source.release()
+  await target.release()
+})
+
+test('snapshot session save', async () => {
+  const options = {
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+  }
+  const file = path.resolve(__dirname, './tmp.snapshot.sess')
+  const source = await loadModel(options)
+  const params = { temperature: 0, n_predict: 8, seed: 0 }
+  const prompt = 'My name is Merve and my favorite'
+  const first = await source.completion({ prompt, ...params })
+  const continued = `${prompt}${first.text} and`
+
+  // The next completion is started before the save resolves
+  const saved = source.saveSession(file, { snapshot: true })
+  const next = source.completion({ prompt: `${continued} then`, ...params })
+  await Promise.all([saved, next])
+
+  const target = await loadModel(options)
+  await target.loadSession(file)
+  const restored = await target.completion({ prompt: continued, ...params })
+  const reference = await loadModel(options)
+  await reference.completion({ prompt, ...params })
+  const expected = await reference.completion({ prompt: continued, ...params })
+  expect(restored.text).toBe(expected.text)
+  // Only the words after the snapshot's completion are evaluated
+  const appended =
+    (await target.tokenize(continued)).tokens.length -
+    (await target.tokenize(prompt)).tokens.length
+  expect(restored.timings.prompt_n).toBeLessThanOrEqual(appended + 1)
+  await source.release()
+  await target.release()
+  await reference.release()
+})
+
+test('prefix cache directory', async () => {
+  const dir = path.resolve(__dirname, './tmp.prefix-cache')
+  fs.rmSync(dir, { recursive: true, force: true })
+  const model = path.resolve(__dirname, './tiny-random-llama.gguf')
+  const options = { model, prefix_cache_dir: dir, prefix_cache_block_size: 8 }
+  const system =
+    'You are a helpful assistant. Answer every question briefly and politely. '
+  const params = (question: string) => ({
+    prompt: `${system}${question}`,
+    temperature: 0,
+    n_predict: 8,
+    seed: 0,
+  })
+
+  // The second prompt finds the system prompt shared and stores it
+  const writer = await loadModel(options)
+  await writer.completion(params('What is the capital of France?'))
+  await writer.completion(params('Name a color.'))
+  await writer.release()
+
+  const reader = await loadModel(options)
+  const reference = await loadModel({ model })
+  const question = params('How many legs does a cat have?')
+  const cached = await reader.completion(question)
+  const plain = await reference.completion(question)
+  expect(cached.text).toBe(plain.text)
+  expect(cached.timings.prompt_n).toBeLessThan(plain.timings.prompt_n)
+  // The restored prefix and the evaluated rest stay in the context
+  const repeated = await reader.completion(question)
+  expect(repeated.text).toBe(plain.text)
+  expect(repeated.timings.prompt_n).toBeLessThanOrEqual(1)
+  await reader.release()
+  await reference.release()
+  fs.rmSync(dir, { recursive: true, force: true })
+})
+
+test('state cache directory is unused by attention models', async () => {
+  const dir = path.resolve(__dirname, './tmp.state-cache')
+  fs.rmSync(dir, { recursive: true, force: true })
+  const model = await loadModel({
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+    state_cache_dir: dir,
+    state_cache_interval: 8,
+    state_cache_disk_budget_mb: 16,
+  })
+  await model.completion({
+    prompt: 'You are a helpful assistant. Answer every question briefly.',
+    temperature: 0,
+    n_predict: 4,
+    seed: 0,
+  })
+  const stats = model.getStateCacheStats()
+  expect(stats.budget).toBe(16 * 1024 * 1024)
+  expect(stats.stores).toBe(0)
+  expect(stats.entries).toBe(0)
+  expect(fs.existsSync(dir)).toBe(false)
+  await model.release()
+})
+
+test('state cache directory restores spilled checkpoints', async () => {
+  const dir = path.resolve(__dirname, './tmp.state-cache-force')
+  fs.rmSync(dir, { recursive: true, force: true })
+  const model = path.resolve(__dirname, './tiny-random-llama.gguf')
+  // The tiny fixture is an attention model, so force the disk tier on
+  process.env.LLAMA_NODE_STATE_CACHE_FORCE = '1'
+  const options = {
+    model,
+    state_cache_dir: dir,
+    state_cache_interval: 8,
+    state_cache_disk_budget_mb: 16,
+  }
+  const params = {
+    prompt:
+      'You are a helpful assistant. Answer every question briefly. What is the capital of France?',
+    temperature: 0,
+    n_predict: 8,
+    seed: 0,
+  }
+  const writer = await loadModel(options)
+  await writer.completion(params)
+  // Releasing flushes the checkpoints and drops them from memory
+  await writer.release()
+  const files = fs
+    .readdirSync(dir)
+    .flatMap((sub) => fs.readdirSync(path.join(dir, sub)))
+    .filter((name) => name.endsWith('.ckpt'))
+  expect(files.length).toBeGreaterThan(0)
+
+  const reader = await loadModel(options)
+  const reference = await loadModel({ model })
+  const restored = await reader.completion(params)
+  const plain = await reference.completion(params)
+  expect(restored.text).toBe(plain.text)
+  const stats = reader.getStateCacheStats()
+  expect(stats.hits).toBe(1)
+  expect(stats.entries).toBe(files.length)
+  // Only the tokens after the deepest checkpoint are evaluated
+  expect(restored.timings.prompt_n).toBeLessThanOrEqual(8)
+  expect(restored.timings.prompt_n).toBeLessThan(plain.timings.prompt_n)
+  await reader.release()
+  await reference.release()
+  delete process.env.LLAMA_NODE_STATE_CACHE_FORCE
+  fs.rmSync(dir, { recursive: true, force: true })
+})
+
+test('hibernate and wake', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+  })
+  const params = {
+    prompt: 'My name is Merve and my favorite',
+    temperature: 0,
+    n_predict: 8,
+    seed: 0,
+  }
+  const first = await model.completion(params)
+  expect(first.timings.wake_ms).toBeUndefined()
+  const info = model.getModelInfo()
+  expect(await model.hibernate()).toBe(0)
+  expect(await model.hibernate()).toBe(0)
+
+  // The model stays loaded; the rest wait for the wake
+  expect(model.getModelInfo()).toEqual(info)
+  expect(model.getLoadedLoraAdapters()).toEqual([])
+  expect(model.getFormattedChat([{ role: 'user', content: 'Hi' }])).toBeTruthy()
+  const second = await model.completion(params)
+  expect(second.text).toBe(first.text)
+  expect(second.timings.wake_ms).toBeGreaterThan(0)
+  // The restored KV cache covers the prompt
+  expect(second.timings.prompt_n).toBeLessThanOrEqual(1)
+
+  expect(await model.hibernate()).toBe(0)
+  expect(await model.wake()).toBeGreaterThan(0)
+  expect(await model.wake()).toBe(0)
+  expect(model.getFormattedChat([{ role: 'user', content: 'Hi' }])).toBeTruthy()
+  const third = await model.completion(params)
+  expect(third.timings.wake_ms).toBeUndefined()
+  expect(third.timings.prompt_n).toBeLessThanOrEqual(1)
+  await model.release()
+})
+
+const loraPath = path.resolve(__dirname, './tiny-random-llama-lora.gguf')
+
+;(fs.existsSync(loraPath) ? test : test.skip)(
+  'wake applies lora adapters again',
+  async () => {
+    const model = await loadModel({
+      model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+    })
+    const adapters = [{ path: loraPath, scaled: 1 }]
+    model.applyLoraAdapters(adapters)
+    const params = {
+      prompt: 'My name is Merve and my favorite',
+      temperature: 0,
+      n_predict: 8,
+      seed: 0,
+    }
+    const first = await model.completion(params)
+    expect(await model.hibernate()).toBe(0)
+    expect(model.getLoadedLoraAdapters()).toEqual(adapters)
+    const second = await model.completion(params)
+    expect(second.timings.wake_ms).toBeGreaterThan(0)
+    expect(second.text).toBe(first.text)
+    expect(model.getLoadedLoraAdapters()).toEqual(adapters)
+    await model.release()
+  },
+)
+
+test('fork', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+    n_parallel: 4,
+    kv_unified: true,
+  })
+  const prompt = 'My name is Merve and my favorite'
+  const greedy = await model.completion({
+    prompt,
+    temperature: 0,
+    n_predict: 8,
+    ignore_eos: true,
+  })
+  const same = await model.fork(2, {
+    prompt,
+    temperature: 0,
+    n_predict: 8,
+    ignore_eos: true,
+  })
+  expect(same.branches.map((b) => b.text)).toEqual([greedy.text, greedy.text])
+  expect(same.timings.predicted_n).toBe(16)
+
+  // The fork leaves the prompt in the KV cache for the next completion
+  const after = await model.completion({
+    prompt,
+    temperature: 0,
+    n_predict: 8,
+    ignore_eos: true,
+  })
+  expect(after.text).toBe(greedy.text)
+  expect(after.timings.prompt_n).toBeLessThanOrEqual(1)
+
+  const pruned = await model.fork(3, {
+    prompt,
+    temperature: 0.8,
+    n_predict: 8,
+    ignore_eos: true,
+    seed: 0,
+    keep_branches: 1,
+    prune_interval: 2,
+  })
+  expect(pruned.branches.filter((b) => b.pruned)).toHaveLength(2)
+  const [kept] = pruned.branches.filter((b) => !b.pruned)
+  expect(kept.tokens).toHaveLength(8)
+  expect(kept.stopped_limit).toBe(true)
+  expect(() => model.fork(5, { prompt })).toThrow(/n_parallel/)
+  await model.release()
+})
+
+test('completion stream', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+  })
+  const { stream, result } = model.completionStream(
+    {
+      prompt: 'My name is Merve and my favorite',
+      temperature: 0,
+      n_predict: 10,
+      seed: 0,
+    },
+    { capacity: 1 },
+  )
+  let tokens = ''
+  for await (const data of stream) {
+    // Simulate a slow consumer; generation waits on the full buffer
+    await new Promise((resolve) => setTimeout(resolve, 5))
+    tokens += data.token
+  }
+  expect(tokens).toBe((await result).text)
+
+  // Leaving the loop early stops the completion
+  const early = model.completionStream(
+    {
+      prompt: 'My name is Merve and my favorite',
+      temperature: 0,
+      n_predict: 100,
+      seed: 0,
+    },
+    { capacity: 1 },
+  )
+  for await (const _ of early.stream) break
+  const stopped = await early.result
+  expect(stopped.interrupted).toBe(true)
+  await model.release()
+})
+
 test('completion with t5-like model', async () => {
   const model = await loadModel({
     model: path.resolve(__dirname, './flan-t5-small.Q4_0.gguf'),
@@ -206,6 +629,106 @@ test('works fine with vocab_only', async () => {
   ).toMatchSnapshot('empty result')
 })
 
+test('tokenizeBatch & countTokens', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './tiny-random-llama.gguf'),
+    vocab_only: true,
+  })
+  const texts = [
+    'Once upon a time',
+    '',
+    'The quick brown fox jumps over the lazy dog',
+    'Hello, world!\n'.repeat(50),
+  ]
+  const { tokens, offsets } = await model.tokenizeBatch(texts)
+  expect(offsets.length).toBe(texts.length + 1)
+  expect(offsets[texts.length]).toBe(tokens.length)
+  for (let i = 0; i < texts.length; i++) {
+    const single = await model.tokenize(texts[i])
+    expect(Array.from(tokens.subarray(offsets[i], offsets[i + 1]))).toEqual(
+      Array.from(single.tokens),
+    )
+  }
+
+  const counts = await model.countTokens(texts)
+  expect(Array.from(counts)).toEqual(
+    texts.map((_, i) => offsets[i + 1] - offsets[i]),
+  )
+
+  // BOS is added on request
+  const withSpecial = await model.tokenizeBatch(texts.slice(0, 1), {
+    add_special: true,
+  })
+  expect(withSpecial.tokens[0]).toBe(128000)
+  expect(withSpecial.tokens.length).toBe(offsets[1] + 1)
+  await model.release()
+})
+
+test('parallel tokenization of long inputs matches a single pass', async () => {
+  const paragraph = [
+    'Once upon a time, in a land far away, there were 123 tokens.',
+    '  Indented line\twith tabs and numbers 4567890!',
+    '',
+    'Unicode: caf\u00e9, \u65e5\u672c\u8a9e, emoji \u{1F600}.',
+    '\r\nWindows newline; symbols: <|im_start|> {}[]()',
+    '\n\n\n   spaces after newlines',
+  ].join('\n')
+  const text = `${paragraph}\n`.repeat(2000)
+  const models = [
+    'tiny-random-llama.gguf',
+    'bge-small-en.gguf',
+    'Qwen3-0.6B-Q6_K.gguf',
+    'flan-t5-small.Q4_0.gguf',
+    'SmolVLM-256M-Instruct-Q8_0.gguf',
+  ]
+  for (const name of models) {
+    const load = (n_threads: number) =>
+      loadModel({
+        model: path.resolve(__dirname, name),
+        vocab_only: true,
+        n_threads,
+      })
+    const single = await load(1)
+    const parallel = await load(4)
+    const expected = await single.tokenize(text)
+    const actual = await parallel.tokenize(text)
+    expect(Array.from(actual.tokens)).toEqual(Array.from(expected.tokens))
+
+    const [count] = await parallel.countTokens([text], { add_special: true })
+    const withSpecial = await single.tokenizeBatch([text], {
+      add_special: true,
+    })
+    expect(count).toBe(withSpecial.tokens.length)
+    await single.release()
+    await parallel.release()
+  }
+})
+
+test('loadTokenizer', async () => {
+  const modelPath = path.resolve(__dirname, './tiny-random-llama.gguf')
+  const tokenizer = await loadTokenizer(modelPath)
+  const model = await loadModel({ model: modelPath, vocab_only: true })
+  const text = 'Once upon a time'
+  const expected = await model.tokenize(text)
+  const tokens = tokenizer.tokenize(text)
+  expect(Array.from(tokens)).toEqual(Array.from(expected.tokens))
+  expect(tokenizer.countTokens(text)).toBe(tokens.length)
+  expect(tokenizer.countTokens(text, { add_special: true })).toBe(
+    tokens.length + 1,
+  )
+  expect(tokenizer.detokenize(tokens)).toBe(text)
+  expect(tokenizer.getInfo()).toMatchObject({ bos: 128000, add_bos: true })
+  expect(() => tokenizer.detokenize([-1])).toThrow('Invalid token -1')
+
+  // A second handle shares the loaded vocab
+  const again = await loadTokenizer(modelPath)
+  expect(Array.from(again.tokenize(text))).toEqual(Array.from(tokens))
+  await expect(loadTokenizer('/nonexistent.gguf')).rejects.toThrow(
+    'Failed to load tokenizer from /nonexistent.gguf',
+  )
+  await model.release()
+})
+
 test('tokeneize & detokenize & getFormattedChat', async () => {
   const model = await loadModel({
     model: path.resolve(__dirname, './tiny-random-llama.gguf'),
@@ -272,6 +795,303 @@ test('embedding', async () => {
   await model.release()
 })
 
+test('embedding truncation and quantization', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './bge-small-en.gguf'),
+    embedding: true,
+    n_gpu_layers: 0,
+  })
+  const text = 'Once upon a time'
+  const full = (await model.embedding(text)).embedding as Float32Array
+
+  // Matryoshka truncation keeps the prefix, renormalized
+  const short = (await model.embedding(text, { embd_dim: 128 }))
+    .embedding as Float32Array
+  expect(short).toBeInstanceOf(Float32Array)
+  expect(short.length).toBe(128)
+  expect(Math.hypot(...short)).toBeCloseTo(1, 4)
+  const scale = Math.hypot(...full.subarray(0, 128))
+  for (let i = 0; i < 128; i++) {
+    expect(short[i]).toBeCloseTo(full[i] / scale, 4)
+  }
+
+  const half = (await model.embedding(text, { embd_quant: 'f16' })).embedding
+  expect(half).toBeInstanceOf(Uint16Array)
+  expect(half.length).toBe(384)
+
+  const int8 = (await model.embedding(text, { embd_quant: 'int8' })).embedding
+  expect(int8).toBeInstanceOf(Int8Array)
+  expect(int8.length).toBe(384)
+  for (let i = 0; i < 384; i++) {
+    expect(Math.abs(int8[i] - full[i] * 127)).toBeLessThanOrEqual(0.5 + 1e-3)
+  }
+
+  const binary = (await model.embedding(text, { embd_quant: 'binary' }))
+    .embedding
+  expect(binary).toBeInstanceOf(Uint8Array)
+  expect(binary.length).toBe(48)
+  for (let i = 0; i < 384; i++) {
+    const bit = (binary[i >> 3] >> (7 - (i & 7))) & 1
+    expect(bit).toBe(full[i] > 0 ? 1 : 0)
+  }
+
+  const batch = await model.embeddingBatch([text, text], {
+    embd_dim: 64,
+    embd_quant: 'binary',
+  })
+  expect(batch.embeddings).toBeInstanceOf(Uint8Array)
+  expect(batch.n_embd).toBe(64)
+  expect(Array.from(batch.offsets)).toEqual([0, 8, 16])
+
+  expect(() =>
+    model.embedding(text, { embd_quant: 'int4' as any }),
+  ).toThrow("embd_quant must be one of 'f32', 'f16', 'int8', 'binary'")
+  // Un-normalized components would saturate at +-127
+  expect(() =>
+    model.embedding(text, { embd_quant: 'int8', embd_normalize: -1 }),
+  ).toThrow("embd_quant 'int8' needs embd_normalize >= 1")
+  await expect(model.embedding(text, { embd_dim: 1024 })).rejects.toThrow(
+    'embd_dim 1024 exceeds the embedding size 384',
+  )
+  await model.release()
+})
+
+test('embedding cache', async () => {
+  const cachePath = path.resolve(__dirname, './tmp.embd-cache')
+  fs.rmSync(cachePath, { force: true })
+  const options = {
+    model: path.resolve(__dirname, './bge-small-en.gguf'),
+    embedding: true,
+    n_gpu_layers: 0,
+    embedding_cache_size: 1024 * 1024,
+    embedding_cache_path: cachePath,
+  }
+  const model = await loadModel(options)
+  const first = await model.embedding('Once upon a time')
+  const second = await model.embedding('Once upon a time')
+  expect(Array.from(second.embedding)).toEqual(Array.from(first.embedding))
+  expect(model.getEmbeddingCacheStats()).toMatchObject({
+    hits: 1,
+    misses: 1,
+    entries: 1,
+    bytes: 384 * 4,
+  })
+
+  // A different normalization is a different entry
+  await model.embedding('Once upon a time', { embd_normalize: -1 })
+  expect(model.getEmbeddingCacheStats().entries).toBe(2)
+
+  expect(await model.saveEmbeddingCache()).toBe(2)
+  // Overlapping saves each write their own temporary file
+  expect(
+    await Promise.all([model.saveEmbeddingCache(), model.saveEmbeddingCache()]),
+  ).toEqual([2, 2])
+  expect(
+    fs
+      .readdirSync(__dirname)
+      .filter((file) => file.startsWith('tmp.embd-cache.')),
+  ).toEqual([])
+  await model.release()
+
+  // Restarts come up warm from the saved file
+  const restored = await loadModel(options)
+  expect(restored.getEmbeddingCacheStats().entries).toBe(2)
+  const third = await restored.embedding('Once upon a time')
+  expect(Array.from(third.embedding)).toEqual(Array.from(first.embedding))
+  expect(restored.getEmbeddingCacheStats().hits).toBe(1)
+
+  restored.clearEmbeddingCache()
+  expect(restored.getEmbeddingCacheStats()).toMatchObject({
+    entries: 0,
+    bytes: 0,
+  })
+  await restored.release()
+})
+
+test('embeddingBatch', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './bge-small-en.gguf'),
+    embedding: true,
+    n_gpu_layers: 0,
+    n_parallel: 4,
+  })
+  const texts = [
+    'Once upon a time',
+    'The quick brown fox jumps over the lazy dog',
+    'Hello',
+    'Batched embeddings pack several sequences into one decode',
+    'The end',
+  ]
+  const { embeddings, offsets, n_embd } = await model.embeddingBatch(texts, {
+    max_batch_tokens: 32,
+  })
+  expect(n_embd).toBe(384)
+  expect(embeddings.length).toBe(texts.length * n_embd)
+  expect(Array.from(offsets)).toEqual(
+    texts.map((_, i) => i * n_embd).concat(texts.length * n_embd),
+  )
+
+  // Matches embedding one text at a time
+  for (let i = 0; i < texts.length; i++) {
+    const { embedding } = await model.embedding(texts[i])
+    const batched = embeddings.subarray(offsets[i], offsets[i + 1])
+    for (let j = 0; j < n_embd; j++) {
+      expect(batched[j]).toBeCloseTo(embedding[j], 3)
+    }
+  }
+
+  // Packed decodes would clear the sequences of the parallel slots
+  await model.parallel.enable({ n_parallel: 2 })
+  await expect(model.embeddingBatch(texts)).rejects.toThrow(/parallel mode/)
+  model.parallel.disable()
+  await model.release()
+})
+
+test('embeddingChunks', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './bge-small-en.gguf'),
+    embedding: true,
+    n_gpu_layers: 0,
+    n_parallel: 4,
+  })
+  const text = 'The quick brown fox jumps over the lazy dog. '.repeat(8)
+  const { tokens } = await model.tokenize(text)
+  const chunked = await model.embeddingChunks(text, {
+    chunk_tokens: 24,
+    overlap_tokens: 8,
+  })
+  expect(chunked.n_embd).toBe(384)
+  // Windows advance by 16 tokens and the last one ends the document
+  const { chunks } = chunked
+  const nChunks = chunks.length / 2
+  expect(chunked.offsets.length).toBe(nChunks + 1)
+  expect(chunks[0]).toBe(0)
+  expect(chunks[1]).toBe(24)
+  expect(chunks[2]).toBe(16)
+  expect(chunks[chunks.length - 1]).toBe(chunked.n_tokens)
+  expect(chunked.n_tokens).toBeGreaterThan(24)
+  expect(chunked.n_tokens).toBeLessThanOrEqual(tokens.length)
+
+  // A document that fits in one chunk matches a plain embedding
+  const short = 'Once upon a time'
+  const single = await model.embeddingChunks(short)
+  const { embedding } = await model.embedding(short)
+  expect(single.chunks.length).toBe(2)
+  for (let j = 0; j < 384; j++) {
+    expect(single.embeddings[j]).toBeCloseTo(embedding[j], 3)
+  }
+
+  const pooled = await model.embeddingChunks(text, {
+    chunk_tokens: 24,
+    overlap_tokens: 8,
+    aggregate: 'weighted',
+  })
+  expect(pooled.embeddings.length).toBe(384)
+  expect(Array.from(pooled.offsets)).toEqual([0, 384])
+  const norm = Math.hypot(...Array.from(pooled.embeddings))
+  expect(norm).toBeCloseTo(1, 3)
+
+  await expect(
+    model.embeddingChunks(text, { chunk_tokens: 8, overlap_tokens: 8 }),
+  ).rejects.toThrow('overlap_tokens must be less than the chunk size of 8')
+  await model.release()
+})
+
+test('token embeddings and maxSim', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './bge-small-en.gguf'),
+    embedding: true,
+    n_gpu_layers: 0,
+    pooling_type: 'none',
+  })
+  const query = await model.embeddingTokens('How do I bake a cake?')
+  expect(query.n_embd).toBe(384)
+  expect(query.n_tokens).toBeGreaterThan(5)
+  expect(query.embeddings.length).toBe(query.n_tokens * 384)
+  const first = query.embeddings.subarray(0, 384)
+  expect(Math.hypot(...Array.from(first))).toBeCloseTo(1, 3)
+
+  const docs: Float32Array[] = []
+  for (const text of [
+    'Stock markets fell sharply today',
+    'A recipe for chocolate cake',
+  ]) {
+    docs.push((await model.embeddingTokens(text)).embeddings)
+  }
+  const scores = await model.maxSim(query.embeddings, docs)
+  expect(scores.length).toBe(2)
+  expect(scores[1]).toBeGreaterThan(scores[0])
+  // Every query token matches itself exactly
+  const [self] = await model.maxSim(query.embeddings, [query.embeddings])
+  expect(self).toBeCloseTo(query.n_tokens, 2)
+
+  expect(() => model.maxSim(query.embeddings, [new Float32Array(10)])).toThrow(
+    'Token matrices must be Float32Arrays of n_embd 384 columns',
+  )
+  await model.release()
+})
+
+test('vector index', async () => {
+  const indexPath = path.resolve(__dirname, './tmp.vector-index')
+  fs.rmSync(indexPath, { force: true })
+  const model = await loadModel({
+    model: path.resolve(__dirname, './bge-small-en.gguf'),
+    embedding: true,
+    n_gpu_layers: 0,
+    n_parallel: 4,
+  })
+  const texts = [
+    'The cat sat on the mat',
+    'Stock markets fell sharply today',
+    'A recipe for chocolate cake',
+    'The dog chased the ball in the park',
+  ]
+  const index = await createVectorIndex({ quant: 'int8' })
+  await model.embeddingBatch(texts, { index, ids: [10, 11, 12, 13] })
+  expect(index.info()).toMatchObject({
+    dim: 384,
+    quant: 'int8',
+    metric: 'cosine',
+    size: 4,
+  })
+
+  const { embedding } = await model.embedding('How do I bake a cake?')
+  const hits = await index.search(embedding as Float32Array, 2)
+  expect(hits.ids[0]).toBe(12)
+  expect(hits.scores[0]).toBeGreaterThan(hits.scores[1])
+
+  // Replacing and removing by id
+  expect(index.remove([11, 99])).toBe(1)
+  expect(index.info().size).toBe(3)
+
+  expect(await index.save(indexPath)).toBe(3)
+  const loaded = await loadVectorIndex(indexPath)
+  expect(loaded.info()).toMatchObject({ dim: 384, quant: 'int8', size: 3 })
+  const reloaded = await loaded.search(embedding as Float32Array, 2)
+  expect(Array.from(reloaded.ids)).toEqual(Array.from(hits.ids))
+  // Searched in the mapped file until an add copies the rows
+  loaded.add([14], embedding as Float32Array)
+  expect(loaded.info().size).toBe(4)
+  const top = await loaded.search(embedding as Float32Array, 3)
+  expect(Array.from(top.ids)).toEqual([14, ...Array.from(hits.ids)])
+
+  // Binary rows straight from embd_quant output
+  const binary = await createVectorIndex({ dim: 384, quant: 'binary' })
+  const batch = await model.embeddingBatch(texts, { embd_quant: 'binary' })
+  binary.add([0, 1, 2, 3], batch.embeddings as Uint8Array)
+  const query = await model.embedding('How do I bake a cake?', {
+    embd_quant: 'binary',
+  })
+  const binaryHits = await binary.search(query.embedding as Uint8Array, 1)
+  expect(binaryHits.ids[0]).toBe(2)
+
+  await expect(index.search(new Float32Array(8), 1)).rejects.toThrow(
+    'Query does not match the index dimension of 384',
+  )
+  fs.rmSync(indexPath, { force: true })
+  await model.release()
+})
+
 test('devices parameter', async () => {
   // First, get available devices
   const devices = await getBackendDevicesInfo()
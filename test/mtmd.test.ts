@@ -59,6 +59,22 @@ test('multimodal with images', async () => {
     media_paths: ['<img-path>'],
   }).toMatchSnapshot()
 
+  // Image bytes from a Buffer tokenize the same as the file path
+  const imageBuffer = fs.readFileSync(path.resolve(__dirname, './test-1.jpeg'))
+  const fromPath = await model.tokenize(formatted.prompt, {
+    media_paths: formatted.media_paths,
+  })
+  const fromBuffer = await model.tokenize(formatted.prompt, {
+    media_paths: [imageBuffer],
+  })
+  expect(fromBuffer.bitmap_hashes).toEqual(fromPath.bitmap_hashes)
+  expect(Array.from(fromBuffer.tokens)).toEqual(Array.from(fromPath.tokens))
+  expect(() =>
+    model.tokenize(formatted.prompt, {
+      media_paths: [new Uint8Array([1, 2, 3])],
+    }),
+  ).toThrow('Unsupported media buffer format')
+
   // Test with multiple images
   const result = await model.completion({
     ...formatted,
@@ -90,6 +106,188 @@ test('multimodal with images', async () => {
   await model.release()
 })
 
+test('multimodal media encoder cache', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './SmolVLM-256M-Instruct-Q8_0.gguf'),
+    n_gpu_layers: 0,
+    n_ctx: 512,
+  })
+  model.initMultimodal({
+    path: path.resolve(__dirname, './mmproj-SmolVLM-256M-Instruct-Q8_0.gguf'),
+    use_gpu: false,
+    media_cache_size: 64 * 1024 * 1024,
+  })
+
+  const formatted = model.getFormattedChat(
+    [
+      {
+        role: 'user',
+        content: [
+          { type: 'text', text: 'Describe this image.' },
+          {
+            type: 'image_url',
+            image_url: { url: path.resolve(__dirname, './test-1.jpeg') },
+          },
+        ],
+      },
+    ],
+    undefined,
+    { jinja: false },
+  )
+  const params = { ...formatted, temperature: 0, n_predict: 8, seed: 0 }
+
+  const first = await model.completion(params)
+  // SmolVLM slices the image into several chunks, all under one entry
+  expect(model.getMediaCacheStats()).toMatchObject({
+    hits: 0,
+    misses: 1,
+    entries: 1,
+  })
+
+  // Dropping the KV cache forces the image to be evaluated again, this time
+  // from the cached encoder output
+  model.clearCache()
+  const second = await model.completion(params)
+  expect(second.text).toBe(first.text)
+  const stats = model.getMediaCacheStats()
+  expect(stats.hits).toBe(1)
+  expect(stats.misses).toBe(1)
+  expect(stats.bytes).toBeGreaterThan(0)
+  expect(stats.bytes).toBeLessThanOrEqual(stats.budget)
+
+  // The same bytes passed as a Buffer hit the same entry
+  model.clearCache()
+  const third = await model.completion({
+    ...params,
+    media_paths: [fs.readFileSync(path.resolve(__dirname, './test-1.jpeg'))],
+  })
+  expect(third.text).toBe(first.text)
+  expect(model.getMediaCacheStats().hits).toBe(2)
+
+  // Queued completions draw on the same entries and byte budget
+  await model.parallel.enable({ n_parallel: 2 })
+  const queued = await (await model.parallel.completion(params)).promise
+  expect(queued.text.length).toBeGreaterThan(0)
+  expect(model.getMediaCacheStats()).toMatchObject({
+    hits: 3,
+    misses: 1,
+    entries: 1,
+  })
+  model.parallel.disable()
+
+  model.clearMediaCache()
+  expect(model.getMediaCacheStats()).toMatchObject({ entries: 0, bytes: 0 })
+  await model.release()
+})
+
+test('multimodal background media encoding', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './SmolVLM-256M-Instruct-Q8_0.gguf'),
+    n_gpu_layers: 0,
+    n_ctx: 512,
+  })
+  const mmproj = path.resolve(
+    __dirname,
+    './mmproj-SmolVLM-256M-Instruct-Q8_0.gguf',
+  )
+  const formatted = model.getFormattedChat(
+    [
+      {
+        role: 'user',
+        content: [
+          { type: 'text', text: 'Describe this image.' },
+          {
+            type: 'image_url',
+            image_url: { url: path.resolve(__dirname, './test-1.jpeg') },
+          },
+        ],
+      },
+    ],
+    undefined,
+    { jinja: false },
+  )
+  const params = { ...formatted, temperature: 0, n_predict: 8, seed: 0 }
+
+  model.initMultimodal({
+    path: mmproj,
+    use_gpu: false,
+    async_media_encode: false,
+  })
+  const serial = await model.completion(params)
+  model.releaseMultimodal()
+
+  model.initMultimodal({
+    path: mmproj,
+    use_gpu: false,
+    async_media_encode: true,
+  })
+  model.clearCache()
+  const overlapped = await model.completion(params)
+  expect(overlapped.text).toBe(serial.text)
+
+  // Queued media is evaluated off the slot loop the same way
+  await model.parallel.enable({ n_parallel: 2 })
+  const queued = await (await model.parallel.completion(params)).promise
+  expect(queued.text.length).toBeGreaterThan(0)
+  model.parallel.disable()
+  await model.release()
+})
+
+test('queued media completion', async () => {
+  const model = await loadModel({
+    model: path.resolve(__dirname, './SmolVLM-256M-Instruct-Q8_0.gguf'),
+    n_gpu_layers: 0,
+    n_ctx: 1024,
+    n_parallel: 2,
+  })
+  model.initMultimodal({
+    path: path.resolve(__dirname, './mmproj-SmolVLM-256M-Instruct-Q8_0.gguf'),
+    use_gpu: false,
+  })
+  const imagePath = path.resolve(__dirname, './test-1.jpeg')
+  const formatted = model.getFormattedChat(
+    [
+      {
+        role: 'user',
+        content: [
+          { type: 'text', text: 'Describe this image.' },
+          { type: 'image_url', image_url: { url: imagePath } },
+        ],
+      },
+    ],
+    undefined,
+    { jinja: false },
+  )
+  const params = { ...formatted, temperature: 0, n_predict: 8, seed: 0 }
+  await model.parallel.enable({ n_parallel: 2 })
+
+  // Media prefixes are evaluated before the slot sees them, from the path
+  // or straight from a Buffer's bytes
+  const fromPath = await (await model.parallel.completion(params)).promise
+  const fromBuffer = await (
+    await model.parallel.completion({
+      ...params,
+      media_paths: [fs.readFileSync(imagePath)],
+    })
+  ).promise
+  expect(fromPath.text.length).toBeGreaterThan(0)
+  expect(fromBuffer.text).toBe(fromPath.text)
+
+  // queueCompletion stays synchronous and takes media paths only
+  const queued = model.ctx.queueCompletion({ ...params, n_predict: 1 })
+  expect(queued).not.toBeInstanceOf(Promise)
+  expect(typeof queued.requestId).toBe('number')
+  expect(() =>
+    model.ctx.queueCompletion({
+      ...params,
+      media_paths: [fs.readFileSync(imagePath)],
+    }),
+  ).toThrow(/queueMediaCompletion/)
+
+  model.parallel.disable()
+  await model.release()
+})
+
 const modelPath = path.resolve(__dirname, './Llama-3.2-1B-Instruct-Q4_K_M.gguf')
 
 ;(fs.existsSync(modelPath) ? test : test.skip)(
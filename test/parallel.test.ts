@@ -167,6 +167,123 @@ describe('Parallel Decoding', () => {
       expect(tokens.length).toBeGreaterThan(0)
     }, 5000)
 
+    test('should stream tokens through an async iterator', async () => {
+      const request = await context.parallel.completionStream(
+        {
+          prompt: 'Test',
+          n_predict: 8,
+          temperature: 0,
+        },
+        { capacity: 2 },
+      )
+
+      let text = ''
+      for await (const chunk of request.stream) {
+        expect(chunk.requestId).toBe(request.requestId)
+        text += chunk.token
+      }
+      const result: any = await request.promise
+      expect(text).toBe(result.text)
+    }, 10000)
+
+    test('should not stall other slots behind a slow stream', async () => {
+      const slow = await context.parallel.completionStream(
+        {
+          prompt: 'Test',
+          n_predict: 16,
+          temperature: 0,
+          ignore_eos: true,
+        },
+        { capacity: 1 },
+      )
+      // Never read until the other request is done
+      const abandoned = await context.parallel.completionStream(
+        { prompt: 'Other', n_predict: 16, ignore_eos: true },
+        { capacity: 1 },
+      )
+      const other = await context.parallel.completion({
+        prompt: 'Hello',
+        n_predict: 8,
+        ignore_eos: true,
+      })
+      const otherResult: any = await other.promise
+      expect(otherResult.tokens_predicted).toBe(8)
+      abandoned.promise.catch(() => null)
+      abandoned.stop()
+
+      let text = ''
+      for await (const chunk of slow.stream) {
+        await new Promise((resolve) => setTimeout(resolve, 20))
+        text += chunk.token
+      }
+      const result: any = await slow.promise
+      // Tokens the reader fell behind on arrive merged, not lost
+      expect(text).toBe(result.text)
+    }, 10000)
+
+    test('should snapshot and restore a slot sequence', async () => {
+      const prompt = 'Snapshot this conversation'
+      let snapshots: Promise<Buffer[]> | undefined
+      const request = await context.parallel.completion(
+        { prompt, n_predict: 32, ignore_eos: true, temperature: 0 },
+        (requestId: number) => {
+          // Overlapping snapshots share one pause of the slot loop, which
+          // must keep running once both are done
+          snapshots ??= Promise.all([
+            context.parallel.getSequenceState(requestId),
+            context.parallel.getSequenceState(requestId),
+          ])
+        },
+      )
+      const original: any = await request.promise
+      const [state, other] = await snapshots!
+      for (const snapshot of [state, other]) {
+        // llama_state_seq_save_file layout: 'ggsq' magic, version, token count
+        expect(snapshot.readUInt32LE(0)).toBe(0x67677371)
+        expect(snapshot.readUInt32LE(8)).toBeGreaterThan(0)
+      }
+      expect(original.tokens_predicted).toBe(32)
+
+      // Fresh slots: only the snapshot holds the prompt
+      context.parallel.disable()
+      await context.parallel.enable({ n_parallel: 2, n_batch: 128 })
+      const resumed = await context.parallel.completion({
+        prompt,
+        n_predict: 8,
+        ignore_eos: true,
+        temperature: 0,
+        load_state: state,
+      })
+      const result: any = await resumed.promise
+      expect(result.timings.prompt_n).toBeLessThanOrEqual(1)
+      expect(original.text.startsWith(result.text)).toBe(true)
+
+      // The slots were recreated since
+      await expect(
+        context.parallel.getSequenceState(request.requestId),
+      ).rejects.toThrow('No slot holds the sequence of request')
+    }, 20000)
+
+    test('should snapshot a slot sequence after the request completed', async () => {
+      const request = await context.parallel.completion({
+        prompt: 'Idle slots keep their sequence',
+        n_predict: 8,
+        ignore_eos: true,
+        temperature: 0,
+      })
+      const result: any = await request.promise
+      expect(typeof result.slot_id).toBe('number')
+
+      const byRequest = await context.parallel.getSequenceState(
+        request.requestId,
+      )
+      const bySlot = await context.parallel.getSequenceState({
+        slot_id: result.slot_id,
+      })
+      expect(byRequest.readUInt32LE(8)).toBeGreaterThan(0)
+      expect(bySlot.equals(byRequest)).toBe(true)
+    }, 20000)
+
     test('should stop completion request', async () => {
       // Queue a request and immediately stop it
       const request = await context.parallel.completion({